@@ -20,7 +20,9 @@ class Game:
         self.game_state = GameState()
         self.my_own_id = -1
         self.draw_offset: Point = Point(0, 0)
-        self.s_connection = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        # path of server's Unix domain socket(unix_socket_path) instead of ip, same messages as over TCP
+        self.local = ip.startswith('/')
+        self.s_connection = socket.socket(socket.AF_UNIX if self.local else socket.AF_INET, socket.SOCK_STREAM)
         self.background_color = (255,255,255)
         self.display_scores = False
         self.latency = deque([0], maxlen=15)
@@ -28,11 +30,18 @@ class Game:
         self.ping_period = 0.2
         self.font = None
         self.font_big = None
+        self.ip = 'localhost' if self.local else ip
+        # optional UDP channel for game states, offered by server in welcome message
+        self.udp_connection = None
+        self.udp_hello = None
+        self.udp_ready = False
+        self.last_udp_hello = 0
+        self.last_sequence = -1
 
         try:
-            self.s_connection.connect((ip, 5000))
+            self.s_connection.connect(ip if self.local else (ip, 5000))
             self.connected = True
-        except ConnectionRefusedError as e:
+        except (ConnectionRefusedError, FileNotFoundError) as e:
             print(e)
             self.connected = False
 
@@ -41,6 +50,8 @@ class Game:
 
     def __exit__(self, exc_type, exc_value, traceback):
         self.s_connection.close()
+        if self.udp_connection is not None:
+            self.udp_connection.close()
     
     def calculateOrientationAngle(self, player_position: Point, mouse_position: Point):
         return math.atan2(-(player_position.y - mouse_position.y), mouse_position.x - player_position.x)
@@ -120,6 +131,7 @@ class Game:
             start = time.perf_counter_ns()
             while self.receive_message() == 1:
                 pass
+            self.receive_datagrams()
             total_receive += time.perf_counter_ns() - start
             no_receive +=1
 
@@ -323,25 +335,62 @@ class Game:
             self.my_own_id = Game.read_int(rest, 2)
             self.player_radius = Game.read_float(rest, 'd')
             self.projectile_radius = Game.read_float(rest, 'd')
+            udp_port = Game.read_int(rest, 2)
+            if udp_port != 0:
+                # client id and token are sent back in hello
+                self.udp_hello = rest.read(12)
+                self.udp_connection = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+                self.udp_connection.setblocking(False)
+                self.udp_connection.connect((self.ip, udp_port))
         elif type == DataType.GAME_MAP:
             self.map = Game.get_map_from_bytes(rest)
         elif type == DataType.PING:
             self.latency.append(time.perf_counter() - self.last_ping[1] + (self.last_ping[0] - Game.read_int(rest, 2)) * self.ping_period)
         elif type == DataType.GAME_STATE:
-            self.game_state = Game.get_gamestate_from_bytes(rest)
-            player = next((player for player in self.game_state.players if player.id == self.my_own_id), None)
-            if player is not None and player.alive:
-                self.draw_offset = add_points(player.position, Point(-self.display_width / 2, -self.display_height / 2))
-                # TODO should probably change this to something different
-                angle = self.calculateOrientationAngle(sub_points(player.position, self.draw_offset), Point(*pygame.mouse.get_pos()))
-                if angle != self.angle:
-                    self.angle = angle
-                    player.orientation_angle = angle
-                    self.send_message(DataType.CHANGE_ORIENTATION)
+            self.handle_game_state(rest)
         else:
             print('Nie wiadomo co to za wiadomość')
         return 1
 
+    def receive_datagrams(self):
+        if self.udp_connection is None:
+            return
+        # hello is repeated until first game state comes over UDP
+        if self.udp_ready is False and time.perf_counter() - self.last_udp_hello > 0.5:
+            try:
+                self.udp_connection.send(self.udp_hello)
+            except socket.error:
+                pass
+            self.last_udp_hello = time.perf_counter()
+        newest = None
+        while True:
+            try:
+                datagram = self.udp_connection.recv(65536)
+            except socket.error:
+                break
+            self.udp_ready = True
+            sequence = int.from_bytes(datagram[:4], 'little')
+            # older game states that came late are skipped
+            if sequence > self.last_sequence:
+                self.last_sequence = sequence
+                newest = datagram
+        if newest is not None:
+            rest = BytesIO(newest[4:])
+            if Game.read_int(rest, 1) == DataType.GAME_STATE:
+                self.handle_game_state(rest)
+
+    def handle_game_state(self, rest: BytesIO):
+        self.game_state = Game.get_gamestate_from_bytes(rest)
+        player = next((player for player in self.game_state.players if player.id == self.my_own_id), None)
+        if player is not None and player.alive:
+            self.draw_offset = add_points(player.position, Point(-self.display_width / 2, -self.display_height / 2))
+            # TODO should probably change this to something different
+            angle = self.calculateOrientationAngle(sub_points(player.position, self.draw_offset), Point(*pygame.mouse.get_pos()))
+            if angle != self.angle:
+                self.angle = angle
+                player.orientation_angle = angle
+                self.send_message(DataType.CHANGE_ORIENTATION)
+
     def get_map_from_bytes(map: BytesIO) -> Map:
         number_of_walls = Game.read_int(map, 2)
         number_of_obstacles = Game.read_int(map, 2)
@@ -0,0 +1,119 @@
+#include "gateway_backends.h"
+#include "gateway_relay.h"
+#include "../Server/server_config.h"
+#include "../Server/server_listen.h"
+#include "../Server/server_wakeup.h"
+#include <sys/epoll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+// Gateway: clients connect to its port and are relayed to the least loaded server(bin/host with
+// gateway_socket_path) on the same machine. Only the TCP stream is relayed, UDP game states go directly
+
+#define MAX_EVENTS 64
+
+// set by signal handler
+static volatile sig_atomic_t stop_signal = 0;
+static Wakeup signal_wakeup;
+// addresses used as epoll_event.data.ptr, backends use their index + 1
+static char listen_tag;
+static char wake_tag;
+
+static void handleStopSignal(int signal_number) {
+    (void)signal_number;
+    stop_signal = 1;
+    wakeupSignal(&signal_wakeup);
+}
+
+static void runControlLoop(int epoll_fd, int control_fd) {
+    struct epoll_event events[MAX_EVENTS];
+    while(stop_signal == 0) {
+        int ready = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+        if(ready == -1) {
+            if(errno == EINTR) {
+                continue;
+            }
+            perror("epoll_wait() error");
+            return;
+        }
+        for(int i = 0; i < ready; ++i) {
+            if(events[i].data.ptr == &wake_tag) {
+                wakeupClear(&signal_wakeup);
+            } else if(events[i].data.ptr == &listen_tag) {
+                int server_socket;
+                while((server_socket = acceptConnection(control_fd)) != -1) {
+                    int backend = addBackend(server_socket);
+                    if(backend == -1) {
+                        continue;
+                    }
+                    struct epoll_event event = {.events = EPOLLIN | EPOLLRDHUP, .data = {.u64 = (uint64_t)backend + 1}};
+                    if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, server_socket, &event) == -1) {
+                        perror("epoll_ctl(ADD) error");
+                        removeBackend(backend);
+                    }
+                }
+            } else {
+                int backend = (int)(events[i].data.u64 - 1);
+                // closed socket is removed from epoll by close()
+                if(receiveBackendReports(backend) == -1) {
+                    removeBackend(backend);
+                }
+            }
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    // bin/gateway gateway_socket_path=path [port=value] [io_threads=value] [listen_backlog=value]
+    ServerConfig config = defaultServerConfig();
+    for(int i = 1; i < argc; ++i) {
+        if(setServerOption(&config, argv[i]) != 0) {
+            return 1;
+        }
+    }
+    if(config.gateway_socket_path[0] == '\0') {
+        fprintf(stderr, "Gateway needs gateway_socket_path option\n");
+        return 1;
+    }
+    setServerConfig(config);
+    const ServerConfig* gateway_config = getServerConfig();
+    signal(SIGPIPE, SIG_IGN);
+    if(wakeupInit(&signal_wakeup) != 0) {
+        return 1;
+    }
+    struct sigaction action = {.sa_handler = handleStopSignal, .sa_flags = SA_RESTART};
+    sigfillset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    initBackends();
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    int control_fd = openUnixListeningSocket(gateway_config->gateway_socket_path);
+    if(epoll_fd == -1 || control_fd == -1) {
+        perror("Gateway: control socket error");
+        return 1;
+    }
+    struct epoll_event wake_event = {.events = EPOLLIN, .data = {.ptr = &wake_tag}};
+    struct epoll_event listen_event = {.events = EPOLLIN, .data = {.ptr = &listen_tag}};
+    if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, signal_wakeup.fd, &wake_event) == -1
+            || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, control_fd, &listen_event) == -1) {
+        perror("epoll_ctl(ADD) error");
+        return 1;
+    }
+    printf("Gateway control socket: %s\n", gateway_config->gateway_socket_path);
+    if(startRelays() == 0) {
+        runControlLoop(epoll_fd, control_fd);
+    }
+    stopRelays();
+    RelayStats stats = getRelayStats();
+    printf("Gateway: %zu relays, %zu refused, %zu bytes to servers, %zu bytes to clients, %zu splice() calls\n",
+           stats.relays, stats.refused, stats.client_bytes, stats.server_bytes, stats.splice_calls);
+    closeUnixListeningSocket(control_fd, gateway_config->gateway_socket_path);
+    close(epoll_fd);
+    destroyBackends();
+    wakeupDestroy(&signal_wakeup);
+    return 0;
+}
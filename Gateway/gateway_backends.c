@@ -0,0 +1,150 @@
+#include "gateway_backends.h"
+#include "../Server/server_gateway.h"
+#include "../Server/server_mutex.h"
+#include <sys/socket.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#define MAX_BACKENDS 64
+// load report with the longest path fits
+#define CONTROL_BUFFER_SIZE (2 * (sizeof(uint32_t) + GATEWAY_REPORT_SIZE + SOCKET_PATH_SIZE))
+
+typedef struct {
+    bool active;
+    // true after first report
+    bool ready;
+    int control_socket;
+    // used only by control loop
+    unsigned char buffer[CONTROL_BUFFER_SIZE];
+    size_t buffered;
+    BackendAddress address;
+    size_t players;
+    size_t waiting;
+    size_t max_players;
+    // clients sent to server after its last report, report already counts older ones
+    size_t relayed;
+} Backend;
+
+static Backend backends[MAX_BACKENDS];
+static pthread_mutex_t backends_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+void initBackends() {
+    nameMutex(&backends_mutex, "gateway backends_mutex");
+    memset(backends, 0, sizeof(backends));
+}
+
+void destroyBackends() {
+    for(int i = 0; i < MAX_BACKENDS; ++i) {
+        if(backends[i].active) {
+            removeBackend(i);
+        }
+    }
+}
+
+int addBackend(int control_socket) {
+    lockMutex(&backends_mutex);
+    for(int i = 0; i < MAX_BACKENDS; ++i) {
+        if(backends[i].active == false) {
+            backends[i] = (Backend){.active = true, .control_socket = control_socket};
+            unlockMutex(&backends_mutex);
+            return i;
+        }
+    }
+    unlockMutex(&backends_mutex);
+    fprintf(stderr, "Gateway: too many servers, control connection refused\n");
+    close(control_socket);
+    return -1;
+}
+
+void removeBackend(int index) {
+    lockMutex(&backends_mutex);
+    Backend* backend = &backends[index];
+    if(backend->ready) {
+        printf("Gateway: server on port %d disconnected\n", backend->address.port);
+    }
+    close(backend->control_socket);
+    backend->active = false;
+    backend->ready = false;
+    unlockMutex(&backends_mutex);
+}
+
+static void applyReport(Backend* backend, const unsigned char* data, uint32_t size) {
+    if(size < GATEWAY_REPORT_SIZE || size - GATEWAY_REPORT_SIZE >= SOCKET_PATH_SIZE || data[0] != GATEWAY_LOAD_REPORT) {
+        return;
+    }
+    uint16_t port;
+    uint32_t load[3];
+    memcpy(&port, data + 1, sizeof(port));
+    memcpy(load, data + 1 + sizeof(port), sizeof(load));
+    lockMutex(&backends_mutex);
+    if(backend->ready == false) {
+        printf("Gateway: server on port %d connected\n", port);
+    }
+    backend->ready = true;
+    backend->address.port = port;
+    memcpy(backend->address.unix_socket_path, data + GATEWAY_REPORT_SIZE, size - GATEWAY_REPORT_SIZE);
+    backend->address.unix_socket_path[size - GATEWAY_REPORT_SIZE] = '\0';
+    backend->players = load[0];
+    backend->waiting = load[1];
+    backend->max_players = load[2];
+    backend->relayed = 0;
+    unlockMutex(&backends_mutex);
+}
+
+int receiveBackendReports(int index) {
+    Backend* backend = &backends[index];
+    while(true) {
+        ssize_t received = recv(backend->control_socket, backend->buffer + backend->buffered,
+                                CONTROL_BUFFER_SIZE - backend->buffered, MSG_DONTWAIT);
+        if(received == -1 && errno == EAGAIN) {
+            return 0;
+        } else if(received == -1 && errno == EINTR) {
+            continue;
+        } else if(received <= 0) {
+            return -1;
+        }
+        backend->buffered += (size_t)received;
+        size_t parsed = 0;
+        uint32_t size;
+        while(backend->buffered - parsed >= sizeof(size)) {
+            memcpy(&size, backend->buffer + parsed, sizeof(size));
+            if(size > CONTROL_BUFFER_SIZE - sizeof(size)) {
+                fprintf(stderr, "Gateway: wrong load report size %u\n", size);
+                return -1;
+            }
+            if(backend->buffered - parsed < sizeof(size) + size) {
+                break;
+            }
+            applyReport(backend, backend->buffer + parsed + sizeof(size), size);
+            parsed += sizeof(size) + size;
+        }
+        memmove(backend->buffer, backend->buffer + parsed, backend->buffered - parsed);
+        backend->buffered -= parsed;
+    }
+}
+
+bool chooseBackend(BackendAddress* address) {
+    Backend* best = NULL;
+    lockMutex(&backends_mutex);
+    for(int i = 0; i < MAX_BACKENDS; ++i) {
+        Backend* backend = &backends[i];
+        if(backend->ready == false || backend->max_players == 0) {
+            continue;
+        }
+        size_t load = backend->players + backend->waiting + backend->relayed;
+        // load / max_players < best_load / best->max_players without division
+        if(best == NULL || load * best->max_players
+                < (best->players + best->waiting + best->relayed) * backend->max_players) {
+            best = backend;
+        }
+    }
+    if(best != NULL) {
+        ++best->relayed;
+        *address = best->address;
+    }
+    unlockMutex(&backends_mutex);
+    return best != NULL;
+}
@@ -0,0 +1,29 @@
+#ifndef GATEWAY_BACKENDS_H
+#define GATEWAY_BACKENDS_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "../Server/server_config.h"
+
+// Servers(bin/host) that sent load report over gateway control channel(Server/server_gateway.h).
+// Table is shared by control loop(writes reports) and relay threads(choose backend for new client)
+
+// where relay connects, Unix socket if path isn't empty, otherwise TCP on loopback
+typedef struct {
+    uint16_t port;
+    char unix_socket_path[SOCKET_PATH_SIZE];
+} BackendAddress;
+
+void initBackends();
+void destroyBackends();
+// control connection of new server, returns index of backend or -1 if table is full
+int addBackend(int control_socket);
+// reads everything available on control socket and applies reports, returns -1 if server disconnected
+int receiveBackendReports(int backend);
+// closes control socket, relays to server keep running
+void removeBackend(int backend);
+// chooses backend with lowest(players + waiting + clients relayed since last report) / max_players,
+// returns false if no server reported yet. Full servers are chosen too, they queue clients(waiting_queue_size)
+bool chooseBackend(BackendAddress* address);
+
+#endif
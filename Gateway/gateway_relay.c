@@ -0,0 +1,361 @@
+// splice()
+#define _GNU_SOURCE
+#include "gateway_relay.h"
+#include "gateway_backends.h"
+#include "../Server/server_listen.h"
+#include "../Server/server_wakeup.h"
+#include "../Server/server_config.h"
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#define MAX_EVENTS 64
+// default pipe capacity, every splice() into pipe takes at most this much
+#define PIPE_BYTES 65536
+// splice() rounds for one event, so one busy relay can't starve others
+#define PUMP_ROUNDS 16
+
+typedef struct Relay Relay;
+
+// one socket of relay with pipe holding bytes read from it and not yet written to the other socket
+typedef struct {
+    Relay* relay;
+    int socket;
+    int pipe[2];
+    size_t piped;
+    uint32_t events;
+} RelayEnd;
+
+struct Relay {
+    // client and server
+    RelayEnd ends[2];
+    // waiting for non-blocking connect() to server
+    bool connecting;
+    bool closed;
+    Relay* previous;
+    Relay* next;
+};
+
+typedef struct {
+    pthread_t thread_id;
+    bool thread_started;
+    int epoll_fd;
+    int listen_fd;
+    Wakeup wake;
+    Relay* relays;
+    // closed in current batch of events, freed after it
+    Relay* closed_relays;
+} RelayThread;
+
+static RelayThread* threads = NULL;
+static size_t threads_size = 0;
+static atomic_bool stopped = false;
+static atomic_size_t relays_opened;
+static atomic_size_t client_bytes;
+static atomic_size_t server_bytes;
+static atomic_size_t splice_calls;
+static atomic_size_t refused;
+// addresses used as epoll_event.data.ptr to distinguish them from relay ends
+static char listen_tag;
+static char wake_tag;
+
+static int connectToBackend(const BackendAddress* address) {
+    int server_socket;
+    int result;
+    if(address->unix_socket_path[0] != '\0') {
+        struct sockaddr_un unix_address = {.sun_family = AF_UNIX};
+        strncpy(unix_address.sun_path, address->unix_socket_path, sizeof(unix_address.sun_path) - 1);
+        server_socket = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if(server_socket == -1) {
+            return -1;
+        }
+        result = connect(server_socket, (struct sockaddr*)&unix_address, sizeof(unix_address));
+    } else {
+        struct sockaddr_in tcp_address = {.sin_family = AF_INET, .sin_port = htons(address->port),
+                                          .sin_addr = {.s_addr = htonl(INADDR_LOOPBACK)}};
+        server_socket = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if(server_socket == -1) {
+            return -1;
+        }
+        int nodelay = 1;
+        setsockopt(server_socket, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+        result = connect(server_socket, (struct sockaddr*)&tcp_address, sizeof(tcp_address));
+    }
+    if(result == -1 && errno != EINPROGRESS) {
+        perror("Gateway: connect(server) error");
+        close(server_socket);
+        return -1;
+    }
+    return server_socket;
+}
+
+static int setEvents(RelayThread* thread, RelayEnd* end, uint32_t events) {
+    if(end->events == events) {
+        return 0;
+    }
+    end->events = events;
+    struct epoll_event event = {.events = events, .data = {.ptr = end}};
+    return epoll_ctl(thread->epoll_fd, EPOLL_CTL_MOD, end->socket, &event);
+}
+
+static void closeRelay(RelayThread* thread, Relay* relay) {
+    relay->closed = true;
+    for(int i = 0; i < 2; ++i) {
+        epoll_ctl(thread->epoll_fd, EPOLL_CTL_DEL, relay->ends[i].socket, NULL);
+        close(relay->ends[i].socket);
+        close(relay->ends[i].pipe[0]);
+        close(relay->ends[i].pipe[1]);
+    }
+    if(relay->previous != NULL) {
+        relay->previous->next = relay->next;
+    } else {
+        thread->relays = relay->next;
+    }
+    if(relay->next != NULL) {
+        relay->next->previous = relay->previous;
+    }
+    relay->next = thread->closed_relays;
+    thread->closed_relays = relay;
+}
+
+static void openRelay(RelayThread* thread, int client_socket) {
+    BackendAddress address;
+    int server_socket;
+    if(chooseBackend(&address) == false || (server_socket = connectToBackend(&address)) == -1) {
+        atomic_fetch_add_explicit(&refused, 1, memory_order_relaxed);
+        close(client_socket);
+        return;
+    }
+    int nodelay = 1;
+    setsockopt(client_socket, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    Relay* relay = calloc(1, sizeof(Relay));
+    if(relay == NULL) {
+        perror("calloc() error!");
+        exit(1);
+    }
+    relay->connecting = true;
+    relay->ends[0] = (RelayEnd){.relay = relay, .socket = client_socket};
+    relay->ends[1] = (RelayEnd){.relay = relay, .socket = server_socket};
+    if(pipe2(relay->ends[0].pipe, O_NONBLOCK | O_CLOEXEC) == -1 || pipe2(relay->ends[1].pipe, O_NONBLOCK | O_CLOEXEC) == -1) {
+        perror("pipe2() error");
+        exit(1);
+    }
+    relay->next = thread->relays;
+    if(thread->relays != NULL) {
+        thread->relays->previous = relay;
+    }
+    thread->relays = relay;
+    // client is read after server accepted connection, its bytes wait in socket until then
+    relay->ends[1].events = EPOLLOUT;
+    struct epoll_event client_event = {.events = 0, .data = {.ptr = &relay->ends[0]}};
+    struct epoll_event server_event = {.events = EPOLLOUT, .data = {.ptr = &relay->ends[1]}};
+    if(epoll_ctl(thread->epoll_fd, EPOLL_CTL_ADD, client_socket, &client_event) == -1
+            || epoll_ctl(thread->epoll_fd, EPOLL_CTL_ADD, server_socket, &server_event) == -1) {
+        perror("epoll_ctl(ADD) error");
+        closeRelay(thread, relay);
+        return;
+    }
+    atomic_fetch_add_explicit(&relays_opened, 1, memory_order_relaxed);
+}
+
+// moves bytes from socket of from to its pipe and from pipe to socket of to.
+// returns -1 if relay should be closed
+static int pump(RelayEnd* from, RelayEnd* to, atomic_size_t* counter) {
+    for(int round = 0; round < PUMP_ROUNDS; ++round) {
+        while(from->piped > 0) {
+            ssize_t moved = splice(from->pipe[0], NULL, to->socket, NULL, from->piped, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            atomic_fetch_add_explicit(&splice_calls, 1, memory_order_relaxed);
+            if(moved > 0) {
+                from->piped -= (size_t)moved;
+                atomic_fetch_add_explicit(counter, (size_t)moved, memory_order_relaxed);
+            } else if(moved == -1 && errno == EINTR) {
+                continue;
+            } else if(moved == -1 && errno == EAGAIN) {
+                // to is full, rest is sent after EPOLLOUT
+                return 0;
+            } else {
+                return -1;
+            }
+        }
+        // pipe is empty, so EAGAIN means socket is drained
+        ssize_t moved = splice(from->socket, NULL, from->pipe[1], NULL, PIPE_BYTES, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        atomic_fetch_add_explicit(&splice_calls, 1, memory_order_relaxed);
+        if(moved > 0) {
+            from->piped = (size_t)moved;
+        } else if(moved == -1 && errno == EINTR) {
+            continue;
+        } else if(moved == -1 && errno == EAGAIN) {
+            return 0;
+        } else {
+            // end of stream or error
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void handleRelayEvent(RelayThread* thread, RelayEnd* end, uint32_t events) {
+    Relay* relay = end->relay;
+    if(relay->closed) {
+        return;
+    }
+    if(events & (EPOLLHUP | EPOLLERR)) {
+        closeRelay(thread, relay);
+        return;
+    }
+    if(relay->connecting) {
+        int error = 0;
+        socklen_t length = sizeof(error);
+        if(getsockopt(relay->ends[1].socket, SOL_SOCKET, SO_ERROR, &error, &length) == -1 || error != 0) {
+            atomic_fetch_add_explicit(&refused, 1, memory_order_relaxed);
+            closeRelay(thread, relay);
+            return;
+        }
+        relay->connecting = false;
+    }
+    RelayEnd* client = &relay->ends[0];
+    RelayEnd* server = &relay->ends[1];
+    if(pump(client, server, &client_bytes) == -1 || pump(server, client, &server_bytes) == -1) {
+        closeRelay(thread, relay);
+        return;
+    }
+    // socket is read only when its pipe is empty and written only when other pipe has bytes
+    for(int i = 0; i < 2; ++i) {
+        RelayEnd* other = &relay->ends[1 - i];
+        uint32_t wanted = (relay->ends[i].piped == 0 ? EPOLLIN : 0) | (other->piped > 0 ? EPOLLOUT : 0);
+        if(setEvents(thread, &relay->ends[i], wanted) == -1) {
+            perror("epoll_ctl(MOD) error");
+            closeRelay(thread, relay);
+            return;
+        }
+    }
+}
+
+static void* runRelayThread(void* thread_arg) {
+    RelayThread* thread = thread_arg;
+    struct epoll_event events[MAX_EVENTS];
+    while(atomic_load(&stopped) == false) {
+        int ready = epoll_wait(thread->epoll_fd, events, MAX_EVENTS, -1);
+        if(ready == -1) {
+            if(errno == EINTR) {
+                continue;
+            }
+            perror("epoll_wait() error");
+            break;
+        }
+        for(int i = 0; i < ready; ++i) {
+            void* ptr = events[i].data.ptr;
+            if(ptr == &wake_tag) {
+                wakeupClear(&thread->wake);
+            } else if(ptr == &listen_tag) {
+                int client_socket;
+                while((client_socket = acceptConnection(thread->listen_fd)) != -1) {
+                    openRelay(thread, client_socket);
+                }
+            } else {
+                handleRelayEvent(thread, ptr, events[i].events);
+            }
+        }
+        // both ends of relay can be in the same batch
+        while(thread->closed_relays != NULL) {
+            Relay* relay = thread->closed_relays;
+            thread->closed_relays = relay->next;
+            free(relay);
+        }
+    }
+    while(thread->relays != NULL) {
+        closeRelay(thread, thread->relays);
+    }
+    while(thread->closed_relays != NULL) {
+        Relay* relay = thread->closed_relays;
+        thread->closed_relays = relay->next;
+        free(relay);
+    }
+    return NULL;
+}
+
+static void destroyRelayThread(RelayThread* thread) {
+    if(thread->epoll_fd != -1) {
+        close(thread->epoll_fd);
+    }
+    if(thread->listen_fd != -1) {
+        close(thread->listen_fd);
+    }
+    wakeupDestroy(&thread->wake);
+}
+
+static int createRelayThread(RelayThread* thread, bool first) {
+    *thread = (RelayThread){.epoll_fd = -1, .listen_fd = -1, .wake = {.fd = -1}};
+    thread->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if(thread->epoll_fd == -1 || wakeupInit(&thread->wake) != 0
+            || (thread->listen_fd = openListeningSocket(first)) == -1) {
+        destroyRelayThread(thread);
+        return -1;
+    }
+    struct epoll_event wake_event = {.events = EPOLLIN, .data = {.ptr = &wake_tag}};
+    struct epoll_event listen_event = {.events = EPOLLIN, .data = {.ptr = &listen_tag}};
+    if(epoll_ctl(thread->epoll_fd, EPOLL_CTL_ADD, thread->wake.fd, &wake_event) == -1
+            || epoll_ctl(thread->epoll_fd, EPOLL_CTL_ADD, thread->listen_fd, &listen_event) == -1) {
+        perror("epoll_ctl(ADD) error");
+        destroyRelayThread(thread);
+        return -1;
+    }
+    int err = pthread_create(&thread->thread_id, NULL, runRelayThread, thread);
+    if(err != 0) {
+        errno = err;
+        perror("Couldn't create relay thread");
+        destroyRelayThread(thread);
+        return -1;
+    }
+    thread->thread_started = true;
+    return 0;
+}
+
+int startRelays() {
+    size_t io_threads = getServerConfig()->io_threads;
+    threads = calloc(io_threads, sizeof(RelayThread));
+    if(threads == NULL) {
+        perror("calloc() error!");
+        exit(1);
+    }
+    for(threads_size = 0; threads_size < io_threads; ++threads_size) {
+        if(createRelayThread(&threads[threads_size], threads_size == 0) != 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void stopRelays() {
+    atomic_store(&stopped, true);
+    for(size_t i = 0; i < threads_size; ++i) {
+        wakeupSignal(&threads[i].wake);
+    }
+    for(size_t i = 0; i < threads_size; ++i) {
+        pthread_join(threads[i].thread_id, NULL);
+        destroyRelayThread(&threads[i]);
+    }
+    free(threads);
+    threads = NULL;
+    threads_size = 0;
+}
+
+RelayStats getRelayStats() {
+    return (RelayStats){.relays = atomic_load(&relays_opened),
+                        .client_bytes = atomic_load(&client_bytes),
+                        .server_bytes = atomic_load(&server_bytes),
+                        .splice_calls = atomic_load(&splice_calls),
+                        .refused = atomic_load(&refused)};
+}
@@ -0,0 +1,24 @@
+#ifndef GATEWAY_RELAY_H
+#define GATEWAY_RELAY_H
+#include <stddef.h>
+
+// Relay threads(io_threads of them) accept clients on their own SO_REUSEPORT socket bound to port,
+// connect each one to backend chosen by chooseBackend() and move bytes in both directions with splice()
+// through a pipe, so frames are never copied to user space
+
+typedef struct {
+    size_t relays;
+    // bytes moved from clients to servers and back
+    size_t client_bytes;
+    size_t server_bytes;
+    size_t splice_calls;
+    // clients closed because there was no server or connect() failed
+    size_t refused;
+} RelayStats;
+
+// returns 0 if every thread started
+int startRelays();
+void stopRelays();
+RelayStats getRelayStats();
+
+#endif
@@ -2,6 +2,23 @@
 #include "collisions.h"
 #include <cmath>
 
+size_t minimumMessageSize(DataType type) {
+    switch(type) {
+        // float angle
+        case CHANGE_ORIENTATION:
+            return 5;
+        // double x and y of velocity
+        case CHANGE_MOVEMENT_DIRECTION:
+            return 17;
+        // 2 byte number sent back
+        case PING:
+            return 3;
+        // SPAWN, SHOOT, SPECTATE(room number is optional) and unknown types
+        default:
+            return 1;
+    }
+}
+
 Point::Point(double x, double y) : x(x), y(y) {}
 
 double Point::length() const {
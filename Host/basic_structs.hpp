@@ -1,6 +1,7 @@
 #pragma once
 #include <array>
 #include <ostream>
+#include <cstddef>
 
 // type of data sent and received from client
 enum DataType {
@@ -14,10 +15,16 @@ enum DataType {
     CHANGE_ORIENTATION = 12,
     CHANGE_MOVEMENT_DIRECTION = 13,
     PING = 14,
+    // client stops being player and only watches room(spectator relay, bin/spectator)
+    SPECTATE = 15,
 
     OTHER = 999
 };
 
+// bytes of incoming message with its type byte and payload, 1 for types without payload and unknown types.
+// Shorter messages are dropped before handlers read payload
+size_t minimumMessageSize(DataType type);
+
 struct Point {
     Point(double x, double y);
     Point(const Point& copy) = default;
@@ -90,4 +90,81 @@ bool circleLineSegmentCollision(const Circle& c, const Point& a, const Point& b)
 	if (length_closest_c <= c.r)
 		return true;
 	return false;
+}
+
+double dot(const Vector& a, const Vector& b) {
+	return a.x * b.x + a.y * b.y;
+}
+
+Point closestPointOnSegment(const Point& p, const Point& a, const Point& b) {
+	Vector ab = b - a;
+	double length2 = dot(ab, ab);
+	if (length2 == 0)
+		return a;
+	double t = std::fmax(0.0, std::fmin(1.0, dot(p - a, ab) / length2));
+	return a + ab * t;
+}
+
+// circle of radius r around point, moving centre is a ray
+double sweptPointCollision(const Point& centre, const Vector& d, const Point& point, double r) {
+	Vector m = centre - point;
+	double c = dot(m, m) - square(r);
+	if (c <= 0)
+		return 0;
+	double a = dot(d, d);
+	double b = dot(m, d);
+	// not moving or moving away
+	if (a == 0 || b >= 0)
+		return -1;
+	double discriminant = square(b) - a * c;
+	if (discriminant < 0)
+		return -1;
+	double t = (-b - std::sqrt(discriminant)) / a;
+	return t <= 1 ? t : -1;
+}
+
+double sweptCollision(const Circle& c, const Vector& d, const Circle& target) {
+	return sweptPointCollision(c.centre, d, target.centre, c.r + target.r);
+}
+
+double sweptCollision(const Circle& c, const Vector& d, const Point& P1, const Point& P2) {
+	if (distance(closestPointOnSegment(c.centre, P1, P2), c.centre) <= c.r)
+		return 0;
+	double first = -1;
+	auto earlier = [&first](double t) {
+		if (t >= 0 && (first < 0 || t < first))
+			first = t;
+	};
+	// 1. Środek koła dochodzi do prostej przesuniętej o promień - uderzenie w odcinek poza końcami
+	Vector edge = P2 - P1;
+	double length = edge.length();
+	if (length > 0) {
+		Vector normal(-edge.y / length, edge.x / length);
+		double height = dot(c.centre - P1, normal);
+		double side = height > 0 ? 1 : -1;
+		double approach = -dot(d, normal) * side;
+		if (approach > 0) {
+			double t = (height * side - c.r) / approach;
+			Point contact = c.centre + d * t - normal * (c.r * side);
+			double along = dot(contact - P1, edge) / (length * length);
+			if (t <= 1 && along >= 0 && along <= 1)
+				earlier(t);
+		}
+	}
+	// 2. Uderzenie w jeden z końców odcinka
+	earlier(sweptPointCollision(c.centre, d, P1, c.r));
+	earlier(sweptPointCollision(c.centre, d, P2, c.r));
+	return first;
+}
+
+double sweptCollision(const Circle& c, const Vector& d, const Rectangle& rec) {
+	if (checkCollision(c, rec))
+		return 0;
+	double first = -1;
+	for (size_t i = 0; i < 4; ++i) {
+		double t = sweptCollision(c, d, rec.points[i], rec.points[(i + 1) % 4]);
+		if (t >= 0 && (first < 0 || t < first))
+			first = t;
+	}
+	return first;
 }
\ No newline at end of file
@@ -8,4 +8,11 @@ bool checkCollision(const Circle& c, const Point& P1, const Point& P2);
 // height falling from point a onto bc segment
 double triangleHeight(const Point& a, const Point& b, const Point& c);
 double distance(const Point& a, const Point& b);
-double square(double x);
\ No newline at end of file
+double square(double x);
+// Swept tests, circle c moves by displacement d during tick. Return time of first touch in [0, 1]
+// (0 if c already touches target) or -1 if c doesn't touch target on its way
+double sweptCollision(const Circle& c, const Vector& d, const Circle& target);
+double sweptCollision(const Circle& c, const Vector& d, const Point& P1, const Point& P2);
+double sweptCollision(const Circle& c, const Vector& d, const Rectangle& rec);
+Point closestPointOnSegment(const Point& p, const Point& a, const Point& b);
+double dot(const Vector& a, const Vector& b);
\ No newline at end of file
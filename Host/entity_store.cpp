@@ -0,0 +1,382 @@
+#include "entity_store.hpp"
+#include <cmath>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define ENTITY_KERNELS_X86
+#endif
+
+size_t EntityStore::size() const {
+    return x.size();
+}
+
+uint32_t EntityStore::add(const Point& position, const Vector& velocity, double radius, bool is_alive,
+                          uint8_t entity_health) {
+    x.push_back(position.x);
+    y.push_back(position.y);
+    vx.push_back(velocity.x);
+    vy.push_back(velocity.y);
+    r.push_back(radius);
+    alive.push_back(is_alive);
+    health.push_back(entity_health);
+    return static_cast<uint32_t>(x.size() - 1);
+}
+
+namespace {
+
+template<class T>
+void swapRemoveColumn(std::vector<T>& column, uint32_t index) {
+    column[index] = column.back();
+    column.pop_back();
+}
+
+} // namespace
+
+void EntityStore::swapRemove(uint32_t index) {
+    swapRemoveColumn(x, index);
+    swapRemoveColumn(y, index);
+    swapRemoveColumn(vx, index);
+    swapRemoveColumn(vy, index);
+    swapRemoveColumn(r, index);
+    swapRemoveColumn(alive, index);
+    swapRemoveColumn(health, index);
+}
+
+void EntityStore::clear() {
+    x.clear();
+    y.clear();
+    vx.clear();
+    vy.clear();
+    r.clear();
+    alive.clear();
+    health.clear();
+}
+
+Point EntityStore::position(uint32_t index) const {
+    return Point(x[index], y[index]);
+}
+
+Vector EntityStore::velocity(uint32_t index) const {
+    return Vector(vx[index], vy[index]);
+}
+
+Circle EntityStore::circle(uint32_t index) const {
+    return Circle(position(index), r[index]);
+}
+
+void EntityStore::setPosition(uint32_t index, const Point& position) {
+    x[index] = position.x;
+    y[index] = position.y;
+}
+
+void EntityStore::setVelocity(uint32_t index, const Vector& velocity) {
+    vx[index] = velocity.x;
+    vy[index] = velocity.y;
+}
+
+namespace {
+
+// scalar kernels repeat operations of Point operators and collisions.cpp in the same order,
+// vector kernels repeat scalar ones lane by lane. No fused multiply-add, so results are identical
+
+void integrateScalar(EntityStore& store, size_t begin, double speed, double timestep) {
+    for(size_t i = begin; i < store.size(); ++i) {
+        if(store.alive[i]) {
+            store.x[i] += store.vx[i] * speed * timestep;
+            store.y[i] += store.vy[i] * speed * timestep;
+        }
+    }
+}
+
+bool overlapScalar(const Circle& circle, double x, double y, double r) {
+    double dx = circle.centre.x - x;
+    double dy = circle.centre.y - y;
+    double radiuses = circle.r + r;
+    return (dx * dx + dy * dy) < radiuses * radiuses - 1.0e-10;
+}
+
+bool touchSegmentScalar(const Circle& circle, double ax, double ay, double bx, double by) {
+    double cx = circle.centre.x, cy = circle.centre.y;
+    double ca = std::sqrt((cx - ax) * (cx - ax) + (cy - ay) * (cy - ay));
+    double cb = std::sqrt((cx - bx) * (cx - bx) + (cy - by) * (cy - by));
+    if(circle.r >= ca || circle.r >= cb) {
+        return true;
+    }
+    double line_length = std::sqrt((bx - ax) * (bx - ax) + (by - ay) * (by - ay));
+    double dot = (((cx - ax) * (bx - ax)) + ((cy - ay) * (by - ay))) / (line_length * line_length);
+    double closest_x = ax + dot * (bx - ax);
+    double closest_y = ay + dot * (by - ay);
+    double length_ac = std::sqrt((closest_x - ax) * (closest_x - ax) + (closest_y - ay) * (closest_y - ay));
+    double length_bc = std::sqrt((closest_x - bx) * (closest_x - bx) + (closest_y - by) * (closest_y - by));
+    double lengths = length_ac + length_bc;
+    if(!(lengths >= line_length - 0.01 && lengths <= line_length + 0.01)) {
+        return false;
+    }
+    double length_closest_c = std::sqrt((cx - closest_x) * (cx - closest_x) + (cy - closest_y) * (cy - closest_y));
+    return length_closest_c <= circle.r;
+}
+
+void overlapCirclesScalar(const EntityStore& store, const uint32_t* indices, size_t begin, size_t count,
+                          const Circle& circle, uint8_t* hits) {
+    for(size_t k = begin; k < count; ++k) {
+        uint32_t i = indices[k];
+        hits[k] = overlapScalar(circle, store.x[i], store.y[i], store.r[i]);
+    }
+}
+
+void touchSegmentsScalar(const SegmentColumns& segments, const uint32_t* indices, size_t begin, size_t count,
+                         const Circle& circle, uint8_t* hits) {
+    for(size_t k = begin; k < count; ++k) {
+        uint32_t i = indices[k];
+        hits[k] = touchSegmentScalar(circle, segments.ax[i], segments.ay[i], segments.bx[i], segments.by[i]);
+    }
+}
+
+#ifdef ENTITY_KERNELS_X86
+
+void integrateSse2(EntityStore& store, double speed, double timestep) {
+    const __m128d speeds = _mm_set1_pd(speed), timesteps = _mm_set1_pd(timestep);
+    size_t i = 0;
+    for(; i + 2 <= store.size(); i += 2) {
+        __m128d alive = _mm_castsi128_pd(_mm_set_epi64x(-static_cast<int64_t>(store.alive[i + 1] != 0),
+                                                        -static_cast<int64_t>(store.alive[i] != 0)));
+        __m128d x = _mm_loadu_pd(&store.x[i]), y = _mm_loadu_pd(&store.y[i]);
+        __m128d moved_x = _mm_add_pd(x, _mm_mul_pd(_mm_mul_pd(_mm_loadu_pd(&store.vx[i]), speeds), timesteps));
+        __m128d moved_y = _mm_add_pd(y, _mm_mul_pd(_mm_mul_pd(_mm_loadu_pd(&store.vy[i]), speeds), timesteps));
+        _mm_storeu_pd(&store.x[i], _mm_or_pd(_mm_and_pd(alive, moved_x), _mm_andnot_pd(alive, x)));
+        _mm_storeu_pd(&store.y[i], _mm_or_pd(_mm_and_pd(alive, moved_y), _mm_andnot_pd(alive, y)));
+    }
+    integrateScalar(store, i, speed, timestep);
+}
+
+void overlapCirclesSse2(const EntityStore& store, const uint32_t* indices, size_t count, const Circle& circle,
+                        uint8_t* hits) {
+    const __m128d cx = _mm_set1_pd(circle.centre.x), cy = _mm_set1_pd(circle.centre.y), cr = _mm_set1_pd(circle.r);
+    const __m128d epsilon = _mm_set1_pd(1.0e-10);
+    size_t k = 0;
+    for(; k + 2 <= count; k += 2) {
+        uint32_t i0 = indices[k], i1 = indices[k + 1];
+        __m128d dx = _mm_sub_pd(cx, _mm_set_pd(store.x[i1], store.x[i0]));
+        __m128d dy = _mm_sub_pd(cy, _mm_set_pd(store.y[i1], store.y[i0]));
+        __m128d radiuses = _mm_add_pd(cr, _mm_set_pd(store.r[i1], store.r[i0]));
+        __m128d lhs = _mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy));
+        __m128d rhs = _mm_sub_pd(_mm_mul_pd(radiuses, radiuses), epsilon);
+        int mask = _mm_movemask_pd(_mm_cmplt_pd(lhs, rhs));
+        hits[k] = mask & 1;
+        hits[k + 1] = (mask >> 1) & 1;
+    }
+    overlapCirclesScalar(store, indices, k, count, circle, hits);
+}
+
+__m128d distanceSse2(__m128d x1, __m128d y1, __m128d x2, __m128d y2) {
+    __m128d dx = _mm_sub_pd(x1, x2), dy = _mm_sub_pd(y1, y2);
+    return _mm_sqrt_pd(_mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy)));
+}
+
+void touchSegmentsSse2(const SegmentColumns& segments, const uint32_t* indices, size_t count, const Circle& circle,
+                       uint8_t* hits) {
+    const __m128d cx = _mm_set1_pd(circle.centre.x), cy = _mm_set1_pd(circle.centre.y), r = _mm_set1_pd(circle.r);
+    const __m128d tolerance = _mm_set1_pd(0.01);
+    size_t k = 0;
+    for(; k + 2 <= count; k += 2) {
+        uint32_t i0 = indices[k], i1 = indices[k + 1];
+        __m128d ax = _mm_set_pd(segments.ax[i1], segments.ax[i0]), ay = _mm_set_pd(segments.ay[i1], segments.ay[i0]);
+        __m128d bx = _mm_set_pd(segments.bx[i1], segments.bx[i0]), by = _mm_set_pd(segments.by[i1], segments.by[i0]);
+        __m128d ends = _mm_or_pd(_mm_cmpge_pd(r, distanceSse2(cx, cy, ax, ay)),
+                                 _mm_cmpge_pd(r, distanceSse2(cx, cy, bx, by)));
+        __m128d abx = _mm_sub_pd(bx, ax), aby = _mm_sub_pd(by, ay);
+        __m128d line_length = _mm_sqrt_pd(_mm_add_pd(_mm_mul_pd(abx, abx), _mm_mul_pd(aby, aby)));
+        __m128d dot = _mm_div_pd(_mm_add_pd(_mm_mul_pd(_mm_sub_pd(cx, ax), abx), _mm_mul_pd(_mm_sub_pd(cy, ay), aby)),
+                                 _mm_mul_pd(line_length, line_length));
+        __m128d closest_x = _mm_add_pd(ax, _mm_mul_pd(dot, abx)), closest_y = _mm_add_pd(ay, _mm_mul_pd(dot, aby));
+        __m128d lengths = _mm_add_pd(distanceSse2(closest_x, closest_y, ax, ay),
+                                     distanceSse2(closest_x, closest_y, bx, by));
+        __m128d on_segment = _mm_and_pd(_mm_cmpge_pd(lengths, _mm_sub_pd(line_length, tolerance)),
+                                        _mm_cmple_pd(lengths, _mm_add_pd(line_length, tolerance)));
+        __m128d near = _mm_cmple_pd(distanceSse2(cx, cy, closest_x, closest_y), r);
+        int mask = _mm_movemask_pd(_mm_or_pd(ends, _mm_and_pd(on_segment, near)));
+        hits[k] = mask & 1;
+        hits[k + 1] = (mask >> 1) & 1;
+    }
+    touchSegmentsScalar(segments, indices, k, count, circle, hits);
+}
+
+__attribute__((target("avx2")))
+void integrateAvx2(EntityStore& store, double speed, double timestep) {
+    const __m256d speeds = _mm256_set1_pd(speed), timesteps = _mm256_set1_pd(timestep);
+    size_t i = 0;
+    for(; i + 4 <= store.size(); i += 4) {
+        int32_t alive_bytes;
+        __builtin_memcpy(&alive_bytes, &store.alive[i], sizeof(alive_bytes));
+        __m256i alive_lanes = _mm256_cvtepu8_epi64(_mm_cvtsi32_si128(alive_bytes));
+        __m256d alive = _mm256_castsi256_pd(_mm256_cmpgt_epi64(alive_lanes, _mm256_setzero_si256()));
+        __m256d x = _mm256_loadu_pd(&store.x[i]), y = _mm256_loadu_pd(&store.y[i]);
+        __m256d moved_x = _mm256_add_pd(x, _mm256_mul_pd(_mm256_mul_pd(_mm256_loadu_pd(&store.vx[i]), speeds), timesteps));
+        __m256d moved_y = _mm256_add_pd(y, _mm256_mul_pd(_mm256_mul_pd(_mm256_loadu_pd(&store.vy[i]), speeds), timesteps));
+        _mm256_storeu_pd(&store.x[i], _mm256_blendv_pd(x, moved_x, alive));
+        _mm256_storeu_pd(&store.y[i], _mm256_blendv_pd(y, moved_y, alive));
+    }
+    integrateScalar(store, i, speed, timestep);
+}
+
+__attribute__((target("avx2")))
+void storeHits(__m256d mask, uint8_t* hits) {
+    int bits = _mm256_movemask_pd(mask);
+    for(int lane = 0; lane < 4; ++lane) {
+        hits[lane] = (bits >> lane) & 1;
+    }
+}
+
+__attribute__((target("avx2")))
+void overlapCirclesAvx2(const EntityStore& store, const uint32_t* indices, size_t count, const Circle& circle,
+                        uint8_t* hits) {
+    const __m256d cx = _mm256_set1_pd(circle.centre.x), cy = _mm256_set1_pd(circle.centre.y);
+    const __m256d cr = _mm256_set1_pd(circle.r), epsilon = _mm256_set1_pd(1.0e-10);
+    size_t k = 0;
+    for(; k + 4 <= count; k += 4) {
+        __m128i lanes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(indices + k));
+        __m256d dx = _mm256_sub_pd(cx, _mm256_i32gather_pd(store.x.data(), lanes, 8));
+        __m256d dy = _mm256_sub_pd(cy, _mm256_i32gather_pd(store.y.data(), lanes, 8));
+        __m256d radiuses = _mm256_add_pd(cr, _mm256_i32gather_pd(store.r.data(), lanes, 8));
+        __m256d lhs = _mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy));
+        __m256d rhs = _mm256_sub_pd(_mm256_mul_pd(radiuses, radiuses), epsilon);
+        storeHits(_mm256_cmp_pd(lhs, rhs, _CMP_LT_OQ), hits + k);
+    }
+    overlapCirclesScalar(store, indices, k, count, circle, hits);
+}
+
+__attribute__((target("avx2")))
+__m256d distanceAvx2(__m256d x1, __m256d y1, __m256d x2, __m256d y2) {
+    __m256d dx = _mm256_sub_pd(x1, x2), dy = _mm256_sub_pd(y1, y2);
+    return _mm256_sqrt_pd(_mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy)));
+}
+
+__attribute__((target("avx2")))
+void touchSegmentsAvx2(const SegmentColumns& segments, const uint32_t* indices, size_t count, const Circle& circle,
+                       uint8_t* hits) {
+    const __m256d cx = _mm256_set1_pd(circle.centre.x), cy = _mm256_set1_pd(circle.centre.y);
+    const __m256d r = _mm256_set1_pd(circle.r), tolerance = _mm256_set1_pd(0.01);
+    size_t k = 0;
+    for(; k + 4 <= count; k += 4) {
+        __m128i lanes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(indices + k));
+        __m256d ax = _mm256_i32gather_pd(segments.ax.data(), lanes, 8);
+        __m256d ay = _mm256_i32gather_pd(segments.ay.data(), lanes, 8);
+        __m256d bx = _mm256_i32gather_pd(segments.bx.data(), lanes, 8);
+        __m256d by = _mm256_i32gather_pd(segments.by.data(), lanes, 8);
+        __m256d ends = _mm256_or_pd(_mm256_cmp_pd(r, distanceAvx2(cx, cy, ax, ay), _CMP_GE_OQ),
+                                    _mm256_cmp_pd(r, distanceAvx2(cx, cy, bx, by), _CMP_GE_OQ));
+        __m256d abx = _mm256_sub_pd(bx, ax), aby = _mm256_sub_pd(by, ay);
+        __m256d line_length = _mm256_sqrt_pd(_mm256_add_pd(_mm256_mul_pd(abx, abx), _mm256_mul_pd(aby, aby)));
+        __m256d dot = _mm256_div_pd(_mm256_add_pd(_mm256_mul_pd(_mm256_sub_pd(cx, ax), abx),
+                                                  _mm256_mul_pd(_mm256_sub_pd(cy, ay), aby)),
+                                    _mm256_mul_pd(line_length, line_length));
+        __m256d closest_x = _mm256_add_pd(ax, _mm256_mul_pd(dot, abx));
+        __m256d closest_y = _mm256_add_pd(ay, _mm256_mul_pd(dot, aby));
+        __m256d lengths = _mm256_add_pd(distanceAvx2(closest_x, closest_y, ax, ay),
+                                        distanceAvx2(closest_x, closest_y, bx, by));
+        __m256d on_segment = _mm256_and_pd(_mm256_cmp_pd(lengths, _mm256_sub_pd(line_length, tolerance), _CMP_GE_OQ),
+                                           _mm256_cmp_pd(lengths, _mm256_add_pd(line_length, tolerance), _CMP_LE_OQ));
+        __m256d near = _mm256_cmp_pd(distanceAvx2(cx, cy, closest_x, closest_y), r, _CMP_LE_OQ);
+        storeHits(_mm256_or_pd(ends, _mm256_and_pd(on_segment, near)), hits + k);
+    }
+    touchSegmentsScalar(segments, indices, k, count, circle, hits);
+}
+
+#endif
+
+bool kernelsSupported(EntityKernels kernels) {
+    switch(kernels) {
+        case EntityKernels::SCALAR:
+            return true;
+#ifdef ENTITY_KERNELS_X86
+        case EntityKernels::SSE2:
+            return true;
+        case EntityKernels::AVX2:
+            return __builtin_cpu_supports("avx2");
+#endif
+        default:
+            return false;
+    }
+}
+
+EntityKernels bestKernels() {
+    for(EntityKernels kernels : {EntityKernels::AVX2, EntityKernels::SSE2}) {
+        if(kernelsSupported(kernels)) {
+            return kernels;
+        }
+    }
+    return EntityKernels::SCALAR;
+}
+
+EntityKernels active_kernels = bestKernels();
+
+} // namespace
+
+EntityKernels getEntityKernels() {
+    return active_kernels;
+}
+
+bool setEntityKernels(EntityKernels kernels) {
+    if(!kernelsSupported(kernels)) {
+        return false;
+    }
+    active_kernels = kernels;
+    return true;
+}
+
+const char* entityKernelsName(EntityKernels kernels) {
+    switch(kernels) {
+        case EntityKernels::SSE2:
+            return "sse2";
+        case EntityKernels::AVX2:
+            return "avx2";
+        default:
+            return "scalar";
+    }
+}
+
+void integratePositions(EntityStore& store, double speed, double timestep) {
+    switch(active_kernels) {
+#ifdef ENTITY_KERNELS_X86
+        case EntityKernels::AVX2:
+            integrateAvx2(store, speed, timestep);
+            return;
+        case EntityKernels::SSE2:
+            integrateSse2(store, speed, timestep);
+            return;
+#endif
+        default:
+            integrateScalar(store, 0, speed, timestep);
+    }
+}
+
+void overlapCircles(const EntityStore& store, const uint32_t* indices, size_t count, const Circle& circle,
+                    uint8_t* hits) {
+    switch(active_kernels) {
+#ifdef ENTITY_KERNELS_X86
+        case EntityKernels::AVX2:
+            overlapCirclesAvx2(store, indices, count, circle, hits);
+            return;
+        case EntityKernels::SSE2:
+            overlapCirclesSse2(store, indices, count, circle, hits);
+            return;
+#endif
+        default:
+            overlapCirclesScalar(store, indices, 0, count, circle, hits);
+    }
+}
+
+void touchSegments(const SegmentColumns& segments, const uint32_t* indices, size_t count, const Circle& circle,
+                   uint8_t* hits) {
+    switch(active_kernels) {
+#ifdef ENTITY_KERNELS_X86
+        case EntityKernels::AVX2:
+            touchSegmentsAvx2(segments, indices, count, circle, hits);
+            return;
+        case EntityKernels::SSE2:
+            touchSegmentsSse2(segments, indices, count, circle, hits);
+            return;
+#endif
+        default:
+            touchSegmentsScalar(segments, indices, 0, count, circle, hits);
+    }
+}
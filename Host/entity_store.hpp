@@ -0,0 +1,53 @@
+#pragma once
+#include "basic_structs.hpp"
+#include <vector>
+#include <cstdint>
+
+// Moving circles(players or projectiles) stored as columns, entity i is i-th element of every column.
+// Hot loops read only columns they need and kernels below process few entities per instruction
+struct EntityStore {
+    std::vector<double> x, y;
+    std::vector<double> vx, vy;
+    std::vector<double> r;
+    std::vector<uint8_t> alive;
+    std::vector<uint8_t> health;
+
+    size_t size() const;
+    // appends entity, returns its index
+    uint32_t add(const Point& position, const Vector& velocity, double radius, bool is_alive, uint8_t entity_health);
+    // moves last entity into index(swap and pop)
+    void swapRemove(uint32_t index);
+    void clear();
+    Point position(uint32_t index) const;
+    Vector velocity(uint32_t index) const;
+    Circle circle(uint32_t index) const;
+    void setPosition(uint32_t index, const Point& position);
+    void setVelocity(uint32_t index, const Vector& velocity);
+};
+
+// segments(border edges) as columns, segment i goes from (ax[i], ay[i]) to (bx[i], by[i])
+struct SegmentColumns {
+    std::vector<double> ax, ay, bx, by;
+};
+
+// instruction set used by kernels, chosen when host starts. Every variant gives bit exact results of scalar
+// code they replace(Point operators and checkCollision() from collisions.h)
+enum class EntityKernels {
+    SCALAR,
+    SSE2,
+    AVX2
+};
+
+EntityKernels getEntityKernels();
+// returns false if cpu doesn't support kernels, used by benchmarks to compare variants
+bool setEntityKernels(EntityKernels kernels);
+const char* entityKernelsName(EntityKernels kernels);
+
+// position += velocity * speed * timestep for alive entities
+void integratePositions(EntityStore& store, double speed, double timestep);
+// hits[k] = checkCollision(circle, store.circle(indices[k]))
+void overlapCircles(const EntityStore& store, const uint32_t* indices, size_t count, const Circle& circle,
+                    uint8_t* hits);
+// hits[k] = checkCollision(circle, A, B) of segment indices[k]
+void touchSegments(const SegmentColumns& segments, const uint32_t* indices, size_t count, const Circle& circle,
+                   uint8_t* hits);
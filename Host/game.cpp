@@ -1,24 +1,14 @@
 #include "game.hpp"
-#include "timer.hpp"
 #include "collisions.h"
+#include "../Server/server_mutex.h"
 #include <iostream>
-#include <thread>
-#include <atomic>
 #include <random>
 #include <cmath>
 #include <fstream>
 #include <sstream>
 #include <limits>
 
-// set by signal handler, waited on by run()
-volatile static sig_atomic_t stop_signal = false;
-// set by run() after exiting loop, checked by other threads
-volatile static std::atomic<bool> stop = false;
-
 struct Constants {
-    static constexpr std::chrono::milliseconds timestep{3};
-    static constexpr std::chrono::duration<double> double_timestep{timestep};
-    static_assert(timestep > std::chrono::milliseconds(2));
     static constexpr std::chrono::milliseconds send_delay{16};
     static constexpr double epsilon_one = 0.00001;
     // distance traveled per second
@@ -28,6 +18,13 @@ struct Constants {
     static constexpr double projectile_radius = 4;
     static constexpr double player_radius = 30;
     static constexpr double border_width = 4;
+    // cell of player_grid, two player radiuses
+    static constexpr double grid_cell_size = 64;
+    // sweepPlayer() slides along at most this many walls in one tick
+    static constexpr size_t max_slides = 3;
+    // bytes of player and projectile in game state
+    static constexpr size_t player_state_size = 2 + 1 + 1 + 2 * sizeof(double) * 2 + sizeof(float) + 2 + 2;
+    static constexpr size_t projectile_state_size = 2 + 2 * sizeof(double) * 2;
 };
 
 template <class CopyAs, class ArgType>
@@ -45,41 +42,23 @@ copyToBuf(unsigned char*& buf, ArgType point) {
     return size + copyToBuf<double>(buf, point.y);
 }
 
-Projectile::Projectile() : Circle(Point(), Constants::projectile_radius) {}
-
-Projectile::Projectile(size_t owner_id, Point start_position, Vector velocity) :
-            Circle(start_position, Constants::projectile_radius), owner_id(owner_id), velocity(velocity) {}
-
-Point& Projectile::getPosition() {
-    return centre;
-}
-
-const Point& Projectile::getPosition() const {
-    return centre;
-}
-
-Player::Player(size_t player_id) : Circle(Point(), Constants::player_radius), player_id(player_id) {}
+Player::Player(size_t player_id) : player_id(player_id) {}
 
-Point& Player::getPosition() {
-    return centre;
+Game::Game(size_t room_id, std::shared_ptr<const Map> game_map) : room_id(room_id), game_map(std::move(game_map)),
+            timestep(getServerConfig()->simulation_tick_ms),
+            timestep_seconds(std::chrono::duration<double>(timestep).count()),
+            player_grid(Constants::grid_cell_size) {
+    initMutex(&update_mutex);
+    // all rooms share statistics
+    nameMutex(&update_mutex, "Game::update_mutex");
 }
 
-const Point& Player::getPosition() const {
-    return centre;
+size_t Game::getRoomId() const {
+    return room_id;
 }
 
-Game::Game(std::string map_name) {
-    static bool first_init = false;
-    Server::run();
-    if(first_init == false) {
-        // CTRL+C
-        struct sigaction action = {.sa_flags = SA_RESTART};
-        action.sa_handler = [](int) { stop_signal = true; };
-        sigfillset(&action.sa_mask);
-        sigaction(SIGINT, &action, NULL);
-        first_init = true;
-    }
-    getMap(map_name);
+const Map& Game::getMap() const {
+    return *game_map;
 }
 
 std::pair<char, std::vector<double>> splitMapLine(const std::string& line) {
@@ -111,14 +90,15 @@ std::ostream& operator<<(std::ostream& out, const std::vector<T, U>& vec) {
     return out;
 }
 
-void Game::getMap(std::string map_name) {
-    // add mutex locking before using outside of constructor(during map change)
+std::shared_ptr<const Map> loadMap(const std::string& map_name) {
+    auto game_map = std::make_shared<Map>();
+    game_map->name = map_name;
     std::fstream map(std::string("../Maps/") + map_name, map.in);
     if(!map.is_open()) {
         map.open(std::string("Maps/") + map_name, map.in);
         if(!map.is_open()) {
             std::cout << "Couldn't open ../Maps/" << map_name << " or Maps/" << map_name << "\n";
-            return;
+            return game_map;
         }
     }
     std::string line;
@@ -127,17 +107,17 @@ void Game::getMap(std::string map_name) {
         switch(type) {
             case 'B':
                 for(size_t i = 0; i < values.size(); i += 2) {
-                    game_map.borders.push_back(Point(values[i], values[i+1]));
+                    game_map->borders.push_back(Point(values[i], values[i+1]));
                 }
                 break;
             case 'W':
-                game_map.walls.push_back(Rectangle(Point(values[0], values[1]), Point(values[2], values[3]),
+                game_map->walls.push_back(Rectangle(Point(values[0], values[1]), Point(values[2], values[3]),
                                                     Point(values[4], values[5]), Point(values[6], values[7])));
                 break;
             case 'O':
             {
                 Circle obstacle(Point(values[0], values[1]), values[2]);
-                game_map.obstacles.push_back(obstacle);
+                game_map->obstacles.push_back(obstacle);
             }
                 break;
             case '#':
@@ -150,22 +130,116 @@ void Game::getMap(std::string map_name) {
     double min_y = min_x;
     double max_x = std::numeric_limits<double>::min();
     double max_y = max_x;
-    for(const auto& point : game_map.borders) {
+    for(const auto& point : game_map->borders) {
         min_x = std::min(min_x, point.x);
         min_y = std::min(min_y, point.y);
         max_x = std::max(max_x, point.x);
         max_y = std::max(max_y, point.y);
     }
-    game_map.top_left = Point(min_x, min_y);
-    game_map.bottom_right = Point(max_x, max_y);
+    game_map->top_left = Point(min_x, min_y);
+    game_map->bottom_right = Point(max_x, max_y);
+    game_map->geometry.build(game_map->walls, game_map->obstacles, game_map->borders);
+    return game_map;
+}
+
+void Snapshot::writeString(const std::string& value) {
+    write<uint64_t>(value.size());
+    data.insert(data.end(), value.begin(), value.end());
+}
+
+std::string Snapshot::readString() {
+    uint64_t size = read<uint64_t>();
+    if(error || data.size() - position < size) {
+        error = true;
+        return std::string();
+    }
+    std::string value(reinterpret_cast<const char*>(data.data() + position), size);
+    position += size;
+    return value;
+}
+
+void saveMap(Snapshot& snapshot, const Map& game_map) {
+    snapshot.writeString(game_map.name);
+    snapshot.writeVector(game_map.borders);
+    snapshot.write(game_map.top_left);
+    snapshot.write(game_map.bottom_right);
+    snapshot.writeVector(game_map.walls);
+    snapshot.writeVector(game_map.obstacles);
+}
+
+std::shared_ptr<const Map> loadSavedMap(Snapshot& snapshot) {
+    auto game_map = std::make_shared<Map>();
+    game_map->name = snapshot.readString();
+    game_map->borders = snapshot.readVector<Point>();
+    game_map->top_left = snapshot.read<Point>();
+    game_map->bottom_right = snapshot.read<Point>();
+    game_map->walls = snapshot.readVector<Rectangle>();
+    game_map->obstacles = snapshot.readVector<Circle>();
+    game_map->geometry.build(game_map->walls, game_map->obstacles, game_map->borders);
+    return game_map;
+}
+
+void Game::saveState(Snapshot& snapshot) {
+    lockMutex(&update_mutex);
+    snapshot.write<uint64_t>(players.size());
+    for(uint32_t i = 0; i < players.size(); ++i) {
+        snapshot.write(players[i]);
+        snapshot.write(player_store.position(i));
+        snapshot.write(player_store.velocity(i));
+        snapshot.write(player_store.alive[i]);
+        snapshot.write(player_store.health[i]);
+    }
+    snapshot.write<uint64_t>(projectiles.size());
+    for(uint32_t i = 0; i < projectiles.size(); ++i) {
+        snapshot.write(projectiles.ownerAt(i));
+        snapshot.write(projectiles.entities().position(i));
+        snapshot.write(projectiles.entities().velocity(i));
+    }
+    unlockMutex(&update_mutex);
+}
+
+void Game::loadState(Snapshot& snapshot) {
+    lockMutex(&update_mutex);
+    players.clear();
+    player_indices.clear();
+    player_store.clear();
+    uint64_t players_size = snapshot.read<uint64_t>();
+    for(uint64_t i = 0; i < players_size && snapshot.error == false; ++i) {
+        Player player = snapshot.read<Player>();
+        Point position = snapshot.read<Point>();
+        Vector velocity = snapshot.read<Vector>();
+        uint8_t alive = snapshot.read<uint8_t>();
+        uint8_t health = snapshot.read<uint8_t>();
+        if(snapshot.error || player_indices.count(player.player_id) != 0) {
+            break;
+        }
+        packets[player.player_id];
+        player_indices[player.player_id] = player_store.add(position, velocity, Constants::player_radius, alive, health);
+        players.push_back(player);
+    }
+    projectiles.clear();
+    uint64_t projectiles_size = snapshot.read<uint64_t>();
+    for(uint64_t i = 0; i < projectiles_size && snapshot.error == false; ++i) {
+        size_t owner_id = snapshot.read<size_t>();
+        Point position = snapshot.read<Point>();
+        Vector velocity = snapshot.read<Vector>();
+        if(snapshot.error == false) {
+            projectiles.add(owner_id, position, velocity, Constants::projectile_radius);
+        }
+    }
+    old_projectiles = projectiles.size();
+    shot_origins.clear();
+    std::cout << "Room " << room_id << " restored, players: " << players.size() << ", projectiles: " << projectiles.size() << "\n";
+    unlockMutex(&update_mutex);
 }
 
 Game::~Game() {
-    Server::stop();
+    destroyMutex(&update_mutex);
+    std::cout << "Room " << room_id << "(" << game_map->name << "):\n";
     for(const auto& [id, number] : packets) {
         std::cout << "Client(" << id << "): recv = " << number.first << ", send = " << number.second << "\n";
     }
-    auto map_size = game_map.obstacles.size() + game_map.walls.size() + game_map.borders.size() / 2;
+    auto map_size = game_map->obstacles.size() + game_map->walls.size() + game_map->borders.size() / 2;
     std::cout << "Map size: " << map_size << "\n";
     for(const auto& [sizes, time_map] : calc_time) {
         const auto& [players_size, projectiles_size] = sizes;
@@ -179,149 +253,170 @@ Game::~Game() {
     }
 }
 
-void Game::run() {
-    std::thread update(&Game::updateThread, this);
-    std::thread send(&Game::sendThread, this);
-    std::thread receive(&Game::receiveThread, this);
-    while(stop_signal == false) {
-        std::this_thread::sleep_for(std::chrono::seconds(1));
-    }
-    stop.store(true);
-    receive.join();
-    send.join();
-    update.join();
-}
-
-void Game::updateThread() {
-    Timer update_timer;
-    Timer<>::DurationType accumulator(0);
-
-    while(stop.load() == false) {
-        std::this_thread::sleep_for(Constants::timestep - std::chrono::milliseconds(2));
-        accumulator += update_timer.restart();
-        if(accumulator > Constants::timestep) {
-            update_mutex.lock();
-            while(accumulator > Constants::timestep) {
-                Timer start;
-                updatePositions();
-                auto update_duration = start.restart();
-                checkCollisions();
-                auto collision_duration = start.duration();
-                accumulator -= Constants::timestep;
-                auto& update = calc_time[std::make_pair(players.size(), projectiles.size())];
-                auto& [no_collision, collision_total_time] = update["collision"];
-                auto& [no_update, update_total_time] = update["update"];
-                no_collision += 1;
-                collision_total_time += update_duration;
-                no_update += 1;
-                update_total_time += collision_duration;
-            }
-            update_mutex.unlock();
+void Game::step() {
+    accumulator += update_timer.restart();
+    if(accumulator > timestep) {
+        update();
+    }
+    if(send_timer.duration() >= Constants::send_delay) {
+        send_timer.start();
+        sendGameState();
+    }
+}
+
+void Game::update() {
+    lockMutex(&update_mutex);
+    while(accumulator > timestep) {
+        Timer start;
+        updatePositions();
+        auto update_duration = start.restart();
+        checkCollisions();
+        auto collision_duration = start.duration();
+        accumulator -= timestep;
+        auto& update = calc_time[std::make_pair(player_store.size(), projectiles.size())];
+        auto& [no_collision, collision_total_time] = update["collision"];
+        auto& [no_update, update_total_time] = update["update"];
+        no_collision += 1;
+        collision_total_time += update_duration;
+        no_update += 1;
+        update_total_time += collision_duration;
+    }
+    unlockMutex(&update_mutex);
+}
+
+void Game::sendGameState() {
+    lockMutex(&update_mutex);
+    Timer start = Timer();
+    Message game_state = serializeGameState();
+    auto serialization_duration = start.duration();
+    auto& [no_serialize, serialize_total_time] = calc_time[std::make_pair(player_store.size(), projectiles.size())]["serialize"];
+    no_serialize += 1;
+    serialize_total_time += serialization_duration;
+    for(const auto& player : players) {
+        packets[player.player_id].second += 1;
+    }
+    if(applied_times.empty() == false) {
+        uint64_t now = Server::latencyNow();
+        for(uint64_t applied_time : applied_times) {
+            Server::recordLatency(LATENCY_APPLY_TO_BROADCAST, applied_time, now);
         }
+        applied_times.clear();
     }
+    unlockMutex(&update_mutex);
+    Server::sendMessageToRoom(game_state, room_id);
 }
 
-void Game::sendThread() {
-    while(stop.load() == false) {
-        std::this_thread::sleep_for(Constants::send_delay);
-        update_mutex.lock();
-        Timer start = Timer();
-        Message game_state = serializeGameState();
-        auto serialization_duration = start.duration();
-        auto& [no_serialize, serialize_total_time] = calc_time[std::make_pair(players.size(), projectiles.size())]["serialize"];
-        no_serialize += 1;
-        serialize_total_time += serialization_duration;
-        for(auto& [player_id, player] : players) {
-            packets[player_id].second += 1;
-        }
-        update_mutex.unlock();
-        Server::sendMessageToEveryone(game_state);
-    }
+void Game::addPlayer(size_t player_id) {
+    lockMutex(&update_mutex);
+    resetPlayer(player_id);
+    packets[player_id];
+    std::cout << "Player " << player_id << " moved to room " << room_id << "\n";
+    Server::sendMessageTo(serializeMap(), player_id);
+    unlockMutex(&update_mutex);
+}
+
+void Game::addSpectator(size_t client_id) {
+    lockMutex(&update_mutex);
+    std::cout << "Spectator " << client_id << " watches room " << room_id << "\n";
+    Server::sendMessageTo(serializeMap(), client_id);
+    unlockMutex(&update_mutex);
+}
+
+void Game::removePlayer(size_t player_id) {
+    lockMutex(&update_mutex);
+    erasePlayer(player_id);
+    unlockMutex(&update_mutex);
 }
 
-void Game::receiveThread() {
-    while(stop.load() == false) {
-        handleMessage(Server::takeMessage(1));
+void Game::handleMessages(std::vector<IncomingMessageWrapper>& messages) {
+    lockMutex(&update_mutex);
+    bool timestamps = getServerConfig()->latency_timestamps;
+    uint64_t locked_time = timestamps ? Server::latencyNow() : 0;
+    for(auto& message : messages) {
+        handleMessage(message);
+        if(timestamps && message.getTakenTime() != 0) {
+            Server::recordLatency(LATENCY_LOCK_WAIT, message.getTakenTime(), locked_time);
+            applied_times.push_back(Server::latencyNow());
+        }
     }
+    unlockMutex(&update_mutex);
 }
 
-void Game::handleMessage(IncomingMessageWrapper&& message) {
-    if(message.getType() != MessageType::EMPTY) {
-        update_mutex.lock();
-        auto start = Timer();
-        switch(message.getType()) {
-            case MessageType::NEW_CONNECTION:
-                createNewPlayer(message.getClientId());
-                sendWelcomeMessage(message.getClientId());
+void Game::handleMessage(IncomingMessageWrapper& message) {
+    auto start = Timer();
+    switch(message.getType()) {
+        case MessageType::NEW_CONNECTION:
+            createNewPlayer(message.getClientId());
+            sendWelcomeMessage(message.getClientId());
+            Server::sendMessageTo(serializeMap(), message.getClientId());
+            return;
+        case MessageType::LOST_CONNECTION:
+            deletePlayer(message.getClientId());
+            break;
+        case MessageType::MESSAGE:
+            switch(static_cast<DataType>(message.getBuffer()[0])) {
+                case SPAWN:
+                    spawnPlayer(message.getClientId());
+                    break;
+                case SHOOT:
+                    shootProjectile(message.getClientId());
+                    break;
+                case CHANGE_ORIENTATION:
+                    changePlayerOrientation(message.getClientId(), *reinterpret_cast<float*>(message.getBuffer() + 1));
+                    break;
+                case CHANGE_MOVEMENT_DIRECTION:
+                    changePlayerMovement(message.getClientId(), *reinterpret_cast<double*>(message.getBuffer() + 1),
+                                        *reinterpret_cast<double*>(message.getBuffer() + 9));
+                    break;
+                case PING:
                 {
-                    Message map = serializeMap();
-                    update_mutex.unlock();
-                    Server::sendMessageTo(map, message.getClientId());
-                }
-                return;
-            case MessageType::LOST_CONNECTION:
-                deletePlayer(message.getClientId());
-                break;
-            case MessageType::MESSAGE:
-                switch(static_cast<DataType>(message.getBuffer()[0])) {
-                    case SPAWN:
-                        spawnPlayer(message.getClientId());
-                        break;
-                    case SHOOT:
-                        shootProjectile(message.getClientId());
-                        break;
-                    case CHANGE_ORIENTATION:
-                        changePlayerOrientation(message.getClientId(), *reinterpret_cast<float*>(message.getBuffer() + 1));
-                        break;
-                    case CHANGE_MOVEMENT_DIRECTION:
-                        changePlayerMovement(message.getClientId(), *reinterpret_cast<double*>(message.getBuffer() + 1),
-                                            *reinterpret_cast<double*>(message.getBuffer() + 9));
-                        break;
-                    case PING:
-                    {
-                        unsigned char* buf = new unsigned char[3];
-                        Message msg = {.size = 3, .data = buf};
-                        copyToBuf<uint8_t>(buf, PING);
-                        copyToBuf<uint16_t>(buf, *reinterpret_cast<uint16_t*>(message.getBuffer() + 1));
-                        Server::sendMessageTo(msg, message.getClientId());
-                    }   
-                        break;
-                    default:
-                        std::cout << "UNKNOWN\n";
-                        break;
-                }
-                break;
-        }
-        auto duration = start.duration();
-        auto& [no_receive, receive_total_time] = calc_time[std::make_pair(players.size(), projectiles.size())]["receive"];
-        no_receive += 1;
-        receive_total_time += duration;
-        ++packets[message.getClientId()].first;
-        update_mutex.unlock();
+                    unsigned char* buf = new unsigned char[3];
+                    Message msg = {.size = 3, .data = buf};
+                    copyToBuf<uint8_t>(buf, PING);
+                    copyToBuf<uint16_t>(buf, *reinterpret_cast<uint16_t*>(message.getBuffer() + 1));
+                    Server::sendMessageTo(msg, message.getClientId());
+                }   
+                    break;
+                default:
+                    std::cout << "UNKNOWN\n";
+                    break;
+            }
+            break;
+        default:
+            return;
     }
+    auto duration = start.duration();
+    auto& [no_receive, receive_total_time] = calc_time[std::make_pair(player_store.size(), projectiles.size())]["receive"];
+    no_receive += 1;
+    receive_total_time += duration;
+    ++packets[message.getClientId()].first;
 }
 
 void Game::shootProjectile(size_t player_id) {
-    const auto& player = players[player_id];
-    if(player.alive == false) {
+    uint32_t index = findPlayer(player_id);
+    if(index == no_player || player_store.alive[index] == false) {
         return;
     }
+    const Player& player = players[index];
     Vector normalized_direction(cos(player.orientation_angle), sin(player.orientation_angle));
-    Projectile projectile(player_id, player.centre + normalized_direction * player.r, normalized_direction);
-    projectiles.push_back(projectile);
+    projectiles.add(player_id, player_store.position(index) + normalized_direction * player_store.r[index],
+                    normalized_direction, Constants::projectile_radius);
+    shot_origins.push_back(player_store.position(index));
 }
 
 void Game::spawnPlayer(size_t player_id) {
-    Player& player = players[player_id];
-    if(player.alive == false) {
+    uint32_t index = findPlayer(player_id);
+    if(index != no_player && player_store.alive[index] == false) {
         auto r_engine = std::default_random_engine(std::random_device()());
-        auto dist_x = std::uniform_int_distribution(static_cast<int>(game_map.top_left.x), static_cast<int>(game_map.bottom_right.x));
-        auto dist_y = std::uniform_int_distribution(static_cast<int>(game_map.top_left.y), static_cast<int>(game_map.bottom_right.y));
-        player.alive = true;
-        player.health = 100;
+        auto dist_x = std::uniform_int_distribution(static_cast<int>(game_map->top_left.x), static_cast<int>(game_map->bottom_right.x));
+        auto dist_y = std::uniform_int_distribution(static_cast<int>(game_map->top_left.y), static_cast<int>(game_map->bottom_right.y));
+        player_store.alive[index] = true;
+        player_store.health[index] = 100;
+        Point centre;
         do {
-        player.centre = Point(dist_x(r_engine), dist_y(r_engine));
-        } while(!isInsideBorder(player.centre));
+        centre = Point(dist_x(r_engine), dist_y(r_engine));
+        } while(!isInsideBorder(centre));
+        player_store.setPosition(index, centre);
         // FIXME add check to make sure player isn't inside another rectangle
         // if players centre is outside then collision check will push him out
         // but if it's inside player will be stuck inside wall
@@ -334,125 +429,325 @@ bool Game::isInsideBorder(const Point& point) const {
 }
 
 void Game::changePlayerOrientation(size_t player_id, float angle) {
-    players[player_id].orientation_angle = angle;
+    uint32_t index = findPlayer(player_id);
+    if(index != no_player) {
+        players[index].orientation_angle = angle;
+    }
 }
 
 void Game::changePlayerMovement(size_t player_id, double velocity_x, double velocity_y) {
+    uint32_t index = findPlayer(player_id);
+    if(index == no_player) {
+        return;
+    }
     if(square(velocity_x) + square(velocity_y) <= 1 + Constants::epsilon_one) {
-        players[player_id].velocity = Vector(velocity_x, velocity_y);
+        player_store.setVelocity(index, Vector(velocity_x, velocity_y));
     }
     else {
         std::cout << "|v| = " << square(velocity_x) + square(velocity_y) << "\n";
     }
 }
 
+uint32_t Game::findPlayer(size_t player_id) const {
+    auto iter = player_indices.find(player_id);
+    return iter == player_indices.end() ? no_player : iter->second;
+}
+
+uint32_t Game::resetPlayer(size_t player_id) {
+    uint32_t index = findPlayer(player_id);
+    if(index == no_player) {
+        index = player_store.add(Point(), Vector(0, 0), Constants::player_radius, false, 100);
+        players.emplace_back(player_id);
+        player_indices[player_id] = index;
+        return index;
+    }
+    players[index] = Player(player_id);
+    player_store.setPosition(index, Point());
+    player_store.setVelocity(index, Vector(0, 0));
+    player_store.alive[index] = false;
+    player_store.health[index] = 100;
+    return index;
+}
+
+void Game::erasePlayer(size_t player_id) {
+    uint32_t index = findPlayer(player_id);
+    if(index == no_player) {
+        return;
+    }
+    player_indices.erase(player_id);
+    player_store.swapRemove(index);
+    players[index] = players.back();
+    players.pop_back();
+    if(index < players.size()) {
+        player_indices[players[index].player_id] = index;
+    }
+}
+
 void Game::createNewPlayer(size_t player_id) {
-    players[player_id] = Player(player_id);
+    resetPlayer(player_id);
     packets[player_id] = {0,0};
-    std::cout << "New player connected: " << player_id << "\n";
+    std::cout << "New player connected: " << player_id << ", room: " << room_id << "\n";
 }
 
 void Game::deletePlayer(size_t player_id) {
-    players.erase(player_id);
+    erasePlayer(player_id);
+    ClientSendStats stats;
+    if(Server::getClientSendStats(player_id, stats)) {
+        std::cout << "Player disconnected: " << player_id << ", max queued: " << stats.max_queued_bytes
+                  << " B, dropped: " << stats.dropped_frames << " frames(" << stats.dropped_bytes << " B)\n";
+    }
 }
 
 void Game::sendWelcomeMessage(size_t player_id) {
     // TODO send needed constants(max player speed, projectile speed)
-    const size_t size = 1 + 2 + sizeof(double) * 2;
+    // UDP port(0 if game states come only over TCP), client id and token are sent back in client's UDP hello
+    const size_t size = 1 + 2 + sizeof(double) * 2 + 2 + 8 + 4;
     unsigned char* buf = new unsigned char[size];
     Message msg = {.size = size, .data = buf};
+    UdpOffer offer{};
+    Server::getUdpOffer(player_id, offer);
     copyToBuf<uint8_t>(buf, DataType::WELCOME_MESSAGE);
     copyToBuf<uint16_t>(buf, player_id);
     copyToBuf<double>(buf, Constants::player_radius);
     copyToBuf<double>(buf, Constants::projectile_radius);
+    copyToBuf<uint16_t>(buf, offer.port);
+    copyToBuf<uint64_t>(buf, player_id);
+    copyToBuf<uint32_t>(buf, offer.token);
     Server::sendMessageTo(msg, player_id);
 }
 
 void Game::updatePositions() {
-    for(auto& [player_id, player] : players) {
-        if(player.alive == false) {
-            continue;
-        }
-        player.getPosition() += player.velocity * Constants::max_player_speed * Constants::double_timestep.count();
+    player_starts.clear();
+    for(uint32_t i = 0; i < player_store.size(); ++i) {
+        player_starts.push_back(player_store.position(i));
+    }
+    projectile_starts.clear();
+    for(uint32_t i = 0; i < projectiles.size(); ++i) {
+        projectile_starts.push_back(i < old_projectiles ? projectiles.entities().position(i)
+                                                        : shot_origins[i - old_projectiles]);
     }
-    for(auto& projectile : projectiles) {
-        projectile.getPosition() += projectile.velocity * Constants::projectile_speed * Constants::double_timestep.count();
+    integratePositions(player_store, Constants::max_player_speed, timestep_seconds);
+    integratePositions(projectiles.entities(), Constants::projectile_speed, timestep_seconds);
+}
+
+void Game::buildPlayerGrid() {
+    player_centres.clear();
+    for(uint32_t i = 0; i < player_store.size(); ++i) {
+        player_centres.push_back(player_store.position(i));
     }
+    player_grid.build(player_centres, Constants::player_radius);
 }
 
 void Game::checkCollisions() {
-    for(auto& [player_id, player] : players) {
-        if(player.alive == false) {
+    const StaticGeometry& geometry = game_map->geometry;
+    // players touching other players are pushed apart first, they move less than their radius per tick
+    // (simulation_tick_ms <= 50), so none can pass through other
+    buildPlayerGrid();
+    for(uint32_t index = 0; index < player_store.size(); ++index) {
+        if(player_store.alive[index] == false) {
             continue;
         }
-        for(auto& [player_id, second_player] : players) {
-            if(&second_player == &player) {
-                continue;
-            }
-            else if(checkCollision(player, second_player)) {
-                moveAlongNormal(player, second_player);
+        // moved in local copy, written back after all checks
+        Circle player = player_store.circle(index);
+        // earlier pairs push players out of their hashed position by at most one radius
+        player_grid.forEachNear(player.centre, player.r + Constants::player_radius, [&](uint32_t second_index) {
+            Circle second_player = player_store.circle(second_index);
+            if(second_index != index && checkCollision(player, second_player)) {
+                moveApart(player, second_player);
+                player_store.setPosition(second_index, second_player.centre);
             }
+        });
+        player_store.setPosition(index, player.centre);
+    }
+    // way from start of tick includes pushes, so no player is moved or pushed through map geometry
+    for(uint32_t index = 0; index < player_store.size(); ++index) {
+        if(player_store.alive[index] == false) {
+            continue;
         }
-        for(const auto& wall : game_map.walls) {
-            if(checkCollision(player, wall)) {
-                moveAlongNormal(player, wall);
+        sweepPlayer(index);
+        Circle player = player_store.circle(index);
+        // pushing player out of geometry moves it by at most one radius
+        Point reach(2 * player.r, 2 * player.r);
+        geometry.query(player.centre - reach, player.centre + reach, geometry_query);
+        for(uint32_t wall : geometry_query.walls) {
+            if(geometry.checkWall(player, wall)) {
+                moveAlongNormal(player, geometry.getWallEdges(wall));
             }
         }
-        for(const auto& obstacle : game_map.obstacles) {
-            if(checkCollision(player, obstacle)) {
-                moveAlongNormal(player, obstacle);
+        for(uint32_t obstacle : geometry_query.obstacles) {
+            if(geometry.checkObstacle(player, obstacle)) {
+                moveAlongNormal(player, game_map->obstacles[obstacle]);
             }
         }
-        for(size_t i = 0; i < game_map.borders.size() - 1; ++i) {
-            if(checkCollision(player, game_map.borders[i], game_map.borders[i+1])) {
-                moveAlongNormal(player, game_map.borders[i], game_map.borders[i+1]);
+        for(uint32_t edge : geometry_query.edges) {
+            if(geometry.checkEdge(player, edge)) {
+                moveAlongNormal(player, geometry.getEdges()[edge]);
             }
         }
-        if(!game_map.borders.empty() && checkCollision(player, game_map.borders.back(), game_map.borders.front())) {
-            moveAlongNormal(player, game_map.borders.back(), game_map.borders.front());
-        }
+        player_store.setPosition(index, player.centre);
     }
-    for(auto projectile_iter = projectiles.begin(); projectile_iter != projectiles.end();) {
-        if(checkProjectileCollisions(*projectile_iter)) {
-            projectile_iter = projectiles.erase(projectile_iter);
-        } else {
-            ++projectile_iter;
+    // players moved
+    buildPlayerGrid();
+    for(uint32_t index = 0; index < projectiles.size(); ++index) {
+        if(checkProjectileCollisions(index)) {
+            projectiles.release(projectiles.handleAt(index));
         }
     }
+    projectiles.compact();
+    // shots added later are appended after every projectile
+    old_projectiles = projectiles.size();
+    shot_origins.clear();
 }
 
-bool Game::checkProjectileCollisions(const Projectile& projectile) {
-    for(const auto& wall : game_map.walls) {
-        if(checkCollision(projectile, wall)) {
-            return true;
-        }
+// unit vector from closest point of shape to point, zero if point is on shape
+Vector awayFrom(const Point& point, const Point& closest) {
+    Vector away = point - closest;
+    double length = away.length();
+    return length > 0 ? away * (1 / length) : Vector(0, 0);
+}
+
+Vector awayFrom(const Point& point, const Rectangle& wall) {
+    // centre inside wall, pushing out is left to moveAlongNormal()
+    if(checkCollision(Circle(point, 0), wall)) {
+        return Vector(0, 0);
     }
-    for(const auto& obstacle : game_map.obstacles) {
-        if(checkCollision(projectile, obstacle)) {
-            return true;
+    Point closest = closestPointOnSegment(point, wall.points[0], wall.points[1]);
+    for(size_t i = 1; i < 4; ++i) {
+        Point edge_closest = closestPointOnSegment(point, wall.points[i], wall.points[(i + 1) % 4]);
+        if(distance(point, edge_closest) < distance(point, closest)) {
+            closest = edge_closest;
         }
     }
-    for(auto& [player_id, player] : players) {
-        if(player.alive == true && player_id != projectile.owner_id && checkCollision(projectile, player)) {
-            if(player.health <= Constants::projectile_damage) {
-                player.alive = false;
-                ++player.deaths;
-                ++players[projectile.owner_id].kills;
-            } else {
-                player.health -= Constants::projectile_damage;
+    return awayFrom(point, closest);
+}
+
+void Game::sweepPlayer(uint32_t index) {
+    const StaticGeometry& geometry = game_map->geometry;
+    Point position = player_starts[index];
+    Vector remaining = player_store.position(index) - position;
+    double r = player_store.r[index];
+    Point end = position + remaining;
+    Point reach(r + 1, r + 1);
+    geometry.query(Point(std::min(position.x, end.x), std::min(position.y, end.y)) - reach,
+                   Point(std::max(position.x, end.x), std::max(position.y, end.y)) + reach, geometry_query);
+    for(size_t slide = 0; slide < Constants::max_slides; ++slide) {
+        if(remaining.x == 0 && remaining.y == 0) {
+            break;
+        }
+        Circle player(position, r);
+        double first = 2;
+        Vector normal;
+        // touch counts only if player moves into shape, so player already touching wall can move along it
+        auto touch = [&](double t, auto away) {
+            if(t < 0 || t >= first) {
+                return;
+            }
+            Vector contact_normal = away(position + remaining * t);
+            if(dot(contact_normal, remaining) < 0) {
+                first = t;
+                normal = contact_normal;
             }
-            return true;
+        };
+        for(uint32_t wall : geometry_query.walls) {
+            const Rectangle& rectangle = game_map->walls[wall];
+            touch(sweptCollision(player, remaining, rectangle), [&](const Point& at) {
+                return awayFrom(at, rectangle);
+            });
+        }
+        for(uint32_t obstacle : geometry_query.obstacles) {
+            const Circle& circle = game_map->obstacles[obstacle];
+            touch(sweptCollision(player, remaining, circle), [&](const Point& at) {
+                return awayFrom(at, circle.centre);
+            });
+        }
+        for(uint32_t edge : geometry_query.edges) {
+            const GeometryEdge& geometry_edge = geometry.getEdges()[edge];
+            touch(sweptCollision(player, remaining, geometry_edge.start, geometry_edge.end), [&](const Point& at) {
+                return awayFrom(at, closestPointOnSegment(at, geometry_edge.start, geometry_edge.end));
+            });
+        }
+        if(first > 1) {
+            position += remaining;
+            break;
+        }
+        // rest of the way without part going into shape
+        position += remaining * first;
+        remaining = remaining * (1 - first);
+        remaining += normal * -dot(remaining, normal);
+    }
+    player_store.setPosition(index, position);
+}
+
+bool Game::checkProjectileCollisions(uint32_t projectile_index) {
+    const StaticGeometry& geometry = game_map->geometry;
+    Circle projectile(projectile_starts[projectile_index], projectiles.entities().r[projectile_index]);
+    Vector way = projectiles.entities().position(projectile_index) - projectile.centre;
+    size_t owner_id = projectiles.ownerAt(projectile_index);
+    // circle containing whole way, kernels use it to skip shapes that can't be touched
+    Circle bounds(projectile.centre + way * 0.5, way.length() / 2 + projectile.r + 1);
+    Point reach(bounds.r, bounds.r);
+    geometry.query(bounds.centre - reach, bounds.centre + reach, geometry_query);
+    double first = 2;
+    for(uint32_t wall : geometry_query.walls) {
+        if(geometry.checkWall(bounds, wall)) {
+            double t = sweptCollision(projectile, way, game_map->walls[wall]);
+            first = t >= 0 ? std::min(first, t) : first;
+        }
+    }
+    for(uint32_t obstacle : geometry_query.obstacles) {
+        double t = sweptCollision(projectile, way, game_map->obstacles[obstacle]);
+        first = t >= 0 ? std::min(first, t) : first;
+    }
+    const auto& edges = geometry_query.edges;
+    candidate_hits.resize(edges.size());
+    touchSegments(geometry.getEdgeColumns(), edges.data(), edges.size(), bounds, candidate_hits.data());
+    for(size_t k = 0; k < edges.size(); ++k) {
+        if(candidate_hits[k]) {
+            const GeometryEdge& edge = geometry.getEdges()[edges[k]];
+            double t = sweptCollision(projectile, way, edge.start, edge.end);
+            first = t >= 0 ? std::min(first, t) : first;
         }
     }
-    for(size_t i = 0; i < game_map.borders.size() - 1; ++i) {
-            if(checkCollision(projectile, game_map.borders[i], game_map.borders[i+1])) {
-                return true;
+    // players moved during tick too, so their way is subtracted and they are tested from start of tick.
+    // Sweeping and pushing moves player by at most its step and radius
+    double player_reach = Constants::max_player_speed * timestep_seconds + Constants::player_radius;
+    Circle player_bounds(bounds.centre, bounds.r + player_reach);
+    candidates.clear();
+    player_grid.forEachNear(player_bounds.centre, player_bounds.r, [&](uint32_t index) {
+        candidates.push_back(index);
+    });
+    candidate_hits.resize(candidates.size());
+    overlapCircles(player_store, candidates.data(), candidates.size(), player_bounds, candidate_hits.data());
+    uint32_t hit = no_player;
+    for(size_t k = 0; k < candidates.size(); ++k) {
+        uint32_t index = candidates[k];
+        if(candidate_hits[k] == false || player_store.alive[index] == false || players[index].player_id == owner_id) {
+            continue;
+        }
+        Point player_start = player_starts[index];
+        Vector relative_way = way - (player_store.position(index) - player_start);
+        double t = sweptCollision(projectile, relative_way, Circle(player_start, player_store.r[index]));
+        if(t >= 0 && t < first) {
+            first = t;
+            hit = index;
+        }
+    }
+    if(first > 1) {
+        return false;
+    }
+    if(hit != no_player) {
+        if(player_store.health[hit] <= Constants::projectile_damage) {
+            player_store.alive[hit] = false;
+            ++players[hit].deaths;
+            uint32_t owner = findPlayer(owner_id);
+            if(owner != no_player) {
+                ++players[owner].kills;
             }
+        } else {
+            player_store.health[hit] -= Constants::projectile_damage;
         }
-    if(!game_map.borders.empty() && checkCollision(projectile, game_map.borders.back(), game_map.borders.front())) {
-        return true;
     }
-    return false;
+    return true;
 }
 
 std::pair<Vector, double> calculateDisplacement(const Circle& circle1, const Circle& circle2) {
@@ -463,82 +758,75 @@ std::pair<Vector, double> calculateDisplacement(const Circle& circle1, const Cir
     return std::make_pair(displacement_vector, displacement);
 }
 
-std::pair<Vector, double> calculateDisplacement(const Circle& circle, const Point& P1, const Point& P2) {
-    auto dx = P2.x - P1.x;
-    auto dy = P2.y - P1.y;
-    Vector normal = Point(-dy, dx);
-    normal /= normal.length(); // normalize vector
-    double displacement = circle.r - triangleHeight(circle.centre, P1, P2);
-    return std::make_pair(normal, displacement);
+std::pair<Vector, double> calculateDisplacement(const Circle& circle, const GeometryEdge& edge) {
+    Vector to_centre = circle.centre - edge.start;
+    // distance of centre from edge's line
+    double height = std::abs(to_centre.x * edge.normal.x + to_centre.y * edge.normal.y);
+    return std::make_pair(edge.normal, circle.r - height);
 }
 
-void Game::moveAlongNormal(Player& player1, Player& player2) {
+void Game::moveApart(Circle& player1, Circle& player2) {
     const auto& [displacement_vector, displacement] = calculateDisplacement(player1, player2);
     double half_displacement = displacement / 2;
     player1.centre += displacement_vector * half_displacement;
     player2.centre += displacement_vector * half_displacement * -1;
 }
 
-void Game::moveAlongNormal(Player& player, const Point& P1, const Point& P2) {
-    const auto& [displacement_vector, displacement] = calculateDisplacement(player, P1, P2);
+void Game::moveAlongNormal(Circle& player, const GeometryEdge& edge) {
+    const auto& [displacement_vector, displacement] = calculateDisplacement(player, edge);
     player.centre += displacement_vector * displacement;
 }
 
-void Game::moveAlongNormal(Player& player, const Circle& object) {
+void Game::moveAlongNormal(Circle& player, const Circle& object) {
     const auto& [displacement_vector, displacement] = calculateDisplacement(player, object);
     player.centre += displacement_vector * displacement;
 }
 
-void Game::moveAlongNormal(Player& player, const Rectangle& object) {
+void Game::moveAlongNormal(Circle& player, const std::array<GeometryEdge, 4>& wall_edges) {
     // FIXME wrong displacement when colliding with rectangle edges
     // maybe change to movement along tangent(styczna) or displacement along tangent's normal
     // detecting edge: check if rectangle's points are inside circle? if yes then edge
-    if(checkCollision(player, object.points[0], object.points[1])) {
-        moveAlongNormal(player, object.points[1], object.points[0]);
-    }
-    if(checkCollision(player, object.points[1], object.points[2])) {
-        moveAlongNormal(player, object.points[2], object.points[1]);
-    }
-    if(checkCollision(player, object.points[2], object.points[3])) {
-        moveAlongNormal(player, object.points[3], object.points[2]);
-    }
-    if(checkCollision(player, object.points[3], object.points[0])) {
-        moveAlongNormal(player, object.points[0], object.points[3]);
+    for(const auto& edge : wall_edges) {
+        if(checkCollision(player, edge.start, edge.end)) {
+            moveAlongNormal(player, edge);
+        }
     }
 }
 
 Message Game::serializeGameState() {
     uint16_t players_size = static_cast<uint16_t>(players.size());
     uint16_t projectiles_size = static_cast<uint16_t>(projectiles.size());
-    unsigned char* buf = new unsigned char[5 + players_size * sizeof(Player) + projectiles_size * sizeof(Projectile)];
+    unsigned char* buf = new unsigned char[5 + players_size * Constants::player_state_size
+                                           + projectiles_size * Constants::projectile_state_size];
     uint32_t size = 0;
     Message message = {.data = buf};
     size += copyToBuf<uint8_t>(buf, DataType::GAME_STATE);
     size += copyToBuf<uint16_t>(buf, players_size);
     size += copyToBuf<uint16_t>(buf, projectiles_size);
-    for(const auto& [player_id, player] : players) {
+    for(uint32_t i = 0; i < players_size; ++i) {
+        const Player& player = players[i];
         size += copyToBuf<uint16_t>(buf, player.player_id);
-        size += copyToBuf<uint8_t>(buf, player.alive);
-        size += copyToBuf<uint8_t>(buf, player.health);
-        size += copyToBuf<double>(buf, player.getPosition());
-        size += copyToBuf<double>(buf, player.velocity);
+        size += copyToBuf<uint8_t>(buf, player_store.alive[i]);
+        size += copyToBuf<uint8_t>(buf, player_store.health[i]);
+        size += copyToBuf<double>(buf, player_store.position(i));
+        size += copyToBuf<double>(buf, player_store.velocity(i));
         size += copyToBuf<float>(buf, player.orientation_angle);
         size += copyToBuf<uint16_t>(buf, player.kills);
         size += copyToBuf<uint16_t>(buf, player.deaths);
     }
-    for(const auto& projectile : projectiles) {
-        size += copyToBuf<uint16_t>(buf, projectile.owner_id);
-        size += copyToBuf<double>(buf, projectile.getPosition());
-        size += copyToBuf<double>(buf, projectile.velocity);
+    for(uint32_t i = 0; i < projectiles_size; ++i) {
+        size += copyToBuf<uint16_t>(buf, projectiles.ownerAt(i));
+        size += copyToBuf<double>(buf, projectiles.entities().position(i));
+        size += copyToBuf<double>(buf, projectiles.entities().velocity(i));
     }
     message.size = size;
     return message;
 }
 
 Message Game::serializeMap() {
-    uint16_t walls_size = static_cast<uint16_t>(game_map.walls.size());
-    uint16_t obstacles_size = static_cast<uint16_t>(game_map.obstacles.size());
-    uint16_t borders_size = static_cast<uint16_t>(game_map.borders.size());
+    uint16_t walls_size = static_cast<uint16_t>(game_map->walls.size());
+    uint16_t obstacles_size = static_cast<uint16_t>(game_map->obstacles.size());
+    uint16_t borders_size = static_cast<uint16_t>(game_map->borders.size());
     unsigned char* buf = new unsigned char[7 + walls_size * sizeof(Rectangle) + obstacles_size * sizeof(Circle) + borders_size * sizeof(Point)];
     uint32_t size = 0;
     Message message = {.data = buf};
@@ -546,15 +834,15 @@ Message Game::serializeMap() {
     size += copyToBuf<uint16_t>(buf, walls_size);
     size += copyToBuf<uint16_t>(buf, obstacles_size);
     size += copyToBuf<uint16_t>(buf, borders_size);
-    for(const auto& wall : game_map.walls) {
+    for(const auto& wall : game_map->walls) {
         for(int i = 0; i < 4; ++i)
             size += copyToBuf<double>(buf, wall.points[i]);
     }
-    for(const auto& obstacle : game_map.obstacles) {
+    for(const auto& obstacle : game_map->obstacles) {
         size += copyToBuf<double>(buf, obstacle.centre);
         size += copyToBuf<double>(buf, obstacle.r);
     }
-    for(const auto& point : game_map.borders) {
+    for(const auto& point : game_map->borders) {
         size += copyToBuf<double>(buf, point);
     }
     message.size = size;
@@ -1,45 +1,44 @@
 #pragma once
 #include "basic_structs.hpp"
 #include "server_wrapper.hpp"
+#include "timer.hpp"
+#include "spatial_hash.hpp"
+#include "static_geometry.hpp"
+#include "entity_store.hpp"
+#include "projectile_pool.hpp"
 #include <vector>
 #include <string>
 #include <unordered_map>
 #include <chrono>
 #include <array>
 #include <utility>
-#include <mutex>
+#include <memory>
+#include <pthread.h>
 #include <cstdint>
+#include <cstring>
+#include <type_traits>
 
-struct Projectile : Circle {
-    size_t owner_id;
-    Vector velocity;
-
-    Projectile();
-    Projectile(size_t owner_id, Point start_position, Vector velocity);
-    Point& getPosition();
-    const Point& getPosition() const;
-};
-
-struct Player : Circle {
+// part of player not used by movement and collisions, position, velocity, radius, alive and health are
+// in Game::player_store at the same index
+struct Player {
     size_t player_id;
-    bool alive = false;
-    uint8_t health = 100;
-    Vector velocity = {0, 0};
     float orientation_angle = 0;
     uint16_t kills = 0;
     uint16_t deaths = 0;
 
     Player(size_t player_id = 0);
-    Point& getPosition();
-    const Point& getPosition() const;
 };
 
+// immutable after loading, rooms with the same map share it
 struct Map {
+    std::string name;
     std::vector<Point> borders;
     // border is inside this rectangle(top left, bottom right points)
     Point top_left, bottom_right;
     std::vector<Rectangle> walls;
     std::vector<Circle> obstacles;
+    // grid over walls, obstacles and border edges, built by loadMap() and loadSavedMap()
+    StaticGeometry geometry;
 };
 
 struct PairHash {
@@ -48,40 +47,155 @@ struct PairHash {
     }
 };
 
+// reads ../Maps/map_name or Maps/map_name, returns empty map if neither can be opened
+std::shared_ptr<const Map> loadMap(const std::string& map_name);
+
+// state of rooms given to new host on restart(handoff_socket_path). Values are copied as they are in memory,
+// both hosts run on the same machine
+struct Snapshot {
+    std::vector<unsigned char> data;
+    size_t position = 0;
+    // set when read goes past end of data, next reads return zeros
+    bool error = false;
+
+    template<class T>
+    void write(const T& value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        const auto* bytes = reinterpret_cast<const unsigned char*>(&value);
+        data.insert(data.end(), bytes, bytes + sizeof(T));
+    }
+    template<class T>
+    T read() {
+        static_assert(std::is_trivially_copyable_v<T>);
+        T value{};
+        if(error || data.size() - position < sizeof(T)) {
+            error = true;
+            return value;
+        }
+        std::memcpy(&value, data.data() + position, sizeof(T));
+        position += sizeof(T);
+        return value;
+    }
+    template<class T>
+    void writeVector(const std::vector<T>& values) {
+        write<uint64_t>(values.size());
+        for(const auto& value : values) {
+            write(value);
+        }
+    }
+    template<class T>
+    std::vector<T> readVector() {
+        std::vector<T> values;
+        uint64_t size = read<uint64_t>();
+        // every element takes at least one byte, so broken size can't allocate too much
+        while(error == false && values.size() < size && position < data.size()) {
+            values.push_back(read<T>());
+        }
+        error = error || values.size() != size;
+        return values;
+    }
+    void writeString(const std::string& value);
+    std::string readString();
+};
+
+// whole geometry is saved, so clients keep map they got even if file changed
+void saveMap(Snapshot& snapshot, const Map& game_map);
+std::shared_ptr<const Map> loadSavedMap(Snapshot& snapshot);
+
+// One match(room). Clients are routed to it by Rooms, which also runs step() on one of simulation threads
 class Game {
 public:
-    Game(std::string map_name = "map1");
+    Game(size_t room_id, std::shared_ptr<const Map> game_map);
     ~Game();
-    void run();
+    // applies whole batch under one update_mutex lock
+    void handleMessages(std::vector<IncomingMessageWrapper>& messages);
+    // runs updates that are due and sends game state to room every send_delay
+    void step();
+    // player moved from other room, gets map of this room(player id and welcome message stay the same)
+    void addPlayer(size_t player_id);
+    // player moved to other room
+    void removePlayer(size_t player_id);
+    // client watching room without player, gets only map and game states
+    void addSpectator(size_t client_id);
+    size_t getRoomId() const;
+    const Map& getMap() const;
+    // appends players and projectiles to snapshot
+    void saveState(Snapshot& snapshot);
+    // replaces players and projectiles with ones saved by room of old host
+    void loadState(Snapshot& snapshot);
 
 private:
-    void getMap(std::string map_name);
-    void handleMessage(IncomingMessageWrapper&& message);
+    // update_mutex needs to be locked. Message isn't shorter than minimumMessageSize() of its type(Rooms::routeMessages())
+    void handleMessage(IncomingMessageWrapper& message);
     void createNewPlayer(size_t player_id);
     void deletePlayer(size_t player_id);
     void updatePositions();
     void checkCollisions();
-    bool checkProjectileCollisions(const Projectile& projectile);
+    // moves alive player from its start of tick position along its way until it touches map geometry,
+    // then slides along it
+    void sweepPlayer(uint32_t player);
+    // hashes every player into player_grid
+    void buildPlayerGrid();
+    bool checkProjectileCollisions(uint32_t projectile);
     Message serializeGameState();
     Message serializeMap();
-    void updateThread();
-    void sendThread();
-    void receiveThread();
+    void update();
+    void sendGameState();
     void sendWelcomeMessage(size_t player_id);
-    void moveAlongNormal(Player& player, const Point& P1, const Point& P2);
-    void moveAlongNormal(Player& player, const Circle& object);
-    void moveAlongNormal(Player& player, const Rectangle& object);
-    void moveAlongNormal(Player& player, Player& object);
+    void moveAlongNormal(Circle& player, const GeometryEdge& edge);
+    void moveAlongNormal(Circle& player, const Circle& object);
+    void moveAlongNormal(Circle& player, const std::array<GeometryEdge, 4>& wall_edges);
+    // both players move by half of overlap
+    void moveApart(Circle& player1, Circle& player2);
     void shootProjectile(size_t player_id);
     void spawnPlayer(size_t player_id);
     bool isInsideBorder(const Point& point) const;
     void changePlayerOrientation(size_t player_id, float angle);
     void changePlayerMovement(size_t player_id, double velocity_x, double velocity_y);
+    // index of player in player_store and players, no_player if player isn't in room
+    uint32_t findPlayer(size_t player_id) const;
+    // adds player or resets existing one to state after connecting
+    uint32_t resetPlayer(size_t player_id);
+    // last player takes index of erased one
+    void erasePlayer(size_t player_id);
+
+    static constexpr uint32_t no_player = UINT32_MAX;
 
-    Map game_map;
-    std::unordered_map<size_t, Player> players;
-    std::vector<Projectile> projectiles;
-    std::mutex update_mutex;
+    const size_t room_id;
+    const std::shared_ptr<const Map> game_map;
+    // entity i of player_store is players[i]
+    EntityStore player_store;
+    std::vector<Player> players;
+    std::unordered_map<size_t, uint32_t> player_indices;
+    // getServerConfig()->simulation_tick_ms
+    const std::chrono::milliseconds timestep;
+    const double timestep_seconds;
+    // positions before last updatePositions(), index is index in player_store and projectiles
+    std::vector<Point> player_starts;
+    std::vector<Point> projectile_starts;
+    // projectiles from index old_projectiles were shot since last tick, their first way starts in centre of
+    // player shooting them(shot_origins), so they don't start behind wall player overlaps
+    size_t old_projectiles = 0;
+    std::vector<Point> shot_origins;
+    // projectiles that hit something are released during checkCollisions() and removed together after it
+    ProjectilePool projectiles;
+    // broadphase of checkCollisions(), players are hashed by centre every tick. Index in grid is index in
+    // player_store, player_centres are centres from last build
+    SpatialHash player_grid;
+    std::vector<Point> player_centres;
+    // candidates from player_grid or geometry_query tested by kernels
+    std::vector<uint32_t> candidates;
+    std::vector<uint8_t> candidate_hits;
+    // map geometry near checked player or projectile
+    GeometryQuery geometry_query;
+    // latency_timestamps, times inputs were applied since last game state
+    std::vector<uint64_t> applied_times;
+    // server mutex, so lock profiling covers it
+    pthread_mutex_t update_mutex;
+    // used only by simulation thread running step()
+    Timer<> update_timer;
+    Timer<>::DurationType accumulator{0};
+    Timer<> send_timer;
 
     // debug
     std::unordered_map<size_t, std::pair<size_t, size_t>> packets;
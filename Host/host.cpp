@@ -1,11 +1,26 @@
-#include "game.hpp"
+#include "rooms.hpp"
 #include "collisions.h"
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <vector>
+#include <cstring>
 
 int main(int argc, char* argv[]) {
-    // argv[1] == map_name
-    Game game = argc > 1 ? Game(argv[1]) : Game();
-    game.run();
-}
\ No newline at end of file
+    // bin/host [map_name...] [server_option=value...], every map name opens one room
+    std::vector<std::string> map_names;
+    ServerConfig config = defaultServerConfig();
+    for(int i = 1; i < argc; ++i) {
+        if(std::strchr(argv[i], '=') == nullptr) {
+            map_names.push_back(argv[i]);
+        } else if(setServerOption(&config, argv[i]) != 0) {
+            return 1;
+        }
+    }
+    if(map_names.empty()) {
+        map_names.push_back("map1");
+    }
+    Server::setConfig(config);
+    Rooms rooms(map_names);
+    rooms.run();
+}
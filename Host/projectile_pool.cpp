@@ -0,0 +1,116 @@
+#include "projectile_pool.hpp"
+#include <algorithm>
+
+ProjectilePool::ProjectilePool(size_t initial_capacity) {
+    reserve(initial_capacity);
+}
+
+void ProjectilePool::reserve(size_t new_capacity) {
+    capacity = new_capacity;
+    for(auto* column : {&store.x, &store.y, &store.vx, &store.vy, &store.r}) {
+        column->reserve(capacity);
+    }
+    store.alive.reserve(capacity);
+    store.health.reserve(capacity);
+    owners.reserve(capacity);
+    slots_of.reserve(capacity);
+    index_of.reserve(capacity);
+    generations.reserve(capacity);
+    free_slots.reserve(capacity);
+    released.reserve(capacity);
+}
+
+ProjectileHandle ProjectilePool::add(size_t owner_id, const Point& position, const Vector& velocity, double radius) {
+    if(store.size() == capacity) {
+        reserve(std::max<size_t>(capacity * 2, 16));
+    }
+    uint32_t slot;
+    if(free_slots.empty()) {
+        slot = static_cast<uint32_t>(index_of.size());
+        index_of.push_back(0);
+        generations.push_back(0);
+    } else {
+        slot = free_slots.back();
+        free_slots.pop_back();
+    }
+    uint32_t index = store.add(position, velocity, radius, true, 0);
+    index_of[slot] = index;
+    owners.push_back(owner_id);
+    slots_of.push_back(slot);
+    return {slot, generations[slot]};
+}
+
+void ProjectilePool::release(ProjectileHandle handle) {
+    uint32_t index = indexOf(handle);
+    if(index == UINT32_MAX || store.alive[index] == false) {
+        return;
+    }
+    // alive is cleared so released projectile isn't released twice or moved until compact()
+    store.alive[index] = false;
+    released.push_back(index);
+}
+
+void ProjectilePool::compact() {
+    // from the highest index, so projectile moved into hole was never released
+    std::sort(released.begin(), released.end(), std::greater<uint32_t>());
+    for(uint32_t index : released) {
+        uint32_t slot = slots_of[index];
+        index_of[slot] = UINT32_MAX;
+        ++generations[slot];
+        free_slots.push_back(slot);
+        uint32_t last = static_cast<uint32_t>(store.size() - 1);
+        if(index != last) {
+            slots_of[index] = slots_of[last];
+            owners[index] = owners[last];
+            index_of[slots_of[index]] = index;
+        }
+        store.swapRemove(index);
+        owners.pop_back();
+        slots_of.pop_back();
+    }
+    released.clear();
+}
+
+void ProjectilePool::clear() {
+    for(uint32_t slot : slots_of) {
+        index_of[slot] = UINT32_MAX;
+        ++generations[slot];
+        free_slots.push_back(slot);
+    }
+    store.clear();
+    owners.clear();
+    slots_of.clear();
+    released.clear();
+}
+
+bool ProjectilePool::isValid(ProjectileHandle handle) const {
+    return indexOf(handle) != UINT32_MAX;
+}
+
+uint32_t ProjectilePool::indexOf(ProjectileHandle handle) const {
+    if(handle.slot >= index_of.size() || generations[handle.slot] != handle.generation) {
+        return UINT32_MAX;
+    }
+    return index_of[handle.slot];
+}
+
+ProjectileHandle ProjectilePool::handleAt(uint32_t index) const {
+    uint32_t slot = slots_of[index];
+    return {slot, generations[slot]};
+}
+
+size_t ProjectilePool::size() const {
+    return store.size();
+}
+
+size_t ProjectilePool::ownerAt(uint32_t index) const {
+    return owners[index];
+}
+
+const EntityStore& ProjectilePool::entities() const {
+    return store;
+}
+
+EntityStore& ProjectilePool::entities() {
+    return store;
+}
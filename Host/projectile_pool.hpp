@@ -0,0 +1,49 @@
+#pragma once
+#include "entity_store.hpp"
+#include <vector>
+#include <cstdint>
+
+// refers to one projectile for its whole life, stays valid when other projectiles are removed or moved
+struct ProjectileHandle {
+    uint32_t slot = UINT32_MAX;
+    uint32_t generation = 0;
+};
+
+// Projectiles of one room. Live projectiles are dense in entities() so kernels see contiguous columns,
+// slots map handles to their current index. Removal is deferred to compact(), which fills holes with last
+// projectiles(swap and pop), so order of projectiles changes. Every buffer keeps its capacity, firing at
+// steady rate doesn't allocate after first ticks
+class ProjectilePool {
+public:
+    explicit ProjectilePool(size_t initial_capacity = 256);
+    ProjectileHandle add(size_t owner_id, const Point& position, const Vector& velocity, double radius);
+    // projectile stays in pool until compact(), releasing it twice or after compact() does nothing
+    void release(ProjectileHandle handle);
+    // removes released projectiles
+    void compact();
+    void clear();
+    bool isValid(ProjectileHandle handle) const;
+    // index in entities() or UINT32_MAX if handle isn't valid
+    uint32_t indexOf(ProjectileHandle handle) const;
+    ProjectileHandle handleAt(uint32_t index) const;
+    size_t size() const;
+    size_t ownerAt(uint32_t index) const;
+    const EntityStore& entities() const;
+    EntityStore& entities();
+
+private:
+    // growing capacity of every buffer together, so steady state doesn't reallocate any of them
+    void reserve(size_t capacity);
+
+    EntityStore store;
+    // owners[i] and slots_of[i] belong to store entity i
+    std::vector<size_t> owners;
+    std::vector<uint32_t> slots_of;
+    // index_of[slot] is index in store, UINT32_MAX for free slot
+    std::vector<uint32_t> index_of;
+    std::vector<uint32_t> generations;
+    std::vector<uint32_t> free_slots;
+    // indices in store released since last compact()
+    std::vector<uint32_t> released;
+    size_t capacity = 0;
+};
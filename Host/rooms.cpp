@@ -0,0 +1,468 @@
+#include "rooms.hpp"
+#include "../Server/server_wakeup.h"
+#include "../Server/server_mutex.h"
+#include <iostream>
+#include <thread>
+#include <algorithm>
+#include <csignal>
+#include <poll.h>
+
+// set by signal handler, waited on by run()
+volatile static sig_atomic_t stop_signal = false;
+// set by SIGUSR1 handler, run() prints lock profile
+volatile static sig_atomic_t report_signal = false;
+// signaled by signal handlers, run() sleeps on it
+static Wakeup signal_wakeup;
+
+Rooms::Rooms(const std::vector<std::string>& map_names) : map_names(map_names) {
+    // sockets of old server are used by run()
+    Snapshot snapshot;
+    bool taken_over = Server::takeOver(snapshot.data);
+    Server::run();
+    initMutex(&rooms_mutex);
+    nameMutex(&rooms_mutex, "Rooms::rooms_mutex");
+    if(wakeupInit(&signal_wakeup) != 0) {
+        exit(1);
+    }
+    // CTRL+C
+    struct sigaction action = {.sa_flags = SA_RESTART};
+    action.sa_handler = [](int) {
+        stop_signal = true;
+        wakeupSignal(&signal_wakeup);
+    };
+    sigfillset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    // lock profile without stopping
+    struct sigaction report_action = {.sa_flags = SA_RESTART};
+    report_action.sa_handler = [](int) {
+        report_signal = true;
+        wakeupSignal(&signal_wakeup);
+    };
+    sigfillset(&report_action.sa_mask);
+    sigaction(SIGUSR1, &report_action, NULL);
+    size_t max_rooms = getServerConfig()->max_rooms;
+    rooms.resize(max_rooms);
+    retired_rooms.resize(max_rooms);
+    room_players.resize(max_rooms, 0);
+    room_batches.resize(max_rooms);
+    if(taken_over) {
+        if(loadSnapshot(snapshot) == false) {
+            std::cout << "Game state of old host was cut short, only part of it was restored\n";
+        }
+    } else {
+        openMapRooms();
+    }
+}
+
+Rooms::~Rooms() {
+    Server::stop();
+    printServerStats();
+    // every room prints its statistics
+    rooms.clear();
+    destroyMutex(&rooms_mutex);
+    wakeupDestroy(&signal_wakeup);
+}
+
+void Rooms::run() {
+    std::thread receive(&Rooms::receiveThread, this);
+    std::vector<std::thread> simulation;
+    for(size_t i = 0; i < getServerConfig()->simulation_threads; ++i) {
+        simulation.emplace_back(&Rooms::simulationThread, this, i);
+    }
+    int handoff_socket = -1;
+    while(stop_signal == false && handoff_socket == -1) {
+        // poll() ignores handoff socket if it's -1
+        pollfd fds[2] = {{.fd = signal_wakeup.fd, .events = POLLIN}, {.fd = Server::getHandoffSocket(), .events = POLLIN}};
+        if(poll(fds, 2, -1) == -1) {
+            continue;
+        }
+        wakeupClear(&signal_wakeup);
+        if(fds[1].revents & POLLIN) {
+            handoff_socket = Server::acceptHandoff();
+        }
+        if(report_signal) {
+            report_signal = false;
+            if(isLockProfiling()) {
+                printLockProfile();
+            } else {
+                std::cout << "Lock profiling is off, start host with lock_profiling=1\n";
+            }
+        }
+    }
+    // nothing is received after pause, so messages taken later are the last ones
+    if(handoff_socket != -1) {
+        Server::pause();
+    }
+    stop.store(true);
+    // receive thread can wait for messages, simulation threads sleep only for one step
+    Server::interruptTakeMessages();
+    receive.join();
+    for(auto& thread : simulation) {
+        thread.join();
+    }
+    if(handoff_socket != -1) {
+        handOff(handoff_socket);
+    }
+}
+
+void Rooms::openMapRooms() {
+    for(const auto& map_name : map_names) {
+        if(createRoom(map_name) == no_room) {
+            std::cout << "Too many maps for max_rooms=" << rooms.size() << ", " << map_name << " wasn't opened\n";
+        } else {
+            ++permanent_rooms;
+        }
+    }
+}
+
+Snapshot Rooms::saveSnapshot() {
+    Snapshot snapshot;
+    snapshot.write<uint64_t>(permanent_rooms);
+    snapshot.write<uint64_t>(next_map);
+    std::vector<std::shared_ptr<Game>> open_rooms;
+    for(const auto& room : rooms) {
+        if(room != nullptr) {
+            open_rooms.push_back(room);
+        }
+    }
+    snapshot.write<uint64_t>(open_rooms.size());
+    for(const auto& room : open_rooms) {
+        snapshot.write<uint64_t>(room->getRoomId());
+        saveMap(snapshot, room->getMap());
+        room->saveState(snapshot);
+    }
+    snapshot.write<uint64_t>(client_rooms.size());
+    for(const auto& [client_id, room_id] : client_rooms) {
+        snapshot.write<uint64_t>(client_id);
+        snapshot.write<uint64_t>(room_id);
+        snapshot.write<uint8_t>(spectators.count(client_id) > 0);
+    }
+    return snapshot;
+}
+
+bool Rooms::loadSnapshot(Snapshot& snapshot) {
+    permanent_rooms = std::min<size_t>(snapshot.read<uint64_t>(), rooms.size());
+    next_map = snapshot.read<uint64_t>();
+    uint64_t rooms_size = snapshot.read<uint64_t>();
+    for(uint64_t i = 0; i < rooms_size && snapshot.error == false; ++i) {
+        size_t room_id = snapshot.read<uint64_t>();
+        auto game_map = loadSavedMap(snapshot);
+        // rooms of old host shared maps with the same name
+        auto& shared_map = maps[game_map->name];
+        if(shared_map == nullptr) {
+            shared_map = game_map;
+        }
+        auto room = std::make_shared<Game>(room_id, shared_map);
+        room->loadState(snapshot);
+        if(room_id < rooms.size() && rooms[room_id] == nullptr) {
+            rooms[room_id] = room;
+        } else {
+            std::cout << "Room " << room_id << " doesn't fit into max_rooms=" << rooms.size() << ", its clients are moved\n";
+        }
+    }
+    if(std::all_of(rooms.begin(), rooms.end(), [](const auto& room) { return room == nullptr; })) {
+        permanent_rooms = 0;
+        openMapRooms();
+    }
+    ++rooms_version;
+    uint64_t clients_size = snapshot.read<uint64_t>();
+    for(uint64_t i = 0; i < clients_size && snapshot.error == false; ++i) {
+        size_t client_id = snapshot.read<uint64_t>();
+        size_t room_id = snapshot.read<uint64_t>();
+        bool spectator = snapshot.read<uint8_t>() != 0;
+        bool moved = room_id >= rooms.size() || rooms[room_id] == nullptr;
+        if(moved) {
+            room_id = chooseRoom();
+        }
+        // shared memory clients and clients that didn't fit into client slots weren't taken over
+        if(Server::setClientRoom(client_id, room_id) == false) {
+            if(moved == false && spectator == false) {
+                rooms[room_id]->removePlayer(client_id);
+            }
+            continue;
+        }
+        client_rooms[client_id] = room_id;
+        if(spectator) {
+            spectators.insert(client_id);
+            if(moved) {
+                rooms[room_id]->addSpectator(client_id);
+            }
+        } else {
+            ++room_players[room_id];
+            if(moved) {
+                rooms[room_id]->addPlayer(client_id);
+            }
+        }
+    }
+    for(size_t room_id = permanent_rooms; room_id < rooms.size(); ++room_id) {
+        if(rooms[room_id] != nullptr && room_players[room_id] == 0) {
+            destroyRoom(room_id);
+        }
+    }
+    std::cout << "Restored " << client_rooms.size() << " clients of old host\n";
+    return snapshot.error == false;
+}
+
+void Rooms::handOff(int handoff_socket) {
+    std::vector<IncomingMessageWrapper> messages;
+    while(Server::takeMessages(messages, receive_batch, 0) > 0) {
+        routeMessages(messages);
+        messages.clear();
+    }
+    Snapshot snapshot = saveSnapshot();
+    if(Server::handOff(handoff_socket, snapshot.data)) {
+        std::cout << "New host took over, stopping\n";
+    } else {
+        std::cout << "Handoff failed, stopping\n";
+    }
+}
+
+size_t Rooms::createRoom(const std::string& map_name) {
+    size_t room_id = 0;
+    while(room_id < rooms.size() && (rooms[room_id] != nullptr || retired_rooms[room_id].expired() == false)) {
+        ++room_id;
+    }
+    if(room_id == rooms.size()) {
+        return no_room;
+    }
+    auto& game_map = maps[map_name];
+    if(game_map == nullptr) {
+        game_map = loadMap(map_name);
+    }
+    auto room = std::make_shared<Game>(room_id, game_map);
+    lockMutex(&rooms_mutex);
+    rooms[room_id] = room;
+    unlockMutex(&rooms_mutex);
+    ++rooms_version;
+    std::cout << "Room " << room_id << " opened, map: " << map_name << "\n";
+    return room_id;
+}
+
+bool Rooms::destroyRoom(size_t room_id) {
+    if(room_id >= rooms.size() || rooms[room_id] == nullptr) {
+        return false;
+    }
+    size_t open_rooms = 0;
+    for(const auto& room : rooms) {
+        open_rooms += room != nullptr;
+    }
+    if(open_rooms == 1) {
+        return false;
+    }
+    auto room = rooms[room_id];
+    retired_rooms[room_id] = room;
+    lockMutex(&rooms_mutex);
+    rooms[room_id] = nullptr;
+    unlockMutex(&rooms_mutex);
+    ++rooms_version;
+    for(auto& [client_id, client_room] : client_rooms) {
+        if(client_room != room_id) {
+            continue;
+        }
+        size_t target = chooseRoom();
+        client_room = target;
+        Server::setClientRoom(client_id, target);
+        if(spectators.count(client_id) > 0) {
+            rooms[target]->addSpectator(client_id);
+            continue;
+        }
+        room->removePlayer(client_id);
+        --room_players[room_id];
+        ++room_players[target];
+        rooms[target]->addPlayer(client_id);
+    }
+    std::cout << "Room " << room_id << " closed\n";
+    return true;
+}
+
+size_t Rooms::chooseRoom() {
+    size_t best = no_room;
+    for(size_t room_id = 0; room_id < rooms.size(); ++room_id) {
+        if(rooms[room_id] != nullptr && (best == no_room || room_players[room_id] < room_players[best])) {
+            best = room_id;
+        }
+    }
+    size_t room_limit = getServerConfig()->room_players;
+    if(room_limit > 0 && room_players[best] >= room_limit) {
+        // maps of permanent rooms are used in turns
+        size_t opened = createRoom(map_names[next_map++ % map_names.size()]);
+        if(opened != no_room) {
+            return opened;
+        }
+    }
+    return best;
+}
+
+void Rooms::makeSpectator(size_t client_id, IncomingMessageWrapper& message, std::vector<size_t>& emptied_rooms) {
+    size_t& room_id = client_rooms[client_id];
+    size_t target = room_id;
+    // 2 byte room number, other rooms' game states can be watched only by spectators
+    if(message.getSize() >= 3) {
+        size_t requested = *reinterpret_cast<uint16_t*>(message.getBuffer() + 1);
+        if(requested < rooms.size() && rooms[requested] != nullptr) {
+            target = requested;
+        }
+    }
+    if(spectators.insert(client_id).second) {
+        rooms[room_id]->removePlayer(client_id);
+        if(--room_players[room_id] == 0 && room_id >= permanent_rooms) {
+            emptied_rooms.push_back(room_id);
+        }
+    }
+    room_id = target;
+    Server::setClientRoom(client_id, target);
+    rooms[target]->addSpectator(client_id);
+}
+
+void Rooms::routeMessages(std::vector<IncomingMessageWrapper>& messages) {
+    std::vector<size_t> emptied_rooms;
+    for(auto& message : messages) {
+        size_t client_id = message.getClientId();
+        size_t room_id;
+        if(message.getType() == MessageType::NEW_CONNECTION) {
+            room_id = chooseRoom();
+            Server::setClientRoom(client_id, room_id);
+            client_rooms[client_id] = room_id;
+            ++room_players[room_id];
+        } else {
+            auto client = client_rooms.find(client_id);
+            if(client == client_rooms.end()) {
+                continue;
+            }
+            room_id = client->second;
+            bool spectator = spectators.count(client_id) > 0;
+            if(message.getType() == MessageType::LOST_CONNECTION) {
+                client_rooms.erase(client);
+                if(spectator) {
+                    spectators.erase(client_id);
+                    // room has nothing to remove
+                    continue;
+                }
+                if(--room_players[room_id] == 0 && room_id >= permanent_rooms) {
+                    emptied_rooms.push_back(room_id);
+                }
+            } else if(message.getType() == MessageType::MESSAGE
+                      && (message.getSize() == 0
+                          || message.getSize() < minimumMessageSize(static_cast<DataType>(message.getBuffer()[0])))) {
+                // game reads payload at fixed offsets
+                ++short_messages;
+                continue;
+            } else if(message.getType() == MessageType::MESSAGE && message.getBuffer()[0] == SPECTATE) {
+                makeSpectator(client_id, message, emptied_rooms);
+                continue;
+            } else if(spectator) {
+                continue;
+            }
+        }
+        room_batches[room_id].push_back(std::move(message));
+    }
+    for(size_t room_id = 0; room_id < room_batches.size(); ++room_id) {
+        if(room_batches[room_id].empty() == false) {
+            rooms[room_id]->handleMessages(room_batches[room_id]);
+            // frees messages
+            room_batches[room_id].clear();
+        }
+    }
+    // room could get new player later in the same batch
+    for(size_t room_id : emptied_rooms) {
+        if(room_players[room_id] == 0) {
+            destroyRoom(room_id);
+        }
+    }
+}
+
+void Rooms::receiveThread() {
+    std::vector<IncomingMessageWrapper> messages;
+    messages.reserve(receive_batch);
+    while(stop.load() == false) {
+        if(Server::takeMessages(messages, receive_batch, 1000) > 0) {
+            routeMessages(messages);
+        }
+        // frees messages that weren't routed
+        messages.clear();
+    }
+}
+
+void Rooms::simulationThread(size_t index) {
+    size_t threads = getServerConfig()->simulation_threads;
+    // rooms with number % simulation_threads == index
+    std::vector<std::shared_ptr<Game>> owned_rooms;
+    size_t version = rooms_version.load() - 1;
+    while(stop.load() == false) {
+        std::this_thread::sleep_for(step_delay);
+        size_t current_version = rooms_version.load();
+        if(current_version != version) {
+            version = current_version;
+            owned_rooms.clear();
+            lockMutex(&rooms_mutex);
+            for(size_t room_id = index; room_id < rooms.size(); room_id += threads) {
+                if(rooms[room_id] != nullptr) {
+                    owned_rooms.push_back(rooms[room_id]);
+                }
+            }
+            unlockMutex(&rooms_mutex);
+        }
+        for(auto& room : owned_rooms) {
+            room->step();
+        }
+    }
+}
+
+void Rooms::printServerStats() {
+    auto send_stats = Server::getSendStats();
+    if(send_stats.broadcasts > 0) {
+        std::cout << "Broadcasts: " << send_stats.broadcasts << ", send syscalls per broadcast: "
+                  << static_cast<double>(send_stats.broadcast_syscalls) / send_stats.broadcasts
+                  << ", total send syscalls: " << send_stats.send_syscalls
+                  << ", conflated: " << send_stats.conflated_frames << ", zerocopy sends: " << send_stats.zerocopy_sends << "\n";
+    }
+    auto shard_stats = Server::getSenderShardStats();
+    for(size_t i = 0; i < shard_stats.size(); ++i) {
+        const auto& shard = shard_stats[i];
+        if(shard.broadcasts == 0) {
+            continue;
+        }
+        std::cout << "Sender shard " << i << ": game states: " << shard.broadcasts << ", max clients: " << shard.max_clients
+                  << ", send syscalls: " << shard.send_syscalls
+                  << ", latency avg: " << shard.total_latency_us / shard.broadcasts << " us, max: " << shard.max_latency_us
+                  << " us, under 64/256/1024/4096/16384 us and longer:";
+        for(auto flushes : shard.latency_histogram) {
+            std::cout << " " << flushes;
+        }
+        std::cout << "\n";
+    }
+    if(send_stats.udp_datagrams + send_stats.udp_simulated_losses > 0) {
+        std::cout << "UDP game states: " << send_stats.udp_datagrams << ", sendmmsg calls: " << send_stats.udp_syscalls
+                  << ", simulated losses: " << send_stats.udp_simulated_losses << "\n";
+    }
+    auto receive_stats = Server::getReceiveStats();
+    if(receive_stats.received_frames > 0) {
+        std::cout << "Received frames: " << receive_stats.received_frames << ", recv syscalls per frame: "
+                  << static_cast<double>(receive_stats.receive_syscalls) / receive_stats.received_frames
+                  << ", oversized frames: " << receive_stats.oversized_frames
+                  << ", empty frames: " << receive_stats.empty_frames << ", short messages: " << short_messages << "\n";
+    }
+    const char* stage_names[LATENCY_STAGES] = {"kernel to user", "queue wait", "lock wait", "apply to broadcast",
+                                               "broadcast to wire"};
+    auto latency_stats = Server::getLatencyStats();
+    for(size_t stage = 0; stage < latency_stats.size(); ++stage) {
+        const auto& latency = latency_stats[stage];
+        if(latency.samples == 0) {
+            continue;
+        }
+        std::cout << "Input latency, " << stage_names[stage] << ": samples: " << latency.samples
+                  << ", avg: " << latency.total_us / latency.samples << " us, max: " << latency.max_us
+                  << " us, under 16/64/256/1024/4096/16384/65536 us and longer:";
+        for(auto samples : latency.histogram) {
+            std::cout << " " << samples;
+        }
+        std::cout << "\n";
+    }
+    auto pool_stats = Server::getReceivePoolStats();
+    std::cout << "Received payloads: " << pool_stats.allocations << ", malloc fallbacks: " << pool_stats.fallback_mallocs
+              << ", pool blocks max in use:";
+    for(const auto& size_class : pool_stats.classes) {
+        std::cout << " " << size_class.max_in_use << "/" << size_class.blocks << "(" << size_class.block_size << "B)";
+    }
+    std::cout << "\n";
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include "game.hpp"
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <pthread.h>
+
+// Network core of host. Server is shared by every room(Game), receive thread routes each client to one room
+// and simulation threads run rooms. Rooms are numbered like server rooms(0 to max_rooms - 1)
+class Rooms {
+public:
+    // starts server and opens one permanent room for every map name. With handoff_socket_path server listening
+    // on it is taken over first and its rooms, players and clients are used instead
+    Rooms(const std::vector<std::string>& map_names);
+    ~Rooms();
+    // runs until SIGINT or until new host takes over
+    void run();
+
+private:
+    static constexpr size_t no_room = SIZE_MAX;
+    // simulation threads wake up this often, every room runs updates and sends game state if they are due
+    static constexpr std::chrono::milliseconds step_delay{1};
+    // max messages taken from server in one batch, every room applies its part under one update_mutex lock
+    static constexpr size_t receive_batch = 256;
+
+    // functions below are used only by receive thread(and constructor before run())
+    // returns number of new room or no_room if all max_rooms are used
+    size_t createRoom(const std::string& map_name);
+    // moves players of room to other rooms and removes it, last room can't be destroyed
+    bool destroyRoom(size_t room_id);
+    // room with fewest players, new one is opened if every room has room_players
+    size_t chooseRoom();
+    // opens room for every map name, they stay open when empty
+    void openMapRooms();
+    // SPECTATE message, client's player is removed and client is moved to requested room(if it's open)
+    void makeSpectator(size_t client_id, IncomingMessageWrapper& message, std::vector<size_t>& emptied_rooms);
+    void routeMessages(std::vector<IncomingMessageWrapper>& messages);
+    void receiveThread();
+
+    void simulationThread(size_t index);
+    void printServerStats();
+
+    // restart(handoff_socket_path), used after receive and simulation threads stopped or before they start
+    Snapshot saveSnapshot();
+    // returns false if snapshot was cut short, rooms and clients read before that are kept
+    bool loadSnapshot(Snapshot& snapshot);
+    // routes last messages and gives server and rooms to new host
+    void handOff(int handoff_socket);
+
+    std::vector<std::string> map_names;
+    // maps are loaded once and shared by rooms using them
+    std::unordered_map<std::string, std::shared_ptr<const Map>> maps;
+    // max_rooms long, written by receive thread under rooms_mutex and read by simulation threads
+    std::vector<std::shared_ptr<Game>> rooms;
+    // destroyed rooms, number is reused after simulation threads release them, so old room can't send
+    // game state to clients of new one
+    std::vector<std::weak_ptr<Game>> retired_rooms;
+    pthread_mutex_t rooms_mutex;
+    // incremented after rooms change, simulation threads copy their rooms again
+    std::atomic<size_t> rooms_version{0};
+    // rooms opened for map names, they stay open when empty
+    size_t permanent_rooms = 0;
+    // next map name used for opened room
+    size_t next_map = 0;
+
+    // used only by receive thread
+    std::unordered_map<size_t, size_t> client_rooms;
+    // clients in client_rooms that aren't counted in room_players and whose messages aren't routed
+    std::unordered_set<size_t> spectators;
+    std::vector<size_t> room_players;
+    std::vector<std::vector<IncomingMessageWrapper>> room_batches;
+    // messages shorter than minimumMessageSize() of their type, dropped before reaching rooms
+    size_t short_messages = 0;
+
+    std::atomic<bool> stop{false};
+};
@@ -1,5 +1,6 @@
 #include "server_wrapper.hpp"
 #include "../Server/server.h"
+#include <cstdlib>
 
 volatile sig_atomic_t Server::running = false;
 
@@ -7,6 +8,10 @@ IncomingMessageWrapper::IncomingMessageWrapper(IncomingMessage&& move) : incomin
     move.message.data = nullptr;
 }
 
+IncomingMessageWrapper::IncomingMessageWrapper(IncomingMessageWrapper&& move) : incoming_message(move.incoming_message) {
+    move.incoming_message.message.data = nullptr;
+}
+
 IncomingMessageWrapper::~IncomingMessageWrapper() {
     freeMessage(incoming_message);
 }
@@ -35,6 +40,14 @@ bool IncomingMessageWrapper::isMessage() {
     return incoming_message.message.data != nullptr;
 }
 
+uint64_t IncomingMessageWrapper::getTakenTime() {
+    return incoming_message.taken_time_ns;
+}
+
+void Server::setConfig(const ServerConfig& config) {
+    setServerConfig(config);
+}
+
 bool Server::run() {
     if(isRunning() == true) {
         return false;
@@ -65,6 +78,98 @@ void Server::sendMessageToEveryone(Message message) {
     sendToEveryone(message);
 }
 
+void Server::sendMessageToRoom(Message message, size_t room) {
+    sendToRoom(message, room);
+}
+
+bool Server::setClientRoom(size_t client_id, size_t room) {
+    return ::setClientRoom(client_id, room) == 0;
+}
+
 IncomingMessageWrapper Server::takeMessage(size_t wait_seconds) {
     return take(wait_seconds);
 }
+
+size_t Server::takeMessages(std::vector<IncomingMessageWrapper>& messages, size_t max_messages, size_t wait_milliseconds) {
+    // reused between calls so taking messages doesn't allocate
+    thread_local std::vector<IncomingMessage> buffer;
+    if(buffer.size() < max_messages) {
+        buffer.resize(max_messages);
+    }
+    size_t taken = takeMany(buffer.data(), max_messages, wait_milliseconds);
+    for(size_t i = 0; i < taken; ++i) {
+        messages.emplace_back(std::move(buffer[i]));
+    }
+    return taken;
+}
+
+void Server::interruptTakeMessages() {
+    interruptTake();
+}
+
+bool Server::getClientSendStats(size_t client_id, ClientSendStats& stats) {
+    return ::getClientSendStats(client_id, &stats) == 0;
+}
+
+ServerSendStats Server::getSendStats() {
+    return getServerSendStats();
+}
+
+std::vector<SenderShardStats> Server::getSenderShardStats() {
+    std::vector<SenderShardStats> stats(::getSenderShardStats(nullptr, 0));
+    stats.resize(::getSenderShardStats(stats.data(), stats.size()));
+    return stats;
+}
+
+bool Server::getUdpOffer(size_t client_id, UdpOffer& offer) {
+    return getClientUdpOffer(client_id, &offer) == 0;
+}
+
+ServerReceiveStats Server::getReceiveStats() {
+    return getServerReceiveStats();
+}
+
+ReceivePoolStats Server::getReceivePoolStats() {
+    return ::getReceivePoolStats();
+}
+
+uint64_t Server::latencyNow() {
+    return ::latencyNow();
+}
+
+void Server::recordLatency(LatencyStage stage, uint64_t start, uint64_t end) {
+    ::recordLatency(stage, start, end);
+}
+
+std::vector<LatencyStageStats> Server::getLatencyStats() {
+    std::vector<LatencyStageStats> stats(LATENCY_STAGES);
+    ::getLatencyStats(stats.data());
+    return stats;
+}
+
+bool Server::takeOver(std::vector<unsigned char>& snapshot) {
+    unsigned char* data = nullptr;
+    size_t size = 0;
+    if(takeOverServer(&data, &size) != 0) {
+        return false;
+    }
+    snapshot.assign(data, data + size);
+    free(data);
+    return true;
+}
+
+int Server::getHandoffSocket() {
+    return ::getHandoffSocket();
+}
+
+int Server::acceptHandoff() {
+    return ::acceptHandoff();
+}
+
+void Server::pause() {
+    pauseServer();
+}
+
+bool Server::handOff(int handoff_socket, const std::vector<unsigned char>& snapshot) {
+    return handOffServer(handoff_socket, snapshot.data(), snapshot.size()) == 0;
+}
@@ -1,6 +1,8 @@
 #pragma once
 #include "../Server/server_structs.h"
+#include "../Server/server_config.h"
 #include <string>
+#include <vector>
 #include <csignal>
 
 using MessageType = IncomingMessage::MessageType;
@@ -10,6 +12,7 @@ public:
     IncomingMessageWrapper() = delete;
     IncomingMessageWrapper(const IncomingMessageWrapper& copy) = delete;
     IncomingMessageWrapper(IncomingMessage&& move);
+    IncomingMessageWrapper(IncomingMessageWrapper&& move);
     ~IncomingMessageWrapper();
 
     unsigned char* getBuffer();
@@ -18,12 +21,16 @@ public:
     size_t getClientId();
     MessageType getType();
     bool isMessage();
+    // Server::latencyNow() time when host took message, 0 if latency_timestamps is off
+    uint64_t getTakenTime();
 private:
     IncomingMessage incoming_message;
 };
 
 class Server {
 public:
+    // needs to be called before run()
+    static void setConfig(const ServerConfig& config);
     // true if everything ok
     static bool run();
     static void stop();
@@ -31,7 +38,40 @@ public:
     static bool isMessageWaiting();
     static void sendMessageTo(Message message, size_t client_id);
     static void sendMessageToEveryone(Message message);
+    // game state for clients of room
+    static void sendMessageToRoom(Message message, size_t room);
+    // false if client isn't running or room >= max_rooms
+    static bool setClientRoom(size_t client_id, size_t room);
     static IncomingMessageWrapper takeMessage(size_t wait_seconds = 0);
+    // waits for first message up to wait_milliseconds and appends it with every other waiting message
+    // (up to max_messages) to messages. Returns number of appended messages
+    static size_t takeMessages(std::vector<IncomingMessageWrapper>& messages, size_t max_messages, size_t wait_milliseconds);
+    // wakes thread waiting in takeMessage(s), it returns without message
+    static void interruptTakeMessages();
+    // false if client doesn't exist
+    static bool getClientSendStats(size_t client_id, ClientSendStats& stats);
+    static ServerSendStats getSendStats();
+    static std::vector<SenderShardStats> getSenderShardStats();
+    // false if UDP channel is disabled or client isn't running
+    static bool getUdpOffer(size_t client_id, UdpOffer& offer);
+    static ServerReceiveStats getReceiveStats();
+    static ReceivePoolStats getReceivePoolStats();
+    // latency_timestamps, clock of kernel timestamps in nanoseconds
+    static uint64_t latencyNow();
+    // ignored if latency_timestamps is off or start is 0
+    static void recordLatency(LatencyStage stage, uint64_t start, uint64_t end);
+    static std::vector<LatencyStageStats> getLatencyStats();
+    // restart with handoff_socket_path, needs to be called before run(). True if old server was taken over,
+    // snapshot is set to game state saved by old host
+    static bool takeOver(std::vector<unsigned char>& snapshot);
+    // readable when new server wants to take over, -1 if handoff is off
+    static int getHandoffSocket();
+    // -1 if new server isn't connecting
+    static int acceptHandoff();
+    // server stops receiving, messages taken after it are the last ones
+    static void pause();
+    // gives clients and snapshot to new server, true if it got everything. stop() needs to be called after it
+    static bool handOff(int handoff_socket, const std::vector<unsigned char>& snapshot);
 private:
     volatile static std::sig_atomic_t running;
 };
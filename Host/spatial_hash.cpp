@@ -0,0 +1,33 @@
+#include "spatial_hash.hpp"
+
+SpatialHash::SpatialHash(double cell_size) : cell_size(cell_size) {}
+
+void SpatialHash::build(const std::vector<Point>& centres, double max_radius) {
+    this->max_radius = max_radius;
+    entity_count = centres.size();
+    if(entity_count < linear_limit) {
+        return;
+    }
+    // about two buckets per entity keeps hashed cells mostly apart
+    size_t buckets = 64;
+    while(buckets < centres.size() * 2) {
+        buckets *= 2;
+    }
+    mask = buckets - 1;
+    bucket_start.assign(buckets + 1, 0);
+    entity_buckets.resize(centres.size());
+    for(size_t i = 0; i < centres.size(); ++i) {
+        size_t bucket = bucketOf(cellOf(centres[i].x), cellOf(centres[i].y));
+        entity_buckets[i] = static_cast<uint32_t>(bucket);
+        ++bucket_start[bucket + 1];
+    }
+    // counting sort, bucket_start becomes offsets of buckets
+    for(size_t bucket = 0; bucket < buckets; ++bucket) {
+        bucket_start[bucket + 1] += bucket_start[bucket];
+    }
+    bucket_fill.assign(bucket_start.begin(), bucket_start.end() - 1);
+    entries.resize(centres.size());
+    for(size_t i = 0; i < centres.size(); ++i) {
+        entries[bucket_fill[entity_buckets[i]]++] = static_cast<uint32_t>(i);
+    }
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include "basic_structs.hpp"
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+// Uniform grid over moving circles(players), rebuilt every tick. Every circle is stored only in cell of its centre
+// and queries reach max_radius further, so each one is found once. Cells are hashed into buckets, grid isn't
+// limited to map bounds. Buffers are reused, rebuild doesn't allocate after first ticks.
+// Below linear_limit entities grid isn't built and every entity is a candidate, pairwise loop is faster then
+class SpatialHash {
+public:
+    // cell_size should be at least twice the biggest radius, so query usually touches 3x3 cells
+    explicit SpatialHash(double cell_size);
+    // entities are identified by their position in centres
+    void build(const std::vector<Point>& centres, double max_radius);
+    // calls function(index) for every entity whose centre can be closer to centre than radius + its radius.
+    // Cells hashed into the same bucket give extra candidates, exact test is caller's job
+    template<class Function>
+    void forEachNear(const Point& centre, double radius, Function function) const;
+
+private:
+    int64_t cellOf(double coordinate) const;
+    size_t bucketOf(int64_t cell_x, int64_t cell_y) const;
+
+    // query touching more cells visits every bucket once instead
+    static constexpr size_t max_query_cells = 64;
+    // bench_collisions(-O2): brute force is faster up to about 30 players, 2.4 vs 4.8 us/tick at 10 players and 100 projectiles
+    static constexpr size_t linear_limit = 32;
+
+    double cell_size;
+    double max_radius = 0;
+    size_t entity_count = 0;
+    size_t mask = 0;
+    // entities of bucket b are entries[bucket_start[b]..bucket_start[b + 1])
+    std::vector<uint32_t> bucket_start;
+    std::vector<uint32_t> entries;
+    // used only by build()
+    std::vector<uint32_t> entity_buckets;
+    std::vector<uint32_t> bucket_fill;
+};
+
+inline int64_t SpatialHash::cellOf(double coordinate) const {
+    return static_cast<int64_t>(std::floor(coordinate / cell_size));
+}
+
+inline size_t SpatialHash::bucketOf(int64_t cell_x, int64_t cell_y) const {
+    return (static_cast<size_t>(cell_x) * 73856093u ^ static_cast<size_t>(cell_y) * 19349663u) & mask;
+}
+
+template<class Function>
+void SpatialHash::forEachNear(const Point& centre, double radius, Function function) const {
+    if(entity_count < linear_limit) {
+        for(uint32_t i = 0; i < entity_count; ++i) {
+            function(i);
+        }
+        return;
+    }
+    double reach = radius + max_radius;
+    int64_t min_x = cellOf(centre.x - reach), max_x = cellOf(centre.x + reach);
+    int64_t min_y = cellOf(centre.y - reach), max_y = cellOf(centre.y + reach);
+    auto visitBucket = [&](size_t bucket) {
+        for(uint32_t i = bucket_start[bucket]; i < bucket_start[bucket + 1]; ++i) {
+            function(entries[i]);
+        }
+    };
+    if(static_cast<uint64_t>(max_x - min_x + 1) * static_cast<uint64_t>(max_y - min_y + 1) > max_query_cells) {
+        for(size_t bucket = 0; bucket <= mask; ++bucket) {
+            visitBucket(bucket);
+        }
+        return;
+    }
+    // different cells can share bucket, it's visited once so entity isn't reported twice
+    size_t visited[max_query_cells];
+    size_t visited_size = 0;
+    for(int64_t cell_x = min_x; cell_x <= max_x; ++cell_x) {
+        for(int64_t cell_y = min_y; cell_y <= max_y; ++cell_y) {
+            size_t bucket = bucketOf(cell_x, cell_y);
+            if(std::find(visited, visited + visited_size, bucket) != visited + visited_size) {
+                continue;
+            }
+            visited[visited_size++] = bucket;
+            visitBucket(bucket);
+        }
+    }
+}
@@ -0,0 +1,183 @@
+#include "static_geometry.hpp"
+#include "collisions.h"
+#include <algorithm>
+#include <cmath>
+
+GeometryEdge::GeometryEdge(const Point& start, const Point& end) : start(start), end(end), edge(end - start),
+            normal(Point(-edge.y, edge.x)), min(std::min(start.x, end.x), std::min(start.y, end.y)),
+            max(std::max(start.x, end.x), std::max(start.y, end.y)) {
+    normal /= normal.length();
+}
+
+void StaticGeometry::build(const std::vector<Rectangle>& walls, const std::vector<Circle>& obstacles,
+                           const std::vector<Point>& borders) {
+    this->walls = walls;
+    this->obstacles = obstacles;
+    wall_edges.clear();
+    wall_bounds.clear();
+    obstacle_bounds.clear();
+    edges.clear();
+    Point min(INFINITY, INFINITY), max(-INFINITY, -INFINITY);
+    auto extend = [&](const Bounds& bounds) {
+        min = Point(std::min(min.x, bounds.min.x), std::min(min.y, bounds.min.y));
+        max = Point(std::max(max.x, bounds.max.x), std::max(max.y, bounds.max.y));
+    };
+    for(const auto& wall : walls) {
+        std::array<GeometryEdge, 4> wall_edge;
+        Bounds bounds{Point(INFINITY, INFINITY), Point(-INFINITY, -INFINITY)};
+        for(size_t i = 0; i < 4; ++i) {
+            const Point& point = wall.points[i];
+            wall_edge[i] = GeometryEdge(wall.points[(i + 1) % 4], point);
+            bounds.min = Point(std::min(bounds.min.x, point.x), std::min(bounds.min.y, point.y));
+            bounds.max = Point(std::max(bounds.max.x, point.x), std::max(bounds.max.y, point.y));
+        }
+        bounds.min += Point(-bounds_margin, -bounds_margin);
+        bounds.max += Point(bounds_margin, bounds_margin);
+        wall_edges.push_back(wall_edge);
+        wall_bounds.push_back(bounds);
+        extend(bounds);
+    }
+    for(const auto& obstacle : obstacles) {
+        double reach = obstacle.r + bounds_margin;
+        Bounds bounds{obstacle.centre + Point(-reach, -reach), obstacle.centre + Point(reach, reach)};
+        obstacle_bounds.push_back(bounds);
+        extend(bounds);
+    }
+    for(size_t i = 0; i + 1 < borders.size(); ++i) {
+        edges.emplace_back(borders[i], borders[i + 1]);
+    }
+    if(!borders.empty()) {
+        edges.emplace_back(borders.back(), borders.front());
+    }
+    edge_columns = SegmentColumns();
+    for(auto& edge : edges) {
+        edge_columns.ax.push_back(edge.start.x);
+        edge_columns.ay.push_back(edge.start.y);
+        edge_columns.bx.push_back(edge.end.x);
+        edge_columns.by.push_back(edge.end.y);
+        edge.min += Point(-bounds_margin, -bounds_margin);
+        edge.max += Point(bounds_margin, bounds_margin);
+        extend({edge.min, edge.max});
+    }
+
+    cell_start.clear();
+    cell_items.clear();
+    size_t items = walls.size() + obstacles.size() + edges.size();
+    if(items == 0) {
+        columns = rows = 0;
+        return;
+    }
+    // about one cell per item, big maps with few items get bigger cells
+    origin = min;
+    double area = std::max(max.x - min.x, 1.0) * std::max(max.y - min.y, 1.0);
+    cell_size = std::max(min_cell_size, std::sqrt(area / static_cast<double>(items)));
+    columns = static_cast<size_t>((max.x - min.x) / cell_size) + 1;
+    rows = static_cast<size_t>((max.y - min.y) / cell_size) + 1;
+    cell_start.assign(columns * rows + 1, 0);
+    // first pass counts items of every cell, second places them
+    for(bool count : {true, false}) {
+        for(uint32_t i = 0; i < wall_bounds.size(); ++i) {
+            addItem(WALL << type_shift | i, wall_bounds[i], count);
+        }
+        for(uint32_t i = 0; i < obstacle_bounds.size(); ++i) {
+            addItem(OBSTACLE << type_shift | i, obstacle_bounds[i], count);
+        }
+        for(uint32_t i = 0; i < edges.size(); ++i) {
+            addItem(EDGE << type_shift | i, {edges[i].min, edges[i].max}, count);
+        }
+        if(count) {
+            for(size_t cell = 0; cell < columns * rows; ++cell) {
+                cell_start[cell + 1] += cell_start[cell];
+            }
+            cell_items.resize(cell_start.back());
+        }
+    }
+    // second pass moved every start to the end of its cell
+    for(size_t cell = columns * rows; cell > 0; --cell) {
+        cell_start[cell] = cell_start[cell - 1];
+    }
+    cell_start[0] = 0;
+}
+
+void StaticGeometry::addItem(uint32_t item, const Bounds& bounds, bool count) {
+    for(size_t y = cellY(bounds.min.y); y <= cellY(bounds.max.y); ++y) {
+        for(size_t x = cellX(bounds.min.x); x <= cellX(bounds.max.x); ++x) {
+            size_t cell = y * columns + x;
+            if(count) {
+                ++cell_start[cell + 1];
+            } else {
+                cell_items[cell_start[cell]++] = item;
+            }
+        }
+    }
+}
+
+size_t StaticGeometry::cellX(double x) const {
+    return static_cast<size_t>(std::clamp((x - origin.x) / cell_size, 0.0, static_cast<double>(columns - 1)));
+}
+
+size_t StaticGeometry::cellY(double y) const {
+    return static_cast<size_t>(std::clamp((y - origin.y) / cell_size, 0.0, static_cast<double>(rows - 1)));
+}
+
+void StaticGeometry::query(const Point& min, const Point& max, GeometryQuery& result) const {
+    result.walls.clear();
+    result.obstacles.clear();
+    result.edges.clear();
+    if(columns == 0) {
+        return;
+    }
+    for(size_t y = cellY(min.y); y <= cellY(max.y); ++y) {
+        for(size_t x = cellX(min.x); x <= cellX(max.x); ++x) {
+            size_t cell = y * columns + x;
+            for(uint32_t i = cell_start[cell]; i < cell_start[cell + 1]; ++i) {
+                uint32_t index = cell_items[i] & index_mask;
+                switch(cell_items[i] >> type_shift) {
+                    case WALL:
+                        result.walls.push_back(index);
+                        break;
+                    case OBSTACLE:
+                        result.obstacles.push_back(index);
+                        break;
+                    default:
+                        result.edges.push_back(index);
+                        break;
+                }
+            }
+        }
+    }
+    // items spanning many cells were added once per cell
+    for(auto* indices : {&result.walls, &result.obstacles, &result.edges}) {
+        std::sort(indices->begin(), indices->end());
+        indices->erase(std::unique(indices->begin(), indices->end()), indices->end());
+    }
+}
+
+bool StaticGeometry::checkWall(const Circle& circle, uint32_t wall) const {
+    Point reach(circle.r, circle.r);
+    return overlaps(circle.centre - reach, circle.centre + reach, wall_bounds[wall].min, wall_bounds[wall].max)
+           && checkCollision(circle, walls[wall]);
+}
+
+bool StaticGeometry::checkObstacle(const Circle& circle, uint32_t obstacle) const {
+    return checkCollision(circle, obstacles[obstacle]);
+}
+
+bool StaticGeometry::checkEdge(const Circle& circle, uint32_t edge) const {
+    const GeometryEdge& geometry_edge = edges[edge];
+    Point reach(circle.r, circle.r);
+    return overlaps(circle.centre - reach, circle.centre + reach, geometry_edge.min, geometry_edge.max)
+           && checkCollision(circle, geometry_edge.start, geometry_edge.end);
+}
+
+const std::vector<GeometryEdge>& StaticGeometry::getEdges() const {
+    return edges;
+}
+
+const SegmentColumns& StaticGeometry::getEdgeColumns() const {
+    return edge_columns;
+}
+
+const std::array<GeometryEdge, 4>& StaticGeometry::getWallEdges(uint32_t wall) const {
+    return wall_edges[wall];
+}
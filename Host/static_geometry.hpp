@@ -0,0 +1,88 @@
+#pragma once
+#include "basic_structs.hpp"
+#include "entity_store.hpp"
+#include <vector>
+#include <array>
+#include <cstdint>
+
+// segment with everything collision response needs computed once
+struct GeometryEdge {
+    GeometryEdge(const Point& start, const Point& end);
+    GeometryEdge() = default;
+
+    Point start, end;
+    // end - start
+    Vector edge;
+    // unit normal (-edge.y, edge.x), circle touching edge is pushed along it or against it
+    Vector normal;
+    // bounding box
+    Point min, max;
+};
+
+// indices of walls, obstacles and border edges returned by StaticGeometry::query(), ascending like in Map
+struct GeometryQuery {
+    std::vector<uint32_t> walls;
+    std::vector<uint32_t> obstacles;
+    std::vector<uint32_t> edges;
+};
+
+// Uniform grid over walls, obstacles and border edges of one map, built once when map is loaded.
+// Every item is stored in each cell its bounding box overlaps. Immutable after build(), so rooms
+// sharing map can query it from different simulation threads
+class StaticGeometry {
+public:
+    // border edges are borders[i] -> borders[i + 1] and borders.back() -> borders.front()
+    void build(const std::vector<Rectangle>& walls, const std::vector<Circle>& obstacles,
+               const std::vector<Point>& borders);
+    // fills result with items whose bounding boxes overlap box min..max
+    void query(const Point& min, const Point& max, GeometryQuery& result) const;
+    // exact tests, bounding boxes are checked first
+    bool checkWall(const Circle& circle, uint32_t wall) const;
+    bool checkObstacle(const Circle& circle, uint32_t obstacle) const;
+    bool checkEdge(const Circle& circle, uint32_t edge) const;
+
+    const std::vector<GeometryEdge>& getEdges() const;
+    // end points of edges for touchSegments()
+    const SegmentColumns& getEdgeColumns() const;
+    // edges of wall in order of Rectangle::points, reversed so normal points outside like in Game::moveAlongNormal()
+    const std::array<GeometryEdge, 4>& getWallEdges(uint32_t wall) const;
+
+private:
+    enum ItemType : uint32_t {
+        WALL = 0,
+        OBSTACLE = 1,
+        EDGE = 2
+    };
+    static constexpr uint32_t type_shift = 30;
+    static constexpr uint32_t index_mask = (1u << type_shift) - 1;
+    // bounding boxes are this much bigger, exact tests accept points a bit outside of shapes
+    static constexpr double bounds_margin = 1;
+    static constexpr double min_cell_size = 64;
+
+    struct Bounds {
+        Point min, max;
+    };
+
+    void addItem(uint32_t item, const Bounds& bounds, bool count);
+    size_t cellX(double x) const;
+    size_t cellY(double y) const;
+
+    std::vector<Rectangle> walls;
+    std::vector<Circle> obstacles;
+    std::vector<std::array<GeometryEdge, 4>> wall_edges;
+    std::vector<Bounds> wall_bounds;
+    std::vector<Bounds> obstacle_bounds;
+    std::vector<GeometryEdge> edges;
+    SegmentColumns edge_columns;
+
+    Point origin;
+    double cell_size = min_cell_size;
+    size_t columns = 0, rows = 0;
+    // items of cell c are cell_items[cell_start[c]..cell_start[c + 1]), item = type << type_shift | index
+    std::vector<uint32_t> cell_start;
+    std::vector<uint32_t> cell_items;
+};
+
+inline bool overlaps(const Point& min1, const Point& max1, const Point& min2, const Point& max2) {
+    return min1.x <= max2.x && min2.x <= max1.x && min1.y <= max2.y && min2.y <= max1.y;
+}
@@ -1,3 +1,4 @@
+#pragma once
 #include <chrono>
 
 template <class DurType = std::chrono::microseconds, class ClockType = std::chrono::steady_clock>
@@ -14,10 +14,54 @@ int runServer(Dealocator dealocator);
 void stopServer();
 void freeMessage(IncomingMessage message);
 void sendTo(Message message, size_t client_id);
+// game state for every client of room 0(everyone if rooms aren't used)
 void sendToEveryone(Message message);
+// game state for every client of room(< max_rooms), replaces state of that room that wasn't sent yet
+void sendToRoom(Message message, size_t room);
+// client gets game states of room from now on, returns 0 if client is running and room < max_rooms
+int setClientRoom(size_t client_id, size_t room);
 // returns first message in queue or waits for one up to wait_seconds.
 // if function times out without message then returns IncomingMessage{.message_type=OTHER, Message{.size=0, .data=NULL}}
+// only one thread can take messages at a time
 IncomingMessage take(size_t wait_seconds);
+// waits for first message up to wait_milliseconds, then copies every waiting message(up to max_messages)
+// into messages without waiting. Returns number of copied messages, each needs to be freed with freeMessage()
+size_t takeMany(IncomingMessage* messages, size_t max_messages, size_t wait_milliseconds);
+// makes take() or takeMany() that waits now(or next one that would wait) return without message,
+// used to stop thread taking messages without waiting for its timeout
+void interruptTake();
+// copies outbound queue statistics of client(also disconnected one) into *stats, returns 0 if client exists
+int getClientSendStats(size_t client_id, ClientSendStats* stats);
+// counters since last runServer()
+ServerSendStats getServerSendStats();
+// copies statistics of up to max_shards sender shards into stats, returns number of shards.
+// counters since last runServer()
+size_t getSenderShardStats(SenderShardStats* stats, size_t max_shards);
+// returns 0 and fills *offer if UDP channel is enabled and client is running
+int getClientUdpOffer(size_t client_id, UdpOffer* offer);
+// CLOCK_REALTIME in nanoseconds, the clock of kernel timestamps(latency_timestamps)
+uint64_t latencyNow();
+// adds end_ns - start_ns to statistics of stage, ignored if latency_timestamps is off or start_ns is 0
+void recordLatency(LatencyStage stage, uint64_t start_ns, uint64_t end_ns);
+// copies statistics of LATENCY_STAGES stages into stats, counters since last runServer()
+void getLatencyStats(LatencyStageStats* stats);
+// Zero-downtime restart(handoff_socket_path). Called before runServer(), takes over server listening on
+// handoff socket. Returns 0 and sets *snapshot(free with free()) to game state sent by old host,
+// 1 if handoff is off or nobody listens, -1 on error
+int takeOverServer(unsigned char** snapshot, size_t* size);
+// listening handoff socket(readable when new server connects) or -1 if handoff is off
+int getHandoffSocket();
+// returns connected socket of new server or -1
+int acceptHandoff();
+// reactors stop receiving and accepting, call before taking last messages
+void pauseServer();
+// sends remaining game states and messages, then gives sockets, clients and snapshot to new server.
+// Returns 0 if new server got everything. stopServer() needs to be called after it in both cases
+int handOffServer(int handoff_socket, const unsigned char* snapshot, size_t size);
+// counters since process start
+ServerReceiveStats getServerReceiveStats();
+// occupancy of received payloads pool, counters since process start
+ReceivePoolStats getReceivePoolStats();
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,73 @@
+#include "server_broadcast.h"
+#include "server_internal.h"
+#include <stdlib.h>
+#include <stdio.h>
+
+BroadcastBuffer* broadcastCreate(Message message) {
+    BroadcastBuffer* buffer = malloc(sizeof(BroadcastBuffer));
+    if(buffer == NULL) {
+        perror("malloc() error!");
+        exit(1);
+    }
+    atomic_init(&buffer->references, 1);
+    buffer->message = message;
+    buffer->publish_time_ns = 0;
+    return buffer;
+}
+
+void broadcastAcquire(BroadcastBuffer* buffer) {
+    atomic_fetch_add_explicit(&buffer->references, 1, memory_order_relaxed);
+}
+
+void broadcastRelease(BroadcastBuffer* buffer) {
+    if(atomic_fetch_sub_explicit(&buffer->references, 1, memory_order_acq_rel) == 1) {
+        freeOutgoingMessage(buffer->message);
+        free(buffer);
+    }
+}
+
+static ZerocopyHold* holdAt(ZerocopyHolds* holds, size_t index) {
+    return &holds->holds[(holds->first + index) % holds->capacity];
+}
+
+void zerocopyHold(ZerocopyHolds* holds, uint32_t send_number, BroadcastBuffer* buffer) {
+    if(holds->size == holds->capacity) {
+        size_t new_capacity = holds->capacity == 0 ? 8 : holds->capacity * 2;
+        ZerocopyHold* new_holds = malloc(sizeof(ZerocopyHold) * new_capacity);
+        if(new_holds == NULL) {
+            perror("malloc() error!");
+            exit(1);
+        }
+        for(size_t i = 0; i < holds->size; ++i) {
+            new_holds[i] = *holdAt(holds, i);
+        }
+        free(holds->holds);
+        holds->holds = new_holds;
+        holds->capacity = new_capacity;
+        holds->first = 0;
+    }
+    broadcastAcquire(buffer);
+    ZerocopyHold hold = {.send_number = send_number, .buffer = buffer};
+    *holdAt(holds, holds->size) = hold;
+    ++holds->size;
+}
+
+void zerocopyReleaseCompleted(ZerocopyHolds* holds, uint32_t completed) {
+    // send numbers wrap around after 2^32 sends
+    while(holds->size > 0 && (int32_t)(holdAt(holds, 0)->send_number - completed) < 0) {
+        broadcastRelease(holdAt(holds, 0)->buffer);
+        holds->first = (holds->first + 1) % holds->capacity;
+        --holds->size;
+    }
+}
+
+void zerocopyReleaseAll(ZerocopyHolds* holds) {
+    while(holds->size > 0) {
+        broadcastRelease(holdAt(holds, 0)->buffer);
+        holds->first = (holds->first + 1) % holds->capacity;
+        --holds->size;
+    }
+    free(holds->holds);
+    holds->holds = NULL;
+    holds->capacity = 0;
+}
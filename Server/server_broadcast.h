@@ -0,0 +1,41 @@
+#ifndef SERVER_BROADCAST_H
+#define SERVER_BROADCAST_H
+#include "server_structs.h"
+#include <stdatomic.h>
+
+// Immutable game state shared by outbound queues of every client. message.size is also used
+// as 4 byte size sent before data, so it can't be changed after creation
+typedef struct {
+    atomic_size_t references;
+    Message message;
+    // latencyNow() in sendToRoom(), 0 if latency_timestamps is off
+    uint64_t publish_time_ns;
+} BroadcastBuffer;
+
+// takes ownership of message, returns buffer with one reference
+BroadcastBuffer* broadcastCreate(Message message);
+void broadcastAcquire(BroadcastBuffer* buffer);
+// frees message with freeOutgoingMessage() after last reference is released
+void broadcastRelease(BroadcastBuffer* buffer);
+
+typedef struct {
+    // MSG_ZEROCOPY send number, counted by kernel for every socket from 0
+    uint32_t send_number;
+    BroadcastBuffer* buffer;
+} ZerocopyHold;
+
+// FIFO of broadcast buffers kernel can still read from after MSG_ZEROCOPY sendmsg() returned
+typedef struct {
+    ZerocopyHold* holds;
+    size_t capacity;
+    size_t first;
+    size_t size;
+} ZerocopyHolds;
+
+// acquires reference to buffer until send_number is completed
+void zerocopyHold(ZerocopyHolds* holds, uint32_t send_number, BroadcastBuffer* buffer);
+// releases buffers of every send before completed(number of first send that isn't completed)
+void zerocopyReleaseCompleted(ZerocopyHolds* holds, uint32_t completed);
+void zerocopyReleaseAll(ZerocopyHolds* holds);
+
+#endif
@@ -0,0 +1,300 @@
+#include "server_internal.h"
+#include "server.h"
+#include "server_config.h"
+#include "server_mutex.h"
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <sched.h>
+#include <sys/socket.h>
+
+// Client registry. Client id is generation << CLIENT_SLOT_BITS | slot, slot is reused after client stops,
+// so ids stay unique while slot(player id sent to clients) stays below max_clients.
+// Readers don't lock or copy anything: they enter read section and use slots and lists of running
+// slots directly. Running slots are split by sender shard(slot % sender_threads), so every sending thread
+// visits only its own clients. Writers(reactors) are serialized and wait for readers to leave(grace period)
+// before freeing anything readers could still see, like in RCU.
+
+#define SLOT_MASK (((size_t)1 << CLIENT_SLOT_BITS) - 1)
+// client_id of slot that wasn't used yet
+#define NO_CLIENT SIZE_MAX
+
+typedef enum {RUNNING, STOP, STOPPED} ClientStatus;
+
+typedef struct {
+    // NULL after client is stopped. Stored after client_id, so reader that sees connection sees its id
+    _Atomic(Connection*) connection;
+    // id of client using slot or last client that used it
+    atomic_size_t client_id;
+    atomic_int status;
+    // fields below are guarded by writer_mutex
+    size_t generation;
+    // outbound queue statistics saved when client was stopped
+    ClientSendStats last_stats;
+} ClientSlot;
+
+// immutable after publishing, writers replace it
+typedef struct {
+    size_t size;
+    uint32_t slots[];
+} RunningList;
+
+static ClientSlot* slots;
+static size_t capacity;
+// shard_count long, list of shard is replaced when its client is added or stopped
+static _Atomic(RunningList*)* running;
+static size_t shard_count;
+// FIFO of free slots, so slot and stats of stopped client are reused as late as possible
+static uint32_t* free_slots;
+static size_t free_first;
+static size_t free_size;
+static pthread_mutex_t writer_mutex;
+// readers count themselves in readers[epoch % 2]
+static atomic_size_t epoch;
+static atomic_size_t readers[2];
+
+static size_t readLock() {
+    while(true) {
+        size_t current = atomic_load(&epoch);
+        atomic_fetch_add(&readers[current % 2], 1);
+        // writer could change epoch and stop waiting before reader was counted
+        if(atomic_load(&epoch) == current) {
+            return current;
+        }
+        atomic_fetch_sub(&readers[current % 2], 1);
+    }
+}
+
+static void readUnlock(size_t token) {
+    atomic_fetch_sub(&readers[token % 2], 1);
+}
+
+// waits until every reader that could see state from before last change leaves read section.
+// writer_mutex needs to be locked
+static void synchronizeReaders() {
+    size_t previous = atomic_fetch_add(&epoch, 1);
+    while(atomic_load(&readers[previous % 2]) != 0) {
+        sched_yield();
+    }
+}
+
+static RunningList* createRunningList(size_t size) {
+    RunningList* list = malloc(sizeof(RunningList) + size * sizeof(uint32_t));
+    if(list == NULL) {
+        perror("malloc() error!");
+        exit(1);
+    }
+    list->size = size;
+    return list;
+}
+
+// publishes copy of shard's running list with slot added(or removed if remove == true)
+// and waits for readers of old one
+static void replaceRunningList(uint32_t index, bool remove) {
+    _Atomic(RunningList*)* shard_list = &running[index % shard_count];
+    RunningList* old_list = atomic_load(shard_list);
+    RunningList* new_list = createRunningList(remove ? old_list->size - 1 : old_list->size + 1);
+    size_t size = 0;
+    for(size_t i = 0; i < old_list->size; ++i) {
+        if(old_list->slots[i] != index) {
+            new_list->slots[size++] = old_list->slots[i];
+        }
+    }
+    if(remove == false) {
+        new_list->slots[size] = index;
+    }
+    atomic_store(shard_list, new_list);
+    synchronizeReaders();
+    free(old_list);
+}
+
+void initClients() {
+    capacity = getServerConfig()->max_clients;
+    shard_count = getServerConfig()->sender_threads;
+    slots = calloc(capacity, sizeof(ClientSlot));
+    free_slots = malloc(capacity * sizeof(uint32_t));
+    running = calloc(shard_count, sizeof(*running));
+    if(slots == NULL || free_slots == NULL || running == NULL) {
+        perror("calloc() error!");
+        exit(1);
+    }
+    for(size_t i = 0; i < capacity; ++i) {
+        atomic_init(&slots[i].connection, NULL);
+        atomic_init(&slots[i].client_id, NO_CLIENT);
+        atomic_init(&slots[i].status, STOPPED);
+        free_slots[i] = (uint32_t)i;
+    }
+    free_first = 0;
+    free_size = capacity;
+    for(size_t shard = 0; shard < shard_count; ++shard) {
+        atomic_init(&running[shard], createRunningList(0));
+    }
+    atomic_init(&epoch, 0);
+    atomic_init(&readers[0], 0);
+    atomic_init(&readers[1], 0);
+    initMutex(&writer_mutex);
+    nameMutex(&writer_mutex, "clients writer_mutex");
+}
+
+// not thread safe! Releases registry references of clients that weren't stopped
+void destroyClients() {
+    for(size_t shard = 0; shard < shard_count; ++shard) {
+        RunningList* list = atomic_load(&running[shard]);
+        for(size_t i = 0; i < list->size; ++i) {
+            connectionRelease(atomic_load(&slots[list->slots[i]].connection));
+        }
+        free(list);
+    }
+    free(running);
+    free(slots);
+    free(free_slots);
+    running = NULL;
+    slots = NULL;
+    destroyMutex(&writer_mutex);
+}
+
+int addClient(Connection* connection) {
+    lockMutex(&writer_mutex);
+    if(free_size == 0) {
+        unlockMutex(&writer_mutex);
+        return 1;
+    }
+    uint32_t index = free_slots[free_first];
+    free_first = (free_first + 1) % capacity;
+    --free_size;
+    ClientSlot* slot = &slots[index];
+    connection->client_id = slot->generation++ << CLIENT_SLOT_BITS | index;
+    connectionAcquire(connection);
+    slot->last_stats = (ClientSendStats){0};
+    atomic_store(&slot->client_id, connection->client_id);
+    atomic_store(&slot->status, RUNNING);
+    atomic_store(&slot->connection, connection);
+    replaceRunningList(index, false);
+    unlockMutex(&writer_mutex);
+    return 0;
+}
+
+int addClientWithId(Connection* connection, size_t client_id) {
+    uint32_t index = (uint32_t)(client_id & SLOT_MASK);
+    lockMutex(&writer_mutex);
+    size_t position = 0;
+    while(position < free_size && free_slots[(free_first + position) % capacity] != index) {
+        ++position;
+    }
+    if(index >= capacity || position == free_size) {
+        unlockMutex(&writer_mutex);
+        return 1;
+    }
+    // slot is taken out of free FIFO, first free slot takes its position
+    free_slots[(free_first + position) % capacity] = free_slots[free_first];
+    free_first = (free_first + 1) % capacity;
+    --free_size;
+    ClientSlot* slot = &slots[index];
+    // next client in slot gets newer id than any client of old server
+    slot->generation = (client_id >> CLIENT_SLOT_BITS) + 1;
+    connection->client_id = client_id;
+    connectionAcquire(connection);
+    slot->last_stats = (ClientSendStats){0};
+    atomic_store(&slot->client_id, client_id);
+    atomic_store(&slot->status, RUNNING);
+    atomic_store(&slot->connection, connection);
+    replaceRunningList(index, false);
+    unlockMutex(&writer_mutex);
+    return 0;
+}
+
+void stopClient(size_t client_id) {
+    lockMutex(&writer_mutex);
+    ClientSlot* slot = &slots[client_id & SLOT_MASK];
+    Connection* connection = atomic_load(&slot->connection);
+    if(atomic_load(&slot->client_id) != client_id || connection == NULL) {
+        unlockMutex(&writer_mutex);
+        return;
+    }
+    atomic_store(&slot->connection, NULL);
+    atomic_store(&slot->status, STOPPED);
+    // also waits for readers that could take connection from slot
+    replaceRunningList((uint32_t)(client_id & SLOT_MASK), true);
+    outboundGetStats(&connection->outbound, &slot->last_stats);
+    connectionRelease(connection);
+    free_slots[(free_first + free_size) % capacity] = (uint32_t)(client_id & SLOT_MASK);
+    ++free_size;
+    unlockMutex(&writer_mutex);
+}
+
+// returns connection of running client, needs to be called in read section
+static Connection* findConnection(size_t client_id) {
+    size_t index = client_id & SLOT_MASK;
+    if(slots == NULL || index >= capacity) {
+        return NULL;
+    }
+    Connection* connection = atomic_load(&slots[index].connection);
+    // slot could be reused by client with newer id
+    if(connection == NULL || atomic_load(&slots[index].client_id) != client_id) {
+        return NULL;
+    }
+    return connection;
+}
+
+bool signalClientToStop(size_t client_id) {
+    size_t token = readLock();
+    Connection* connection = findConnection(client_id);
+    int status = RUNNING;
+    bool running_client = connection != NULL
+                          && atomic_compare_exchange_strong(&slots[client_id & SLOT_MASK].status, &status, STOP);
+    if(running_client) {
+        // reactor will get EPOLLHUP and close connection
+        shutdown(connection->socket, SHUT_RDWR);
+    }
+    readUnlock(token);
+    return running_client;
+}
+
+Connection* acquireClientConnection(size_t client_id) {
+    size_t token = readLock();
+    Connection* connection = findConnection(client_id);
+    if(connection != NULL && atomic_load(&slots[client_id & SLOT_MASK].status) == RUNNING) {
+        connectionAcquire(connection);
+    } else {
+        connection = NULL;
+    }
+    readUnlock(token);
+    return connection;
+}
+
+size_t clientShard(size_t client_id) {
+    return (client_id & SLOT_MASK) % shard_count;
+}
+
+void forEachShardConnection(size_t shard, void (*function)(Connection* connection, void* argument), void* argument) {
+    size_t token = readLock();
+    RunningList* list = atomic_load(&running[shard]);
+    for(size_t i = 0; i < list->size; ++i) {
+        ClientSlot* slot = &slots[list->slots[i]];
+        Connection* connection = atomic_load(&slot->connection);
+        if(connection != NULL && atomic_load(&slot->status) == RUNNING) {
+            function(connection, argument);
+        }
+    }
+    readUnlock(token);
+}
+
+int getClientSendStats(size_t client_id, ClientSendStats* stats) {
+    int err = 1;
+    if(slots == NULL) {
+        return err;
+    }
+    lockMutex(&writer_mutex);
+    ClientSlot* slot = &slots[(client_id & SLOT_MASK) < capacity ? client_id & SLOT_MASK : 0];
+    if(atomic_load(&slot->client_id) == client_id) {
+        Connection* connection = atomic_load(&slot->connection);
+        if(connection != NULL) {
+            outboundGetStats(&connection->outbound, stats);
+        } else {
+            *stats = slot->last_stats;
+        }
+        err = 0;
+    }
+    unlockMutex(&writer_mutex);
+    return err;
+}
@@ -0,0 +1,223 @@
+#include "server_config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+typedef int (*OptionParser)(void* field, const char* value);
+
+typedef struct {
+    const char* name;
+    size_t offset;
+    OptionParser parse;
+} Option;
+
+// used both for static initialization and by defaultServerConfig()
+#define DEFAULT_SERVER_CONFIG { \
+    .port = 5000, \
+    .listen_backlog = 512, \
+    .io_threads = 2, \
+    .sender_threads = 1, \
+    .send_queue_budget = 256 * 1024, \
+    .slow_client_policy = DROP_OLD_STATE, \
+    .slow_client_timeout_ms = 2000, \
+    .tcp_send_policy = TCP_POLICY_NODELAY, \
+    .zerocopy_threshold = 0, \
+    .receive_queue_capacity = 64 * 1024, \
+    .max_frame_size = 4096, \
+    .receive_buffer_size = 8192, \
+    .max_clients = 1024, \
+    .max_players = 0, \
+    .waiting_queue_size = 256, \
+    .max_rooms = 64, \
+    .room_players = 0, \
+    .simulation_threads = 1, \
+    .simulation_tick_ms = 3, \
+    .udp_port = 0, \
+    .udp_loss_percent = 0, \
+    .receive_pool_blocks = 4096, \
+    .unix_socket_path = "", \
+    .shm_socket_path = "", \
+    .shm_ring_size = 1024 * 1024, \
+    .gateway_socket_path = "", \
+    .handoff_socket_path = "", \
+    .latency_timestamps = false, \
+    .lock_profiling = false, \
+}
+
+static ServerConfig config = DEFAULT_SERVER_CONFIG;
+
+static int parseSize(void* field, const char* value) {
+    char* end;
+    errno = 0;
+    unsigned long long parsed = strtoull(value, &end, 10);
+    if(errno != 0 || end == value || *end != '\0' || value[0] == '-') {
+        return 1;
+    }
+    *(size_t*)field = (size_t)parsed;
+    return 0;
+}
+
+static int parsePositiveSize(void* field, const char* value) {
+    size_t parsed;
+    if(parseSize(&parsed, value) != 0 || parsed == 0) {
+        return 1;
+    }
+    *(size_t*)field = parsed;
+    return 0;
+}
+
+static int parseMaxClients(void* field, const char* value) {
+    size_t parsed;
+    if(parsePositiveSize(&parsed, value) != 0 || parsed > 65536) {
+        return 1;
+    }
+    *(size_t*)field = parsed;
+    return 0;
+}
+
+static int parsePort(void* field, const char* value) {
+    size_t parsed;
+    if(parseSize(&parsed, value) != 0 || parsed > 65535) {
+        return 1;
+    }
+    *(size_t*)field = parsed;
+    return 0;
+}
+
+static int parsePercent(void* field, const char* value) {
+    size_t parsed;
+    if(parseSize(&parsed, value) != 0 || parsed > 100) {
+        return 1;
+    }
+    *(size_t*)field = parsed;
+    return 0;
+}
+
+static int parseSimulationTick(void* field, const char* value) {
+    size_t parsed;
+    // players moving less than their radius per tick can't pass through each other, it holds up to 50 ms
+    if(parseSize(&parsed, value) != 0 || parsed == 0 || parsed > 50) {
+        return 1;
+    }
+    *(size_t*)field = parsed;
+    return 0;
+}
+
+static int parseSocketPath(void* field, const char* value) {
+    if(strlen(value) >= SOCKET_PATH_SIZE) {
+        return 1;
+    }
+    strcpy(field, value);
+    return 0;
+}
+
+static int parseRingSize(void* field, const char* value) {
+    size_t parsed;
+    // both rings of every shared memory client are mapped at once, so size is limited to 1 GiB
+    if(parseSize(&parsed, value) != 0 || parsed < 4096 || parsed > ((size_t)1 << 30)) {
+        return 1;
+    }
+    *(size_t*)field = parsed;
+    return 0;
+}
+
+static int parseBool(void* field, const char* value) {
+    if(strcmp(value, "1") == 0 || strcmp(value, "true") == 0) {
+        *(bool*)field = true;
+    } else if(strcmp(value, "0") == 0 || strcmp(value, "false") == 0) {
+        *(bool*)field = false;
+    } else {
+        return 1;
+    }
+    return 0;
+}
+
+static int parseSlowClientPolicy(void* field, const char* value) {
+    if(strcmp(value, "drop_state") == 0) {
+        *(SlowClientPolicy*)field = DROP_OLD_STATE;
+    } else if(strcmp(value, "disconnect") == 0) {
+        *(SlowClientPolicy*)field = DISCONNECT_SLOW;
+    } else {
+        return 1;
+    }
+    return 0;
+}
+
+static int parseTcpSendPolicy(void* field, const char* value) {
+    if(strcmp(value, "nodelay") == 0) {
+        *(TcpSendPolicy*)field = TCP_POLICY_NODELAY;
+    } else if(strcmp(value, "cork") == 0) {
+        *(TcpSendPolicy*)field = TCP_POLICY_CORK;
+    } else if(strcmp(value, "nagle") == 0) {
+        *(TcpSendPolicy*)field = TCP_POLICY_NAGLE;
+    } else {
+        return 1;
+    }
+    return 0;
+}
+
+static const Option options[] = {
+    {"port", offsetof(ServerConfig, port), parsePort},
+    {"listen_backlog", offsetof(ServerConfig, listen_backlog), parsePositiveSize},
+    {"io_threads", offsetof(ServerConfig, io_threads), parsePositiveSize},
+    {"sender_threads", offsetof(ServerConfig, sender_threads), parsePositiveSize},
+    {"send_queue_budget", offsetof(ServerConfig, send_queue_budget), parsePositiveSize},
+    {"slow_client_policy", offsetof(ServerConfig, slow_client_policy), parseSlowClientPolicy},
+    {"slow_client_timeout_ms", offsetof(ServerConfig, slow_client_timeout_ms), parseSize},
+    {"tcp_send_policy", offsetof(ServerConfig, tcp_send_policy), parseTcpSendPolicy},
+    {"zerocopy_threshold", offsetof(ServerConfig, zerocopy_threshold), parseSize},
+    {"receive_queue_capacity", offsetof(ServerConfig, receive_queue_capacity), parsePositiveSize},
+    {"max_frame_size", offsetof(ServerConfig, max_frame_size), parsePositiveSize},
+    {"receive_buffer_size", offsetof(ServerConfig, receive_buffer_size), parsePositiveSize},
+    {"max_clients", offsetof(ServerConfig, max_clients), parseMaxClients},
+    {"max_players", offsetof(ServerConfig, max_players), parseSize},
+    {"waiting_queue_size", offsetof(ServerConfig, waiting_queue_size), parseSize},
+    {"max_rooms", offsetof(ServerConfig, max_rooms), parseMaxClients},
+    {"room_players", offsetof(ServerConfig, room_players), parseSize},
+    {"simulation_threads", offsetof(ServerConfig, simulation_threads), parsePositiveSize},
+    {"simulation_tick_ms", offsetof(ServerConfig, simulation_tick_ms), parseSimulationTick},
+    {"udp_port", offsetof(ServerConfig, udp_port), parsePort},
+    {"udp_loss_percent", offsetof(ServerConfig, udp_loss_percent), parsePercent},
+    {"receive_pool_blocks", offsetof(ServerConfig, receive_pool_blocks), parseSize},
+    {"unix_socket_path", offsetof(ServerConfig, unix_socket_path), parseSocketPath},
+    {"shm_socket_path", offsetof(ServerConfig, shm_socket_path), parseSocketPath},
+    {"shm_ring_size", offsetof(ServerConfig, shm_ring_size), parseRingSize},
+    {"gateway_socket_path", offsetof(ServerConfig, gateway_socket_path), parseSocketPath},
+    {"handoff_socket_path", offsetof(ServerConfig, handoff_socket_path), parseSocketPath},
+    {"latency_timestamps", offsetof(ServerConfig, latency_timestamps), parseBool},
+    {"lock_profiling", offsetof(ServerConfig, lock_profiling), parseBool},
+};
+
+ServerConfig defaultServerConfig() {
+    ServerConfig default_config = DEFAULT_SERVER_CONFIG;
+    return default_config;
+}
+
+int setServerOption(ServerConfig* server_config, const char* option) {
+    const char* separator = strchr(option, '=');
+    if(separator == NULL) {
+        fprintf(stderr, "Server option \"%s\" isn't in name=value format\n", option);
+        return 1;
+    }
+    size_t name_length = (size_t)(separator - option);
+    for(size_t i = 0; i < sizeof(options) / sizeof(options[0]); ++i) {
+        if(strlen(options[i].name) == name_length && strncmp(options[i].name, option, name_length) == 0) {
+            if(options[i].parse((char*)server_config + options[i].offset, separator + 1) != 0) {
+                fprintf(stderr, "Wrong value for server option \"%s\"\n", option);
+                return 1;
+            }
+            return 0;
+        }
+    }
+    fprintf(stderr, "Unknown server option \"%s\"\n", option);
+    return 1;
+}
+
+void setServerConfig(ServerConfig server_config) {
+    config = server_config;
+}
+
+const ServerConfig* getServerConfig() {
+    return &config;
+}
@@ -0,0 +1,102 @@
+#ifndef SERVER_CONFIG_H
+#define SERVER_CONFIG_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdbool.h>
+
+typedef enum {
+    // drop queued game states that weren't started yet, oldest first
+    DROP_OLD_STATE,
+    // disconnect client whose queue stays over budget longer than slow_client_timeout_ms
+    DISCONNECT_SLOW
+} SlowClientPolicy;
+
+typedef enum {
+    // TCP_NODELAY, every flush is sent right away. Frames are already coalesced into one sendmsg() per flush
+    TCP_POLICY_NODELAY,
+    // TCP_CORK around flushes that need more than one sendmsg(), so they leave in full packets
+    TCP_POLICY_CORK,
+    // kernel default(Nagle's algorithm)
+    TCP_POLICY_NAGLE
+} TcpSendPolicy;
+
+// sizeof(sockaddr_un.sun_path)
+#define SOCKET_PATH_SIZE 108
+
+typedef struct {
+    // TCP port, every reactor listens on it with its own SO_REUSEPORT socket
+    size_t port;
+    size_t listen_backlog;
+    // number of threads running epoll event loops(accept, receive and close for every socket)
+    size_t io_threads;
+    // threads sending to clients, every one owns clients with slot % sender_threads equal to its number
+    size_t sender_threads;
+    // bytes(including 4 byte sizes) that can wait in one client's outbound queue before policy is applied
+    size_t send_queue_budget;
+    SlowClientPolicy slow_client_policy;
+    size_t slow_client_timeout_ms;
+    TcpSendPolicy tcp_send_policy;
+    // game states at least this big are sent with MSG_ZEROCOPY, 0 turns it off
+    size_t zerocopy_threshold;
+    // slots in received messages queue(rounded up to power of 2), reactors stop reading connections that find it
+    // full until it's half empty
+    size_t receive_queue_capacity;
+    // biggest frame(without 4 byte size) accepted from client, client sending bigger one is disconnected
+    size_t max_frame_size;
+    // per connection receive ring buffer, grows to fit max_frame_size if needed
+    size_t receive_buffer_size;
+    // clients connected at the same time, at most 65536 so slot fits uint16_t player id
+    size_t max_clients;
+    // connections that can be clients at the same time, 0 or more than max_clients means max_clients
+    size_t max_players;
+    // connections over max_players waiting for free place, next ones are closed
+    size_t waiting_queue_size;
+    // game rooms, every client is in one of them and gets only its game states. Clients start in room 0
+    size_t max_rooms;
+    // players in one room before host opens next room, 0 means no limit
+    size_t room_players;
+    // host threads simulating and serializing rooms, every one owns rooms with number % simulation_threads equal to its number
+    size_t simulation_threads;
+    // length of one simulation step of rooms in milliseconds, movement is swept so longer ticks don't let
+    // projectiles pass through walls
+    size_t simulation_tick_ms;
+    // UDP port for game states, 0 turns UDP channel off
+    size_t udp_port;
+    // percent of game state datagrams dropped on purpose, for testing
+    size_t udp_loss_percent;
+    // blocks in every size class of received payloads pool, read only by first runServer()
+    size_t receive_pool_blocks;
+    // Unix domain socket for clients on the same machine(same frames as TCP), empty turns it off
+    char unix_socket_path[SOCKET_PATH_SIZE];
+    // Unix domain socket for clients using shared memory rings(Protokol_komunikacji.txt), empty turns it off
+    char shm_socket_path[SOCKET_PATH_SIZE];
+    // bytes in each of two rings of shared memory connection
+    size_t shm_ring_size;
+    // control socket of gateway(bin/gateway), server sends it load reports. Empty means server isn't behind gateway.
+    // Gateway listens on it
+    char gateway_socket_path[SOCKET_PATH_SIZE];
+    // Unix socket for zero-downtime restart. New server started with the same path takes over sockets,
+    // clients and game of server listening on it, then listens there itself. Empty turns it off
+    char handoff_socket_path[SOCKET_PATH_SIZE];
+    // kernel receive/send timestamps(SO_TIMESTAMPING) on TCP clients and per stage input latency histograms
+    bool latency_timestamps;
+    // measures wait and hold times of named mutexes, report is printed by stopServer()
+    bool lock_profiling;
+} ServerConfig;
+
+ServerConfig defaultServerConfig();
+// parses "name=value" option and sets matching field in *config.
+// returns 0 if option was recognized and value is valid
+int setServerOption(ServerConfig* config, const char* option);
+// config is copied, needs to be called before runServer()
+void setServerConfig(ServerConfig config);
+const ServerConfig* getServerConfig();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,45 @@
+#include "server_connection.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/random.h>
+
+Connection* connectionCreate(int socket, Transport transport) {
+    Connection* connection = calloc(1, sizeof(Connection));
+    if(connection == NULL) {
+        perror("calloc() error!");
+        exit(1);
+    }
+    atomic_init(&connection->references, 1);
+    connection->socket = socket;
+    connection->transport = transport;
+    outboundCreate(&connection->outbound);
+    atomic_init(&connection->zerocopy_completed, 0);
+    atomic_init(&connection->send_sample_time_ns, 0);
+    atomic_init(&connection->udp_state, UDP_OFF);
+    atomic_init(&connection->room, 0);
+    if(getrandom(&connection->udp_token, sizeof(connection->udp_token), 0) != sizeof(connection->udp_token)) {
+        connection->udp_token = (uint32_t)rand();
+    }
+    return connection;
+}
+
+void connectionAcquire(Connection* connection) {
+    atomic_fetch_add_explicit(&connection->references, 1, memory_order_relaxed);
+}
+
+void connectionRelease(Connection* connection) {
+    if(atomic_fetch_sub_explicit(&connection->references, 1, memory_order_acq_rel) != 1) {
+        return;
+    }
+    if(close(connection->socket) == -1) {
+        perror("close() error!");
+    }
+    if(connection->shm != NULL) {
+        shmDestroy(connection->shm);
+    }
+    clearReceiveState(&connection->receive_state);
+    outboundDestroy(&connection->outbound);
+    zerocopyReleaseAll(&connection->zerocopy_holds);
+    free(connection);
+}
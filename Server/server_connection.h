@@ -0,0 +1,77 @@
+#ifndef SERVER_CONNECTION_H
+#define SERVER_CONNECTION_H
+#include "server_receive.h"
+#include "server_outbound.h"
+#include "server_shm.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <time.h>
+#include <netinet/in.h>
+
+// how client is connected, local ones don't use TCP socket options
+typedef enum {TRANSPORT_TCP, TRANSPORT_UNIX, TRANSPORT_SHM} Transport;
+
+// UDP channel state(server_udp.c)
+typedef enum {UDP_OFF, UDP_REGISTERING, UDP_READY} UdpState;
+
+struct Connection;
+typedef struct Connection Connection;
+
+// Shared by reactor, sending thread and clients array. Socket is closed when last reference is released
+struct Connection {
+    atomic_size_t references;
+    int socket;
+    size_t client_id;
+    // room whose game states client gets, changed by setClientRoom()
+    atomic_size_t room;
+    Transport transport;
+    // rings used instead of socket if transport is TRANSPORT_SHM, otherwise NULL
+    ShmTransport* shm;
+
+    // used only by reactor thread that accepted connection
+    Connection* reactor_previous;
+    Connection* reactor_next;
+    ReceiveState receive_state;
+    // set by closeConnection(), later events of the same epoll_wait() are ignored
+    bool closed;
+
+    // used only by sending thread
+    OutboundQueue outbound;
+    // true if sending thread waits for EPOLLOUT on socket, it holds one reference then
+    bool waiting_for_write;
+    bool registered_for_write;
+    Connection* sender_previous;
+    Connection* sender_next;
+    // true if frames were pushed since last flush, connection is in dirty list and holds reference
+    bool dirty;
+    Connection* dirty_next;
+    // monotonic time when outbound queue went over budget
+    bool over_budget;
+    struct timespec over_budget_since;
+    // SO_ZEROCOPY was enabled on socket
+    bool zerocopy;
+    // number of MSG_ZEROCOPY sendmsg() calls, used only by sending thread
+    uint32_t zerocopy_sends;
+    ZerocopyHolds zerocopy_holds;
+    // number of first MSG_ZEROCOPY send that wasn't completed, updated by reactor from socket error queue
+    atomic_uint zerocopy_completed;
+    // SO_TIMESTAMPING was enabled on socket(latency_timestamps)
+    bool timestamps;
+    // sendToRoom() time of game state whose sendmsg() asked for kernel send timestamp, 0 if none is pending.
+    // Set by sending thread, taken by reactor reading socket error queue
+    _Atomic uint64_t send_sample_time_ns;
+
+    // random token sent in welcome message and checked in client's UDP hello
+    uint32_t udp_token;
+    atomic_int udp_state;
+    // set once by reactor before udp_state becomes UDP_READY
+    struct sockaddr_in udp_address;
+};
+
+// returns connection with one reference owned by caller
+Connection* connectionCreate(int socket, Transport transport);
+void connectionAcquire(Connection* connection);
+// closes socket and frees connection when last reference is released
+void connectionRelease(Connection* connection);
+
+#endif
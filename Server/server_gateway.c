@@ -0,0 +1,91 @@
+#include "server_gateway.h"
+#include "server_config.h"
+#include "server_listen.h"
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+static int gateway_socket = -1;
+static int report_timer = -1;
+
+int openGatewayChannel() {
+    const ServerConfig* config = getServerConfig();
+    if(config->gateway_socket_path[0] == '\0') {
+        return 0;
+    }
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+    strncpy(address.sun_path, config->gateway_socket_path, sizeof(address.sun_path) - 1);
+    gateway_socket = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(gateway_socket == -1) {
+        perror("socket(AF_UNIX) error");
+        return 1;
+    }
+    if(connect(gateway_socket, (struct sockaddr*)&address, sizeof(address)) == -1) {
+        perror("connect(gateway) error");
+        closeGatewayChannel();
+        return 1;
+    }
+    report_timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    struct itimerspec period = {.it_interval = {.tv_nsec = GATEWAY_REPORT_MS * 1000000},
+                                .it_value = {.tv_nsec = 1}};
+    if(report_timer == -1 || timerfd_settime(report_timer, 0, &period, NULL) == -1) {
+        perror("timerfd error");
+        closeGatewayChannel();
+        return 1;
+    }
+    printf("Server reports load to gateway: %s\n", config->gateway_socket_path);
+    return 0;
+}
+
+void closeGatewayChannel() {
+    if(gateway_socket != -1) {
+        close(gateway_socket);
+        gateway_socket = -1;
+    }
+    if(report_timer != -1) {
+        close(report_timer);
+        report_timer = -1;
+    }
+}
+
+int getGatewayTimer() {
+    return report_timer;
+}
+
+static void putValue(unsigned char** buffer, const void* value, size_t size) {
+    memcpy(*buffer, value, size);
+    *buffer += size;
+}
+
+void reportLoadToGateway() {
+    uint64_t expirations;
+    if(read(report_timer, &expirations, sizeof(expirations)) == -1 || gateway_socket == -1) {
+        return;
+    }
+    const ServerConfig* config = getServerConfig();
+    size_t admitted, waiting, max_players;
+    getAdmissionLoad(&admitted, &waiting, &max_players);
+    size_t path_length = strlen(config->unix_socket_path);
+    unsigned char frame[sizeof(uint32_t) + GATEWAY_REPORT_SIZE + SOCKET_PATH_SIZE];
+    unsigned char* position = frame;
+    uint32_t size = (uint32_t)(GATEWAY_REPORT_SIZE + path_length);
+    uint8_t type = GATEWAY_LOAD_REPORT;
+    uint16_t port = (uint16_t)config->port;
+    uint32_t load[3] = {(uint32_t)admitted, (uint32_t)waiting, (uint32_t)max_players};
+    putValue(&position, &size, sizeof(size));
+    putValue(&position, &type, sizeof(type));
+    putValue(&position, &port, sizeof(port));
+    putValue(&position, load, sizeof(load));
+    putValue(&position, config->unix_socket_path, path_length);
+    // report is small and sent rarely, if socket is full gateway will get next one
+    if(send(gateway_socket, frame, (size_t)(position - frame), MSG_DONTWAIT | MSG_NOSIGNAL) == -1
+            && errno != EAGAIN && errno != EWOULDBLOCK) {
+        perror("Gateway control channel closed");
+        close(gateway_socket);
+        gateway_socket = -1;
+    }
+}
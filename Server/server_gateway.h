@@ -0,0 +1,24 @@
+#ifndef SERVER_GATEWAY_H
+#define SERVER_GATEWAY_H
+#include <stddef.h>
+#include <stdint.h>
+
+// Control channel to gateway(Gateway/gateway.c) that relays clients from one public port to many servers.
+// Server connects to gateway_socket_path and every GATEWAY_REPORT_MS sends load report:
+// uint32_t size, 1(1 byte), uint16_t port, uint32_t players, uint32_t waiting, uint32_t max_players,
+// unix_socket_path(rest of frame, can be empty). Gateway connects relayed clients to Unix socket if it's set
+
+#define GATEWAY_REPORT_MS 100
+#define GATEWAY_LOAD_REPORT 1
+// size of load report without path and 4 byte size
+#define GATEWAY_REPORT_SIZE (1 + 2 + 4 + 4 + 4)
+
+// connects to gateway if gateway_socket_path is set, returns 0 if it's not set or server connected
+int openGatewayChannel();
+void closeGatewayChannel();
+// timerfd that reactor waits for, -1 if server isn't behind gateway
+int getGatewayTimer();
+// called by reactor after timer expired, sends report without blocking
+void reportLoadToGateway();
+
+#endif
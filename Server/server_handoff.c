@@ -0,0 +1,676 @@
+#include "server_handoff.h"
+#include "server.h"
+#include "server_internal.h"
+#include "server_config.h"
+#include "server_listen.h"
+#include "server_reactor.h"
+#include "server_send.h"
+#include "server_udp.h"
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+// first 4 bytes of blob, "PRSH"
+#define HANDOFF_MAGIC 0x48535250u
+// sockets sent with one sendmsg(), kernel takes at most 253
+#define HANDOFF_FD_BATCH 200
+// new server waits this long for old one to stop and send everything
+#define HANDOFF_TIMEOUT_S 10
+// Unix listening sockets: unix_socket_path and shm_socket_path
+#define UNIX_LISTENERS 2
+
+typedef struct {
+    unsigned char* data;
+    size_t size;
+    size_t capacity;
+} Blob;
+
+typedef struct {
+    const unsigned char* data;
+    size_t size;
+    size_t position;
+    bool error;
+} BlobReader;
+
+typedef struct {
+    int* fds;
+    size_t size;
+    size_t capacity;
+} FdList;
+
+static int handoff_listen_fd = -1;
+static bool handed_off = false;
+
+// taken over by takeOverServer(), -1 where socket was taken
+static int* listeners = NULL;
+static size_t listeners_size = 0;
+static size_t listeners_taken = 0;
+static int udp_socket = -1;
+static int unix_listeners[UNIX_LISTENERS] = {-1, -1};
+static char unix_paths[UNIX_LISTENERS][SOCKET_PATH_SIZE];
+static HandedOffClient* clients = NULL;
+static size_t clients_size = 0;
+static int* waiting_sockets = NULL;
+static Transport* waiting_transports = NULL;
+static size_t waiting_size = 0;
+static size_t waiting_taken = 0;
+static size_t broadcast_sequence = 0;
+
+static void* reserve(void* data, size_t* capacity, size_t needed, size_t element_size) {
+    if(needed <= *capacity) {
+        return data;
+    }
+    while(*capacity < needed) {
+        *capacity = *capacity == 0 ? 64 : *capacity * 2;
+    }
+    data = realloc(data, *capacity * element_size);
+    if(data == NULL) {
+        perror("realloc() error!");
+        exit(1);
+    }
+    return data;
+}
+
+static void blobAppend(Blob* blob, const void* bytes, size_t size) {
+    blob->data = reserve(blob->data, &blob->capacity, blob->size + size, 1);
+    memcpy(blob->data + blob->size, bytes, size);
+    blob->size += size;
+}
+
+static void blobAppendSize(Blob* blob, size_t value) {
+    uint64_t value64 = value;
+    blobAppend(blob, &value64, sizeof(value64));
+}
+
+static void blobAppendByte(Blob* blob, uint8_t value) {
+    blobAppend(blob, &value, sizeof(value));
+}
+
+static void fdAppend(FdList* list, int fd) {
+    list->fds = reserve(list->fds, &list->capacity, list->size + 1, sizeof(int));
+    list->fds[list->size++] = fd;
+}
+
+// returns NULL and sets error if blob is shorter
+static const unsigned char* readBytes(BlobReader* reader, size_t size) {
+    if(reader->error || reader->size - reader->position < size) {
+        reader->error = true;
+        return NULL;
+    }
+    const unsigned char* bytes = reader->data + reader->position;
+    reader->position += size;
+    return bytes;
+}
+
+static size_t readSize(BlobReader* reader) {
+    uint64_t value = 0;
+    const unsigned char* bytes = readBytes(reader, sizeof(value));
+    if(bytes != NULL) {
+        memcpy(&value, bytes, sizeof(value));
+    }
+    return (size_t)value;
+}
+
+static uint8_t readByte(BlobReader* reader) {
+    const unsigned char* bytes = readBytes(reader, 1);
+    return bytes != NULL ? bytes[0] : 0;
+}
+
+static Message readMessage(BlobReader* reader) {
+    size_t size = readSize(reader);
+    const unsigned char* bytes = readBytes(reader, size);
+    Message message = {.size = (uint32_t)size, .data = NULL};
+    if(bytes != NULL && size > 0) {
+        message.data = malloc(size);
+        if(message.data == NULL) {
+            perror("malloc() error!");
+            exit(1);
+        }
+        memcpy(message.data, bytes, size);
+    }
+    return message;
+}
+
+static int sendAll(int socket, const void* data, size_t size) {
+    const unsigned char* bytes = data;
+    while(size > 0) {
+        ssize_t sent = send(socket, bytes, size, MSG_NOSIGNAL);
+        if(sent == -1 && errno == EINTR) {
+            continue;
+        }
+        if(sent <= 0) {
+            perror("handoff send() error");
+            return -1;
+        }
+        bytes += sent;
+        size -= (size_t)sent;
+    }
+    return 0;
+}
+
+static int receiveAll(int socket, void* data, size_t size) {
+    unsigned char* bytes = data;
+    while(size > 0) {
+        ssize_t received = recv(socket, bytes, size, 0);
+        if(received == -1 && errno == EINTR) {
+            continue;
+        }
+        if(received <= 0) {
+            perror("handoff recv() error");
+            return -1;
+        }
+        bytes += received;
+        size -= (size_t)received;
+    }
+    return 0;
+}
+
+// every batch is one byte with sockets attached, so they can't be merged with other data of stream
+static int sendSockets(int socket, const FdList* list) {
+    for(size_t first = 0; first < list->size; first += HANDOFF_FD_BATCH) {
+        size_t count = list->size - first < HANDOFF_FD_BATCH ? list->size - first : HANDOFF_FD_BATCH;
+        char control[CMSG_SPACE(sizeof(int) * HANDOFF_FD_BATCH)];
+        memset(control, 0, sizeof(control));
+        uint8_t byte = 0;
+        struct iovec iov = {.iov_base = &byte, .iov_len = 1};
+        struct msghdr msg = {.msg_iov = &iov, .msg_iovlen = 1, .msg_control = control,
+                             .msg_controllen = CMSG_SPACE(sizeof(int) * count)};
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * count);
+        memcpy(CMSG_DATA(cmsg), list->fds + first, sizeof(int) * count);
+        if(sendmsg(socket, &msg, MSG_NOSIGNAL) != 1) {
+            perror("sendmsg(SCM_RIGHTS) error");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void closeSockets(const int* fds, size_t count) {
+    for(size_t i = 0; i < count; ++i) {
+        close(fds[i]);
+    }
+}
+
+// on error closes every socket received so far, fds are left unset
+static int receiveSockets(int socket, int* fds, size_t count) {
+    for(size_t first = 0; first < count; first += HANDOFF_FD_BATCH) {
+        size_t batch = count - first < HANDOFF_FD_BATCH ? count - first : HANDOFF_FD_BATCH;
+        char control[CMSG_SPACE(sizeof(int) * HANDOFF_FD_BATCH)];
+        uint8_t byte;
+        struct iovec iov = {.iov_base = &byte, .iov_len = 1};
+        struct msghdr msg = {.msg_iov = &iov, .msg_iovlen = 1, .msg_control = control, .msg_controllen = sizeof(control)};
+        if(recvmsg(socket, &msg, MSG_CMSG_CLOEXEC) != 1) {
+            perror("recvmsg(SCM_RIGHTS) error");
+            closeSockets(fds, first);
+            return -1;
+        }
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        if(cmsg == NULL || cmsg->cmsg_type != SCM_RIGHTS || cmsg->cmsg_len != CMSG_LEN(sizeof(int) * batch)) {
+            fprintf(stderr, "Handoff: wrong number of sockets from old server\n");
+            // sockets of wrong batch were received too
+            if(cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS
+               && cmsg->cmsg_len >= CMSG_LEN(0)) {
+                int received[HANDOFF_FD_BATCH];
+                size_t received_count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+                received_count = received_count < HANDOFF_FD_BATCH ? received_count : HANDOFF_FD_BATCH;
+                memcpy(received, CMSG_DATA(cmsg), sizeof(int) * received_count);
+                closeSockets(received, received_count);
+            }
+            closeSockets(fds, first);
+            return -1;
+        }
+        memcpy(fds + first, CMSG_DATA(cmsg), sizeof(int) * batch);
+    }
+    return 0;
+}
+
+int openHandoffListener() {
+    const char* path = getServerConfig()->handoff_socket_path;
+    handed_off = false;
+    if(path[0] == '\0') {
+        return 0;
+    }
+    // old server's file is replaced, next server connects to this one
+    handoff_listen_fd = openUnixListeningSocket(path);
+    return handoff_listen_fd == -1 ? 1 : 0;
+}
+
+void closeHandoffListener() {
+    if(handoff_listen_fd == -1) {
+        return;
+    }
+    if(handed_off) {
+        close(handoff_listen_fd);
+    } else {
+        closeUnixListeningSocket(handoff_listen_fd, getServerConfig()->handoff_socket_path);
+    }
+    handoff_listen_fd = -1;
+}
+
+bool isHandedOff() {
+    return handed_off;
+}
+
+int getHandoffSocket() {
+    return handoff_listen_fd;
+}
+
+int acceptHandoff() {
+    if(handoff_listen_fd == -1) {
+        return -1;
+    }
+    int handoff_socket = acceptConnection(handoff_listen_fd);
+    // everything is sent with blocking calls
+    if(handoff_socket != -1) {
+        fcntl(handoff_socket, F_SETFL, fcntl(handoff_socket, F_GETFL) & ~O_NONBLOCK);
+    }
+    return handoff_socket;
+}
+
+void pauseServer() {
+    pauseReactors();
+}
+
+typedef struct {
+    Blob* blob;
+    FdList* fds;
+    size_t clients;
+} HandoffExport;
+
+static void exportConnection(Connection* connection, void* export_arg) {
+    HandoffExport* handoff = export_arg;
+    // rings live in this process, shared memory clients are disconnected
+    if(connection->transport == TRANSPORT_SHM) {
+        return;
+    }
+    Blob* blob = handoff->blob;
+    blobAppendSize(blob, connection->client_id);
+    blobAppendSize(blob, atomic_load(&connection->room));
+    blobAppendByte(blob, (uint8_t)connection->transport);
+    blobAppendByte(blob, atomic_load(&connection->udp_state) == UDP_READY);
+    blobAppend(blob, &connection->udp_token, sizeof(connection->udp_token));
+    blobAppend(blob, &connection->udp_address, sizeof(connection->udp_address));
+    const ReceiveState* input = &connection->receive_state;
+    blobAppendSize(blob, input->size);
+    for(size_t i = 0; i < input->size; ++i) {
+        blobAppendByte(blob, input->buffer[(input->start + i) % input->capacity]);
+    }
+    OutboundQueue* output = &connection->outbound;
+    size_t output_position = blob->size;
+    blobAppendSize(blob, 0);
+    while(outboundIsEmpty(output) == false) {
+        struct iovec iov[64];
+        size_t frames;
+        bool whole_queue;
+        size_t iov_count = outboundFillIovec(output, iov, 64, false, &frames, &whole_queue);
+        size_t bytes = 0;
+        for(size_t i = 0; i < iov_count; ++i) {
+            blobAppend(blob, iov[i].iov_base, iov[i].iov_len);
+            bytes += iov[i].iov_len;
+        }
+        outboundAdvance(output, bytes);
+    }
+    uint64_t output_size = blob->size - output_position - sizeof(uint64_t);
+    memcpy(blob->data + output_position, &output_size, sizeof(output_size));
+    fdAppend(handoff->fds, connection->socket);
+    ++handoff->clients;
+}
+
+int handOffServer(int handoff_socket, const unsigned char* snapshot, size_t snapshot_size) {
+    const ServerConfig* config = getServerConfig();
+    // everything host sent goes to outbound queues, what socket didn't take is sent by new server
+    drainSenders();
+    Blob blob = {0};
+    FdList fds = {0};
+    uint32_t magic = HANDOFF_MAGIC;
+    blobAppend(&blob, &magic, sizeof(magic));
+    blobAppendSize(&blob, config->port);
+    blobAppendSize(&blob, config->udp_port);
+    blobAppendSize(&blob, getBroadcastSequence());
+    int reactor_listeners[256];
+    size_t listener_count = getReactorListeners(reactor_listeners, sizeof(reactor_listeners) / sizeof(int));
+    blobAppendSize(&blob, listener_count);
+    for(size_t i = 0; i < listener_count; ++i) {
+        fdAppend(&fds, reactor_listeners[i]);
+    }
+    blobAppendByte(&blob, getUdpSocket() != -1);
+    if(getUdpSocket() != -1) {
+        fdAppend(&fds, getUdpSocket());
+    }
+    const char* paths[UNIX_LISTENERS] = {config->unix_socket_path, config->shm_socket_path};
+    Transport transports[UNIX_LISTENERS] = {TRANSPORT_UNIX, TRANSPORT_SHM};
+    for(size_t i = 0; i < UNIX_LISTENERS; ++i) {
+        int listener = getUnixListener(transports[i]);
+        blobAppendByte(&blob, listener != -1);
+        if(listener != -1) {
+            blobAppendSize(&blob, strlen(paths[i]));
+            blobAppend(&blob, paths[i], strlen(paths[i]));
+            fdAppend(&fds, listener);
+        }
+    }
+    size_t clients_position = blob.size;
+    blobAppendSize(&blob, 0);
+    HandoffExport handoff = {.blob = &blob, .fds = &fds, .clients = 0};
+    forEachReactorConnection(exportConnection, &handoff);
+    uint64_t client_count = handoff.clients;
+    memcpy(blob.data + clients_position, &client_count, sizeof(client_count));
+    // waiting sockets belong only to admission queue, they are closed here after sending
+    size_t waiting_first = fds.size;
+    size_t waiting_position = blob.size;
+    blobAppendSize(&blob, 0);
+    Transport transport;
+    int waiting_socket;
+    while((waiting_socket = popWaitingConnection(&transport)) != -1) {
+        blobAppendByte(&blob, (uint8_t)transport);
+        fdAppend(&fds, waiting_socket);
+    }
+    uint64_t waiting_count = fds.size - waiting_first;
+    memcpy(blob.data + waiting_position, &waiting_count, sizeof(waiting_count));
+    blobAppendSize(&blob, snapshot_size);
+    blobAppend(&blob, snapshot, snapshot_size);
+
+    uint64_t blob_size = blob.size;
+    int result = sendAll(handoff_socket, &blob_size, sizeof(blob_size)) == 0
+                 && sendAll(handoff_socket, blob.data, blob.size) == 0
+                 && sendSockets(handoff_socket, &fds) == 0 ? 0 : 1;
+    if(result == 0) {
+        handed_off = true;
+        printf("Server handed off %lu clients(%lu waiting) and %zu B of game state\n",
+               (unsigned long)client_count, (unsigned long)waiting_count, snapshot_size);
+    }
+    for(size_t i = waiting_first; i < fds.size; ++i) {
+        close(fds.fds[i]);
+    }
+    close(handoff_socket);
+    free(blob.data);
+    free(fds.fds);
+    return result;
+}
+
+// every element is -1, so clearHandoff() closes only sockets that were received
+static int* allocateSockets(size_t size) {
+    int* sockets = malloc((size + 1) * sizeof(int));
+    if(sockets == NULL) {
+        perror("malloc() error!");
+        exit(1);
+    }
+    for(size_t i = 0; i <= size; ++i) {
+        sockets[i] = -1;
+    }
+    return sockets;
+}
+
+// reads blob, sockets are set by assignSockets(). Sizes are set only after their arrays are allocated,
+// so clearHandoff() can free whatever was read before an error
+static int parseHandoff(BlobReader* reader, size_t* old_port, size_t* old_udp_port, size_t* socket_count) {
+    const unsigned char* magic = readBytes(reader, sizeof(uint32_t));
+    if(magic == NULL || memcmp(magic, &(uint32_t){HANDOFF_MAGIC}, sizeof(uint32_t)) != 0) {
+        return -1;
+    }
+    *old_port = readSize(reader);
+    *old_udp_port = readSize(reader);
+    broadcast_sequence = readSize(reader);
+    size_t listener_count = readSize(reader);
+    if(reader->error || listener_count > reader->size) {
+        return -1;
+    }
+    listeners = allocateSockets(listener_count);
+    listeners_size = listener_count;
+    *socket_count = listeners_size;
+    if(readByte(reader) == 1) {
+        ++*socket_count;
+        udp_socket = -2;
+    }
+    for(size_t i = 0; i < UNIX_LISTENERS; ++i) {
+        if(readByte(reader) == 1) {
+            size_t length = readSize(reader);
+            const unsigned char* path = readBytes(reader, length);
+            if(path == NULL || length >= SOCKET_PATH_SIZE) {
+                return -1;
+            }
+            memcpy(unix_paths[i], path, length);
+            unix_paths[i][length] = '\0';
+            unix_listeners[i] = -2;
+            ++*socket_count;
+        }
+    }
+    size_t client_count = readSize(reader);
+    if(reader->error || client_count > reader->size) {
+        return -1;
+    }
+    clients = calloc(client_count + 1, sizeof(HandedOffClient));
+    if(clients == NULL) {
+        perror("calloc() error!");
+        exit(1);
+    }
+    for(size_t i = 0; i < client_count; ++i) {
+        clients[i].socket = -1;
+    }
+    clients_size = client_count;
+    for(size_t i = 0; i < clients_size && reader->error == false; ++i) {
+        HandedOffClient* client = &clients[i];
+        client->client_id = readSize(reader);
+        client->room = readSize(reader);
+        client->transport = (Transport)readByte(reader);
+        client->udp_ready = readByte(reader) == 1;
+        const unsigned char* token = readBytes(reader, sizeof(client->udp_token));
+        const unsigned char* address = readBytes(reader, sizeof(client->udp_address));
+        if(token == NULL || address == NULL) {
+            return -1;
+        }
+        memcpy(&client->udp_token, token, sizeof(client->udp_token));
+        memcpy(&client->udp_address, address, sizeof(client->udp_address));
+        client->input = readMessage(reader);
+        client->output = readMessage(reader);
+    }
+    *socket_count += clients_size;
+    size_t waiting_count = readSize(reader);
+    if(reader->error || waiting_count > reader->size) {
+        return -1;
+    }
+    waiting_sockets = allocateSockets(waiting_count);
+    waiting_transports = malloc((waiting_count + 1) * sizeof(Transport));
+    if(waiting_transports == NULL) {
+        perror("malloc() error!");
+        exit(1);
+    }
+    waiting_size = waiting_count;
+    for(size_t i = 0; i < waiting_size; ++i) {
+        waiting_transports[i] = (Transport)readByte(reader);
+    }
+    *socket_count += waiting_size;
+    return reader->error ? -1 : 0;
+}
+
+// sockets come in the same order as their descriptions in blob
+static void assignSockets(const int* fds) {
+    size_t next = 0;
+    for(size_t i = 0; i < listeners_size; ++i) {
+        listeners[i] = fds[next++];
+    }
+    if(udp_socket == -2) {
+        udp_socket = fds[next++];
+    }
+    for(size_t i = 0; i < UNIX_LISTENERS; ++i) {
+        if(unix_listeners[i] == -2) {
+            unix_listeners[i] = fds[next++];
+        }
+    }
+    for(size_t i = 0; i < clients_size; ++i) {
+        clients[i].socket = fds[next++];
+    }
+    for(size_t i = 0; i < waiting_size; ++i) {
+        waiting_sockets[i] = fds[next++];
+    }
+}
+
+static int receiveHandoff(int handoff_socket, unsigned char** snapshot, size_t* snapshot_size) {
+    const ServerConfig* config = getServerConfig();
+    uint64_t blob_size;
+    if(receiveAll(handoff_socket, &blob_size, sizeof(blob_size)) != 0) {
+        return -1;
+    }
+    unsigned char* blob = malloc(blob_size > 0 ? blob_size : 1);
+    if(blob == NULL) {
+        perror("malloc() error!");
+        exit(1);
+    }
+    BlobReader reader = {.data = blob, .size = blob_size};
+    size_t old_port, old_udp_port, socket_count;
+    if(receiveAll(handoff_socket, blob, blob_size) != 0 || parseHandoff(&reader, &old_port, &old_udp_port, &socket_count) != 0) {
+        fprintf(stderr, "Handoff: wrong data from old server\n");
+        free(blob);
+        return -1;
+    }
+    size_t size = readSize(&reader);
+    const unsigned char* snapshot_bytes = readBytes(&reader, size);
+    int* fds = malloc((socket_count + 1) * sizeof(int));
+    if(snapshot_bytes == NULL || fds == NULL || receiveSockets(handoff_socket, fds, socket_count) != 0) {
+        free(fds);
+        free(blob);
+        return -1;
+    }
+    assignSockets(fds);
+    free(fds);
+    // sockets bound to other port than configured one aren't used
+    if(old_port != config->port) {
+        listeners_taken = listeners_size;
+    }
+    if(old_udp_port != config->udp_port && udp_socket != -1) {
+        close(udp_socket);
+        udp_socket = -1;
+    }
+    *snapshot = malloc(size > 0 ? size : 1);
+    if(*snapshot == NULL) {
+        perror("malloc() error!");
+        exit(1);
+    }
+    memcpy(*snapshot, snapshot_bytes, size);
+    *snapshot_size = size;
+    free(blob);
+    return 0;
+}
+
+int takeOverServer(unsigned char** snapshot, size_t* snapshot_size) {
+    const char* path = getServerConfig()->handoff_socket_path;
+    if(path[0] == '\0') {
+        return 1;
+    }
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+    strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+    int handoff_socket = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(handoff_socket == -1) {
+        perror("socket(AF_UNIX) error");
+        return -1;
+    }
+    // nobody listens, server starts without clients
+    if(connect(handoff_socket, (struct sockaddr*)&address, sizeof(address)) == -1) {
+        close(handoff_socket);
+        return 1;
+    }
+    printf("Taking over server on handoff socket: %s\n", path);
+    struct timeval timeout = {.tv_sec = HANDOFF_TIMEOUT_S};
+    setsockopt(handoff_socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    int result = receiveHandoff(handoff_socket, snapshot, snapshot_size);
+    close(handoff_socket);
+    if(result != 0) {
+        clearHandoff();
+        return -1;
+    }
+    printf("Took over %zu clients(%zu waiting), %zu B of game state\n", clients_size, waiting_size, *snapshot_size);
+    return 0;
+}
+
+int takeHandedOffListener() {
+    if(listeners_taken >= listeners_size) {
+        return -1;
+    }
+    int listener = listeners[listeners_taken];
+    listeners[listeners_taken++] = -1;
+    return listener;
+}
+
+int takeHandedOffUnixListener(Transport transport, const char* path) {
+    size_t index = transport == TRANSPORT_UNIX ? 0 : 1;
+    int listener = unix_listeners[index];
+    if(listener == -1 || strcmp(unix_paths[index], path) != 0) {
+        return -1;
+    }
+    unix_listeners[index] = -1;
+    return listener;
+}
+
+int takeHandedOffUdpSocket() {
+    int taken = udp_socket;
+    udp_socket = -1;
+    return taken;
+}
+
+size_t handedOffClientCount() {
+    return clients_size;
+}
+
+HandedOffClient* handedOffClient(size_t index) {
+    return &clients[index];
+}
+
+int takeHandedOffWaiting(Transport* transport) {
+    if(waiting_taken >= waiting_size) {
+        return -1;
+    }
+    *transport = waiting_transports[waiting_taken];
+    int waiting_socket = waiting_sockets[waiting_taken];
+    waiting_sockets[waiting_taken++] = -1;
+    return waiting_socket;
+}
+
+size_t handedOffBroadcastSequence() {
+    return broadcast_sequence;
+}
+
+void clearHandoff() {
+    for(size_t i = 0; i < listeners_size; ++i) {
+        if(listeners[i] >= 0) {
+            close(listeners[i]);
+        }
+    }
+    if(udp_socket >= 0) {
+        close(udp_socket);
+    }
+    udp_socket = -1;
+    for(size_t i = 0; i < UNIX_LISTENERS; ++i) {
+        if(unix_listeners[i] >= 0) {
+            close(unix_listeners[i]);
+        }
+        unix_listeners[i] = -1;
+    }
+    for(size_t i = 0; i < clients_size; ++i) {
+        if(clients[i].socket >= 0) {
+            close(clients[i].socket);
+        }
+        free(clients[i].input.data);
+        free(clients[i].output.data);
+    }
+    for(size_t i = 0; i < waiting_size; ++i) {
+        if(waiting_sockets[i] >= 0) {
+            close(waiting_sockets[i]);
+        }
+    }
+    free(listeners);
+    free(clients);
+    free(waiting_sockets);
+    free(waiting_transports);
+    listeners = NULL;
+    clients = NULL;
+    waiting_sockets = NULL;
+    waiting_transports = NULL;
+    listeners_size = listeners_taken = clients_size = waiting_size = waiting_taken = 0;
+}
@@ -0,0 +1,47 @@
+#ifndef SERVER_HANDOFF_H
+#define SERVER_HANDOFF_H
+#include "server_connection.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// Zero-downtime restart. Old server sends over handoff socket one blob(description of listening sockets, clients
+// with their unparsed and unsent bytes, snapshot of host's game) and then every socket with SCM_RIGHTS.
+// New server uses taken over sockets in its next runServer()
+
+typedef struct {
+    // -1 after connection took it
+    int socket;
+    size_t client_id;
+    size_t room;
+    Transport transport;
+    bool udp_ready;
+    uint32_t udp_token;
+    struct sockaddr_in udp_address;
+    // start of frame old server received only partially
+    Message input;
+    // rest of old outbound queue, sent before anything else. Owned by connection after adoption
+    Message output;
+} HandedOffClient;
+
+// opens listening socket on handoff_socket_path if it's set, returns 0 if it's off or was opened
+int openHandoffListener();
+void closeHandoffListener();
+// true after handOffServer() succeeded, Unix socket files belong to new server then
+bool isHandedOff();
+// Functions below give sockets taken over by takeOverServer(), ownership goes to caller.
+// next TCP listening socket or -1, they are given only if port didn't change
+int takeHandedOffListener();
+// Unix listening socket of transport if old server listened on the same path, otherwise -1
+int takeHandedOffUnixListener(Transport transport, const char* path);
+// UDP socket if udp_port didn't change, otherwise -1
+int takeHandedOffUdpSocket();
+size_t handedOffClientCount();
+HandedOffClient* handedOffClient(size_t index);
+// connection that waited for free place in old server or -1 if there are no more
+int takeHandedOffWaiting(Transport* transport);
+// number of game states old server sent, UDP sequence numbers continue from it
+size_t handedOffBroadcastSequence();
+// closes sockets nobody took and frees everything
+void clearHandoff();
+
+#endif
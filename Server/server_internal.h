@@ -1,24 +1,32 @@
 #ifndef SERVER_INTERNAL_H
 #define SERVER_INTERNAL_H
 #include "server_common.h"
-#include "server_array.h"
+#include "server_connection.h"
 
-typedef enum {RUNNING, STOP, STOPPED} ThreadStatus;
-
-typedef struct {
-    pthread_t thread_id;
-    int socket;
-    ThreadStatus status;
-} Client;
+// client_id = generation << CLIENT_SLOT_BITS | slot, slot fits uint16_t player id sent to clients
+#define CLIENT_SLOT_BITS 16
 
 void printThreadDebugInformation(const char* msg);
 void freeOutgoingMessage(Message message);
-void addClient(int client_socket);
+// client registry(server_clients.c), created by runServer() before reactors start
+void initClients();
+void destroyClients();
+// takes reference to connection and sets connection->client_id, returns 1 if every slot is used
+int addClient(Connection* connection);
+// like addClient() but client keeps client_id given by old server(server_handoff.c).
+// returns 1 if slot doesn't exist or is used
+int addClientWithId(Connection* connection, size_t client_id);
+// called by reactor after connection was closed, releases registry reference and frees slot
 void stopClient(size_t client_id);
-void signalClientToStop(size_t client_id);
-Client getClient(size_t client_id);
-// returns a copy. Needs to be destroyed after use!!!
-Array getAllClients();
-ThreadStatus getClientStatus(size_t client_id);
+// shuts down client socket so reactor owning it will close connection.
+// returns false if client was already stopping
+bool signalClientToStop(size_t client_id);
+// returns connection with acquired reference or NULL if client isn't running. Release after use
+Connection* acquireClientConnection(size_t client_id);
+// sender shard of client, slot % sender_threads
+size_t clientShard(size_t client_id);
+// calls function for every running client of sender shard without copying or locking registry,
+// O(running clients of shard). function can't block, add or stop clients
+void forEachShardConnection(size_t shard, void (*function)(Connection* connection, void* argument), void* argument);
 
 #endif
@@ -0,0 +1,99 @@
+#include "server_latency.h"
+#include "server.h"
+#include "server_config.h"
+#include <linux/net_tstamp.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+
+typedef struct {
+    atomic_size_t samples;
+    atomic_size_t total_us;
+    atomic_size_t max_us;
+    atomic_size_t histogram[LATENCY_BUCKETS];
+} StageCounters;
+
+static StageCounters stages[LATENCY_STAGES];
+
+void initLatencyStats() {
+    for(size_t i = 0; i < LATENCY_STAGES; ++i) {
+        atomic_store(&stages[i].samples, 0);
+        atomic_store(&stages[i].total_us, 0);
+        atomic_store(&stages[i].max_us, 0);
+        for(size_t j = 0; j < LATENCY_BUCKETS; ++j) {
+            atomic_store(&stages[i].histogram[j], 0);
+        }
+    }
+}
+
+uint64_t latencyNow() {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+void recordLatency(LatencyStage stage, uint64_t start_ns, uint64_t end_ns) {
+    if(start_ns == 0 || stage >= LATENCY_STAGES || getServerConfig()->latency_timestamps == false) {
+        return;
+    }
+    // realtime clock can step back
+    size_t latency_us = end_ns > start_ns ? (size_t)((end_ns - start_ns) / 1000) : 0;
+    StageCounters* counters = &stages[stage];
+    atomic_fetch_add_explicit(&counters->samples, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&counters->total_us, latency_us, memory_order_relaxed);
+    size_t max_us = atomic_load_explicit(&counters->max_us, memory_order_relaxed);
+    while(latency_us > max_us
+          && !atomic_compare_exchange_weak_explicit(&counters->max_us, &max_us, latency_us, memory_order_relaxed, memory_order_relaxed)) {
+    }
+    size_t bucket = 0;
+    for(size_t limit = 16; bucket < LATENCY_BUCKETS - 1 && latency_us >= limit; limit *= 4) {
+        ++bucket;
+    }
+    atomic_fetch_add_explicit(&counters->histogram[bucket], 1, memory_order_relaxed);
+}
+
+void getLatencyStats(LatencyStageStats* stats) {
+    for(size_t i = 0; i < LATENCY_STAGES; ++i) {
+        stats[i].samples = atomic_load(&stages[i].samples);
+        stats[i].total_us = atomic_load(&stages[i].total_us);
+        stats[i].max_us = atomic_load(&stages[i].max_us);
+        for(size_t j = 0; j < LATENCY_BUCKETS; ++j) {
+            stats[i].histogram[j] = atomic_load(&stages[i].histogram[j]);
+        }
+    }
+}
+
+void enableSocketTimestamps(Connection* connection) {
+    // send timestamps are generated only for sendmsg() calls with requestSendTimestamp()
+    int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE | SOF_TIMESTAMPING_OPT_TSONLY;
+    if(setsockopt(connection->socket, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) == -1) {
+        perror("setsockopt(SO_TIMESTAMPING) error");
+        return;
+    }
+    connection->timestamps = true;
+}
+
+uint64_t readKernelTimestamp(struct msghdr* msg) {
+    for(struct cmsghdr* cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+        if(cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPING) {
+            // software timestamp is first of three
+            struct timespec software;
+            memcpy(&software, CMSG_DATA(cmsg), sizeof(software));
+            return (uint64_t)software.tv_sec * 1000000000u + (uint64_t)software.tv_nsec;
+        }
+    }
+    return 0;
+}
+
+void requestSendTimestamp(struct msghdr* msg, char* control) {
+    memset(control, 0, LATENCY_CONTROL_SIZE);
+    msg->msg_control = control;
+    msg->msg_controllen = CMSG_SPACE(sizeof(uint32_t));
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SO_TIMESTAMPING;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(uint32_t));
+    uint32_t flags = SOF_TIMESTAMPING_TX_SOFTWARE;
+    memcpy(CMSG_DATA(cmsg), &flags, sizeof(flags));
+}
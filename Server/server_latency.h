@@ -0,0 +1,22 @@
+#ifndef SERVER_LATENCY_H
+#define SERVER_LATENCY_H
+#include "server_connection.h"
+#include <sys/socket.h>
+#include <stdint.h>
+
+// Input latency accounting(latency_timestamps). Times are CLOCK_REALTIME nanoseconds, kernel uses it
+// for SO_TIMESTAMPING, so kernel and user space times can be subtracted
+
+// zeroes statistics, called by runServer()
+void initLatencyStats();
+// kernel timestamps for frames received from socket and for sendmsg() calls that ask for them(TCP only)
+void enableSocketTimestamps(Connection* connection);
+// room for SCM_TIMESTAMPING control message
+#define LATENCY_CONTROL_SIZE CMSG_SPACE(sizeof(struct timespec) * 3)
+// kernel software timestamp from control messages of recvmsg(), 0 if there is none
+uint64_t readKernelTimestamp(struct msghdr* msg);
+// adds SO_TIMESTAMPING control message asking kernel for send timestamp of this sendmsg().
+// control needs LATENCY_CONTROL_SIZE bytes
+void requestSendTimestamp(struct msghdr* msg, char* control);
+
+#endif
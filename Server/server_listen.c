@@ -1,55 +1,208 @@
+// accept4()
+#define _GNU_SOURCE
 #include "server_listen.h"
 #include "server_internal.h"
+#include "server_config.h"
+#include "server_mutex.h"
+#include <limits.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <pthread.h>
-#include <poll.h>
 #include <errno.h>
 
+// waiting connections and number of admitted players, shared by every reactor
+static pthread_mutex_t admission_mutex = PTHREAD_MUTEX_INITIALIZER;
+static size_t players = 0;
+typedef struct {
+    int socket;
+    Transport transport;
+} WaitingConnection;
+
+// FIFO of accepted sockets waiting for free player place, waiting_queue_size long
+static WaitingConnection* waiting = NULL;
+static size_t waiting_first = 0;
+static size_t waiting_size = 0;
+
 // copied from socket-server.c on enauczanie
-void* startListening(void* arg) {
-    printThreadDebugInformation("startListening()");
-    int listenfd = 0, connfd = 0;
+int openListeningSocket(bool print_port) {
+    printThreadDebugInformation("openListeningSocket()");
+    const ServerConfig* config = getServerConfig();
+    int listenfd = 0;
 	struct sockaddr_in serv_addr;
 
-    listenfd = socket(AF_INET, SOCK_STREAM, 0);
+    listenfd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(listenfd == -1) {
+        perror("socket() error");
+        return -1;
+    }
+    // every reactor has its own socket bound to the same port, kernel spreads connections between them.
+    // SO_REUSEADDR allows restarting server while old connections are in TIME_WAIT
+    int enable = 1;
+    if(setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable)) == -1
+            || setsockopt(listenfd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) == -1) {
+        perror("setsockopt(SO_REUSEPORT) error");
+        close(listenfd);
+        return -1;
+    }
 	
 	memset(&serv_addr, '0', sizeof(serv_addr));
 
 	serv_addr.sin_family = AF_INET;
 	serv_addr.sin_addr.s_addr = htonl(INADDR_ANY);
-	serv_addr.sin_port = htons(5000); 
-
-	bind(listenfd, (struct sockaddr*)&serv_addr, sizeof(serv_addr));
-    printf("Server listening on port: 5000\n");
-    listen(listenfd, 10);
-    struct pollfd file_descriptor = {.fd = listenfd, .events = POLLIN};
-
-	while(isStopped() == false) {
-        int return_poll = poll(&file_descriptor, 1, 2000);
-        if(return_poll < 0 && errno != EINTR) {
-            perror("poll() error");
-            break;
-        }
-        else if(return_poll == 1) {
-            if(file_descriptor.revents & POLLIN) {
-                connfd = accept(listenfd, (struct sockaddr*)NULL, NULL);
-                if(connfd < 0) {
-                    perror("accept() error");
-                } else {
-                    addClient(connfd);
-                }
-            }
-            else {
-                printf("File descriptor revents unknown: %d", file_descriptor.revents);
-            }
+	serv_addr.sin_port = htons((uint16_t)config->port); 
+
+	if(bind(listenfd, (struct sockaddr*)&serv_addr, sizeof(serv_addr)) == -1) {
+        perror("bind() error");
+        close(listenfd);
+        return -1;
+    }
+    if(print_port) {
+        printf("Server listening on port: %ld\n", config->port);
+    }
+    if(listen(listenfd, config->listen_backlog > INT_MAX ? INT_MAX : (int)config->listen_backlog) == -1) {
+        perror("listen() error");
+        close(listenfd);
+        return -1;
+    }
+    return listenfd;
+}
+
+int openUnixListeningSocket(const char* path) {
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+    strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+    int listenfd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(listenfd == -1) {
+        perror("socket(AF_UNIX) error");
+        return -1;
+    }
+    // file left by server that didn't stop cleanly
+    unlink(path);
+    if(bind(listenfd, (struct sockaddr*)&address, sizeof(address)) == -1) {
+        perror("bind(AF_UNIX) error");
+        close(listenfd);
+        return -1;
+    }
+    size_t backlog = getServerConfig()->listen_backlog;
+    if(listen(listenfd, backlog > INT_MAX ? INT_MAX : (int)backlog) == -1) {
+        perror("listen(AF_UNIX) error");
+        closeUnixListeningSocket(listenfd, path);
+        return -1;
+    }
+    printf("Server listening on Unix socket: %s\n", path);
+    return listenfd;
+}
+
+void closeUnixListeningSocket(int listen_socket, const char* path) {
+    close(listen_socket);
+    unlink(path);
+}
+
+int acceptConnection(int listen_socket) {
+    int connfd = accept4(listen_socket, (struct sockaddr*)NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if(connfd < 0) {
+        if(errno != EAGAIN && errno != EINTR && errno != ECONNABORTED) {
+            perror("accept() error");
         }
-	}
-    close(listenfd);
-    return NULL;
+        return -1;
+    }
+    return connfd;
+}
+
+static size_t maxPlayers() {
+    const ServerConfig* config = getServerConfig();
+    return config->max_players == 0 || config->max_players > config->max_clients ? config->max_clients : config->max_players;
+}
+
+void initAdmission() {
+    nameMutex(&admission_mutex, "admission_mutex");
+    players = 0;
+    waiting_first = 0;
+    waiting_size = 0;
+    size_t capacity = getServerConfig()->waiting_queue_size;
+    waiting = malloc((capacity > 0 ? capacity : 1) * sizeof(WaitingConnection));
+    if(waiting == NULL) {
+        perror("malloc() error!");
+        exit(1);
+    }
+}
+
+void clearAdmission() {
+    for(size_t i = 0; i < waiting_size; ++i) {
+        close(waiting[(waiting_first + i) % getServerConfig()->waiting_queue_size].socket);
+    }
+    waiting_size = 0;
+    free(waiting);
+    waiting = NULL;
+}
+
+bool admitConnection(int client_socket, Transport transport) {
+    size_t capacity = getServerConfig()->waiting_queue_size;
+    bool admitted = false;
+    lockMutex(&admission_mutex);
+    if(players < maxPlayers()) {
+        ++players;
+        admitted = true;
+    } else if(waiting_size < capacity) {
+        waiting[(waiting_first + waiting_size) % capacity] = (WaitingConnection){client_socket, transport};
+        ++waiting_size;
+    } else {
+        printf("Server is full(%ld players, %ld waiting), connection refused\n", players, waiting_size);
+        close(client_socket);
+    }
+    unlockMutex(&admission_mutex);
+    return admitted;
+}
+
+// admission_mutex needs to be locked
+static int popWaiting(Transport* transport) {
+    if(waiting_size == 0) {
+        return -1;
+    }
+    int client_socket = waiting[waiting_first].socket;
+    *transport = waiting[waiting_first].transport;
+    waiting_first = (waiting_first + 1) % getServerConfig()->waiting_queue_size;
+    --waiting_size;
+    return client_socket;
+}
+
+int takeWaitingConnection(Transport* transport) {
+    lockMutex(&admission_mutex);
+    int client_socket = popWaiting(transport);
+    if(client_socket == -1) {
+        --players;
+    }
+    unlockMutex(&admission_mutex);
+    return client_socket;
+}
+
+int popWaitingConnection(Transport* transport) {
+    lockMutex(&admission_mutex);
+    int client_socket = popWaiting(transport);
+    unlockMutex(&admission_mutex);
+    return client_socket;
+}
+
+void countAdmittedConnection() {
+    lockMutex(&admission_mutex);
+    ++players;
+    unlockMutex(&admission_mutex);
+}
+
+void releaseAdmission() {
+    lockMutex(&admission_mutex);
+    --players;
+    unlockMutex(&admission_mutex);
+}
+
+void getAdmissionLoad(size_t* admitted, size_t* waiting_connections, size_t* max_players) {
+    lockMutex(&admission_mutex);
+    *admitted = players;
+    *waiting_connections = waiting_size;
+    unlockMutex(&admission_mutex);
+    *max_players = maxPlayers();
 }
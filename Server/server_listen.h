@@ -1,7 +1,33 @@
 #ifndef SERVER_LISTEN_H
 #define SERVER_LISTEN_H
+#include <stdbool.h>
+#include <stddef.h>
+#include "server_connection.h"
 
-// arg is unused, returns NULL;
-void* startListening(void*);
+// returns non-blocking listening socket bound with SO_REUSEPORT to configured port or -1 on error
+int openListeningSocket(bool print_port);
+// returns non-blocking listening Unix domain socket bound to path(existing file is removed) or -1 on error
+int openUnixListeningSocket(const char* path);
+// closes socket and removes its file
+void closeUnixListeningSocket(int listen_socket, const char* path);
+// accepts one waiting connection, returns non-blocking client socket or -1 if there was none/error
+int acceptConnection(int listen_socket);
+
+// admission control, at most max_players connections become clients, next ones wait in FIFO
+void initAdmission();
+// closes sockets that are still waiting
+void clearAdmission();
+// returns true if client_socket can become client now, otherwise it's queued or closed when queue is full
+bool admitConnection(int client_socket, Transport transport);
+// called after client left. Returns waiting socket that took its place(and sets *transport) or -1 if nobody waits
+int takeWaitingConnection(Transport* transport);
+// called if admitted connection couldn't become client
+void releaseAdmission();
+// counts client taken over from old server as admitted player
+void countAdmittedConnection();
+// removes first waiting connection without changing admitted players(handoff), -1 if nobody waits
+int popWaitingConnection(Transport* transport);
+// copies number of admitted players, waiting connections and max_players(after limiting to max_clients)
+void getAdmissionLoad(size_t* admitted, size_t* waiting_connections, size_t* max_players);
 
 #endif
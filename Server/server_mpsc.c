@@ -0,0 +1,203 @@
+#include "server_mpsc.h"
+#include "server_wakeup.h"
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <stdatomic.h>
+
+#define MPSC_CACHE_LINE 64
+
+struct MpscQueue {
+    // producers and consumer positions are on separate cache lines
+    _Alignas(MPSC_CACHE_LINE) atomic_size_t enqueue_position;
+    // written only by consumer, atomic so mpscIsEmpty() can be called from any thread
+    _Alignas(MPSC_CACHE_LINE) atomic_size_t dequeue_position;
+    // 1 while consumer sleeps on wakeup
+    atomic_int consumer_sleeping;
+    // set by mpscInterrupt(), cleared by consumer
+    atomic_bool interrupted;
+    Wakeup wakeup;
+    _Alignas(MPSC_CACHE_LINE) unsigned char* slots;
+    size_t slot_size;
+    size_t element_size;
+    // capacity - 1, capacity is power of 2
+    size_t mask;
+};
+
+// every slot starts with sequence number: position + 1 when it's full, position + capacity when it's free
+typedef struct {
+    atomic_size_t sequence;
+} SlotHeader;
+
+static SlotHeader* slotAt(MpscQueue* queue, size_t position) {
+    return (SlotHeader*)(queue->slots + (position & queue->mask) * queue->slot_size);
+}
+
+static void* slotData(SlotHeader* slot) {
+    return (unsigned char*)slot + sizeof(SlotHeader);
+}
+
+MpscQueue* mpscCreate(size_t element_size, size_t capacity) {
+    MpscQueue* queue = aligned_alloc(MPSC_CACHE_LINE, sizeof(MpscQueue));
+    if(queue == NULL) {
+        perror("aligned_alloc() error!");
+        exit(1);
+    }
+    size_t rounded = 2;
+    while(rounded < capacity) {
+        rounded *= 2;
+    }
+    size_t alignment = _Alignof(max_align_t);
+    queue->element_size = element_size;
+    queue->slot_size = (sizeof(SlotHeader) + element_size + alignment - 1) / alignment * alignment;
+    queue->mask = rounded - 1;
+    queue->slots = aligned_alloc(MPSC_CACHE_LINE, (queue->slot_size * rounded + MPSC_CACHE_LINE - 1)
+                                                  / MPSC_CACHE_LINE * MPSC_CACHE_LINE);
+    if(queue->slots == NULL) {
+        perror("aligned_alloc() error!");
+        exit(1);
+    }
+    for(size_t i = 0; i < rounded; ++i) {
+        atomic_init(&slotAt(queue, i)->sequence, i);
+    }
+    atomic_init(&queue->enqueue_position, 0);
+    atomic_init(&queue->dequeue_position, 0);
+    atomic_init(&queue->consumer_sleeping, 0);
+    atomic_init(&queue->interrupted, false);
+    if(wakeupInit(&queue->wakeup) != 0) {
+        exit(1);
+    }
+    return queue;
+}
+
+void mpscDestroy(MpscQueue* queue) {
+    wakeupDestroy(&queue->wakeup);
+    free(queue->slots);
+    free(queue);
+}
+
+static void wakeConsumer(MpscQueue* queue) {
+    // pairs with fence in mpscPop(), either consumer sees new element or producer sees it sleeping
+    atomic_thread_fence(memory_order_seq_cst);
+    if(atomic_load_explicit(&queue->consumer_sleeping, memory_order_relaxed) == 1
+            && atomic_exchange(&queue->consumer_sleeping, 0) == 1) {
+        wakeupSignal(&queue->wakeup);
+    }
+}
+
+bool mpscTryPush(MpscQueue* queue, const void* element) {
+    size_t position = atomic_load_explicit(&queue->enqueue_position, memory_order_relaxed);
+    SlotHeader* slot;
+    while(true) {
+        slot = slotAt(queue, position);
+        size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+        if(difference == 0) {
+            if(atomic_compare_exchange_weak_explicit(&queue->enqueue_position, &position, position + 1,
+                                                     memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if(difference < 0) {
+            return false;
+        } else {
+            position = atomic_load_explicit(&queue->enqueue_position, memory_order_relaxed);
+        }
+    }
+    memcpy(slotData(slot), element, queue->element_size);
+    atomic_store_explicit(&slot->sequence, position + 1, memory_order_release);
+    wakeConsumer(queue);
+    return true;
+}
+
+bool mpscPush(MpscQueue* queue, const void* element, bool (*cancelled)()) {
+    while(mpscTryPush(queue, element) == false) {
+        if(cancelled != NULL && cancelled()) {
+            return false;
+        }
+        sched_yield();
+    }
+    return true;
+}
+
+bool mpscTryPop(MpscQueue* queue, void* buf) {
+    size_t position = atomic_load_explicit(&queue->dequeue_position, memory_order_relaxed);
+    SlotHeader* slot = slotAt(queue, position);
+    if(atomic_load_explicit(&slot->sequence, memory_order_acquire) != position + 1) {
+        return false;
+    }
+    memcpy(buf, slotData(slot), queue->element_size);
+    atomic_store_explicit(&slot->sequence, position + queue->mask + 1, memory_order_release);
+    atomic_store_explicit(&queue->dequeue_position, position + 1, memory_order_relaxed);
+    return true;
+}
+
+static long remainingMilliseconds(const struct timespec* deadline) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (deadline->tv_sec - now.tv_sec) * 1000 + (deadline->tv_nsec - now.tv_nsec) / 1000000;
+}
+
+bool mpscPop(MpscQueue* queue, void* buf, long timeout_ms) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (timeout_ms % 1000) * 1000000;
+    if(deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec += 1;
+        deadline.tv_nsec -= 1000000000;
+    }
+    while(mpscTryPop(queue, buf) == false) {
+        if(atomic_exchange(&queue->interrupted, false)) {
+            return false;
+        }
+        long remaining = timeout_ms < 0 ? -1 : remainingMilliseconds(&deadline);
+        if(timeout_ms >= 0 && remaining <= 0) {
+            return false;
+        }
+        atomic_store(&queue->consumer_sleeping, 1);
+        atomic_thread_fence(memory_order_seq_cst);
+        if(mpscIsEmpty(queue) == false || atomic_load(&queue->interrupted)) {
+            atomic_store(&queue->consumer_sleeping, 0);
+            continue;
+        }
+        // signal left by producer that saw consumer sleeping before it woke up only makes one more loop
+        wakeupWait(&queue->wakeup, remaining);
+        atomic_store(&queue->consumer_sleeping, 0);
+    }
+    return true;
+}
+
+void mpscInterrupt(MpscQueue* queue) {
+    atomic_store(&queue->interrupted, true);
+    wakeupSignal(&queue->wakeup);
+}
+
+size_t mpscPopMany(MpscQueue* queue, void* buf, size_t max_elements, long timeout_ms) {
+    if(max_elements == 0 || mpscPop(queue, buf, timeout_ms) == false) {
+        return 0;
+    }
+    size_t popped = 1;
+    while(popped < max_elements && mpscTryPop(queue, (unsigned char*)buf + popped * queue->element_size)) {
+        ++popped;
+    }
+    return popped;
+}
+
+bool mpscIsEmpty(MpscQueue* queue) {
+    size_t position = atomic_load_explicit(&queue->dequeue_position, memory_order_relaxed);
+    return atomic_load_explicit(&slotAt(queue, position)->sequence, memory_order_acquire) != position + 1;
+}
+
+size_t mpscSize(MpscQueue* queue) {
+    // enqueue position read later can't be smaller
+    size_t dequeue_position = atomic_load(&queue->dequeue_position);
+    size_t enqueue_position = atomic_load(&queue->enqueue_position);
+    return enqueue_position - dequeue_position;
+}
+
+size_t mpscCapacity(const MpscQueue* queue) {
+    return queue->mask + 1;
+}
@@ -0,0 +1,43 @@
+#ifndef SERVER_MPSC_H
+#define SERVER_MPSC_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdbool.h>
+
+// Bounded multi-producer single-consumer ring queue. Elements are copied into preallocated slots,
+// so push and pop don't allocate or lock. Only one thread can pop at a time.
+// Each queue created with mpscCreate needs to be destroyed by mpscDestroy
+typedef struct MpscQueue MpscQueue;
+
+// capacity is rounded up to power of 2
+MpscQueue* mpscCreate(size_t element_size, size_t capacity);
+// not thread safe! Elements left in queue aren't freed
+void mpscDestroy(MpscQueue* queue);
+// copies *element into queue and wakes consumer, returns false if queue is full
+bool mpscTryPush(MpscQueue* queue, const void* element);
+// like mpscTryPush but yields until there is free slot. Returns false without pushing once cancelled() returns true,
+// NULL cancelled waits forever
+bool mpscPush(MpscQueue* queue, const void* element, bool (*cancelled)());
+// copies first element into *buf, returns false if queue is empty
+bool mpscTryPop(MpscQueue* queue, void* buf);
+// waits up to timeout_ms for element(-1 waits forever), returns false on timeout or after mpscInterrupt()
+bool mpscPop(MpscQueue* queue, void* buf, long timeout_ms);
+// makes waiting(or next waiting) mpscPop() of empty queue return false right away, can be called from any thread
+void mpscInterrupt(MpscQueue* queue);
+// waits like mpscPop for first element, then copies without waiting up to max_elements elements into buf.
+// returns number of copied elements
+size_t mpscPopMany(MpscQueue* queue, void* buf, size_t max_elements, long timeout_ms);
+// can be called from any thread
+bool mpscIsEmpty(MpscQueue* queue);
+// number of elements including pushes in progress, can be called from any thread
+size_t mpscSize(MpscQueue* queue);
+size_t mpscCapacity(const MpscQueue* queue);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
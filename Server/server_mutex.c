@@ -1,7 +1,115 @@
 #include "server_mutex.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
 #include <errno.h>
+#include <time.h>
+#include <stdatomic.h>
+
+// mutexes that can be profiled at the same time, power of 2
+#define LOCK_TABLE_SIZE 1024
+#define MAX_LOCK_PROFILES 32
+// wait and hold times under 1, 4, 16, 64, 256, 1024, 4096 us and longer
+#define LOCK_HISTOGRAM_BUCKETS 8
+// key of table entry whose mutex was destroyed, lookups go past it
+#define REMOVED_MUTEX ((pthread_mutex_t*)1)
+
+typedef struct {
+    const char* name;
+    atomic_size_t acquisitions;
+    atomic_size_t contended;
+    atomic_size_t wait_ns;
+    atomic_size_t max_wait_ns;
+    atomic_size_t hold_ns;
+    atomic_size_t max_hold_ns;
+    atomic_size_t wait_histogram[LOCK_HISTOGRAM_BUCKETS];
+    atomic_size_t hold_histogram[LOCK_HISTOGRAM_BUCKETS];
+} LockProfile;
+
+typedef struct {
+    _Atomic(pthread_mutex_t*) mutex;
+    atomic_size_t profile;
+    // used only by thread holding mutex
+    size_t depth;
+    uint64_t locked_at;
+    LockSite* site;
+} LockEntry;
+
+// open addressing table from mutex address to its entry, entries are added and removed under registry_mutex
+static LockEntry entries[LOCK_TABLE_SIZE];
+static LockProfile profiles[MAX_LOCK_PROFILES] = {{.name = "unnamed"}};
+static size_t profiles_size = 1;
+// every call site that was profiled
+static _Atomic(LockSite*) sites = NULL;
+// not profiled, protects registration
+static pthread_mutex_t registry_mutex = PTHREAD_MUTEX_INITIALIZER;
+static atomic_bool profiling = false;
+
+static size_t hashMutex(const pthread_mutex_t* mutex) {
+    return (size_t)(((uintptr_t)mutex >> 4) * 11400714819323198485ull >> 32) & (LOCK_TABLE_SIZE - 1);
+}
+
+static LockEntry* findEntry(const pthread_mutex_t* mutex) {
+    size_t index = hashMutex(mutex);
+    for(size_t i = 0; i < LOCK_TABLE_SIZE; ++i) {
+        LockEntry* entry = &entries[(index + i) & (LOCK_TABLE_SIZE - 1)];
+        pthread_mutex_t* key = atomic_load_explicit(&entry->mutex, memory_order_acquire);
+        if(key == mutex) {
+            return entry;
+        } else if(key == NULL) {
+            return NULL;
+        }
+    }
+    return NULL;
+}
+
+// registry_mutex needs to be locked
+static size_t findProfile(const char* name) {
+    for(size_t i = 0; i < profiles_size; ++i) {
+        if(strcmp(profiles[i].name, name) == 0) {
+            return i;
+        }
+    }
+    if(profiles_size == MAX_LOCK_PROFILES) {
+        return 0;
+    }
+    profiles[profiles_size].name = name;
+    return profiles_size++;
+}
+
+// registers mutex or changes its name, mutex isn't profiled if table is full
+static void registerMutex(pthread_mutex_t* mutex, const char* name) {
+    pthread_mutex_lock(&registry_mutex);
+    size_t profile = findProfile(name);
+    LockEntry* entry = findEntry(mutex);
+    if(entry == NULL) {
+        size_t index = hashMutex(mutex);
+        for(size_t i = 0; i < LOCK_TABLE_SIZE; ++i) {
+            LockEntry* free_entry = &entries[(index + i) & (LOCK_TABLE_SIZE - 1)];
+            pthread_mutex_t* key = atomic_load(&free_entry->mutex);
+            if(key == NULL || key == REMOVED_MUTEX) {
+                entry = free_entry;
+                break;
+            }
+        }
+    }
+    if(entry != NULL) {
+        entry->depth = 0;
+        atomic_store(&entry->profile, profile);
+        atomic_store_explicit(&entry->mutex, mutex, memory_order_release);
+    }
+    pthread_mutex_unlock(&registry_mutex);
+}
+
+static void unregisterMutex(pthread_mutex_t* mutex) {
+    pthread_mutex_lock(&registry_mutex);
+    LockEntry* entry = findEntry(mutex);
+    if(entry != NULL) {
+        atomic_store(&entry->mutex, REMOVED_MUTEX);
+    }
+    pthread_mutex_unlock(&registry_mutex);
+}
 
 static void setAttribute(pthread_mutexattr_t* attr, int type) {
     if ((errno = pthread_mutexattr_init(attr)) != 0) {
@@ -21,6 +129,7 @@ void initMutexWithAttribute(pthread_mutex_t* mutex, int type) {
         perror("pthread_mutex_init() error");
         exit(1);
     }
+    registerMutex(mutex, profiles[0].name);
 }
 
 void initMutex(pthread_mutex_t* mutex) {
@@ -31,18 +140,121 @@ void initRecursiveMutex(pthread_mutex_t* mutex) {
     initMutexWithAttribute(mutex, PTHREAD_MUTEX_RECURSIVE);
 }
 
+void nameMutex(pthread_mutex_t* mutex, const char* name) {
+    registerMutex(mutex, name);
+}
+
 void destroyMutex(pthread_mutex_t* mutex) {
+    unregisterMutex(mutex);
     if((errno = pthread_mutex_destroy(mutex)) != 0) {
         perror("pthread_mutex_destroy() error");
         exit(1);
     }
 }
 
-void lockMutex(pthread_mutex_t* mutex) {
+static uint64_t nowNanoseconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+static size_t histogramBucket(uint64_t nanoseconds) {
+    size_t bucket = 0;
+    for(uint64_t limit = 1000; bucket < LOCK_HISTOGRAM_BUCKETS - 1 && nanoseconds >= limit; limit *= 4) {
+        ++bucket;
+    }
+    return bucket;
+}
+
+static void atomicMax(atomic_size_t* max, size_t value) {
+    size_t current = atomic_load_explicit(max, memory_order_relaxed);
+    while(value > current && !atomic_compare_exchange_weak_explicit(max, &current, value, memory_order_relaxed,
+                                                                       memory_order_relaxed)) {
+    }
+}
+
+static void siteMax(size_t* max, size_t value) {
+    size_t current = __atomic_load_n(max, __ATOMIC_RELAXED);
+    while(value > current && !__atomic_compare_exchange_n(max, &current, value, true, __ATOMIC_RELAXED,
+                                                             __ATOMIC_RELAXED)) {
+    }
+}
+
+static void registerSite(LockSite* site) {
+    int registered = 0;
+    if(__atomic_load_n(&site->registered, __ATOMIC_RELAXED) != 0
+            || !__atomic_compare_exchange_n(&site->registered, &registered, 1, false, __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED)) {
+        return;
+    }
+    LockSite* head = atomic_load(&sites);
+    do {
+        site->next = head;
+    } while(!atomic_compare_exchange_weak(&sites, &head, site));
+}
+
+static void recordWait(LockEntry* entry, LockSite* site, uint64_t wait, bool contended) {
+    size_t profile_index = atomic_load_explicit(&entry->profile, memory_order_relaxed);
+    LockProfile* profile = &profiles[profile_index];
+    atomic_fetch_add_explicit(&profile->acquisitions, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&profile->wait_histogram[histogramBucket(wait)], 1, memory_order_relaxed);
+    registerSite(site);
+    __atomic_store_n(&site->profile, profile_index, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&site->acquisitions, 1, __ATOMIC_RELAXED);
+    if(contended) {
+        atomic_fetch_add_explicit(&profile->contended, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&profile->wait_ns, wait, memory_order_relaxed);
+        atomicMax(&profile->max_wait_ns, wait);
+        __atomic_fetch_add(&site->contended, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&site->wait_ns, wait, __ATOMIC_RELAXED);
+        siteMax(&site->max_wait_ns, wait);
+    }
+}
+
+static void recordHold(LockEntry* entry, uint64_t hold) {
+    LockProfile* profile = &profiles[atomic_load_explicit(&entry->profile, memory_order_relaxed)];
+    atomic_fetch_add_explicit(&profile->hold_ns, hold, memory_order_relaxed);
+    atomicMax(&profile->max_hold_ns, hold);
+    atomic_fetch_add_explicit(&profile->hold_histogram[histogramBucket(hold)], 1, memory_order_relaxed);
+    __atomic_fetch_add(&entry->site->hold_ns, hold, __ATOMIC_RELAXED);
+}
+
+// uncontended lock costs trylock and clock read for hold time, only contended one is timed while waiting
+static void lockProfiled(pthread_mutex_t* mutex, LockEntry* entry, LockSite* site) {
+    uint64_t wait = 0;
+    bool contended = false;
+    int err = pthread_mutex_trylock(mutex);
+    if(err == EBUSY) {
+        contended = true;
+        uint64_t start = nowNanoseconds();
+        err = pthread_mutex_lock(mutex);
+        wait = nowNanoseconds() - start;
+    }
+    if(err != 0) {
+        errno = err;
+        perror("pthread_mutex_lock() error");
+        exit(1);
+    }
+    // recursive locks are counted once, from first lock to last unlock
+    if(entry->depth++ == 0) {
+        entry->locked_at = nowNanoseconds();
+        entry->site = site;
+        recordWait(entry, site, wait, contended);
+    }
+}
+
+void lockMutexAt(pthread_mutex_t* mutex, LockSite* site) {
     #if (defined PRINT_DEBUG && PRINT_DEBUG > 0)
     printf("lockMutex:[%p], Thread: [%ld]\n", (void*)mutex, pthread_self());
     fflush(stdout);
     #endif
+    if(atomic_load_explicit(&profiling, memory_order_relaxed)) {
+        LockEntry* entry = findEntry(mutex);
+        if(entry != NULL) {
+            lockProfiled(mutex, entry, site);
+            return;
+        }
+    }
     if((errno = pthread_mutex_lock(mutex)) != 0) {
         perror("pthread_mutex_lock() error");
         exit(1);
@@ -54,8 +266,63 @@ void unlockMutex(pthread_mutex_t* mutex) {
     printf("unlockMutex:[%p], Thread: [%ld]\n", (void*)mutex, pthread_self());
     fflush(stdout);
     #endif
+    if(atomic_load_explicit(&profiling, memory_order_relaxed)) {
+        LockEntry* entry = findEntry(mutex);
+        if(entry != NULL && entry->depth > 0 && --entry->depth == 0) {
+            recordHold(entry, nowNanoseconds() - entry->locked_at);
+        }
+    }
     if((errno = pthread_mutex_unlock(mutex)) != 0) {
         perror("pthread_mutex_unlock() error");
         exit(1);
     }
 }
+
+void setLockProfiling(bool enabled) {
+    atomic_store(&profiling, enabled);
+}
+
+bool isLockProfiling() {
+    return atomic_load(&profiling);
+}
+
+static void printHistogram(const char* name, atomic_size_t* histogram) {
+    printf("    %s(<1/4/16/64/256/1024/4096 us, longer):", name);
+    for(size_t i = 0; i < LOCK_HISTOGRAM_BUCKETS; ++i) {
+        printf(" %ld", atomic_load(&histogram[i]));
+    }
+    printf("\n");
+}
+
+void printLockProfile() {
+    pthread_mutex_lock(&registry_mutex);
+    printf("Lock profile:\n");
+    for(size_t i = 0; i < profiles_size; ++i) {
+        LockProfile* profile = &profiles[i];
+        size_t acquisitions = atomic_load(&profile->acquisitions);
+        if(acquisitions == 0) {
+            continue;
+        }
+        size_t contended = atomic_load(&profile->contended);
+        printf("  %s: %ld locks, %ld contended, wait avg %.2f us max %.2f us, hold avg %.2f us max %.2f us\n",
+               profile->name, acquisitions, contended,
+               contended > 0 ? atomic_load(&profile->wait_ns) / 1000.0 / contended : 0.0,
+               atomic_load(&profile->max_wait_ns) / 1000.0,
+               atomic_load(&profile->hold_ns) / 1000.0 / acquisitions, atomic_load(&profile->max_hold_ns) / 1000.0);
+        printHistogram("wait", profile->wait_histogram);
+        printHistogram("hold", profile->hold_histogram);
+        for(LockSite* site = atomic_load(&sites); site != NULL; site = site->next) {
+            size_t site_acquisitions = __atomic_load_n(&site->acquisitions, __ATOMIC_RELAXED);
+            if(__atomic_load_n(&site->profile, __ATOMIC_RELAXED) != i || site_acquisitions == 0) {
+                continue;
+            }
+            printf("    %s:%d: %ld locks, %ld contended, wait total %.2f us max %.2f us, hold total %.2f us\n",
+                   site->file, site->line, site_acquisitions, __atomic_load_n(&site->contended, __ATOMIC_RELAXED),
+                   __atomic_load_n(&site->wait_ns, __ATOMIC_RELAXED) / 1000.0,
+                   __atomic_load_n(&site->max_wait_ns, __ATOMIC_RELAXED) / 1000.0,
+                   __atomic_load_n(&site->hold_ns, __ATOMIC_RELAXED) / 1000.0);
+        }
+    }
+    pthread_mutex_unlock(&registry_mutex);
+    fflush(stdout);
+}
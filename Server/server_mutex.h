@@ -1,11 +1,53 @@
 #ifndef SERVER_MUTEX_H
 #define SERVER_MUTEX_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 #include <pthread.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// call site of lockMutex(), one static instance for every place it's written in.
+// counters are updated with __atomic builtins(header is also used from C++) and only while profiling is on
+typedef struct LockSite {
+    const char* file;
+    int line;
+    // set on first profiled lock
+    int registered;
+    struct LockSite* next;
+    // index of named mutex locked here last time
+    size_t profile;
+    size_t acquisitions;
+    // acquisitions that had to wait for other thread
+    size_t contended;
+    size_t wait_ns;
+    size_t max_wait_ns;
+    size_t hold_ns;
+} LockSite;
 
 void initMutex(pthread_mutex_t* mutex);
 void initRecursiveMutex(pthread_mutex_t* mutex);
+// mutexes with the same name share statistics, mutex that isn't named is profiled as "unnamed".
+// can be used for mutex created with PTHREAD_MUTEX_INITIALIZER
+void nameMutex(pthread_mutex_t* mutex, const char* name);
 void destroyMutex(pthread_mutex_t* mutex);
-void lockMutex(pthread_mutex_t* mutex);
+void lockMutexAt(pthread_mutex_t* mutex, LockSite* site);
+#define lockMutex(mutex) do { \
+    static LockSite lock_site = {.file = __FILE__, .line = __LINE__}; \
+    lockMutexAt((mutex), &lock_site); \
+} while(0)
 void unlockMutex(pthread_mutex_t* mutex);
 
+// lock profiling measures wait and hold time of every named mutex and counts locks of every call site.
+// can be changed only when no mutex is locked, runServer() sets it from lock_profiling option
+void setLockProfiling(bool enabled);
+bool isLockProfiling();
+// prints statistics collected since process start to stdout
+void printLockProfile();
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif
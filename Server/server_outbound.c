@@ -0,0 +1,187 @@
+#include "server_outbound.h"
+#include "server_internal.h"
+#include <stdlib.h>
+#include <stdio.h>
+
+static size_t frameBytes(const OutboundFrame* frame) {
+    return sizeof(frame->message.size) + frame->message.size;
+}
+
+static void releaseFrame(OutboundFrame* frame) {
+    if(frame->broadcast != NULL) {
+        broadcastRelease(frame->broadcast);
+    } else if(frame->raw) {
+        free(frame->message.data);
+    } else {
+        freeOutgoingMessage(frame->message);
+    }
+}
+
+static OutboundFrame* frameAt(OutboundQueue* queue, size_t index) {
+    return &queue->frames[(queue->first + index) % queue->capacity];
+}
+
+static void grow(OutboundQueue* queue) {
+    size_t new_capacity = queue->capacity * 2;
+    OutboundFrame* new_frames = malloc(sizeof(OutboundFrame) * new_capacity);
+    if(new_frames == NULL) {
+        perror("malloc() error!");
+        exit(1);
+    }
+    for(size_t i = 0; i < queue->size; ++i) {
+        new_frames[i] = *frameAt(queue, i);
+    }
+    free(queue->frames);
+    queue->frames = new_frames;
+    queue->capacity = new_capacity;
+    queue->first = 0;
+}
+
+void outboundCreate(OutboundQueue* queue) {
+    queue->capacity = 8;
+    queue->frames = malloc(sizeof(OutboundFrame) * queue->capacity);
+    queue->first = 0;
+    queue->size = 0;
+    atomic_init(&queue->queued_bytes, 0);
+    atomic_init(&queue->queued_frames, 0);
+    atomic_init(&queue->max_queued_bytes, 0);
+    atomic_init(&queue->dropped_frames, 0);
+    atomic_init(&queue->dropped_bytes, 0);
+}
+
+void outboundDestroy(OutboundQueue* queue) {
+    for(size_t i = 0; i < queue->size; ++i) {
+        releaseFrame(frameAt(queue, i));
+    }
+    free(queue->frames);
+    queue->frames = NULL;
+    queue->size = 0;
+}
+
+bool outboundIsEmpty(const OutboundQueue* queue) {
+    return queue->size == 0;
+}
+
+static void push(OutboundQueue* queue, OutboundFrame frame) {
+    if(queue->size == queue->capacity) {
+        grow(queue);
+    }
+    *frameAt(queue, queue->size) = frame;
+    ++queue->size;
+    atomic_store(&queue->queued_bytes, atomic_load(&queue->queued_bytes) + frameBytes(&frame) - frame.sent);
+    atomic_store(&queue->queued_frames, queue->size);
+}
+
+void outboundPushMessage(OutboundQueue* queue, Message message) {
+    OutboundFrame frame = {.message = message, .broadcast = NULL, .sent = 0};
+    push(queue, frame);
+}
+
+void outboundPushRaw(OutboundQueue* queue, Message bytes) {
+    // size counts as sent, so only data is written
+    OutboundFrame frame = {.message = bytes, .broadcast = NULL, .sent = sizeof(bytes.size), .raw = true};
+    push(queue, frame);
+}
+
+void outboundPushBroadcast(OutboundQueue* queue, BroadcastBuffer* broadcast) {
+    broadcastAcquire(broadcast);
+    OutboundFrame frame = {.message = broadcast->message, .broadcast = broadcast, .sent = 0};
+    push(queue, frame);
+}
+
+void outboundRecordDepth(OutboundQueue* queue) {
+    size_t queued = atomic_load(&queue->queued_bytes);
+    if(queued > atomic_load(&queue->max_queued_bytes)) {
+        atomic_store(&queue->max_queued_bytes, queued);
+    }
+}
+
+OutboundFrame* outboundFront(OutboundQueue* queue) {
+    return queue->size == 0 ? NULL : frameAt(queue, 0);
+}
+
+OutboundFrame* outboundAt(OutboundQueue* queue, size_t index) {
+    return frameAt(queue, index);
+}
+
+size_t outboundFillIovec(OutboundQueue* queue, struct iovec* iov, size_t max_iovecs, bool broadcast_only,
+                         size_t* frames, bool* whole_queue) {
+    size_t iov_count = 0;
+    size_t i = 0;
+    // every frame can need 2 iovecs
+    for(; i < queue->size && iov_count + 2 <= max_iovecs; ++i) {
+        OutboundFrame* frame = frameAt(queue, i);
+        if(broadcast_only && frame->broadcast == NULL) {
+            break;
+        }
+        const size_t header_size = sizeof(frame->message.size);
+        if(frame->sent < header_size) {
+            // size inside broadcast buffer stays valid after frame is removed from queue(MSG_ZEROCOPY)
+            uint32_t* size = frame->broadcast != NULL ? &frame->broadcast->message.size : &frame->message.size;
+            iov[iov_count].iov_base = (unsigned char*)size + frame->sent;
+            iov[iov_count].iov_len = header_size - frame->sent;
+            ++iov_count;
+        }
+        size_t data_sent = frame->sent > header_size ? frame->sent - header_size : 0;
+        if(data_sent < frame->message.size) {
+            iov[iov_count].iov_base = frame->message.data + data_sent;
+            iov[iov_count].iov_len = frame->message.size - data_sent;
+            ++iov_count;
+        }
+    }
+    *frames = i;
+    *whole_queue = i == queue->size;
+    return iov_count;
+}
+
+void outboundAdvance(OutboundQueue* queue, size_t bytes) {
+    atomic_store(&queue->queued_bytes, atomic_load(&queue->queued_bytes) - bytes);
+    while(bytes > 0) {
+        OutboundFrame* frame = frameAt(queue, 0);
+        size_t frame_left = frameBytes(frame) - frame->sent;
+        if(bytes < frame_left) {
+            frame->sent += bytes;
+            break;
+        }
+        bytes -= frame_left;
+        releaseFrame(frame);
+        queue->first = (queue->first + 1) % queue->capacity;
+        --queue->size;
+    }
+    atomic_store(&queue->queued_frames, queue->size);
+}
+
+void outboundDropStale(OutboundQueue* queue, size_t budget) {
+    size_t queued = atomic_load(&queue->queued_bytes);
+    if(queued <= budget || queue->size < 2) {
+        return;
+    }
+    size_t kept = 0;
+    size_t dropped_frames = 0;
+    size_t dropped_bytes = 0;
+    for(size_t i = 0; i < queue->size; ++i) {
+        OutboundFrame frame = *frameAt(queue, i);
+        bool is_last = i == queue->size - 1;
+        if(queued > budget && frame.broadcast != NULL && frame.sent == 0 && !is_last) {
+            queued -= frameBytes(&frame);
+            ++dropped_frames;
+            dropped_bytes += frameBytes(&frame);
+            releaseFrame(&frame);
+        } else {
+            *frameAt(queue, kept++) = frame;
+        }
+    }
+    queue->size = kept;
+    atomic_store(&queue->queued_bytes, queued);
+    atomic_store(&queue->queued_frames, queue->size);
+    atomic_fetch_add(&queue->dropped_frames, dropped_frames);
+    atomic_fetch_add(&queue->dropped_bytes, dropped_bytes);
+}
+
+void outboundGetStats(const OutboundQueue* queue, ClientSendStats* stats) {
+    stats->queued_bytes = atomic_load(&queue->queued_bytes);
+    stats->queued_frames = atomic_load(&queue->queued_frames);
+    stats->max_queued_bytes = atomic_load(&queue->max_queued_bytes);
+    stats->dropped_frames = atomic_load(&queue->dropped_frames);
+    stats->dropped_bytes = atomic_load(&queue->dropped_bytes);
+}
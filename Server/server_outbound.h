@@ -0,0 +1,63 @@
+#ifndef SERVER_OUTBOUND_H
+#define SERVER_OUTBOUND_H
+#include "server_structs.h"
+#include "server_broadcast.h"
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <sys/uio.h>
+
+typedef struct {
+    // individual message, freed with freeOutgoingMessage() after it's sent or dropped
+    Message message;
+    // game state shared with other clients(frame holds one reference), NULL for individual message.
+    // Game state frames can be dropped when client can't keep up
+    BroadcastBuffer* broadcast;
+    // number of bytes already written to socket, including 4 byte size
+    size_t sent;
+    // rest of frame taken over from old server(server_handoff.c), its size was already sent.
+    // Data is freed with free()
+    bool raw;
+} OutboundFrame;
+
+// ring buffer of frames waiting to be written to one client socket.
+// Only sending thread modifies it, counters can be read by any thread
+typedef struct {
+    OutboundFrame* frames;
+    size_t capacity;
+    size_t first;
+    size_t size;
+    // bytes not yet written to socket, including 4 byte sizes
+    atomic_size_t queued_bytes;
+    atomic_size_t queued_frames;
+    atomic_size_t max_queued_bytes;
+    atomic_size_t dropped_frames;
+    atomic_size_t dropped_bytes;
+} OutboundQueue;
+
+void outboundCreate(OutboundQueue* queue);
+// releases every frame still in queue
+void outboundDestroy(OutboundQueue* queue);
+bool outboundIsEmpty(const OutboundQueue* queue);
+// individual message is owned by queue after push
+void outboundPushMessage(OutboundQueue* queue, Message message);
+// acquires reference to broadcast
+void outboundPushBroadcast(OutboundQueue* queue, BroadcastBuffer* broadcast);
+// bytes sent as they are(without 4 byte size), data is owned by queue and freed with free()
+void outboundPushRaw(OutboundQueue* queue, Message bytes);
+OutboundFrame* outboundFront(OutboundQueue* queue);
+OutboundFrame* outboundAt(OutboundQueue* queue, size_t index);
+// fills iov with unsent parts(4 byte size and data) of frames from the front of queue. If broadcast_only is true
+// stops at first individual message. Returns number of used iovecs, *frames is set to number of used frames
+// and *whole_queue to true if all frames fit
+size_t outboundFillIovec(OutboundQueue* queue, struct iovec* iov, size_t max_iovecs, bool broadcast_only,
+                         size_t* frames, bool* whole_queue);
+// marks bytes from the front of queue as written, releases and removes every frame written completely
+void outboundAdvance(OutboundQueue* queue, size_t bytes);
+// drops game state frames that weren't started, oldest first, until queue is at most budget bytes long.
+// Newest frame is never dropped
+void outboundDropStale(OutboundQueue* queue, size_t budget);
+// updates max_queued_bytes, called when socket didn't take everything
+void outboundRecordDepth(OutboundQueue* queue);
+void outboundGetStats(const OutboundQueue* queue, ClientSendStats* stats);
+
+#endif
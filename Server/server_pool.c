@@ -0,0 +1,155 @@
+#include "server_pool.h"
+#include "server.h"
+#include "server_config.h"
+#include <stdatomic.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+// with AddressSanitizer only requested bytes of taken block are addressable, so reading past payload
+// is reported like for malloc() instead of silently reading neighbouring message
+#ifdef __SANITIZE_ADDRESS__
+#include <sanitizer/asan_interface.h>
+#define POISON_BYTES(address, size) ASAN_POISON_MEMORY_REGION(address, size)
+#define UNPOISON_BYTES(address, size) ASAN_UNPOISON_MEMORY_REGION(address, size)
+#else
+#define POISON_BYTES(address, size) ((void)(address), (void)(size))
+#define UNPOISON_BYTES(address, size) ((void)(address), (void)(size))
+#endif
+
+// marks end of free list
+#define NO_BLOCK UINT32_MAX
+#define INDEX_MASK 0xffffffffu
+
+typedef struct {
+    size_t block_size;
+    uint32_t blocks;
+    unsigned char* memory;
+    // next free block for every block on free list
+    atomic_uint_least32_t* next;
+    // tag(number of changes) in upper 32 bits, index of first free block in lower ones.
+    // tag prevents ABA when block is taken and returned between load and compare exchange
+    _Alignas(64) atomic_uint_least64_t head;
+    atomic_size_t in_use;
+    atomic_size_t max_in_use;
+} SizeClass;
+
+// frames sent by clients are 1-17 bytes, bigger classes are for future messages
+static const size_t block_sizes[RECEIVE_POOL_CLASSES] = {16, 32, 64, 256};
+static SizeClass classes[RECEIVE_POOL_CLASSES];
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+static atomic_size_t allocations;
+static atomic_size_t fallback_mallocs;
+
+static void createPool() {
+    size_t blocks = getServerConfig()->receive_pool_blocks;
+    if(blocks >= NO_BLOCK) {
+        blocks = NO_BLOCK - 1;
+    }
+    for(size_t i = 0; i < RECEIVE_POOL_CLASSES; ++i) {
+        SizeClass* size_class = &classes[i];
+        size_class->block_size = block_sizes[i];
+        size_class->blocks = (uint32_t)blocks;
+        size_class->memory = malloc(blocks * block_sizes[i]);
+        size_class->next = malloc(blocks * sizeof(atomic_uint_least32_t));
+        if(size_class->memory == NULL || size_class->next == NULL) {
+            perror("malloc() error!");
+            exit(1);
+        }
+        POISON_BYTES(size_class->memory, blocks * block_sizes[i]);
+        for(uint32_t block = 0; block < blocks; ++block) {
+            atomic_init(&size_class->next[block], block + 1 < blocks ? block + 1 : NO_BLOCK);
+        }
+        atomic_init(&size_class->head, blocks > 0 ? 0 : NO_BLOCK);
+        atomic_init(&size_class->in_use, 0);
+        atomic_init(&size_class->max_in_use, 0);
+    }
+}
+
+void initReceivePool() {
+    pthread_once(&pool_once, createPool);
+}
+
+static uint64_t nextHead(uint64_t head, uint32_t index) {
+    return ((head >> 32) + 1) << 32 | index;
+}
+
+static unsigned char* popBlock(SizeClass* size_class) {
+    uint64_t head = atomic_load_explicit(&size_class->head, memory_order_acquire);
+    while(true) {
+        uint32_t index = (uint32_t)(head & INDEX_MASK);
+        if(index == NO_BLOCK) {
+            return NULL;
+        }
+        uint32_t next = atomic_load_explicit(&size_class->next[index], memory_order_relaxed);
+        if(atomic_compare_exchange_weak_explicit(&size_class->head, &head, nextHead(head, next),
+                                                 memory_order_acquire, memory_order_acquire)) {
+            return size_class->memory + (size_t)index * size_class->block_size;
+        }
+    }
+}
+
+static void pushBlock(SizeClass* size_class, uint32_t index) {
+    uint64_t head = atomic_load_explicit(&size_class->head, memory_order_relaxed);
+    do {
+        atomic_store_explicit(&size_class->next[index], (uint32_t)(head & INDEX_MASK), memory_order_relaxed);
+    } while(atomic_compare_exchange_weak_explicit(&size_class->head, &head, nextHead(head, index),
+                                                  memory_order_release, memory_order_relaxed) == false);
+}
+
+static void recordInUse(SizeClass* size_class) {
+    size_t in_use = atomic_fetch_add_explicit(&size_class->in_use, 1, memory_order_relaxed) + 1;
+    size_t max = atomic_load_explicit(&size_class->max_in_use, memory_order_relaxed);
+    while(in_use > max && atomic_compare_exchange_weak_explicit(&size_class->max_in_use, &max, in_use,
+                                                                memory_order_relaxed, memory_order_relaxed) == false);
+}
+
+unsigned char* receivePoolAlloc(size_t size) {
+    atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+    for(size_t i = 0; i < RECEIVE_POOL_CLASSES; ++i) {
+        if(size <= classes[i].block_size) {
+            unsigned char* block = popBlock(&classes[i]);
+            if(block != NULL) {
+                recordInUse(&classes[i]);
+                UNPOISON_BYTES(block, size);
+                return block;
+            }
+            break;
+        }
+    }
+    atomic_fetch_add_explicit(&fallback_mallocs, 1, memory_order_relaxed);
+    unsigned char* data = malloc(size > 0 ? size : 1);
+    if(data == NULL) {
+        perror("malloc() error!");
+        exit(1);
+    }
+    return data;
+}
+
+void receivePoolFree(unsigned char* data) {
+    for(size_t i = 0; i < RECEIVE_POOL_CLASSES; ++i) {
+        SizeClass* size_class = &classes[i];
+        if(size_class->memory != NULL && data >= size_class->memory
+                && data < size_class->memory + (size_t)size_class->blocks * size_class->block_size) {
+            size_t index = (size_t)(data - size_class->memory) / size_class->block_size;
+            POISON_BYTES(size_class->memory + index * size_class->block_size, size_class->block_size);
+            pushBlock(size_class, (uint32_t)index);
+            atomic_fetch_sub_explicit(&size_class->in_use, 1, memory_order_relaxed);
+            return;
+        }
+    }
+    free(data);
+}
+
+ReceivePoolStats getReceivePoolStats() {
+    ReceivePoolStats stats;
+    for(size_t i = 0; i < RECEIVE_POOL_CLASSES; ++i) {
+        stats.classes[i].block_size = block_sizes[i];
+        stats.classes[i].blocks = classes[i].blocks;
+        stats.classes[i].in_use = atomic_load(&classes[i].in_use);
+        stats.classes[i].max_in_use = atomic_load(&classes[i].max_in_use);
+    }
+    stats.allocations = atomic_load(&allocations);
+    stats.fallback_mallocs = atomic_load(&fallback_mallocs);
+    return stats;
+}
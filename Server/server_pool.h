@@ -0,0 +1,15 @@
+#ifndef SERVER_POOL_H
+#define SERVER_POOL_H
+#include "server_structs.h"
+
+// Size class pool for received message payloads. Blocks are taken by reactor threads and returned by
+// thread calling freeMessage(), free lists are lock-free so blocks are recycled between them without locking.
+// Payloads bigger than largest class or received while their class is empty are allocated with malloc.
+// Pool is created on first runServer() and lives until process exits, so messages can outlive server
+void initReceivePool();
+// returns block that fits at least size bytes, never NULL
+unsigned char* receivePoolAlloc(size_t size);
+// accepts every pointer returned by receivePoolAlloc() and NULL
+void receivePoolFree(unsigned char* data);
+
+#endif
@@ -0,0 +1,539 @@
+#include "server_reactor.h"
+#include "server_internal.h"
+#include "server_config.h"
+#include "server_listen.h"
+#include "server_receive.h"
+#include "server_connection.h"
+#include "server_send.h"
+#include "server_udp.h"
+#include "server_gateway.h"
+#include "server_wakeup.h"
+#include "server_handoff.h"
+#include <sys/epoll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#define MAX_EVENTS 64
+
+typedef struct {
+    pthread_t thread_id;
+    int epoll_fd;
+    // signaled by stopReactors() to wake thread from epoll_wait()
+    Wakeup wake;
+    // SO_REUSEPORT socket of this reactor
+    int listen_fd;
+    // list of every open connection, each holds reference. Used to close them on stop
+    Connection* connections;
+    // set with wake by resumeBlockedConnections()
+    atomic_bool resume;
+    bool thread_running;
+} Reactor;
+
+static Reactor* reactors = NULL;
+static size_t reactors_size = 0;
+// Unix domain sockets shared by every reactor(EPOLLEXCLUSIVE), -1 if disabled
+static int unix_listen_fd = -1;
+static int shm_listen_fd = -1;
+// set by pauseReactors(), threads leave event loop but keep their connections
+static atomic_bool paused = false;
+// connections that aren't read because receive queue was full
+static atomic_size_t blocked_connections = 0;
+// addresses used as epoll_event.data.ptr to distinguish them from connections
+static char listen_tag;
+static char wake_tag;
+static char udp_tag;
+static char unix_tag;
+static char shm_tag;
+static char gateway_tag;
+
+static bool isConnection(const void* ptr) {
+    return ptr != &listen_tag && ptr != &wake_tag && ptr != &udp_tag && ptr != &unix_tag && ptr != &shm_tag
+           && ptr != &gateway_tag;
+}
+
+static int addToEpoll(int epoll_fd, int fd, uint32_t events, void* ptr) {
+    struct epoll_event event = {.events = events, .data = {.ptr = ptr}};
+    if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1) {
+        perror("epoll_ctl(ADD) error");
+        return -1;
+    }
+    return 0;
+}
+
+static void registerConnection(Reactor* reactor, int client_socket, Transport transport);
+
+// data of shared memory connection comes with server_data eventfd, its socket is watched only for disconnection.
+// Without EPOLLRDHUP half closed connection isn't closed before frames in its buffer are pushed
+static int setReceiving(Reactor* reactor, Connection* connection, bool receiving) {
+    int fd = connection->shm != NULL ? connection->shm->server_data.fd : connection->socket;
+    uint32_t events = connection->shm != NULL ? EPOLLIN : EPOLLIN | EPOLLRDHUP;
+    struct epoll_event event = {.events = receiving ? events : 0, .data = {.ptr = connection}};
+    if(epoll_ctl(reactor->epoll_fd, EPOLL_CTL_MOD, fd, &event) == -1) {
+        perror("epoll_ctl(MOD) error");
+        return -1;
+    }
+    return 0;
+}
+
+static void closeConnection(Reactor* reactor, Connection* connection, bool lost) {
+    if(connection->receive_state.blocked) {
+        atomic_fetch_sub(&blocked_connections, 1);
+    }
+    if(connection->reactor_previous != NULL) {
+        connection->reactor_previous->reactor_next = connection->reactor_next;
+    } else {
+        reactor->connections = connection->reactor_next;
+    }
+    if(connection->reactor_next != NULL) {
+        connection->reactor_next->reactor_previous = connection->reactor_previous;
+    }
+    epoll_ctl(reactor->epoll_fd, EPOLL_CTL_DEL, connection->socket, NULL);
+    connection->closed = true;
+    if(connection->shm != NULL) {
+        // client has duplicate of eventfd, so it wouldn't leave epoll after close()
+        epoll_ctl(reactor->epoll_fd, EPOLL_CTL_DEL, connection->shm->server_data.fd, NULL);
+        // sending thread can wait for free space that won't come
+        atomic_store(&connection->shm->closed, true);
+        wakeupSignal(&connection->shm->server_space);
+    }
+    if(lost) {
+        IncomingMessage disconnected = {.message_type = LOST_CONNECTION, .client_id = connection->client_id,
+                                        .message = {.size = 0, .data = NULL}};
+        pushIncomingMessage(&disconnected);
+    }
+    char buf[64];
+    snprintf(buf, sizeof(buf), "client(%ld): closing", connection->client_id);
+    printThreadDebugInformation(buf);
+    // socket is closed when sending thread also releases connection
+    stopClient(connection->client_id);
+    connectionRelease(connection);
+    if(lost) {
+        // first waiting connection takes place of closed one
+        Transport transport;
+        int waiting_socket = takeWaitingConnection(&transport);
+        if(waiting_socket != -1) {
+            registerConnection(reactor, waiting_socket, transport);
+        }
+    } else {
+        releaseAdmission();
+    }
+}
+
+static void registerConnection(Reactor* reactor, int client_socket, Transport transport) {
+    Connection* connection = connectionCreate(client_socket, transport);
+    configureSocketForSending(connection);
+    // rings need to exist before sending thread can see connection
+    if(transport == TRANSPORT_SHM && (connection->shm = shmCreate(client_socket)) == NULL) {
+        connectionRelease(connection);
+        releaseAdmission();
+        return;
+    }
+    if(addClient(connection) != 0) {
+        fprintf(stderr, "Every one of %ld client slots is used, connection refused\n", getServerConfig()->max_clients);
+        // closes socket
+        connectionRelease(connection);
+        releaseAdmission();
+        return;
+    }
+    IncomingMessage connected = {.message_type = NEW_CONNECTION, .client_id = connection->client_id,
+                                 .message = {.size = 0, .data = NULL}};
+    pushIncomingMessage(&connected);
+    char buf[64];
+    snprintf(buf, sizeof(buf), "client(%ld): connected", connection->client_id);
+    printThreadDebugInformation(buf);
+    connection->reactor_next = reactor->connections;
+    if(reactor->connections != NULL) {
+        reactor->connections->reactor_previous = connection;
+    }
+    reactor->connections = connection;
+    // socket of shared memory connection is watched only for disconnection, data comes with server_data eventfd
+    uint32_t socket_events = transport == TRANSPORT_SHM ? EPOLLRDHUP : EPOLLIN | EPOLLRDHUP;
+    if(addToEpoll(reactor->epoll_fd, client_socket, socket_events, connection) == -1
+            || (connection->shm != NULL
+                && addToEpoll(reactor->epoll_fd, connection->shm->server_data.fd, EPOLLIN, connection) == -1)) {
+        // no events will come for this socket so connection needs to be closed right now
+        closeConnection(reactor, connection, true);
+    }
+}
+
+// receive queue is full, connection isn't read until consumer takes half of it, so sending client
+// is slowed down by TCP flow control or full shared memory ring
+static void blockConnection(Reactor* reactor, Connection* connection) {
+    atomic_fetch_add(&blocked_connections, 1);
+    if(setReceiving(reactor, connection, false) == -1) {
+        closeConnection(reactor, connection, true);
+        return;
+    }
+    // pairs with fence in resumeBlockedConnections(), either consumer sees blocked connection or reactor sees
+    // queue drained
+    atomic_thread_fence(memory_order_seq_cst);
+    if(isReceiveQueueDrained()) {
+        resumeBlockedConnections();
+    }
+}
+
+static void receiveFromConnection(Reactor* reactor, Connection* connection) {
+    int result = connection->shm != NULL
+               ? receiveMessagesFrom(shmReceive, connection->shm, connection->client_id, &connection->receive_state)
+               : receiveMessages(connection->socket, connection->client_id, &connection->receive_state);
+    if(result == -1) {
+        closeConnection(reactor, connection, true);
+    } else if(result == RECEIVE_BLOCKED) {
+        blockConnection(reactor, connection);
+    }
+}
+
+// frames that didn't fit into receive queue are pushed first, connection is read again if all of them fit
+static void resumeConnections(Reactor* reactor) {
+    Connection* connection = reactor->connections;
+    while(connection != NULL) {
+        Connection* next = connection->reactor_next;
+        if(connection->receive_state.blocked) {
+            connectionAcquire(connection);
+            atomic_fetch_sub(&blocked_connections, 1);
+            receiveFromConnection(reactor, connection);
+            if(connection->closed == false && connection->receive_state.blocked == false
+                    && setReceiving(reactor, connection, true) == -1) {
+                closeConnection(reactor, connection, true);
+            }
+            connectionRelease(connection);
+        }
+        connection = next;
+    }
+}
+
+static void handleConnectionEvent(Reactor* reactor, Connection* connection, uint32_t events) {
+    if(connection->closed) {
+        return;
+    }
+    // event could be reported before connection was blocked
+    if((events & EPOLLIN) && connection->receive_state.blocked == false) {
+        receiveFromConnection(reactor, connection);
+        if(connection->closed) {
+            return;
+        }
+    }
+    // EPOLLERR is also reported for MSG_ZEROCOPY notifications
+    if((events & EPOLLERR) && readSocketErrorQueue(connection)) {
+        closeConnection(reactor, connection, true);
+    }
+    // with EPOLLIN still set socket has data, next recv() will return 0 and close connection
+    else if((events & EPOLLHUP) || ((events & EPOLLRDHUP) && !(events & EPOLLIN))) {
+        closeConnection(reactor, connection, true);
+    }
+}
+
+// whole accept queue is taken at once, so burst of connections doesn't need burst of wakeups
+static void acceptConnections(Reactor* reactor, int listen_socket, Transport transport) {
+    int client_socket;
+    while((client_socket = acceptConnection(listen_socket)) != -1) {
+        if(admitConnection(client_socket, transport)) {
+            registerConnection(reactor, client_socket, transport);
+        }
+    }
+}
+
+static void* runReactor(void* reactor_arg) {
+    Reactor* reactor = reactor_arg;
+    printThreadDebugInformation("runReactor()");
+    struct epoll_event events[MAX_EVENTS];
+    while(isStopped() == false && atomic_load(&paused) == false) {
+        int ready = epoll_wait(reactor->epoll_fd, events, MAX_EVENTS, -1);
+        if(ready == -1) {
+            if(errno == EINTR) {
+                continue;
+            }
+            perror("epoll_wait() error");
+            break;
+        }
+        // shared memory connection has two fds, so closing it can't free connection used by later event
+        for(int i = 0; i < ready; ++i) {
+            if(isConnection(events[i].data.ptr)) {
+                connectionAcquire(events[i].data.ptr);
+            }
+        }
+        for(int i = 0; i < ready; ++i) {
+            void* ptr = events[i].data.ptr;
+            if(ptr == &wake_tag) {
+                // eventfd is level triggered, stop and pause are seen in loop condition
+                wakeupClear(&reactor->wake);
+                if(atomic_exchange(&reactor->resume, false)) {
+                    resumeConnections(reactor);
+                }
+            }
+            else if(ptr == &udp_tag) {
+                receiveUdpHellos();
+            }
+            else if(ptr == &gateway_tag) {
+                reportLoadToGateway();
+            }
+            else if(ptr == &listen_tag) {
+                acceptConnections(reactor, reactor->listen_fd, TRANSPORT_TCP);
+            }
+            else if(ptr == &unix_tag) {
+                acceptConnections(reactor, unix_listen_fd, TRANSPORT_UNIX);
+            }
+            else if(ptr == &shm_tag) {
+                acceptConnections(reactor, shm_listen_fd, TRANSPORT_SHM);
+            }
+            else {
+                handleConnectionEvent(reactor, ptr, events[i].events);
+            }
+        }
+        for(int i = 0; i < ready; ++i) {
+            if(isConnection(events[i].data.ptr)) {
+                connectionRelease(events[i].data.ptr);
+            }
+        }
+    }
+    return NULL;
+}
+
+static void destroyReactor(Reactor* reactor) {
+    if(reactor->epoll_fd != -1) {
+        close(reactor->epoll_fd);
+    }
+    wakeupDestroy(&reactor->wake);
+    if(reactor->listen_fd != -1) {
+        close(reactor->listen_fd);
+    }
+}
+
+// thread needs to be joined
+static void closeReactorConnections(Reactor* reactor) {
+    while(reactor->connections != NULL) {
+        closeConnection(reactor, reactor->connections, false);
+    }
+}
+
+// client of old server keeps its id, room, UDP channel, unparsed input and unsent output. Host already knows it,
+// so NEW_CONNECTION isn't pushed
+static void adoptConnection(Reactor* reactor, HandedOffClient* client) {
+    const ServerConfig* config = getServerConfig();
+    Connection* connection = connectionCreate(client->socket, client->transport);
+    client->socket = -1;
+    configureSocketForSending(connection);
+    atomic_store(&connection->room, client->room < config->max_rooms ? client->room : 0);
+    connection->udp_token = client->udp_token;
+    if(client->udp_ready && getUdpSocket() != -1) {
+        connection->udp_address = client->udp_address;
+        atomic_store(&connection->udp_state, UDP_READY);
+    }
+    if(addClientWithId(connection, client->client_id) != 0) {
+        fprintf(stderr, "Client(%ld) of old server doesn't fit into client slots, connection closed\n", client->client_id);
+        connectionRelease(connection);
+        return;
+    }
+    countAdmittedConnection();
+    connection->reactor_next = reactor->connections;
+    if(reactor->connections != NULL) {
+        reactor->connections->reactor_previous = connection;
+    }
+    reactor->connections = connection;
+    int result = client->input.size > 0
+               ? receiveMessagesFromMemory(&client->input, connection->client_id, &connection->receive_state) : 0;
+    if(result == -1) {
+        closeConnection(reactor, connection, true);
+        return;
+    }
+    if(client->output.size > 0) {
+        // sending threads aren't running yet, they flush it when they start
+        outboundPushRaw(&connection->outbound, client->output);
+        client->output = (Message){.size = 0, .data = NULL};
+    }
+    // consumer isn't running yet, it resumes connection after taking half of receive queue
+    if(result == RECEIVE_BLOCKED) {
+        atomic_fetch_add(&blocked_connections, 1);
+    }
+    uint32_t events = result == RECEIVE_BLOCKED ? 0 : EPOLLIN | EPOLLRDHUP;
+    if(addToEpoll(reactor->epoll_fd, connection->socket, events, connection) == -1) {
+        closeConnection(reactor, connection, true);
+    }
+}
+
+// clients are spread over reactors like old server had them, waiting connections and listening sockets
+// of old server's extra reactors go to first reactor
+static void adoptHandedOff(Reactor* reactor, size_t index) {
+    size_t io_threads = getServerConfig()->io_threads;
+    for(size_t i = index; i < handedOffClientCount(); i += io_threads) {
+        adoptConnection(reactor, handedOffClient(i));
+    }
+    if(index != 0) {
+        return;
+    }
+    // connections already accepted by kernel into listening sockets that won't be used are taken now
+    int listen_socket;
+    while((listen_socket = takeHandedOffListener()) != -1) {
+        acceptConnections(reactor, listen_socket, TRANSPORT_TCP);
+        close(listen_socket);
+    }
+    Transport transport;
+    int waiting_socket;
+    while((waiting_socket = takeHandedOffWaiting(&transport)) != -1) {
+        if(admitConnection(waiting_socket, transport)) {
+            registerConnection(reactor, waiting_socket, transport);
+        }
+    }
+}
+
+static int createReactor(Reactor* reactor, size_t index) {
+    reactor->connections = NULL;
+    atomic_store(&reactor->resume, false);
+    reactor->thread_running = false;
+    reactor->wake.fd = -1;
+    reactor->listen_fd = -1;
+    reactor->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if(reactor->epoll_fd == -1) {
+        perror("epoll_create1() error");
+        return -1;
+    }
+    if(wakeupInit(&reactor->wake) != 0) {
+        destroyReactor(reactor);
+        return -1;
+    }
+    // listening socket of old server keeps connections that weren't accepted yet
+    reactor->listen_fd = takeHandedOffListener();
+    if(reactor->listen_fd == -1) {
+        reactor->listen_fd = openListeningSocket(index == 0);
+    }
+    if(reactor->listen_fd == -1
+            || addToEpoll(reactor->epoll_fd, reactor->wake.fd, EPOLLIN, &wake_tag) == -1
+            || addToEpoll(reactor->epoll_fd, reactor->listen_fd, EPOLLIN, &listen_tag) == -1) {
+        destroyReactor(reactor);
+        return -1;
+    }
+    if((getUdpSocket() != -1 && addToEpoll(reactor->epoll_fd, getUdpSocket(), EPOLLIN | EPOLLEXCLUSIVE, &udp_tag) == -1)
+            || (unix_listen_fd != -1 && addToEpoll(reactor->epoll_fd, unix_listen_fd, EPOLLIN | EPOLLEXCLUSIVE, &unix_tag) == -1)
+            || (shm_listen_fd != -1 && addToEpoll(reactor->epoll_fd, shm_listen_fd, EPOLLIN | EPOLLEXCLUSIVE, &shm_tag) == -1)
+            || (index == 0 && getGatewayTimer() != -1 && addToEpoll(reactor->epoll_fd, getGatewayTimer(), EPOLLIN, &gateway_tag) == -1)) {
+        destroyReactor(reactor);
+        return -1;
+    }
+    adoptHandedOff(reactor, index);
+    int err = pthread_create(&reactor->thread_id, NULL, runReactor, reactor);
+    if(err != 0) {
+        errno = err;
+        perror("Couldn't create reactor thread");
+        closeReactorConnections(reactor);
+        destroyReactor(reactor);
+        return -1;
+    }
+    reactor->thread_running = true;
+    return 0;
+}
+
+// listening socket taken over from old server or new one
+static int openUnixListener(Transport transport, const char* path) {
+    int listen_socket = takeHandedOffUnixListener(transport, path);
+    return listen_socket != -1 ? listen_socket : openUnixListeningSocket(path);
+}
+
+int startReactors() {
+    const ServerConfig* config = getServerConfig();
+    atomic_store(&paused, false);
+    if((config->unix_socket_path[0] != '\0' && (unix_listen_fd = openUnixListener(TRANSPORT_UNIX, config->unix_socket_path)) == -1)
+            || (config->shm_socket_path[0] != '\0' && (shm_listen_fd = openUnixListener(TRANSPORT_SHM, config->shm_socket_path)) == -1)) {
+        return 1;
+    }
+    size_t io_threads = config->io_threads;
+    reactors = malloc(sizeof(Reactor) * io_threads);
+    for(reactors_size = 0; reactors_size < io_threads; ++reactors_size) {
+        if(createReactor(&reactors[reactors_size], reactors_size) != 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void pauseReactors() {
+    atomic_store(&paused, true);
+    for(size_t i = 0; i < reactors_size; ++i) {
+        wakeupSignal(&reactors[i].wake);
+    }
+    for(size_t i = 0; i < reactors_size; ++i) {
+        if(reactors[i].thread_running) {
+            pthread_join(reactors[i].thread_id, NULL);
+            reactors[i].thread_running = false;
+        }
+    }
+}
+
+void stopReactors() {
+    for(size_t i = 0; i < reactors_size; ++i) {
+        wakeupSignal(&reactors[i].wake);
+    }
+    for(size_t i = 0; i < reactors_size; ++i) {
+        if(reactors[i].thread_running) {
+            int err = pthread_join(reactors[i].thread_id, NULL);
+            if(err != 0) {
+                errno = err;
+                perror("pthread_join() error!");
+            }
+        }
+        closeReactorConnections(&reactors[i]);
+        destroyReactor(&reactors[i]);
+    }
+    free(reactors);
+    reactors = NULL;
+    reactors_size = 0;
+    atomic_store(&blocked_connections, 0);
+    atomic_store(&paused, false);
+    // after handoff socket files are used by new server
+    if(unix_listen_fd != -1) {
+        if(isHandedOff()) {
+            close(unix_listen_fd);
+        } else {
+            closeUnixListeningSocket(unix_listen_fd, getServerConfig()->unix_socket_path);
+        }
+        unix_listen_fd = -1;
+    }
+    if(shm_listen_fd != -1) {
+        if(isHandedOff()) {
+            close(shm_listen_fd);
+        } else {
+            closeUnixListeningSocket(shm_listen_fd, getServerConfig()->shm_socket_path);
+        }
+        shm_listen_fd = -1;
+    }
+}
+
+void resumeBlockedConnections() {
+    // pairs with fence in blockConnection()
+    atomic_thread_fence(memory_order_seq_cst);
+    if(atomic_load(&blocked_connections) == 0) {
+        return;
+    }
+    for(size_t i = 0; i < reactors_size; ++i) {
+        if(atomic_exchange(&reactors[i].resume, true) == false) {
+            wakeupSignal(&reactors[i].wake);
+        }
+    }
+}
+
+size_t getReactorListeners(int* listeners, size_t max_listeners) {
+    size_t count = 0;
+    for(size_t i = 0; i < reactors_size && count < max_listeners; ++i) {
+        if(reactors[i].listen_fd != -1) {
+            listeners[count++] = reactors[i].listen_fd;
+        }
+    }
+    return count;
+}
+
+int getUnixListener(Transport transport) {
+    return transport == TRANSPORT_UNIX ? unix_listen_fd : shm_listen_fd;
+}
+
+void forEachReactorConnection(void (*function)(Connection* connection, void* argument), void* argument) {
+    for(size_t i = 0; i < reactors_size; ++i) {
+        for(Connection* connection = reactors[i].connections; connection != NULL; connection = connection->reactor_next) {
+            function(connection, argument);
+        }
+    }
+}
@@ -0,0 +1,23 @@
+#ifndef SERVER_REACTOR_H
+#define SERVER_REACTOR_H
+#include "server_connection.h"
+
+// starts getServerConfig()->io_threads threads with epoll event loops. Every thread accepts connections from
+// its own SO_REUSEPORT listening socket and receives/closes connections it accepted. Returns 0 if no error.
+// On error already started reactors need to be stopped with stopReactors()
+int startReactors();
+// wakes and joins every reactor thread, closes connections and sockets they owned. Call after setting server to stopped
+void stopReactors();
+// reactor threads leave their loops and are joined, connections stay open until stopReactors()
+void pauseReactors();
+// wakes reactors to read again connections that were blocked by full receive queue. Called by consumer
+// of receive queue after it was drained
+void resumeBlockedConnections();
+// copies listening sockets of reactors(handoff), returns their number
+size_t getReactorListeners(int* listeners, size_t max_listeners);
+// shared Unix listening socket of TRANSPORT_UNIX or TRANSPORT_SHM, -1 if disabled
+int getUnixListener(Transport transport);
+// calls function for every connection owned by reactors, only while reactors are paused
+void forEachReactorConnection(void (*function)(Connection* connection, void* argument), void* argument);
+
+#endif
@@ -1,129 +1,296 @@
 #include "server_receive.h"
 #include "server_internal.h"
-#include "server_queue.h"
+#include "server_mpsc.h"
+#include "server_config.h"
+#include "server_pool.h"
+#include "server_latency.h"
+#include "server_reactor.h"
+#include "server.h"
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <stdatomic.h>
+#include <string.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <stdio.h>
-#include <poll.h>
 #include <errno.h>
 
-static SynchronizedQueue received_messages;
-static pthread_cond_t recv_message_cond = PTHREAD_COND_INITIALIZER;
-
-static int waitForMessage(size_t seconds) {
-    struct timespec time;
-    clock_gettime(CLOCK_REALTIME, &time);
-    time.tv_sec += (time_t)seconds;
-    while(queueSyncIsEmpty(&received_messages)) {
-        // wait for pthread_cond_signal or timeout
-        int err = pthread_cond_timedwait(&recv_message_cond, received_messages.mutex, &time);
-        if(err == ETIMEDOUT) {
-            return ETIMEDOUT;
-        } else if(err != 0) {
-            errno = err;
-            perror("pthread_cond_timedwait() error");
-            exit(1);
-        }
+// filled by reactor threads, emptied by thread calling take()
+static MpscQueue* received_messages;
+
+// connections that found queue full are read again once consumer has taken half of it
+static void resumeIfDrained() {
+    if(isReceiveQueueDrained()) {
+        resumeBlockedConnections();
     }
-    return 0;
 }
 
 IncomingMessage take(size_t wait_seconds) {
     IncomingMessage recv_msg = {.message_type = EMPTY, .message = {.size = 0, .data = NULL}};
-    queueLock(&received_messages);
-    if(waitForMessage(wait_seconds) == 0) {
-        queueSyncPopCopyFront(&received_messages, &recv_msg);
+    // NULL if server isn't running
+    if(received_messages == NULL) {
+        sleep((unsigned int)wait_seconds);
+        return recv_msg;
+    }
+    if(mpscPop(received_messages, &recv_msg, (long)wait_seconds * 1000)) {
+        resumeIfDrained();
+        if(recv_msg.pushed_time_ns != 0) {
+            recv_msg.taken_time_ns = latencyNow();
+            recordLatency(LATENCY_QUEUE_WAIT, recv_msg.pushed_time_ns, recv_msg.taken_time_ns);
+        }
     }
-    queueUnlock(&received_messages);    
     return recv_msg;
 }
 
+size_t takeMany(IncomingMessage* messages, size_t max_messages, size_t wait_milliseconds) {
+    if(received_messages == NULL) {
+        usleep((useconds_t)(wait_milliseconds * 1000));
+        return 0;
+    }
+    size_t taken = mpscPopMany(received_messages, messages, max_messages, (long)wait_milliseconds);
+    if(taken > 0) {
+        resumeIfDrained();
+    }
+    if(taken > 0 && getServerConfig()->latency_timestamps) {
+        uint64_t now = latencyNow();
+        for(size_t i = 0; i < taken; ++i) {
+            if(messages[i].pushed_time_ns != 0) {
+                messages[i].taken_time_ns = now;
+                recordLatency(LATENCY_QUEUE_WAIT, messages[i].pushed_time_ns, now);
+            }
+        }
+    }
+    return taken;
+}
+
+void interruptTake() {
+    if(received_messages != NULL) {
+        mpscInterrupt(received_messages);
+    }
+}
+
 bool isEmpty() {
-    return queueSyncIsEmpty(&received_messages);
+    return received_messages == NULL || mpscIsEmpty(received_messages);
 }
 
 void initReceivedQueue() {
-    received_messages = queueSyncCreate(sizeof(IncomingMessage));
+    received_messages = mpscCreate(sizeof(IncomingMessage), getServerConfig()->receive_queue_capacity);
 }
 
 void destroyReceivedQueue() {
-    while(queueSyncIsEmpty(&received_messages) == false) {
-        IncomingMessage* msg = queueSyncPopFront(&received_messages);
-        free(msg->message.data);
-        free(msg);
-    }
-    queueSyncDestroy(&received_messages);
-}
-
-void* startReceiving(void* client_id_arg) {
-    size_t client_id = *((size_t*)client_id_arg);
-    IncomingMessage connected = {.message_type = NEW_CONNECTION, .client_id = client_id, .message={.size = 0, .data = NULL}};
-    queueSyncPushBack(&received_messages, &connected);
-    char buf[256];
-    snprintf(buf, 256, "startReceiving() client: %ld", client_id);
-    printThreadDebugInformation(buf);
-    free(client_id_arg);
-    int sock = getClient(client_id).socket;
-    struct pollfd file_descriptor = {.fd = sock, .events = POLLIN};
-    while(getClientStatus(client_id) == RUNNING) {
-        int return_poll = poll(&file_descriptor, 1, 2000);
-        if(return_poll < 0 && errno != EINTR) {
-            perror("poll() error");
+    IncomingMessage msg;
+    while(mpscTryPop(received_messages, &msg)) {
+        receivePoolFree(msg.message.data);
+    }
+    mpscDestroy(received_messages);
+    received_messages = NULL;
+}
+
+bool pushIncomingMessage(const IncomingMessage* message) {
+    return mpscPush(received_messages, message, isStopped);
+}
+
+bool isReceiveQueueDrained() {
+    return received_messages != NULL && mpscSize(received_messages) <= mpscCapacity(received_messages) / 2;
+}
+
+static atomic_size_t received_frames;
+static atomic_size_t receive_syscalls;
+static atomic_size_t oversized_frames;
+static atomic_size_t empty_frames;
+
+typedef struct {
+    int socket;
+    // gets kernel timestamp of every recvmsg()
+    ReceiveState* state;
+} SocketSource;
+
+static ssize_t receiveFromSocket(void* source_arg, size_t client_id, struct iovec* iov, size_t iov_count) {
+    SocketSource* source = source_arg;
+    struct msghdr message = {.msg_iov = iov, .msg_iovlen = iov_count};
+    char control[LATENCY_CONTROL_SIZE];
+    bool timestamps = getServerConfig()->latency_timestamps;
+    if(timestamps) {
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+    }
+    atomic_fetch_add_explicit(&receive_syscalls, 1, memory_order_relaxed);
+    ssize_t return_recv = recvmsg(source->socket, &message, MSG_DONTWAIT);
+    if(return_recv == -1) {
+        if(errno == EAGAIN || errno == EINTR) {
+            return 0;
+        }
+        if(errno != ECONNRESET && errno != EPIPE) {
+            char error_buf[64];
+            snprintf(error_buf, sizeof(error_buf), "client(%ld): recvmsg() error!", client_id);
+            perror(error_buf);
+        }
+        return -1;
+    }
+    else if(return_recv == 0) {
+        return -1;
+    }
+    if(timestamps) {
+        source->state->kernel_time_ns = readKernelTimestamp(&message);
+    }
+    return return_recv;
+}
+
+// returns number of received bytes, 0 if nothing is available now, -1 if connection was closed or on error
+static ssize_t receiveIntoBuffer(ReceiveFunction receive, void* source, size_t client_id, ReceiveState* state) {
+    // free space starts after last byte and can wrap around to the beginning of buffer
+    size_t end = (state->start + state->size) % state->capacity;
+    struct iovec iov[2];
+    size_t iov_count = 1;
+    if(end < state->start) {
+        iov[0] = (struct iovec){.iov_base = state->buffer + end, .iov_len = state->start - end};
+    } else {
+        iov[0] = (struct iovec){.iov_base = state->buffer + end, .iov_len = state->capacity - end};
+        if(state->start > 0) {
+            iov[1] = (struct iovec){.iov_base = state->buffer, .iov_len = state->start};
+            iov_count = 2;
+        }
+    }
+    ssize_t received = receive(source, client_id, iov, iov_count);
+    if(received > 0) {
+        state->size += (size_t)received;
+    }
+    return received;
+}
+
+// copies size bytes starting offset bytes after first unparsed byte
+static void copyFromBuffer(const ReceiveState* state, size_t offset, void* destination, size_t size) {
+    size_t position = (state->start + offset) % state->capacity;
+    size_t first_part = state->capacity - position < size ? state->capacity - position : size;
+    memcpy(destination, state->buffer + position, first_part);
+    memcpy((unsigned char*)destination + first_part, state->buffer, size - first_part);
+}
+
+// pushes every complete frame in buffer and drops empty ones, returns -1 if frame is bigger than max_frame_size.
+// Frame that doesn't fit into receive queue stays in buffer and RECEIVE_BLOCKED is returned
+static int parseFrames(size_t client_id, ReceiveState* state) {
+    uint64_t pushed_time = getServerConfig()->latency_timestamps ? latencyNow() : 0;
+    uint32_t frame_size;
+    while(state->size >= sizeof(frame_size)) {
+        copyFromBuffer(state, 0, &frame_size, sizeof(frame_size));
+        if(frame_size > getServerConfig()->max_frame_size) {
+            atomic_fetch_add_explicit(&oversized_frames, 1, memory_order_relaxed);
+            fprintf(stderr, "client(%ld): frame of %u bytes is bigger than max_frame_size, disconnecting\n",
+                    client_id, frame_size);
+            return -1;
+        }
+        if(state->size < sizeof(frame_size) + frame_size) {
             break;
         }
-        else if(return_poll == 1) {
-            if(file_descriptor.revents & POLLIN) {
-                IncomingMessage recv_msg = {.message_type = MESSAGE, .client_id = client_id};
-                int return_recv = recv(sock, &recv_msg.message.size, sizeof(recv_msg.message.size), MSG_WAITALL);
-                if(return_recv == -1) {
-                    if(errno != ECONNRESET && errno != EPIPE) {
-                        snprintf(buf, 256, "client(%ld): recv(size) error!", client_id);
-                        perror(buf);
-                    }
-                    break;
-                }
-                else if(return_recv == 0) {
-                    break;
-                }
-                else if((size_t)return_recv != sizeof(recv_msg.message.size)) {
-                    fprintf(stderr, "client(%ld): recv(size) returned wrong number of bytes: %d instead of %ld\n", client_id, return_recv, sizeof(recv_msg.message.size));
-                    break;
-                }
-                recv_msg.message.data = malloc(recv_msg.message.size);
-                return_recv = recv(sock, recv_msg.message.data, recv_msg.message.size, MSG_WAITALL);
-                if(return_recv == -1) {
-                    if(errno != ECONNRESET && errno != EPIPE) {
-                        snprintf(buf, 50, "client(%ld): recv(data) data error!", client_id);
-                        perror(buf);
-                    }
-                    free(recv_msg.message.data);
-                    break;
-                }
-                else if((size_t)return_recv != recv_msg.message.size) {
-                    if(return_recv != 0) {
-                        fprintf(stderr, "client(%ld): recv(data) returned wrong number of bytes: %d instead of %d\n", client_id, return_recv, recv_msg.message.size);
-                    }
-                    free(recv_msg.message.data);
-                    break;
-                }
-                queueLock(&received_messages);
-                queueSyncPushBack(&received_messages, &recv_msg);
-                pthread_cond_signal(&recv_message_cond);
-                queueUnlock(&received_messages);
-            }
-            else {
-                printf("client(%ld): File descriptor revents unknown: %d", client_id, file_descriptor.revents);
-            }
+        // every message starts with type byte
+        if(frame_size == 0) {
+            atomic_fetch_add_explicit(&empty_frames, 1, memory_order_relaxed);
+            state->start = (state->start + sizeof(frame_size)) % state->capacity;
+            state->size -= sizeof(frame_size);
+            continue;
+        }
+        IncomingMessage recv_msg = {.message_type = MESSAGE, .client_id = client_id,
+                                    .message = {.size = frame_size, .data = receivePoolAlloc(frame_size)},
+                                    .kernel_time_ns = state->kernel_time_ns, .pushed_time_ns = pushed_time};
+        copyFromBuffer(state, sizeof(frame_size), recv_msg.message.data, frame_size);
+        // reactor stops reading connection, so backpressure goes to client through TCP or shared memory ring
+        if(mpscTryPush(received_messages, &recv_msg) == false) {
+            receivePoolFree(recv_msg.message.data);
+            state->blocked = true;
+            return RECEIVE_BLOCKED;
         }
+        state->start = (state->start + sizeof(frame_size) + frame_size) % state->capacity;
+        state->size -= sizeof(frame_size) + frame_size;
+        atomic_fetch_add_explicit(&received_frames, 1, memory_order_relaxed);
+        recordLatency(LATENCY_KERNEL_TO_USER, recv_msg.kernel_time_ns, pushed_time);
     }
-    IncomingMessage disconnected = {.message_type = LOST_CONNECTION, .client_id = client_id, .message={.size = 0, .data = NULL}};
-    queueSyncPushFront(&received_messages, &disconnected);
-    sprintf(buf, "client(%ld): closing \n", client_id);
-    printThreadDebugInformation(buf);
-    if(close(sock) == -1) {
-        perror("close() error!");
+    if(state->size == 0) {
+        // next recvmsg() can use one contiguous part
+        state->start = 0;
     }
-    stopClient(client_id);
-    return NULL;
+    return 0;
+}
+
+static void allocateReceiveBuffer(ReceiveState* state, size_t min_capacity) {
+    const ServerConfig* config = getServerConfig();
+    // largest allowed frame always fits, so there is free space after every parseFrames()
+    state->capacity = config->receive_buffer_size > config->max_frame_size + sizeof(uint32_t)
+                    ? config->receive_buffer_size : config->max_frame_size + sizeof(uint32_t);
+    state->capacity = state->capacity > min_capacity ? state->capacity : min_capacity;
+    state->buffer = malloc(state->capacity);
+    if(state->buffer == NULL) {
+        perror("malloc() error!");
+        exit(1);
+    }
+}
+
+int receiveMessagesFrom(ReceiveFunction receive, void* source, size_t client_id, ReceiveState* state) {
+    if(state->buffer == NULL) {
+        allocateReceiveBuffer(state, 0);
+    }
+    // buffer can be full, so frames that didn't fit into queue go first
+    if(state->blocked) {
+        state->blocked = false;
+        int result = parseFrames(client_id, state);
+        if(result != 0) {
+            return result;
+        }
+    }
+    while(true) {
+        size_t free_space = state->capacity - state->size;
+        ssize_t received = receiveIntoBuffer(receive, source, client_id, state);
+        if(received <= 0) {
+            return (int)received;
+        }
+        int result = parseFrames(client_id, state);
+        if(result != 0) {
+            return result;
+        }
+        // source is drained, rest will come with next event
+        if((size_t)received < free_space) {
+            return 0;
+        }
+    }
+}
+
+int receiveMessages(int socket, size_t client_id, ReceiveState* state) {
+    SocketSource source = {.socket = socket, .state = state};
+    return receiveMessagesFrom(receiveFromSocket, &source, client_id, state);
+}
+
+int receiveMessagesFromMemory(const Message* input, size_t client_id, ReceiveState* state) {
+    if(state->buffer == NULL) {
+        allocateReceiveBuffer(state, input->size);
+    }
+    if(state->capacity - state->size < input->size) {
+        fprintf(stderr, "client(%ld): %u input bytes don't fit into receive buffer\n", client_id, input->size);
+        return -1;
+    }
+    size_t end = (state->start + state->size) % state->capacity;
+    size_t first_part = state->capacity - end < input->size ? state->capacity - end : input->size;
+    memcpy(state->buffer + end, input->data, first_part);
+    memcpy(state->buffer, input->data + first_part, input->size - first_part);
+    state->size += input->size;
+    if(state->blocked) {
+        return RECEIVE_BLOCKED;
+    }
+    return parseFrames(client_id, state);
+}
+
+void clearReceiveState(ReceiveState* state) {
+    free(state->buffer);
+    state->buffer = NULL;
+    state->start = 0;
+    state->size = 0;
+    state->blocked = false;
+}
+
+ServerReceiveStats getServerReceiveStats() {
+    ServerReceiveStats stats = {
+        .received_frames = atomic_load(&received_frames),
+        .receive_syscalls = atomic_load(&receive_syscalls),
+        .oversized_frames = atomic_load(&oversized_frames),
+        .empty_frames = atomic_load(&empty_frames),
+    };
+    return stats;
 }
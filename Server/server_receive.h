@@ -1,9 +1,48 @@
 #ifndef SERVER_RECEIVE_H
 #define SERVER_RECEIVE_H
+#include "server_structs.h"
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <stdbool.h>
+
+// returned by receiveMessages() when receive queue is full
+#define RECEIVE_BLOCKED 1
+
+// bytes received by reactor but not parsed into messages yet. Owned by reactor thread handling connection.
+// Ring buffer is allocated on first receive and fits at least one frame of max_frame_size
+typedef struct {
+    unsigned char* buffer;
+    size_t capacity;
+    // first unparsed byte
+    size_t start;
+    // number of unparsed bytes, can wrap around end of buffer
+    size_t size;
+    // kernel timestamp of last recvmsg()(latency_timestamps), 0 if source has none
+    uint64_t kernel_time_ns;
+    // complete frames in buffer wait for free space in receive queue, nothing is received until they are pushed
+    bool blocked;
+} ReceiveState;
 
-// client_id should be dynamically allocated size_t*. startReceiving will free client_id memory
-void* startReceiving(void* client_id);
 void initReceivedQueue();
 void destroyReceivedQueue();
+// waits for free space in receive queue, returns false without pushing if server was stopped
+bool pushIncomingMessage(const IncomingMessage* message);
+// receive queue is at most half full, so blocked connections can be read again
+bool isReceiveQueueDrained();
+// reads bytes from source into iov without blocking. Returns number of bytes, 0 if nothing is available now
+// or -1 if source was closed or on error
+typedef ssize_t (*ReceiveFunction)(void* source, size_t client_id, struct iovec* iov, size_t iov_count);
+
+// reads everything available on socket without blocking, usually with one recvmsg(), and pushes every
+// complete message. returns -1 if connection was closed, on error or if client sent too big frame.
+// Returns RECEIVE_BLOCKED if receive queue is full, next call first pushes frames that didn't fit
+int receiveMessages(int socket, size_t client_id, ReceiveState* state);
+// like receiveMessages() but bytes come from receive function
+int receiveMessagesFrom(ReceiveFunction receive, void* source, size_t client_id, ReceiveState* state);
+// like receiveMessages() but bytes are taken from memory. Buffer is made big enough for all of them,
+// so they aren't lost if receive queue is full
+int receiveMessagesFromMemory(const Message* input, size_t client_id, ReceiveState* state);
+// frees receive buffer with partially received frames
+void clearReceiveState(ReceiveState* state);
 
 #endif
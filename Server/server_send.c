@@ -1,134 +1,738 @@
 #include "server_send.h"
 #include "server_internal.h"
+#include "server_connection.h"
+#include "server_config.h"
 #include "server_mutex.h"
 #include "server_queue.h"
+#include "server_udp.h"
+#include "server_wakeup.h"
+#include "server_latency.h"
+#include "server.h"
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <linux/errqueue.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+#define MAX_EVENTS 64
+// iovecs given to one sendmsg(), 2 for each frame
+#define MAX_IOVECS 64
 
 typedef struct {
     Message message;
     size_t client_id;
 } IndividualMessage;
 
-// Queue of IndividualMessages
-static SynchronizedQueue outgoing_queue;
-// message_to_everyone.data == NULL if there is no message
-static Message message_to_everyone = {.size = 0, .data = NULL};
+// newest game state of room
+typedef struct {
+    // holds one reference, NULL before first game state of room
+    BroadcastBuffer* buffer;
+    // number of game states given to sendToRoom() for this room
+    size_t published;
+    // broadcast_sequence when state was published, sent as sequence number of UDP datagrams.
+    // it's shared by all rooms, so it keeps growing for client moved to other room
+    size_t sequence;
+    struct timespec time;
+} RoomBroadcast;
+
+// Sending thread with fixed subset of connections, clients with slot % shard_count == index.
+// Only owning shard flushes connection, so outbound queues, EPOLLOUT registration and
+// sender/dirty lists are never shared between threads
+typedef struct {
+    // shards are written by different threads, so every one starts on its own cache line
+    _Alignas(64) pthread_t thread_id;
+    bool thread_started;
+    // clients with clientShard() == index belong to this shard
+    size_t index;
+    // Queue of IndividualMessages for clients of this shard
+    SynchronizedQueue outgoing_queue;
+    // epoll with wake and sockets that couldn't take whole outbound queue(EPOLLOUT)
+    int epoll_fd;
+    Wakeup wake;
+    // connections waiting for EPOLLOUT, each one holds reference
+    Connection* waiting_connections;
+    // connections with frames pushed since last flush, each one holds reference
+    Connection* dirty_connections;
+    // max_rooms long copy of rooms from last take, buffer is set(with reference) only during pass
+    // that sends it, so published tells which states were already taken
+    RoomBroadcast* taken;
+    UdpBatch udp;
+    atomic_size_t broadcasts;
+    atomic_size_t max_clients;
+    atomic_size_t send_syscalls;
+    atomic_size_t total_latency_us;
+    atomic_size_t max_latency_us;
+    atomic_size_t latency_histogram[SENDER_LATENCY_BUCKETS];
+} SenderShard;
+
+// sender_threads long, kept after destroyOutgoingQueue() so statistics can be read after stopServer()
+static SenderShard* shards = NULL;
+static size_t shard_count = 0;
+// max_rooms long, every shard takes its own reference of game states
+static RoomBroadcast* rooms = NULL;
+static size_t room_count = 0;
+// number of game states given to sendToRoom(), all rooms together
+static size_t broadcast_sequence = 0;
 static pthread_mutex_t message_mutex;
-static pthread_cond_t new_message_cond = PTHREAD_COND_INITIALIZER;
+// set by drainSenders(), threads make last pass and stop
+static atomic_bool draining = false;
+static atomic_size_t broadcasts;
+static atomic_size_t broadcast_syscalls;
+static atomic_size_t send_syscalls;
+static atomic_size_t conflated_frames;
+static atomic_size_t zerocopy_sends;
+// address used as epoll_event.data.ptr of shard's wake
+static char wake_tag;
 
-void sendToEveryone(Message message) {
+static SenderShard* shardOf(size_t client_id) {
+    return &shards[clientShard(client_id)];
+}
+
+// every shard is woken by the same game state, they send it to their clients at the same time
+void sendToRoom(Message message, size_t room) {
+    if(room >= room_count) {
+        freeOutgoingMessage(message);
+        return;
+    }
+    BroadcastBuffer* buffer = broadcastCreate(message);
+    if(getServerConfig()->latency_timestamps) {
+        buffer->publish_time_ns = latencyNow();
+    }
     lockMutex(&message_mutex);
-    freeOutgoingMessage(message_to_everyone);
-    message_to_everyone = message;
-    pthread_cond_signal(&new_message_cond);
+    RoomBroadcast* target = &rooms[room];
+    BroadcastBuffer* replaced = target->buffer;
+    target->buffer = buffer;
+    ++target->published;
+    target->sequence = ++broadcast_sequence;
+    clock_gettime(CLOCK_MONOTONIC, &target->time);
     unlockMutex(&message_mutex);
+    if(replaced != NULL) {
+        broadcastRelease(replaced);
+    }
+    atomic_fetch_add_explicit(&broadcasts, 1, memory_order_relaxed);
+    for(size_t i = 0; i < shard_count; ++i) {
+        wakeupSignal(&shards[i].wake);
+    }
+}
+
+void sendToEveryone(Message message) {
+    sendToRoom(message, 0);
+}
+
+int setClientRoom(size_t client_id, size_t room) {
+    if(room >= room_count) {
+        return 1;
+    }
+    Connection* connection = acquireClientConnection(client_id);
+    if(connection == NULL) {
+        return 1;
+    }
+    // sender shards read it in their next pass, state of old room that is already queued is still sent
+    atomic_store(&connection->room, room);
+    connectionRelease(connection);
+    return 0;
 }
 
 void sendTo(Message message, size_t client_id) {
     IndividualMessage msg = { .client_id = client_id, .message = message };
-    queueSyncPushBack(&outgoing_queue, &msg);
-    pthread_cond_signal(&new_message_cond);
+    SenderShard* shard = shardOf(client_id);
+    queueSyncPushBack(&shard->outgoing_queue, &msg);
+    wakeupSignal(&shard->wake);
 }
 
-// returns shallow copy of message_to_everyone and changes message_to_everyone.data to NULL
-static Message popMessageToEveryone() {
+// takes reference of every room's game state that shard didn't take yet into shard->taken,
+// returns number of taken states. States replaced before shard took them are counted as conflated
+static size_t takeRoomBroadcasts(SenderShard* shard) {
+    size_t taken = 0;
     lockMutex(&message_mutex);
-    Message copy = message_to_everyone;
-    if(message_to_everyone.data != NULL) {
-        message_to_everyone.data = NULL;
+    for(size_t room = 0; room < room_count; ++room) {
+        if(rooms[room].published != shard->taken[room].published) {
+            size_t missed = rooms[room].published - shard->taken[room].published - 1;
+            atomic_fetch_add_explicit(&conflated_frames, missed, memory_order_relaxed);
+            shard->taken[room] = rooms[room];
+            broadcastAcquire(rooms[room].buffer);
+            ++taken;
+        }
     }
     unlockMutex(&message_mutex);
-    return copy;
+    return taken;
+}
+
+static void countSendSyscalls(SenderShard* shard, size_t syscalls) {
+    atomic_fetch_add_explicit(&send_syscalls, syscalls, memory_order_relaxed);
+    atomic_fetch_add_explicit(&shard->send_syscalls, syscalls, memory_order_relaxed);
 }
 
-static void sendMessageTo(Message msg, Client client, size_t client_id) {
-    if(client.status != RUNNING) {
+static void waitForWrite(SenderShard* shard, Connection* connection) {
+    if(connection->waiting_for_write) {
         return;
     }
-    if(send(client.socket, &msg.size, sizeof(msg.size), 0) == -1) {
-        if(errno != ECONNRESET && errno != EPIPE) {
-            perror("Server: Send(size) error!");
+    // shared memory client signals server_space eventfd after it frees space in ring
+    int fd = connection->shm != NULL ? connection->shm->server_space.fd : connection->socket;
+    struct epoll_event event = {.events = (connection->shm != NULL ? EPOLLIN : EPOLLOUT) | EPOLLONESHOT,
+                                .data = {.ptr = connection}};
+    int operation = connection->registered_for_write ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    if(epoll_ctl(shard->epoll_fd, operation, fd, &event) == -1) {
+        perror("epoll_ctl(EPOLLOUT) error");
+        signalClientToStop(connection->client_id);
+        return;
+    }
+    connection->registered_for_write = true;
+    connection->waiting_for_write = true;
+    connectionAcquire(connection);
+    connection->sender_previous = NULL;
+    connection->sender_next = shard->waiting_connections;
+    if(shard->waiting_connections != NULL) {
+        shard->waiting_connections->sender_previous = connection;
+    }
+    shard->waiting_connections = connection;
+}
+
+// releases reference held while waiting
+static void stopWaitingForWrite(SenderShard* shard, Connection* connection) {
+    if(connection->sender_previous != NULL) {
+        connection->sender_previous->sender_next = connection->sender_next;
+    } else {
+        shard->waiting_connections = connection->sender_next;
+    }
+    if(connection->sender_next != NULL) {
+        connection->sender_next->sender_previous = connection->sender_previous;
+    }
+    connection->waiting_for_write = false;
+    connectionRelease(connection);
+}
+
+static void setCork(Connection* connection, int cork) {
+    if(setsockopt(connection->socket, IPPROTO_TCP, TCP_CORK, &cork, sizeof(cork)) == -1) {
+        perror("setsockopt(TCP_CORK) error");
+    }
+}
+
+// kernel can read data of MSG_ZEROCOPY send until it's completed, so frames keep their buffers until then
+static void holdZerocopyFrames(Connection* connection, size_t frames) {
+    for(size_t i = 0; i < frames; ++i) {
+        zerocopyHold(&connection->zerocopy_holds, connection->zerocopy_sends,
+                     outboundAt(&connection->outbound, i)->broadcast);
+    }
+    ++connection->zerocopy_sends;
+    atomic_fetch_add_explicit(&zerocopy_sends, 1, memory_order_relaxed);
+}
+
+// newest game state among first frames of queue, if connection can take next kernel send timestamp sample
+static BroadcastBuffer* sampledBroadcast(Connection* connection, size_t frames) {
+    if(connection->timestamps == false || atomic_load(&connection->send_sample_time_ns) != 0) {
+        return NULL;
+    }
+    for(size_t i = frames; i > 0; --i) {
+        BroadcastBuffer* broadcast = outboundAt(&connection->outbound, i - 1)->broadcast;
+        if(broadcast != NULL && broadcast->publish_time_ns != 0) {
+            return broadcast;
         }
-        signalClientToStop(client_id);
     }
-    if(send(client.socket, msg.data, msg.size, 0) == -1) {
-        if(errno != ECONNRESET && errno != EPIPE) {
-            perror("Server: Send(data) error!");
+    return NULL;
+}
+
+// copies outbound queue into shared memory ring until it's empty or ring is full
+static void flushShmConnection(SenderShard* shard, Connection* connection) {
+    OutboundQueue* queue = &connection->outbound;
+    while(outboundIsEmpty(queue) == false) {
+        struct iovec iov[MAX_IOVECS];
+        bool whole_queue;
+        size_t frames;
+        size_t iov_count = outboundFillIovec(queue, iov, MAX_IOVECS, false, &frames, &whole_queue);
+        ssize_t sent = shmSend(connection->shm, iov, iov_count);
+        if(sent == 0) {
+            waitForWrite(shard, connection);
         }
-        signalClientToStop(client_id);
+        if(sent <= 0) {
+            // -1 means reactor already closes connection
+            break;
+        }
+        // write() to client's eventfd
+        countSendSyscalls(shard, 1);
+        outboundAdvance(queue, (size_t)sent);
     }
 }
 
-static int waitForMessage(size_t seconds) {
-    struct timespec time;
-    clock_gettime(CLOCK_REALTIME, &time);
-    time.tv_sec += (time_t)seconds;
-    while(queueSyncIsEmpty(&outgoing_queue) && message_to_everyone.data == NULL) {
-        // wait for pthread_cond_signal or timeout
-        int err = pthread_cond_timedwait(&new_message_cond, &message_mutex, &time);
-        if(isStopped()) {
-            return -1;
-        } else if(err != 0 && err != ETIMEDOUT) {
-            errno = err;
-            perror("pthread_cond_timedwait() error");
-            exit(1);
+// writes outbound queue until it's empty or socket would block, every sendmsg() takes as many frames as it can
+static void flushConnection(SenderShard* shard, Connection* connection) {
+    if(connection->shm != NULL) {
+        flushShmConnection(shard, connection);
+        return;
+    }
+    OutboundQueue* queue = &connection->outbound;
+    bool corked = false;
+    zerocopyReleaseCompleted(&connection->zerocopy_holds, atomic_load(&connection->zerocopy_completed));
+    while(outboundIsEmpty(queue) == false) {
+        struct iovec iov[MAX_IOVECS];
+        bool whole_queue;
+        size_t frames;
+        OutboundFrame* front = outboundFront(queue);
+        // big game states go without individual messages, their buffers can't be held after sending
+        bool zerocopy = connection->zerocopy && front->broadcast != NULL
+                        && front->message.size >= getServerConfig()->zerocopy_threshold;
+        size_t iov_count = outboundFillIovec(queue, iov, MAX_IOVECS, zerocopy, &frames, &whole_queue);
+        if(whole_queue == false && corked == false && connection->transport == TRANSPORT_TCP
+                && getServerConfig()->tcp_send_policy == TCP_POLICY_CORK) {
+            setCork(connection, 1);
+            corked = true;
+        }
+        struct msghdr msg = {.msg_iov = iov, .msg_iovlen = iov_count};
+        char control[LATENCY_CONTROL_SIZE];
+        BroadcastBuffer* sampled = sampledBroadcast(connection, frames);
+        if(sampled != NULL) {
+            // reactor can read timestamp before sendmsg() returns
+            atomic_store(&connection->send_sample_time_ns, sampled->publish_time_ns);
+            requestSendTimestamp(&msg, control);
+        }
+        ssize_t sent = sendmsg(connection->socket, &msg, MSG_NOSIGNAL | (zerocopy ? MSG_ZEROCOPY : 0));
+        countSendSyscalls(shard, 1);
+        if(sent == -1) {
+            if(sampled != NULL) {
+                atomic_store(&connection->send_sample_time_ns, 0);
+            }
+            if(errno == EINTR) {
+                continue;
+            } else if(errno == EAGAIN) {
+                waitForWrite(shard, connection);
+            } else if(zerocopy && errno == ENOBUFS) {
+                // over optmem limit for pinned pages, send this frame normally
+                connection->zerocopy = false;
+                continue;
+            } else {
+                if(errno != ECONNRESET && errno != EPIPE) {
+                    perror("Server: sendmsg() error!");
+                }
+                signalClientToStop(connection->client_id);
+            }
+            break;
         }
+        if(zerocopy) {
+            holdZerocopyFrames(connection, frames);
+        }
+        outboundAdvance(queue, (size_t)sent);
     }
-    return 0;
+    if(corked) {
+        setCork(connection, 0);
+    }
+}
+
+void configureSocketForSending(Connection* connection) {
+    // Unix domain sockets have no TCP options and no MSG_ZEROCOPY
+    if(connection->transport != TRANSPORT_TCP) {
+        return;
+    }
+    if(getServerConfig()->tcp_send_policy == TCP_POLICY_NODELAY) {
+        int nodelay = 1;
+        if(setsockopt(connection->socket, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay)) == -1) {
+            perror("setsockopt(TCP_NODELAY) error");
+        }
+    }
+    if(getServerConfig()->zerocopy_threshold > 0) {
+        int zerocopy = 1;
+        if(setsockopt(connection->socket, SOL_SOCKET, SO_ZEROCOPY, &zerocopy, sizeof(zerocopy)) == -1) {
+            perror("setsockopt(SO_ZEROCOPY) error");
+        } else {
+            connection->zerocopy = true;
+        }
+    }
+    if(getServerConfig()->latency_timestamps) {
+        enableSocketTimestamps(connection);
+    }
+}
+
+bool readSocketErrorQueue(Connection* connection) {
+    if(connection->zerocopy == false && connection->timestamps == false) {
+        return true;
+    }
+    // MSG_ZEROCOPY completion notifications, every one covers sends [ee_info, ee_data],
+    // and kernel send timestamps asked for by requestSendTimestamp()
+    while(true) {
+        char control[CMSG_SPACE(sizeof(struct sock_extended_err) + sizeof(struct sockaddr_in6)) + LATENCY_CONTROL_SIZE];
+        struct msghdr msg = {.msg_control = control, .msg_controllen = sizeof(control)};
+        if(recvmsg(connection->socket, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1) {
+            break;
+        }
+        uint64_t send_time = readKernelTimestamp(&msg);
+        if(send_time != 0) {
+            recordLatency(LATENCY_BROADCAST_TO_WIRE, atomic_exchange(&connection->send_sample_time_ns, 0), send_time);
+        }
+        for(struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if(cmsg->cmsg_level == SOL_SOCKET) {
+                continue;
+            }
+            struct sock_extended_err* err = (struct sock_extended_err*)CMSG_DATA(cmsg);
+            if(err->ee_errno == 0 && err->ee_origin == SO_EE_ORIGIN_ZEROCOPY) {
+                uint32_t completed = err->ee_data + 1;
+                if((int32_t)(completed - atomic_load(&connection->zerocopy_completed)) > 0) {
+                    atomic_store(&connection->zerocopy_completed, completed);
+                }
+            }
+        }
+    }
+    int error = 0;
+    socklen_t length = sizeof(error);
+    if(getsockopt(connection->socket, SOL_SOCKET, SO_ERROR, &error, &length) == -1) {
+        return true;
+    }
+    return error != 0;
+}
+
+ServerSendStats getServerSendStats() {
+    ServerSendStats stats = {.broadcasts = atomic_load(&broadcasts),
+                             .broadcast_syscalls = atomic_load(&broadcast_syscalls),
+                             .send_syscalls = atomic_load(&send_syscalls),
+                             .conflated_frames = atomic_load(&conflated_frames),
+                             .zerocopy_sends = atomic_load(&zerocopy_sends)};
+    addUdpSendStats(&stats);
+    return stats;
+}
+
+static long elapsedMilliseconds(const struct timespec* since, const struct timespec* now) {
+    return (now->tv_sec - since->tv_sec) * 1000 + (now->tv_nsec - since->tv_nsec) / 1000000;
+}
+
+// applies slow client policy if outbound queue is over budget
+static void enforceBudget(Connection* connection) {
+    const ServerConfig* config = getServerConfig();
+    OutboundQueue* queue = &connection->outbound;
+    outboundRecordDepth(queue);
+    if(config->slow_client_policy == DROP_OLD_STATE) {
+        outboundDropStale(queue, config->send_queue_budget);
+    }
+    if(atomic_load(&queue->queued_bytes) <= config->send_queue_budget) {
+        connection->over_budget = false;
+        return;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if(connection->over_budget == false) {
+        connection->over_budget = true;
+        connection->over_budget_since = now;
+    }
+    long over_budget_time = elapsedMilliseconds(&connection->over_budget_since, &now);
+    if(config->slow_client_policy == DISCONNECT_SLOW && over_budget_time >= (long)config->slow_client_timeout_ms
+            && signalClientToStop(connection->client_id)) {
+        printf("client(%ld): disconnected, %ld bytes queued for %ld ms\n", connection->client_id,
+               atomic_load(&queue->queued_bytes), over_budget_time);
+    }
+}
+
+// frames are only queued here, connection is flushed once with everything pushed before flushDirtyConnections()
+static void markDirty(SenderShard* shard, Connection* connection) {
+    if(connection->dirty) {
+        return;
+    }
+    connection->dirty = true;
+    connectionAcquire(connection);
+    connection->dirty_next = shard->dirty_connections;
+    shard->dirty_connections = connection;
+}
+
+static void flushDirtyConnections(SenderShard* shard) {
+    while(shard->dirty_connections != NULL) {
+        Connection* connection = shard->dirty_connections;
+        shard->dirty_connections = connection->dirty_next;
+        connection->dirty = false;
+        // if connection waits for EPOLLOUT socket is full, frames will be sent after event
+        if(connection->waiting_for_write == false) {
+            flushConnection(shard, connection);
+        }
+        enforceBudget(connection);
+        connectionRelease(connection);
+    }
+}
+
+static void queueIndividualMessages(SenderShard* shard) {
+    while(queueSyncIsEmpty(&shard->outgoing_queue) == false) {
+        IndividualMessage* ind_msg = queueSyncPopFront(&shard->outgoing_queue);
+        Connection* connection = acquireClientConnection(ind_msg->client_id);
+        if(connection == NULL) {
+            freeOutgoingMessage(ind_msg->message);
+        } else {
+            outboundPushMessage(&connection->outbound, ind_msg->message);
+            markDirty(shard, connection);
+            connectionRelease(connection);
+        }
+        free(ind_msg);
+    }
+}
+
+typedef struct {
+    SenderShard* shard;
+    size_t clients;
+} BroadcastTarget;
+
+// every client queue gets reference to the same buffer of its room, it's freed after last client sends it
+static void queueBroadcastTo(Connection* connection, void* target_arg) {
+    BroadcastTarget* target = target_arg;
+    const RoomBroadcast* room = &target->shard->taken[atomic_load_explicit(&connection->room, memory_order_relaxed)];
+    if(room->buffer == NULL) {
+        return;
+    }
+    ++target->clients;
+    if(atomic_load_explicit(&connection->udp_state, memory_order_acquire) == UDP_READY && udpCanSend(room->buffer)) {
+        udpQueue(&target->shard->udp, connection, room->buffer, (uint32_t)room->sequence);
+        return;
+    }
+    outboundPushBroadcast(&connection->outbound, room->buffer);
+    markDirty(target->shard, connection);
+}
+
+// one pass over running clients of shard queues game states of every room taken by takeRoomBroadcasts()
+static void queueBroadcasts(SenderShard* shard) {
+    BroadcastTarget target = {.shard = shard};
+    forEachShardConnection(shard->index, queueBroadcastTo, &target);
+    if(target.clients > atomic_load_explicit(&shard->max_clients, memory_order_relaxed)) {
+        atomic_store_explicit(&shard->max_clients, target.clients, memory_order_relaxed);
+    }
+    size_t syscalls = udpFlush(&shard->udp);
+    countSendSyscalls(shard, syscalls);
+    atomic_fetch_add(&broadcast_syscalls, syscalls);
+}
+
+static void recordFlushLatency(SenderShard* shard, const struct timespec* published) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long elapsed = (now.tv_sec - published->tv_sec) * 1000000 + (now.tv_nsec - published->tv_nsec) / 1000;
+    size_t latency = elapsed > 0 ? (size_t)elapsed : 0;
+    size_t bucket = 0;
+    for(size_t limit = 64; bucket < SENDER_LATENCY_BUCKETS - 1 && latency >= limit; limit *= 4) {
+        ++bucket;
+    }
+    atomic_fetch_add_explicit(&shard->latency_histogram[bucket], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&shard->total_latency_us, latency, memory_order_relaxed);
+    // only shard's thread writes maximum
+    if(latency > atomic_load_explicit(&shard->max_latency_us, memory_order_relaxed)) {
+        atomic_store_explicit(&shard->max_latency_us, latency, memory_order_relaxed);
+    }
+    atomic_fetch_add_explicit(&shard->broadcasts, 1, memory_order_relaxed);
+}
+
+// records latency of every game state sent in this pass and releases shard's references
+static void releaseTakenBroadcasts(SenderShard* shard) {
+    for(size_t room = 0; room < room_count; ++room) {
+        RoomBroadcast* taken = &shard->taken[room];
+        if(taken->buffer != NULL) {
+            recordFlushLatency(shard, &taken->time);
+            broadcastRelease(taken->buffer);
+            taken->buffer = NULL;
+        }
+    }
+}
+
+static void handleWritable(SenderShard* shard, Connection* connection) {
+    // flushConnection() can start waiting again and take new reference before old one is released
+    connectionAcquire(connection);
+    stopWaitingForWrite(shard, connection);
+    if(connection->shm != NULL) {
+        wakeupClear(&connection->shm->server_space);
+    }
+    flushConnection(shard, connection);
+    enforceBudget(connection);
+    connectionRelease(connection);
+}
+
+size_t getSenderShardStats(SenderShardStats* stats, size_t max_shards) {
+    for(size_t i = 0; i < shard_count && i < max_shards; ++i) {
+        SenderShard* shard = &shards[i];
+        stats[i] = (SenderShardStats){.broadcasts = atomic_load(&shard->broadcasts),
+                                      .max_clients = atomic_load(&shard->max_clients),
+                                      .send_syscalls = atomic_load(&shard->send_syscalls),
+                                      .total_latency_us = atomic_load(&shard->total_latency_us),
+                                      .max_latency_us = atomic_load(&shard->max_latency_us)};
+        for(size_t bucket = 0; bucket < SENDER_LATENCY_BUCKETS; ++bucket) {
+            stats[i].latency_histogram[bucket] = atomic_load(&shard->latency_histogram[bucket]);
+        }
+    }
+    return shard_count;
 }
 
-// called by runServer() before creating thread to make sure there won't be any access to mutex or queue
+static void initShard(SenderShard* shard, size_t index) {
+    memset(shard, 0, sizeof(*shard));
+    shard->index = index;
+    shard->taken = calloc(room_count, sizeof(RoomBroadcast));
+    if(shard->taken == NULL) {
+        perror("calloc() error!");
+        exit(1);
+    }
+    shard->outgoing_queue = queueSyncCreate(sizeof(IndividualMessage));
+    nameMutex(shard->outgoing_queue.mutex, "sender outgoing_queue");
+    udpBatchInit(&shard->udp, (unsigned int)time(NULL) + (unsigned int)index);
+    shard->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if(shard->epoll_fd == -1) {
+        perror("epoll_create1() error");
+        exit(1);
+    }
+    if(wakeupInit(&shard->wake) != 0) {
+        exit(1);
+    }
+    struct epoll_event event = {.events = EPOLLIN, .data = {.ptr = &wake_tag}};
+    if(epoll_ctl(shard->epoll_fd, EPOLL_CTL_ADD, shard->wake.fd, &event) == -1) {
+        perror("epoll_ctl(ADD) error");
+        exit(1);
+    }
+}
+
+// called by runServer() before creating threads to make sure there won't be any access to mutex or queues
 // before they are created(in extremely unlikely scenario)
 void initOutgoingQueue() {
+    atomic_store(&broadcasts, 0);
+    atomic_store(&broadcast_syscalls, 0);
+    atomic_store(&send_syscalls, 0);
+    atomic_store(&conflated_frames, 0);
+    atomic_store(&zerocopy_sends, 0);
+    atomic_store(&draining, false);
     initRecursiveMutex(&message_mutex);
-    outgoing_queue = queueSyncCreate(sizeof(IndividualMessage));
+    nameMutex(&message_mutex, "sender message_mutex");
+    broadcast_sequence = 0;
+    room_count = getServerConfig()->max_rooms;
+    rooms = calloc(room_count, sizeof(RoomBroadcast));
+    if(rooms == NULL) {
+        perror("calloc() error!");
+        exit(1);
+    }
+    free(shards);
+    shard_count = getServerConfig()->sender_threads;
+    shards = aligned_alloc(_Alignof(SenderShard), shard_count * sizeof(SenderShard));
+    if(shards == NULL) {
+        perror("aligned_alloc() error!");
+        exit(1);
+    }
+    for(size_t i = 0; i < shard_count; ++i) {
+        initShard(&shards[i], i);
+    }
 }
 
 void destroyOutgoingQueue() {
-    queueSyncDestroy(&outgoing_queue);
+    for(size_t i = 0; i < shard_count; ++i) {
+        SenderShard* shard = &shards[i];
+        queueSyncDestroy(&shard->outgoing_queue);
+        udpBatchDestroy(&shard->udp);
+        wakeupDestroy(&shard->wake);
+        close(shard->epoll_fd);
+        shard->epoll_fd = -1;
+        free(shard->taken);
+        shard->taken = NULL;
+    }
+    for(size_t room = 0; room < room_count; ++room) {
+        if(rooms[room].buffer != NULL) {
+            broadcastRelease(rooms[room].buffer);
+        }
+    }
+    free(rooms);
+    rooms = NULL;
+    room_count = 0;
     destroyMutex(&message_mutex);
 }
 
-void* startSending(void* no_arg) {
+// connections taken over from old server can have unsent bytes
+static void markQueuedConnection(Connection* connection, void* shard_arg) {
+    SenderShard* shard = shard_arg;
+    if(outboundIsEmpty(&connection->outbound) == false) {
+        markDirty(shard, connection);
+    }
+}
+
+// queues individual messages and game states taken now and flushes every connection that got something
+static void sendPass(SenderShard* shard) {
+    queueIndividualMessages(shard);
+    if(takeRoomBroadcasts(shard) > 0) {
+        queueBroadcasts(shard);
+        size_t syscalls_before = atomic_load(&shard->send_syscalls);
+        flushDirtyConnections(shard);
+        atomic_fetch_add(&broadcast_syscalls, atomic_load(&shard->send_syscalls) - syscalls_before);
+        releaseTakenBroadcasts(shard);
+    } else {
+        flushDirtyConnections(shard);
+    }
+}
+
+static void* startSending(void* shard_arg) {
+    SenderShard* shard = shard_arg;
     printThreadDebugInformation("startSending()");
-    while(isStopped() == false) {
-        lockMutex(&message_mutex);
-        if(waitForMessage(1) == -1) {
-            unlockMutex(&message_mutex);
+    struct epoll_event events[MAX_EVENTS];
+    forEachShardConnection(shard->index, markQueuedConnection, shard);
+    flushDirtyConnections(shard);
+    while(isStopped() == false && atomic_load(&draining) == false) {
+        int ready = epoll_wait(shard->epoll_fd, events, MAX_EVENTS, -1);
+        if(ready == -1) {
+            if(errno == EINTR) {
+                continue;
+            }
+            perror("epoll_wait() error");
             break;
         }
-        queueLock(&outgoing_queue);        
-        if(queueSyncIsEmpty(&outgoing_queue) == false) {
-            unlockMutex(&message_mutex);
-            IndividualMessage* ind_msg = queueSyncPopFront(&outgoing_queue);
-            queueUnlock(&outgoing_queue);
-            sendMessageTo(ind_msg->message, getClient(ind_msg->client_id), ind_msg->client_id);
-            freeOutgoingMessage(ind_msg->message);
-            free(ind_msg);
-        } else {
-            queueUnlock(&outgoing_queue);
-            Message msg = popMessageToEveryone();
-            unlockMutex(&message_mutex);
-            Array clients = getAllClients();
-            for(size_t i = 0; i < clients.size; ++i) {
-                Client client = *(Client*)(arrayUnsafeGetItem(&clients, i));
-                sendMessageTo(msg, client, i);
+        for(int i = 0; i < ready; ++i) {
+            if(events[i].data.ptr == &wake_tag) {
+                wakeupClear(&shard->wake);
+            } else {
+                handleWritable(shard, events[i].data.ptr);
             }
-            freeOutgoingMessage(msg);
-            arrayDestroy(&clients);
         }
+        sendPass(shard);
+    }
+    if(atomic_load(&draining)) {
+        sendPass(shard);
     }
-    queueLock(&outgoing_queue);
-    while(queueSyncIsEmpty(&outgoing_queue) == false) {
-        IndividualMessage* ind_msg = queueSyncPopFront(&outgoing_queue);
+    queueLock(&shard->outgoing_queue);
+    while(queueSyncIsEmpty(&shard->outgoing_queue) == false) {
+        IndividualMessage* ind_msg = queueSyncPopFront(&shard->outgoing_queue);
         freeOutgoingMessage(ind_msg->message);
         free(ind_msg);
     }
-    queueUnlock(&outgoing_queue);
-    freeOutgoingMessage(message_to_everyone);
+    queueUnlock(&shard->outgoing_queue);
+    while(shard->waiting_connections != NULL) {
+        stopWaitingForWrite(shard, shard->waiting_connections);
+    }
     return NULL;
 }
+
+int startSenders() {
+    for(size_t i = 0; i < shard_count; ++i) {
+        int err = pthread_create(&shards[i].thread_id, NULL, startSending, &shards[i]);
+        if(err != 0) {
+            errno = err;
+            perror("Couldn't create thread sending outgoing messages");
+            return err;
+        }
+        shards[i].thread_started = true;
+    }
+    return 0;
+}
+
+void stopSenders() {
+    for(size_t i = 0; i < shard_count; ++i) {
+        if(shards[i].thread_started) {
+            wakeupSignal(&shards[i].wake);
+            pthread_join(shards[i].thread_id, NULL);
+            shards[i].thread_started = false;
+        }
+    }
+}
+
+void drainSenders() {
+    atomic_store(&draining, true);
+    stopSenders();
+}
+
+size_t getBroadcastSequence() {
+    lockMutex(&message_mutex);
+    size_t sequence = broadcast_sequence;
+    unlockMutex(&message_mutex);
+    return sequence;
+}
+
+void setBroadcastSequence(size_t sequence) {
+    lockMutex(&message_mutex);
+    broadcast_sequence = sequence;
+    unlockMutex(&message_mutex);
+}
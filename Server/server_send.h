@@ -1,9 +1,24 @@
 #ifndef SERVER_SEND_H
 #define SERVER_SEND_H
+#include "server_connection.h"
+#include <stdbool.h>
 
-// arg is unused, returns NULL
-void* startSending(void*);
 void initOutgoingQueue();
 void destroyOutgoingQueue();
+// creates sender_threads sending threads, returns 0 if every one was created
+int startSenders();
+// wakes and joins sending threads, called after server is stopped
+void stopSenders();
+// sending threads queue everything given to sendTo() and sendToRoom() so far, flush it once and stop.
+// Used before handoff, unsent bytes stay in outbound queues
+void drainSenders();
+// number of game states given to sendToRoom(), continued by server taking over(UDP sequence numbers)
+size_t getBroadcastSequence();
+void setBroadcastSequence(size_t sequence);
+// applies tcp_send_policy and zerocopy_threshold to new client socket
+void configureSocketForSending(Connection* connection);
+// called by reactor after EPOLLERR, reads MSG_ZEROCOPY notifications.
+// returns true if socket has real error and needs to be closed
+bool readSocketErrorQueue(Connection* connection);
 
 #endif
@@ -0,0 +1,158 @@
+// memfd_create()
+#define _GNU_SOURCE
+#include "server_shm.h"
+#include "server_config.h"
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+// memfd and 3 eventfds
+#define HELLO_FDS 4
+
+static ShmRing ringAt(unsigned char* memory, size_t index, size_t ring_size) {
+    unsigned char* start = memory + index * (SHM_RING_HEADER_SIZE + ring_size);
+    return (ShmRing){.header = (ShmRingHeader*)start, .data = start + SHM_RING_HEADER_SIZE};
+}
+
+static int sendHello(int socket, int memfd, const ShmTransport* shm) {
+    uint32_t ring_size = (uint32_t)shm->ring_size;
+    int fds[HELLO_FDS] = {memfd, shm->client_event.fd, shm->server_data.fd, shm->server_space.fd};
+    char control[CMSG_SPACE(sizeof(fds))];
+    memset(control, 0, sizeof(control));
+    struct iovec iov = {.iov_base = &ring_size, .iov_len = sizeof(ring_size)};
+    struct msghdr msg = {.msg_iov = &iov, .msg_iovlen = 1, .msg_control = control, .msg_controllen = sizeof(control)};
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+    // new socket has empty send buffer, so small message can't block
+    if(sendmsg(socket, &msg, MSG_NOSIGNAL) != sizeof(ring_size)) {
+        perror("sendmsg(SCM_RIGHTS) error");
+        return -1;
+    }
+    return 0;
+}
+
+ShmTransport* shmCreate(int socket) {
+    ShmTransport* shm = calloc(1, sizeof(ShmTransport));
+    if(shm == NULL) {
+        perror("calloc() error!");
+        exit(1);
+    }
+    shm->client_event.fd = shm->server_data.fd = shm->server_space.fd = -1;
+    shm->memory = MAP_FAILED;
+    shm->ring_size = getServerConfig()->shm_ring_size;
+    shm->mapped_size = 2 * (SHM_RING_HEADER_SIZE + shm->ring_size);
+    atomic_init(&shm->closed, false);
+    int memfd = memfd_create("client rings", MFD_CLOEXEC);
+    if(memfd == -1) {
+        perror("memfd_create() error");
+        shmDestroy(shm);
+        return NULL;
+    }
+    // pages are zeroed, so both rings start empty
+    if(ftruncate(memfd, (off_t)shm->mapped_size) == -1) {
+        perror("ftruncate() error");
+    } else if((shm->memory = mmap(NULL, shm->mapped_size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0)) == MAP_FAILED) {
+        perror("mmap() error");
+    } else if(wakeupInit(&shm->client_event) == 0 && wakeupInit(&shm->server_data) == 0
+              && wakeupInit(&shm->server_space) == 0) {
+        shm->to_server = ringAt(shm->memory, 0, shm->ring_size);
+        shm->to_client = ringAt(shm->memory, 1, shm->ring_size);
+        if(sendHello(socket, memfd, shm) == 0) {
+            // mapping and client's duplicate keep memory alive
+            close(memfd);
+            return shm;
+        }
+    }
+    close(memfd);
+    shmDestroy(shm);
+    return NULL;
+}
+
+void shmDestroy(ShmTransport* shm) {
+    if(shm->memory != MAP_FAILED) {
+        munmap(shm->memory, shm->mapped_size);
+    }
+    wakeupDestroy(&shm->client_event);
+    wakeupDestroy(&shm->server_data);
+    wakeupDestroy(&shm->server_space);
+    free(shm);
+}
+
+// copies bytes between ring and iovecs starting at position, ring_to_iov chooses direction.
+// returns number of copied bytes, at most available
+static size_t copyRing(const ShmRing* ring, size_t ring_size, uint64_t position, size_t available,
+                       const struct iovec* iov, size_t iov_count, bool ring_to_iov) {
+    size_t copied = 0;
+    for(size_t i = 0; i < iov_count && copied < available; ++i) {
+        size_t length = iov[i].iov_len < available - copied ? iov[i].iov_len : available - copied;
+        unsigned char* buffer = iov[i].iov_base;
+        size_t done = 0;
+        while(done < length) {
+            size_t offset = (size_t)((position + copied + done) % ring_size);
+            size_t part = ring_size - offset < length - done ? ring_size - offset : length - done;
+            if(ring_to_iov) {
+                memcpy(buffer + done, ring->data + offset, part);
+            } else {
+                memcpy(ring->data + offset, buffer + done, part);
+            }
+            done += part;
+        }
+        copied += length;
+    }
+    return copied;
+}
+
+ssize_t shmReceive(void* shm_arg, size_t client_id, struct iovec* iov, size_t iov_count) {
+    (void)client_id;
+    ShmTransport* shm = shm_arg;
+    ShmRingHeader* header = shm->to_server.header;
+    wakeupClear(&shm->server_data);
+    uint64_t tail = atomic_load_explicit(&header->tail, memory_order_relaxed);
+    uint64_t head = atomic_load_explicit(&header->head, memory_order_acquire);
+    if(head - tail > shm->ring_size) {
+        fprintf(stderr, "client(%ld): corrupted shared memory ring\n", client_id);
+        return -1;
+    }
+    size_t received = copyRing(&shm->to_server, shm->ring_size, tail, (size_t)(head - tail), iov, iov_count, true);
+    if(received == 0) {
+        return 0;
+    }
+    atomic_store_explicit(&header->tail, tail + received, memory_order_release);
+    // pairs with fence of client that found ring full, either it sees new tail or server sees it waiting
+    atomic_thread_fence(memory_order_seq_cst);
+    if(atomic_load_explicit(&header->writer_waiting, memory_order_relaxed) == 1
+            && atomic_exchange(&header->writer_waiting, 0) == 1) {
+        wakeupSignal(&shm->client_event);
+    }
+    return (ssize_t)received;
+}
+
+ssize_t shmSend(ShmTransport* shm, const struct iovec* iov, size_t iov_count) {
+    ShmRingHeader* header = shm->to_client.header;
+    if(atomic_load(&shm->closed)) {
+        return -1;
+    }
+    uint64_t head = atomic_load_explicit(&header->head, memory_order_relaxed);
+    uint64_t tail = atomic_load_explicit(&header->tail, memory_order_acquire);
+    if(head - tail >= shm->ring_size) {
+        atomic_store(&header->writer_waiting, 1);
+        atomic_thread_fence(memory_order_seq_cst);
+        tail = atomic_load_explicit(&header->tail, memory_order_acquire);
+        if(head - tail >= shm->ring_size) {
+            return 0;
+        }
+        atomic_store(&header->writer_waiting, 0);
+    }
+    size_t sent = copyRing(&shm->to_client, shm->ring_size, head, (size_t)(shm->ring_size - (head - tail)),
+                           iov, iov_count, false);
+    atomic_store_explicit(&header->head, head + sent, memory_order_release);
+    wakeupSignal(&shm->client_event);
+    return (ssize_t)sent;
+}
@@ -0,0 +1,60 @@
+#ifndef SERVER_SHM_H
+#define SERVER_SHM_H
+#include "server_wakeup.h"
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+// Shared memory transport for clients on the same machine. After client connects to shm_socket_path server
+// sends hello over the socket: uint32_t ring size with memfd and three eventfds(SCM_RIGHTS). Memfd holds
+// two byte rings carrying the same frames as TCP: client to server ring first, server to client ring second.
+// Socket isn't used after hello, closing it disconnects client. Layout is described in Protokol_komunikacji.txt
+
+// ring header is followed by ring data at SHM_RING_HEADER_SIZE offset
+#define SHM_RING_HEADER_SIZE 256
+
+typedef struct {
+    // bytes ever written, changed only by writer
+    _Alignas(64) atomic_uint_least64_t head;
+    // bytes ever read, changed only by reader
+    _Alignas(64) atomic_uint_least64_t tail;
+    // 1 if writer found ring full and waits for reader to signal free space
+    _Alignas(64) atomic_uint writer_waiting;
+} ShmRingHeader;
+
+typedef struct {
+    ShmRingHeader* header;
+    unsigned char* data;
+} ShmRing;
+
+typedef struct {
+    unsigned char* memory;
+    size_t mapped_size;
+    size_t ring_size;
+    ShmRing to_server;
+    ShmRing to_client;
+    // signaled by server after writing to client ring or reading from full server ring
+    Wakeup client_event;
+    // signaled by client after writing to server ring, reactor epoll waits for it
+    Wakeup server_data;
+    // signaled by client after reading from client ring that server waits on, sending thread epoll waits for it
+    Wakeup server_space;
+    // set by reactor after client disconnected, sending thread stops waiting for space
+    atomic_bool closed;
+} ShmTransport;
+
+// creates rings and sends hello to client socket, returns NULL on error
+ShmTransport* shmCreate(int socket);
+// client has duplicates of eventfds, so closing them doesn't remove them from epolls. server_data has to be
+// removed before, server_space can stay only as disarmed EPOLLONESHOT registration that never reports
+void shmDestroy(ShmTransport* shm);
+// ReceiveFunction(server_receive.h) reading client to server ring, source is ShmTransport
+ssize_t shmReceive(void* shm, size_t client_id, struct iovec* iov, size_t iov_count);
+// writes as much of iov as fits into server to client ring. Returns number of written bytes,
+// 0 if ring is full(server_space will be signaled after client reads) or -1 if client disconnected
+ssize_t shmSend(ShmTransport* shm, const struct iovec* iov, size_t iov_count);
+
+#endif
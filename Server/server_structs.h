@@ -17,6 +17,110 @@ typedef struct {
     } message_type;
     size_t client_id;
     Message message;
+    // latency_timestamps, CLOCK_REALTIME nanoseconds(0 if unknown): kernel received last bytes of frame,
+    // reactor pushed message, host took it
+    uint64_t kernel_time_ns;
+    uint64_t pushed_time_ns;
+    uint64_t taken_time_ns;
 } IncomingMessage;
 
+typedef struct {
+    // frames and bytes(including 4 byte sizes) waiting in client's outbound queue
+    size_t queued_frames;
+    size_t queued_bytes;
+    size_t max_queued_bytes;
+    // game state frames dropped because client couldn't keep up
+    size_t dropped_frames;
+    size_t dropped_bytes;
+} ClientSendStats;
+
+typedef struct {
+    // game states given to sendToRoom(), all rooms together
+    size_t broadcasts;
+    // sendmsg() calls made while flushing broadcasts, individual messages waiting at the same time are sent with them
+    size_t broadcast_syscalls;
+    // every sendmsg() call, also ones made after EPOLLOUT
+    size_t send_syscalls;
+    // game states replaced by newer one before sender shard took them, counted for every shard that missed one
+    size_t conflated_frames;
+    size_t zerocopy_sends;
+    // game states sent over UDP channel
+    size_t udp_datagrams;
+    size_t udp_syscalls;
+    size_t udp_simulated_losses;
+} ServerSendStats;
+
+// flushes of game state that took under 64, 256, 1024, 4096, 16384 us and longer
+#define SENDER_LATENCY_BUCKETS 6
+
+typedef struct {
+    // game states queued and flushed by shard
+    size_t broadcasts;
+    // most of shard's connections that got one game state
+    size_t max_clients;
+    size_t send_syscalls;
+    // time from sendToRoom() to end of shard's flush, in microseconds
+    size_t total_latency_us;
+    size_t max_latency_us;
+    size_t latency_histogram[SENDER_LATENCY_BUCKETS];
+} SenderShardStats;
+
+// UDP channel offered to client in welcome message
+typedef struct {
+    uint16_t port;
+    uint32_t token;
+} UdpOffer;
+
+typedef struct {
+    size_t received_frames;
+    // recvmsg() calls made by reactors, one call can read many frames
+    size_t receive_syscalls;
+    // frames bigger than max_frame_size, their clients were disconnected
+    size_t oversized_frames;
+    // frames without message type, they were dropped
+    size_t empty_frames;
+} ServerReceiveStats;
+
+// stages of input latency(latency_timestamps), from kernel receiving frame to game state with its effect leaving kernel
+typedef enum {
+    // kernel receive timestamp to reactor pushing message
+    LATENCY_KERNEL_TO_USER,
+    // received messages queue, pushed to taken by host
+    LATENCY_QUEUE_WAIT,
+    // taken to room's update_mutex locked
+    LATENCY_LOCK_WAIT,
+    // applied to next game state of room serialized
+    LATENCY_APPLY_TO_BROADCAST,
+    // sendToRoom() to kernel send timestamp of sendmsg() with that game state, sampled per client
+    LATENCY_BROADCAST_TO_WIRE,
+    LATENCY_STAGES
+} LatencyStage;
+
+// samples under 16, 64, 256, 1024, 4096, 16384, 65536 us and longer
+#define LATENCY_BUCKETS 8
+
+typedef struct {
+    size_t samples;
+    size_t total_us;
+    size_t max_us;
+    size_t histogram[LATENCY_BUCKETS];
+} LatencyStageStats;
+
+#define RECEIVE_POOL_CLASSES 4
+
+typedef struct {
+    size_t block_size;
+    size_t blocks;
+    size_t in_use;
+    size_t max_in_use;
+} ReceivePoolClassStats;
+
+typedef struct {
+    ReceivePoolClassStats classes[RECEIVE_POOL_CLASSES];
+    // received payloads since process start
+    size_t allocations;
+    // payloads bigger than largest class or received while their class was empty
+    size_t fallback_mallocs;
+} ReceivePoolStats;
+
 #endif
@@ -0,0 +1,215 @@
+#define _GNU_SOURCE
+#include "server_udp.h"
+#include "server_internal.h"
+#include "server_config.h"
+#include "server.h"
+#include "server_handoff.h"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+// biggest UDP payload over IPv4
+#define MAX_DATAGRAM 65507
+#define SEQUENCE_SIZE sizeof(uint32_t)
+#define HELLO_SIZE (sizeof(uint64_t) + sizeof(uint32_t))
+// hello datagrams read with one recvmmsg()
+#define HELLO_BATCH 16
+// datagrams given to one sendmmsg()
+#define SEND_BATCH 1024
+
+static int udp_socket = -1;
+static atomic_size_t udp_datagrams;
+static atomic_size_t udp_syscalls;
+static atomic_size_t udp_losses;
+
+int openUdpSocket() {
+    const ServerConfig* config = getServerConfig();
+    atomic_store(&udp_datagrams, 0);
+    atomic_store(&udp_syscalls, 0);
+    atomic_store(&udp_losses, 0);
+    if(config->udp_port == 0) {
+        return 0;
+    }
+    // old server's socket keeps port bound during restart
+    udp_socket = takeHandedOffUdpSocket();
+    if(udp_socket != -1) {
+        printf("Game states over UDP on port: %ld(taken over), simulated loss: %ld%%\n", config->udp_port, config->udp_loss_percent);
+        return 0;
+    }
+    udp_socket = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(udp_socket == -1) {
+        perror("socket(UDP) error");
+        return -1;
+    }
+    struct sockaddr_in address = {.sin_family = AF_INET, .sin_addr = {.s_addr = htonl(INADDR_ANY)},
+                                  .sin_port = htons((uint16_t)config->udp_port)};
+    if(bind(udp_socket, (struct sockaddr*)&address, sizeof(address)) == -1) {
+        perror("bind(UDP) error");
+        closeUdpSocket();
+        return -1;
+    }
+    printf("Game states over UDP on port: %ld, simulated loss: %ld%%\n", config->udp_port, config->udp_loss_percent);
+    return 0;
+}
+
+void closeUdpSocket() {
+    if(udp_socket != -1) {
+        close(udp_socket);
+        udp_socket = -1;
+    }
+}
+
+int getUdpSocket() {
+    return udp_socket;
+}
+
+static void registerAddress(const unsigned char* hello, const struct sockaddr_in* address) {
+    uint64_t client_id;
+    uint32_t token;
+    memcpy(&client_id, hello, sizeof(client_id));
+    memcpy(&token, hello + sizeof(client_id), sizeof(token));
+    Connection* connection = acquireClientConnection((size_t)client_id);
+    if(connection == NULL) {
+        return;
+    }
+    int state = UDP_OFF;
+    // address is set once, sending thread reads it without locking after it sees UDP_READY
+    if(connection->udp_token == token && atomic_compare_exchange_strong(&connection->udp_state, &state, UDP_REGISTERING)) {
+        connection->udp_address = *address;
+        atomic_store_explicit(&connection->udp_state, UDP_READY, memory_order_release);
+    }
+    connectionRelease(connection);
+}
+
+void receiveUdpHellos() {
+    unsigned char buffers[HELLO_BATCH][HELLO_SIZE];
+    struct sockaddr_in senders[HELLO_BATCH];
+    struct iovec iov[HELLO_BATCH];
+    struct mmsghdr hellos[HELLO_BATCH];
+    while(true) {
+        for(size_t i = 0; i < HELLO_BATCH; ++i) {
+            iov[i] = (struct iovec){.iov_base = buffers[i], .iov_len = HELLO_SIZE};
+            hellos[i] = (struct mmsghdr){.msg_hdr = {.msg_name = &senders[i], .msg_namelen = sizeof(senders[i]),
+                                                     .msg_iov = &iov[i], .msg_iovlen = 1}};
+        }
+        int received = recvmmsg(udp_socket, hellos, HELLO_BATCH, MSG_DONTWAIT, NULL);
+        if(received == -1) {
+            if(errno != EAGAIN && errno != EINTR) {
+                perror("recvmmsg() error");
+            }
+            return;
+        }
+        for(int i = 0; i < received; ++i) {
+            if(hellos[i].msg_len == HELLO_SIZE && (hellos[i].msg_hdr.msg_flags & MSG_TRUNC) == 0) {
+                registerAddress(buffers[i], &senders[i]);
+            }
+        }
+        if(received < HELLO_BATCH) {
+            return;
+        }
+    }
+}
+
+bool udpCanSend(const BroadcastBuffer* buffer) {
+    return udp_socket != -1 && SEQUENCE_SIZE + buffer->message.size <= MAX_DATAGRAM;
+}
+
+void udpBatchInit(UdpBatch* batch, unsigned int seed) {
+    const ServerConfig* config = getServerConfig();
+    *batch = (UdpBatch){.loss_seed = seed};
+    if(config->udp_port == 0) {
+        return;
+    }
+    batch->addresses = malloc(config->max_clients * sizeof(struct sockaddr_in));
+    batch->datagrams = malloc(config->max_clients * sizeof(struct mmsghdr));
+    batch->sequences = malloc(config->max_clients * sizeof(uint32_t));
+    batch->iovecs = malloc(config->max_clients * 2 * sizeof(struct iovec));
+    if(batch->addresses == NULL || batch->datagrams == NULL || batch->sequences == NULL || batch->iovecs == NULL) {
+        perror("malloc() error!");
+        exit(1);
+    }
+}
+
+void udpBatchDestroy(UdpBatch* batch) {
+    free(batch->addresses);
+    free(batch->datagrams);
+    free(batch->sequences);
+    free(batch->iovecs);
+    batch->addresses = NULL;
+    batch->datagrams = NULL;
+    batch->sequences = NULL;
+    batch->iovecs = NULL;
+}
+
+void udpQueue(UdpBatch* batch, Connection* connection, const BroadcastBuffer* buffer, uint32_t sequence) {
+    size_t loss_percent = getServerConfig()->udp_loss_percent;
+    if(loss_percent > 0 && (size_t)(rand_r(&batch->loss_seed) % 100) < loss_percent) {
+        atomic_fetch_add_explicit(&udp_losses, 1, memory_order_relaxed);
+        return;
+    }
+    size_t index = batch->queued++;
+    batch->addresses[index] = connection->udp_address;
+    batch->sequences[index] = sequence;
+    // clients of the same room point to the same game state, nothing is copied
+    batch->iovecs[2 * index] = (struct iovec){.iov_base = &batch->sequences[index], .iov_len = SEQUENCE_SIZE};
+    batch->iovecs[2 * index + 1] = (struct iovec){.iov_base = buffer->message.data, .iov_len = buffer->message.size};
+}
+
+size_t udpFlush(UdpBatch* batch) {
+    struct sockaddr_in* addresses = batch->addresses;
+    struct mmsghdr* datagrams = batch->datagrams;
+    size_t queued = batch->queued;
+    if(queued == 0) {
+        return 0;
+    }
+    for(size_t i = 0; i < queued; ++i) {
+        datagrams[i] = (struct mmsghdr){.msg_hdr = {.msg_name = &addresses[i], .msg_namelen = sizeof(addresses[i]),
+                                                    .msg_iov = &batch->iovecs[2 * i], .msg_iovlen = 2}};
+    }
+    size_t syscalls = 0;
+    size_t sent = 0;
+    while(sent < queued) {
+        unsigned int count = queued - sent < SEND_BATCH ? (unsigned int)(queued - sent) : SEND_BATCH;
+        int result = sendmmsg(udp_socket, datagrams + sent, count, MSG_DONTWAIT);
+        ++syscalls;
+        if(result == -1) {
+            if(errno == EINTR) {
+                continue;
+            }
+            // datagrams are unreliable anyway, client will get next game state
+            if(errno != EAGAIN) {
+                perror("sendmmsg() error");
+            }
+            break;
+        }
+        sent += (size_t)result;
+    }
+    atomic_fetch_add_explicit(&udp_datagrams, sent, memory_order_relaxed);
+    atomic_fetch_add_explicit(&udp_syscalls, syscalls, memory_order_relaxed);
+    batch->queued = 0;
+    return syscalls;
+}
+
+void addUdpSendStats(ServerSendStats* stats) {
+    stats->udp_datagrams = atomic_load(&udp_datagrams);
+    stats->udp_syscalls = atomic_load(&udp_syscalls);
+    stats->udp_simulated_losses = atomic_load(&udp_losses);
+}
+
+int getClientUdpOffer(size_t client_id, UdpOffer* offer) {
+    if(udp_socket == -1) {
+        return 1;
+    }
+    Connection* connection = acquireClientConnection(client_id);
+    if(connection == NULL) {
+        return 1;
+    }
+    offer->port = (uint16_t)getServerConfig()->udp_port;
+    offer->token = connection->udp_token;
+    connectionRelease(connection);
+    return 0;
+}
@@ -0,0 +1,47 @@
+#ifndef SERVER_UDP_H
+#define SERVER_UDP_H
+#include "server_connection.h"
+#include "server_broadcast.h"
+
+// Optional unreliable channel for game states. Client gets udp_port, client_id and token in welcome message
+// and sends hello datagram(uint64_t client_id, uint32_t token) from its UDP socket. From then on game states
+// for that client are sent only as datagrams: uint32_t sequence number followed by game state data.
+// Everything else stays on TCP
+
+// opens socket if udp_port is set, returns 0 if UDP is disabled or socket was opened
+int openUdpSocket();
+void closeUdpSocket();
+// -1 if UDP is disabled
+int getUdpSocket();
+// called by reactor when UDP socket is readable, registers client addresses from hello datagrams
+void receiveUdpHellos();
+// true if game state fits in one datagram
+bool udpCanSend(const BroadcastBuffer* buffer);
+
+struct mmsghdr;
+
+// game state datagrams of one sender pass(clients of different rooms get different states),
+// every sender shard has its own batch
+typedef struct {
+    // max_clients long, allocated only if UDP is enabled
+    struct sockaddr_in* addresses;
+    struct mmsghdr* datagrams;
+    // sequence number and game state of every queued datagram, 2 iovecs each
+    uint32_t* sequences;
+    struct iovec* iovecs;
+    size_t queued;
+    // packet loss simulator state
+    unsigned int loss_seed;
+} UdpBatch;
+
+void udpBatchInit(UdpBatch* batch, unsigned int seed);
+void udpBatchDestroy(UdpBatch* batch);
+// adds datagram with buffer and sequence number for connection with udp_state == UDP_READY to next udpFlush().
+// buffer has to live until udpFlush()
+void udpQueue(UdpBatch* batch, Connection* connection, const BroadcastBuffer* buffer, uint32_t sequence);
+// sends every queued datagram with sendmmsg(), returns number of sendmmsg() calls
+size_t udpFlush(UdpBatch* batch);
+// adds UDP counters to stats
+void addUdpSendStats(ServerSendStats* stats);
+
+#endif
@@ -0,0 +1,52 @@
+#include "server_wakeup.h"
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <errno.h>
+
+int wakeupInit(Wakeup* wakeup) {
+    wakeup->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(wakeup->fd == -1) {
+        perror("eventfd() error");
+        return -1;
+    }
+    return 0;
+}
+
+void wakeupDestroy(Wakeup* wakeup) {
+    if(wakeup->fd != -1) {
+        close(wakeup->fd);
+        wakeup->fd = -1;
+    }
+}
+
+void wakeupSignal(const Wakeup* wakeup) {
+    uint64_t wake = 1;
+    // EAGAIN only if counter is full, thread is woken anyway
+    if(write(wakeup->fd, &wake, sizeof(wake)) == -1 && errno != EAGAIN) {
+        perror("write(eventfd) error");
+    }
+}
+
+bool wakeupClear(const Wakeup* wakeup) {
+    uint64_t wakes;
+    if(read(wakeup->fd, &wakes, sizeof(wakes)) == -1) {
+        if(errno != EAGAIN) {
+            perror("read(eventfd) error");
+        }
+        return false;
+    }
+    return true;
+}
+
+bool wakeupWait(const Wakeup* wakeup, long timeout_ms) {
+    struct pollfd pollfd = {.fd = wakeup->fd, .events = POLLIN};
+    int timeout = timeout_ms < 0 ? -1 : (int)timeout_ms;
+    int ready = poll(&pollfd, 1, timeout);
+    if(ready == -1 && errno != EINTR) {
+        perror("poll(eventfd) error");
+    }
+    return ready > 0 && wakeupClear(wakeup);
+}
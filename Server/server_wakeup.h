@@ -0,0 +1,29 @@
+#ifndef SERVER_WAKEUP_H
+#define SERVER_WAKEUP_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+
+// eventfd every blocking wait of server and host threads sleeps on. Any thread(also signal handler)
+// can signal it and waiting thread returns right away. fd can be added to epoll with EPOLLIN
+typedef struct {
+    int fd;
+} Wakeup;
+
+// returns 0 if eventfd was created
+int wakeupInit(Wakeup* wakeup);
+void wakeupDestroy(Wakeup* wakeup);
+// async-signal-safe, signals are counted until wakeupClear() or wakeupWait()
+void wakeupSignal(const Wakeup* wakeup);
+// clears signals without waiting, returns true if there were any
+bool wakeupClear(const Wakeup* wakeup);
+// waits up to timeout_ms(-1 waits forever) for signal and clears it, returns false on timeout
+bool wakeupWait(const Wakeup* wakeup, long timeout_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
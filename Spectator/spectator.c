@@ -0,0 +1,122 @@
+#include "spectator_upstream.h"
+#include "../Server/server.h"
+#include "../Server/server_config.h"
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+// Spectator relay: one spectator connection to host, game states of watched room are broadcast to any number
+// of viewers connected to relay's own server, so host's send cost doesn't grow with audience
+
+#define TAKE_BATCH 256
+#define PING 14
+
+// set by signal handler and when host disconnects
+static volatile sig_atomic_t stop_signal = 0;
+
+static void handleStopSignal(int signal_number) {
+    (void)signal_number;
+    stop_signal = 1;
+}
+
+static void freeBuffer(unsigned char* buffer) {
+    free(buffer);
+}
+
+static void stopAfterUpstreamClosed() {
+    stop_signal = 1;
+    interruptTake();
+}
+
+static int parseNumber(const char* value, size_t max, size_t* number) {
+    char* end;
+    errno = 0;
+    unsigned long long parsed = strtoull(value, &end, 10);
+    if(errno != 0 || end == value || *end != '\0' || value[0] == '-' || parsed > max) {
+        return 1;
+    }
+    *number = (size_t)parsed;
+    return 0;
+}
+
+static void handleViewerMessage(IncomingMessage* message) {
+    switch(message->message_type) {
+        case NEW_CONNECTION:
+            addViewer(message->client_id);
+            break;
+        case LOST_CONNECTION:
+            removeViewer(message->client_id);
+            break;
+        case MESSAGE:
+            // viewers can't play, only pings are answered(by relay, host doesn't see them)
+            if(message->message.size == 3 && message->message.data[0] == PING) {
+                Message pong = {.size = 3, .data = malloc(3)};
+                if(pong.data == NULL) {
+                    perror("malloc() error!");
+                    exit(1);
+                }
+                memcpy(pong.data, message->message.data, 3);
+                sendTo(pong, message->client_id);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    // bin/spectator upstream=ip:port|path [room=number] [delay_ms=number] [server_option=value...]
+    ServerConfig config = defaultServerConfig();
+    config.port = 5100;
+    const char* upstream = "127.0.0.1:5000";
+    size_t room = 0;
+    size_t delay_ms = 0;
+    for(int i = 1; i < argc; ++i) {
+        if(strncmp(argv[i], "upstream=", 9) == 0) {
+            upstream = argv[i] + 9;
+        } else if(strncmp(argv[i], "room=", 5) == 0) {
+            if(parseNumber(argv[i] + 5, UINT16_MAX - 1, &room) != 0) {
+                fprintf(stderr, "Wrong value for spectator option \"%s\"\n", argv[i]);
+                return 1;
+            }
+        } else if(strncmp(argv[i], "delay_ms=", 9) == 0) {
+            if(parseNumber(argv[i] + 9, 3600 * 1000, &delay_ms) != 0) {
+                fprintf(stderr, "Wrong value for spectator option \"%s\"\n", argv[i]);
+                return 1;
+            }
+        } else if(setServerOption(&config, argv[i]) != 0) {
+            return 1;
+        }
+    }
+    setServerConfig(config);
+    struct sigaction action = {.sa_handler = handleStopSignal};
+    sigfillset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    if(connectUpstream(upstream, room) != 0 || runServer(freeBuffer) != 0) {
+        stopUpstream();
+        return 1;
+    }
+    if(startUpstream(delay_ms, stopAfterUpstreamClosed) == 0) {
+        IncomingMessage messages[TAKE_BATCH];
+        while(stop_signal == 0) {
+            // wakes up every 100 ms to check stop_signal
+            size_t taken = takeMany(messages, TAKE_BATCH, 100);
+            for(size_t i = 0; i < taken; ++i) {
+                handleViewerMessage(&messages[i]);
+                freeMessage(messages[i]);
+            }
+        }
+    }
+    stopUpstream();
+    stopServer();
+    UpstreamStats stats = getUpstreamStats();
+    ServerSendStats send_stats = getServerSendStats();
+    printf("Spectator: %zu game states received, %zu sent, %zu late viewers got cached state, %zu send syscalls\n",
+           stats.received_states, stats.sent_states, stats.cached_sends, send_stats.send_syscalls);
+    return 0;
+}
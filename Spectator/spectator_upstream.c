@@ -0,0 +1,414 @@
+#include "spectator_upstream.h"
+#include "../Server/server.h"
+#include "../Server/server_mutex.h"
+#include "../Server/server_wakeup.h"
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+// message types of Protokol_komunikacji.txt
+#define WELCOME_MESSAGE 0
+#define GAME_MAP 1
+#define GAME_STATE 2
+#define PING 14
+#define SPECTATE 15
+#define WELCOME_SIZE 33
+// player id in welcome message of viewers, host never has that many players
+#define NO_PLAYER UINT16_MAX
+#define HANDSHAKE_TIMEOUT_S 5
+
+// game state waiting for delay_ms, FIFO
+typedef struct DelayedState {
+    struct DelayedState* next;
+    uint64_t due_ms;
+    Message state;
+} DelayedState;
+
+static int upstream_socket = -1;
+static pthread_t thread_id;
+static bool thread_started = false;
+static Wakeup stop_wake = {.fd = -1};
+static atomic_bool stopped = false;
+static size_t delay;
+static void (*close_callback)();
+
+// bytes received from host that don't make whole frame yet, used only by upstream thread(and connectUpstream())
+static unsigned char* receive_buffer = NULL;
+static size_t receive_capacity = 0;
+static size_t received = 0;
+static DelayedState* delayed_first = NULL;
+static DelayedState* delayed_last = NULL;
+
+// guards fields below, used by upstream thread and thread taking viewer connections
+static pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+// radii of player and projectile from host's welcome message
+static unsigned char radii[2 * sizeof(double)];
+static Message cached_map = {0};
+static Message cached_state = {0};
+static size_t* viewers = NULL;
+static size_t viewers_size = 0;
+static size_t viewers_capacity = 0;
+
+static atomic_size_t received_states;
+static atomic_size_t sent_states;
+static atomic_size_t cached_sends;
+
+static uint64_t nowMs() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000;
+}
+
+static Message copyMessage(const unsigned char* data, uint32_t size) {
+    Message copy = {.size = size, .data = malloc(size)};
+    if(copy.data == NULL) {
+        perror("malloc() error!");
+        exit(1);
+    }
+    memcpy(copy.data, data, size);
+    return copy;
+}
+
+static void replaceCached(Message* cached, const unsigned char* data, uint32_t size) {
+    free(cached->data);
+    *cached = copyMessage(data, size);
+}
+
+static int openUpstreamSocket(const char* address) {
+    int upstream;
+    int result;
+    if(address[0] == '/') {
+        struct sockaddr_un unix_address = {.sun_family = AF_UNIX};
+        if(strlen(address) >= sizeof(unix_address.sun_path)) {
+            fprintf(stderr, "Spectator: upstream path too long\n");
+            return -1;
+        }
+        strcpy(unix_address.sun_path, address);
+        if((upstream = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) == -1) {
+            perror("socket() error");
+            return -1;
+        }
+        result = connect(upstream, (struct sockaddr*)&unix_address, sizeof(unix_address));
+    } else {
+        struct sockaddr_in tcp_address = {.sin_family = AF_INET};
+        char ip[INET_ADDRSTRLEN] = "127.0.0.1";
+        unsigned port = 5000;
+        const char* separator = strchr(address, ':');
+        if(separator != NULL && (size_t)(separator - address) < sizeof(ip)) {
+            memcpy(ip, address, (size_t)(separator - address));
+            ip[separator - address] = '\0';
+            port = (unsigned)atoi(separator + 1);
+        } else if(separator == NULL && strlen(address) < sizeof(ip)) {
+            strcpy(ip, address);
+        }
+        if(inet_pton(AF_INET, ip, &tcp_address.sin_addr) != 1 || port == 0 || port > 65535) {
+            fprintf(stderr, "Spectator: wrong upstream address \"%s\", use ip:port or Unix socket path\n", address);
+            return -1;
+        }
+        tcp_address.sin_port = htons((uint16_t)port);
+        if((upstream = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0)) == -1) {
+            perror("socket() error");
+            return -1;
+        }
+        int nodelay = 1;
+        setsockopt(upstream, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+        result = connect(upstream, (struct sockaddr*)&tcp_address, sizeof(tcp_address));
+    }
+    if(result == -1) {
+        perror("Spectator: connect(upstream) error");
+        close(upstream);
+        return -1;
+    }
+    return upstream;
+}
+
+// reads what socket has into receive_buffer. Returns -1 if host disconnected
+static int receiveUpstream() {
+    // buffer starts with frame that isn't whole yet, it has to fit
+    size_t needed = received + 4096;
+    if(received >= sizeof(uint32_t)) {
+        uint32_t size;
+        memcpy(&size, receive_buffer, sizeof(size));
+        needed = needed > sizeof(size) + size ? needed : sizeof(size) + size;
+    }
+    if(needed > receive_capacity) {
+        while(needed > receive_capacity) {
+            receive_capacity = receive_capacity == 0 ? 65536 : receive_capacity * 2;
+        }
+        receive_buffer = realloc(receive_buffer, receive_capacity);
+        if(receive_buffer == NULL) {
+            perror("realloc() error!");
+            exit(1);
+        }
+    }
+    ssize_t result = recv(upstream_socket, receive_buffer + received, receive_capacity - received, 0);
+    if(result > 0) {
+        received += (size_t)result;
+        return 0;
+    }
+    if(result == -1 && (errno == EAGAIN || errno == EINTR)) {
+        return 0;
+    }
+    return -1;
+}
+
+// sends copy of message to every viewer, cache_mutex needs to be locked
+static void sendToViewers(const Message* message) {
+    for(size_t i = 0; i < viewers_size; ++i) {
+        sendTo(copyMessage(message->data, message->size), viewers[i]);
+    }
+}
+
+static void releaseState(Message state) {
+    lockMutex(&cache_mutex);
+    free(cached_state.data);
+    cached_state = state;
+    unlockMutex(&cache_mutex);
+    // server frees its copy after every viewer got it
+    sendToEveryone(copyMessage(state.data, state.size));
+    atomic_fetch_add_explicit(&sent_states, 1, memory_order_relaxed);
+}
+
+static void releaseDueStates(uint64_t now) {
+    while(delayed_first != NULL && delayed_first->due_ms <= now) {
+        DelayedState* first = delayed_first;
+        delayed_first = first->next;
+        if(delayed_first == NULL) {
+            delayed_last = NULL;
+        }
+        releaseState(first->state);
+        free(first);
+    }
+}
+
+static void handleFrame(const unsigned char* data, uint32_t size) {
+    if(size == 0) {
+        return;
+    }
+    switch(data[0]) {
+        case WELCOME_MESSAGE:
+            if(size >= 1 + 2 + sizeof(radii)) {
+                lockMutex(&cache_mutex);
+                memcpy(radii, data + 3, sizeof(radii));
+                unlockMutex(&cache_mutex);
+            }
+            break;
+        case GAME_MAP:
+            // new map comes after host moved relay to other room
+            lockMutex(&cache_mutex);
+            replaceCached(&cached_map, data, size);
+            sendToViewers(&cached_map);
+            unlockMutex(&cache_mutex);
+            break;
+        case GAME_STATE:
+            atomic_fetch_add_explicit(&received_states, 1, memory_order_relaxed);
+            if(delay == 0) {
+                releaseState(copyMessage(data, size));
+                break;
+            }
+            DelayedState* delayed = malloc(sizeof(DelayedState));
+            if(delayed == NULL) {
+                perror("malloc() error!");
+                exit(1);
+            }
+            *delayed = (DelayedState){.due_ms = nowMs() + delay, .state = copyMessage(data, size)};
+            if(delayed_last != NULL) {
+                delayed_last->next = delayed;
+            } else {
+                delayed_first = delayed;
+            }
+            delayed_last = delayed;
+            break;
+        default:
+            break;
+    }
+}
+
+// handles every whole frame in receive_buffer, returns types seen as bit mask
+static unsigned handleFrames() {
+    unsigned seen = 0;
+    size_t position = 0;
+    while(received - position >= sizeof(uint32_t)) {
+        uint32_t size;
+        memcpy(&size, receive_buffer + position, sizeof(size));
+        if(received - position - sizeof(size) < size) {
+            break;
+        }
+        const unsigned char* data = receive_buffer + position + sizeof(size);
+        if(size > 0 && data[0] < 8 * sizeof(seen)) {
+            seen |= 1u << data[0];
+        }
+        handleFrame(data, size);
+        position += sizeof(size) + size;
+    }
+    memmove(receive_buffer, receive_buffer + position, received - position);
+    received -= position;
+    return seen;
+}
+
+int connectUpstream(const char* address, size_t room) {
+    if((upstream_socket = openUpstreamSocket(address)) == -1) {
+        return 1;
+    }
+    nameMutex(&cache_mutex, "spectator cache_mutex");
+    // host sends welcome and map right after accepting relay
+    struct timeval timeout = {.tv_sec = HANDSHAKE_TIMEOUT_S};
+    setsockopt(upstream_socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    unsigned seen = 0;
+    unsigned wanted = 1u << WELCOME_MESSAGE | 1u << GAME_MAP;
+    while((seen & wanted) != wanted) {
+        if(receiveUpstream() != 0) {
+            fprintf(stderr, "Spectator: host didn't send welcome message and map\n");
+            return 1;
+        }
+        seen |= handleFrames();
+    }
+    // host removes relay's player, so it doesn't take part in the match
+    unsigned char spectate[sizeof(uint32_t) + 3] = {3, 0, 0, 0, SPECTATE, (unsigned char)(room & 0xFF), (unsigned char)(room >> 8)};
+    if(send(upstream_socket, spectate, sizeof(spectate), MSG_NOSIGNAL) != sizeof(spectate)) {
+        perror("Spectator: send(SPECTATE) error");
+        return 1;
+    }
+    fcntl(upstream_socket, F_SETFL, fcntl(upstream_socket, F_GETFL) | O_NONBLOCK);
+    printf("Spectator relay watches room %zu of %s\n", room, address);
+    return 0;
+}
+
+static void* runUpstream(void* arg) {
+    (void)arg;
+    struct pollfd fds[2] = {{.fd = upstream_socket, .events = POLLIN}, {.fd = stop_wake.fd, .events = POLLIN}};
+    while(atomic_load(&stopped) == false) {
+        int timeout = -1;
+        if(delayed_first != NULL) {
+            uint64_t now = nowMs();
+            timeout = delayed_first->due_ms > now ? (int)(delayed_first->due_ms - now) : 0;
+        }
+        if(poll(fds, 2, timeout) == -1 && errno != EINTR) {
+            perror("poll() error");
+            break;
+        }
+        if(fds[0].revents != 0) {
+            if(receiveUpstream() != 0) {
+                printf("Spectator: host disconnected\n");
+                close_callback();
+                break;
+            }
+            handleFrames();
+        }
+        releaseDueStates(nowMs());
+    }
+    return NULL;
+}
+
+int startUpstream(size_t delay_ms, void (*on_close)()) {
+    delay = delay_ms;
+    close_callback = on_close;
+    if(wakeupInit(&stop_wake) != 0) {
+        return 1;
+    }
+    int err = pthread_create(&thread_id, NULL, runUpstream, NULL);
+    if(err != 0) {
+        errno = err;
+        perror("Couldn't create upstream thread");
+        return 1;
+    }
+    thread_started = true;
+    return 0;
+}
+
+void stopUpstream() {
+    atomic_store(&stopped, true);
+    if(thread_started) {
+        wakeupSignal(&stop_wake);
+        pthread_join(thread_id, NULL);
+        thread_started = false;
+    }
+    wakeupDestroy(&stop_wake);
+    if(upstream_socket != -1) {
+        close(upstream_socket);
+        upstream_socket = -1;
+    }
+    while(delayed_first != NULL) {
+        DelayedState* first = delayed_first;
+        delayed_first = first->next;
+        free(first->state.data);
+        free(first);
+    }
+    delayed_last = NULL;
+    free(receive_buffer);
+    receive_buffer = NULL;
+    receive_capacity = received = 0;
+    free(cached_map.data);
+    free(cached_state.data);
+    cached_map = cached_state = (Message){0};
+    free(viewers);
+    viewers = NULL;
+    viewers_size = viewers_capacity = 0;
+}
+
+void addViewer(size_t viewer_id) {
+    UdpOffer offer = {0};
+    getClientUdpOffer(viewer_id, &offer);
+    unsigned char welcome[WELCOME_SIZE];
+    unsigned char* position = welcome;
+    uint16_t player = NO_PLAYER;
+    uint64_t client_id = viewer_id;
+    *position++ = WELCOME_MESSAGE;
+    memcpy(position, &player, sizeof(player));
+    position += sizeof(player);
+    lockMutex(&cache_mutex);
+    memcpy(position, radii, sizeof(radii));
+    position += sizeof(radii);
+    memcpy(position, &offer.port, sizeof(offer.port));
+    position += sizeof(offer.port);
+    memcpy(position, &client_id, sizeof(client_id));
+    position += sizeof(client_id);
+    memcpy(position, &offer.token, sizeof(offer.token));
+    sendTo(copyMessage(welcome, sizeof(welcome)), viewer_id);
+    sendTo(copyMessage(cached_map.data, cached_map.size), viewer_id);
+    // viewer would wait for next game state otherwise, with delay_ms that can be long
+    if(cached_state.data != NULL) {
+        sendTo(copyMessage(cached_state.data, cached_state.size), viewer_id);
+        atomic_fetch_add_explicit(&cached_sends, 1, memory_order_relaxed);
+    }
+    if(viewers_size == viewers_capacity) {
+        viewers_capacity = viewers_capacity == 0 ? 64 : viewers_capacity * 2;
+        viewers = realloc(viewers, viewers_capacity * sizeof(size_t));
+        if(viewers == NULL) {
+            perror("realloc() error!");
+            exit(1);
+        }
+    }
+    viewers[viewers_size++] = viewer_id;
+    unlockMutex(&cache_mutex);
+}
+
+void removeViewer(size_t viewer_id) {
+    lockMutex(&cache_mutex);
+    for(size_t i = 0; i < viewers_size; ++i) {
+        if(viewers[i] == viewer_id) {
+            viewers[i] = viewers[--viewers_size];
+            break;
+        }
+    }
+    unlockMutex(&cache_mutex);
+}
+
+UpstreamStats getUpstreamStats() {
+    return (UpstreamStats){.received_states = atomic_load(&received_states),
+                           .sent_states = atomic_load(&sent_states),
+                           .cached_sends = atomic_load(&cached_sends)};
+}
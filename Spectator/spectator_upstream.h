@@ -0,0 +1,29 @@
+#ifndef SPECTATOR_UPSTREAM_H
+#define SPECTATOR_UPSTREAM_H
+#include <stddef.h>
+#include <stdbool.h>
+
+// Connection of spectator relay to host. Relay is one client of host(spectator, without player),
+// game states of watched room are sent to every viewer as broadcast of relay's own server
+
+typedef struct {
+    // game states received from host and sent to viewers
+    size_t received_states;
+    size_t sent_states;
+    // viewers that joined late and got cached map and game state
+    size_t cached_sends;
+} UpstreamStats;
+
+// address is Unix socket path(starts with '/') or ip:port. Connects, waits for welcome and map(up to 5 s)
+// and asks host for spectator place in room. Returns 0 on success
+int connectUpstream(const char* address, size_t room);
+// starts thread receiving from host, game states are sent to viewers delay_ms after they came.
+// on_close is called from that thread when host disconnects
+int startUpstream(size_t delay_ms, void (*on_close)());
+void stopUpstream();
+// new viewer gets welcome message, latest map and latest sent game state
+void addViewer(size_t viewer_id);
+void removeViewer(size_t viewer_id);
+UpstreamStats getUpstreamStats();
+
+#endif
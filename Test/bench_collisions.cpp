@@ -0,0 +1,111 @@
+// compares brute force collision passes of Game::checkCollisions()(every player with every player, every
+// projectile with every player) with SpatialHash broadphase. Only dynamic pairs are timed, map geometry is the same
+// for both. usage: bench_collisions [arena size] [ticks]
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <string>
+#include "../Host/collisions.h"
+#include "../Host/spatial_hash.hpp"
+
+namespace {
+
+constexpr double player_radius = 30;
+constexpr double projectile_radius = 4;
+
+struct Scene {
+    std::vector<Circle> players;
+    std::vector<Circle> projectiles;
+};
+
+Scene generate(size_t players, size_t projectiles, double arena) {
+    std::mt19937 engine(42);
+    std::uniform_real_distribution<double> position(0, arena);
+    Scene scene;
+    for(size_t i = 0; i < players; ++i) {
+        scene.players.emplace_back(Point(position(engine), position(engine)), player_radius);
+    }
+    for(size_t i = 0; i < projectiles; ++i) {
+        scene.projectiles.emplace_back(Point(position(engine), position(engine)), projectile_radius);
+    }
+    return scene;
+}
+
+// returns colliding player pairs + projectile hits, so both passes can be compared
+size_t bruteForce(const Scene& scene) {
+    size_t found = 0;
+    for(size_t i = 0; i < scene.players.size(); ++i) {
+        for(size_t j = 0; j < scene.players.size(); ++j) {
+            found += i != j && checkCollision(scene.players[i], scene.players[j]);
+        }
+    }
+    for(const auto& projectile : scene.projectiles) {
+        for(const auto& player : scene.players) {
+            if(checkCollision(projectile, player)) {
+                ++found;
+                break;
+            }
+        }
+    }
+    return found;
+}
+
+size_t hashed(const Scene& scene, SpatialHash& grid, std::vector<Point>& centres) {
+    centres.clear();
+    for(const auto& player : scene.players) {
+        centres.push_back(player.centre);
+    }
+    grid.build(centres, player_radius);
+    size_t found = 0;
+    for(size_t i = 0; i < scene.players.size(); ++i) {
+        grid.forEachNear(scene.players[i].centre, 2 * player_radius, [&](uint32_t j) {
+            found += i != j && checkCollision(scene.players[i], scene.players[j]);
+        });
+    }
+    for(const auto& projectile : scene.projectiles) {
+        bool hit = false;
+        grid.forEachNear(projectile.centre, projectile.r, [&](uint32_t j) {
+            hit = hit || checkCollision(projectile, scene.players[j]);
+        });
+        found += hit;
+    }
+    return found;
+}
+
+template <typename Pass>
+double microsecondsPerTick(size_t ticks, size_t& found, Pass pass) {
+    auto start = std::chrono::steady_clock::now();
+    for(size_t tick = 0; tick < ticks; ++tick) {
+        found = pass();
+    }
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count()
+           / static_cast<double>(ticks);
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    double arena = argc > 1 ? std::stod(argv[1]) : 8000;
+    size_t ticks = argc > 2 ? std::stoul(argv[2]) : 5;
+    std::cout << "arena " << arena << "x" << arena << ", " << ticks << " ticks" << std::endl;
+    SpatialHash grid(64);
+    std::vector<Point> centres;
+    bool same = true;
+    for(size_t players : {10, 30, 100, 1000, 4000}) {
+        for(size_t projectiles : {100, 1000, 10000}) {
+            Scene scene = generate(players, projectiles, arena);
+            size_t brute_found = 0, hashed_found = 0;
+            double brute_us = microsecondsPerTick(ticks, brute_found, [&]() { return bruteForce(scene); });
+            double hashed_us = microsecondsPerTick(ticks, hashed_found, [&]() { return hashed(scene, grid, centres); });
+            same = same && brute_found == hashed_found;
+            std::cout << players << " players, " << projectiles << " projectiles: brute force " << brute_us
+                      << " us/tick, spatial hash " << hashed_us << " us/tick, collisions " << brute_found << "/"
+                      << hashed_found << std::endl;
+        }
+    }
+    if(same == false) {
+        std::cout << "spatial hash found different collisions" << std::endl;
+    }
+    return same ? 0 : 1;
+}
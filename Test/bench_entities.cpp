@@ -0,0 +1,145 @@
+// checks that every entity kernel variant(scalar, sse2, avx2) gives the same results as scalar code it replaced
+// (Point operators on array of structs and checkCollision()) and times them. Exits with 1 if any result differs.
+// usage: bench_entities [entities] [repeats]
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <algorithm>
+#include "../Host/collisions.h"
+#include "../Host/entity_store.hpp"
+
+namespace {
+
+constexpr double speed = 300;
+constexpr double timestep = 0.003;
+
+// entity as stored before columns
+struct OldEntity : Circle {
+    bool alive;
+    Vector velocity;
+};
+
+struct Data {
+    std::vector<OldEntity> old_entities;
+    EntityStore store;
+    SegmentColumns segments;
+    std::vector<uint32_t> indices;
+    std::vector<Circle> queries;
+};
+
+Data generate(size_t entities) {
+    std::mt19937 engine(42);
+    std::uniform_real_distribution<double> position(0, 1000);
+    std::uniform_real_distribution<double> direction(-1, 1);
+    std::uniform_real_distribution<double> radius(2, 40);
+    Data data;
+    for(size_t i = 0; i < entities; ++i) {
+        OldEntity entity;
+        entity.centre = Point(position(engine), position(engine));
+        entity.r = radius(engine);
+        entity.alive = i % 7 != 0;
+        entity.velocity = Vector(direction(engine), direction(engine));
+        data.old_entities.push_back(entity);
+        data.store.add(entity.centre, entity.velocity, entity.r, entity.alive, 100);
+        Point a(position(engine), position(engine));
+        // some segments are short or points, like broken map edges
+        Point b = i % 11 == 0 ? a : (i % 5 == 0 ? a + Point(direction(engine), direction(engine)) :
+                                     Point(position(engine), position(engine)));
+        data.segments.ax.push_back(a.x);
+        data.segments.ay.push_back(a.y);
+        data.segments.bx.push_back(b.x);
+        data.segments.by.push_back(b.y);
+        data.indices.push_back(static_cast<uint32_t>(i));
+    }
+    std::shuffle(data.indices.begin(), data.indices.end(), engine);
+    for(size_t i = 0; i < 16; ++i) {
+        data.queries.emplace_back(Point(position(engine), position(engine)), radius(engine) * 4);
+    }
+    return data;
+}
+
+template <typename Pass>
+double nanosecondsPerEntity(size_t repeats, size_t entities, Pass pass) {
+    auto start = std::chrono::steady_clock::now();
+    for(size_t repeat = 0; repeat < repeats; ++repeat) {
+        pass();
+    }
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count()
+           / static_cast<double>(repeats * entities);
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    size_t entities = argc > 1 ? std::stoul(argv[1]) : 10000;
+    size_t repeats = argc > 2 ? std::stoul(argv[2]) : 20;
+    Data data = generate(entities);
+    std::cout << entities << " entities, " << repeats << " repeats" << std::endl;
+
+    // reference results of old scalar code
+    std::vector<OldEntity> moved = data.old_entities;
+    double old_integrate_ns = nanosecondsPerEntity(1, entities, [&]() {
+        for(auto& entity : moved) {
+            if(entity.alive) {
+                entity.centre += entity.velocity * speed * timestep;
+            }
+        }
+    });
+    std::vector<uint8_t> circle_hits, segment_hits;
+    double old_circles_ns = nanosecondsPerEntity(1, entities * data.queries.size(), [&]() {
+        for(const auto& query : data.queries) {
+            for(uint32_t i : data.indices) {
+                circle_hits.push_back(checkCollision(query, static_cast<const Circle&>(data.old_entities[i])));
+            }
+        }
+    });
+    double old_segments_ns = nanosecondsPerEntity(1, entities * data.queries.size(), [&]() {
+        for(const auto& query : data.queries) {
+            for(uint32_t i : data.indices) {
+                segment_hits.push_back(checkCollision(query, Point(data.segments.ax[i], data.segments.ay[i]),
+                                                      Point(data.segments.bx[i], data.segments.by[i])));
+            }
+        }
+    });
+    std::cout << "old scalar: integrate " << old_integrate_ns << " ns, circles " << old_circles_ns
+              << " ns, segments " << old_segments_ns << " ns per entity" << std::endl;
+
+    bool same = true;
+    for(EntityKernels kernels : {EntityKernels::SCALAR, EntityKernels::SSE2, EntityKernels::AVX2}) {
+        if(!setEntityKernels(kernels)) {
+            std::cout << entityKernelsName(kernels) << ": not supported" << std::endl;
+            continue;
+        }
+        bool kernels_same = true;
+        EntityStore store = data.store;
+        integratePositions(store, speed, timestep);
+        for(size_t i = 0; i < entities; ++i) {
+            kernels_same = kernels_same && std::memcmp(&store.x[i], &moved[i].centre.x, sizeof(double)) == 0
+                           && std::memcmp(&store.y[i], &moved[i].centre.y, sizeof(double)) == 0;
+        }
+        std::vector<uint8_t> hits(entities);
+        for(size_t q = 0; q < data.queries.size(); ++q) {
+            overlapCircles(data.store, data.indices.data(), entities, data.queries[q], hits.data());
+            kernels_same = kernels_same && std::equal(hits.begin(), hits.end(), circle_hits.begin() + q * entities);
+            touchSegments(data.segments, data.indices.data(), entities, data.queries[q], hits.data());
+            kernels_same = kernels_same && std::equal(hits.begin(), hits.end(), segment_hits.begin() + q * entities);
+        }
+        double integrate_ns = nanosecondsPerEntity(repeats, entities, [&]() {
+            integratePositions(store, speed, timestep);
+        });
+        double circles_ns = nanosecondsPerEntity(repeats, entities, [&]() {
+            overlapCircles(data.store, data.indices.data(), entities, data.queries[0], hits.data());
+        });
+        double segments_ns = nanosecondsPerEntity(repeats, entities, [&]() {
+            touchSegments(data.segments, data.indices.data(), entities, data.queries[0], hits.data());
+        });
+        std::cout << entityKernelsName(kernels) << ": integrate " << integrate_ns << " ns, circles " << circles_ns
+                  << " ns, segments " << segments_ns << " ns per entity, "
+                  << (kernels_same ? "same as old scalar" : "DIFFERENT from old scalar") << std::endl;
+        same = same && kernels_same;
+    }
+    return same ? 0 : 1;
+}
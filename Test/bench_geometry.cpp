@@ -0,0 +1,128 @@
+// compares brute force map geometry checks of Game::checkCollisions()(every circle with every wall, obstacle and
+// border edge) with StaticGeometry grid on generated maps. Only collision tests are timed, nothing is moved.
+// usage: bench_geometry [circles] [ticks]
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <string>
+#include <cmath>
+#include "../Host/collisions.h"
+#include "../Host/static_geometry.hpp"
+
+namespace {
+
+constexpr double arena = 10000;
+constexpr double player_radius = 30;
+constexpr double projectile_radius = 4;
+
+struct GeneratedMap {
+    std::vector<Point> borders;
+    std::vector<Rectangle> walls;
+    std::vector<Circle> obstacles;
+};
+
+// round border with border_points edges, randomly rotated walls and obstacles inside it
+GeneratedMap generateMap(size_t walls, size_t obstacles, size_t border_points, std::mt19937& engine) {
+    std::uniform_real_distribution<double> position(0, arena);
+    std::uniform_real_distribution<double> size(20, 200);
+    std::uniform_real_distribution<double> angle(0, 2 * M_PI);
+    GeneratedMap game_map;
+    for(size_t i = 0; i < border_points; ++i) {
+        double point_angle = 2 * M_PI * static_cast<double>(i) / static_cast<double>(border_points);
+        game_map.borders.emplace_back(arena / 2 * (1 + std::cos(point_angle)), arena / 2 * (1 + std::sin(point_angle)));
+    }
+    for(size_t i = 0; i < walls; ++i) {
+        Point centre(position(engine), position(engine));
+        double wall_angle = angle(engine);
+        Vector length = Vector(std::cos(wall_angle), std::sin(wall_angle)) * size(engine);
+        Vector width = Vector(-std::sin(wall_angle), std::cos(wall_angle)) * (size(engine) / 4);
+        game_map.walls.emplace_back(centre, centre + length, centre + length + width, centre + width);
+    }
+    for(size_t i = 0; i < obstacles; ++i) {
+        game_map.obstacles.emplace_back(Point(position(engine), position(engine)), size(engine) / 4);
+    }
+    return game_map;
+}
+
+size_t bruteForce(const GeneratedMap& game_map, const std::vector<Circle>& circles) {
+    size_t found = 0;
+    for(const auto& circle : circles) {
+        for(const auto& wall : game_map.walls) {
+            found += checkCollision(circle, wall);
+        }
+        for(const auto& obstacle : game_map.obstacles) {
+            found += checkCollision(circle, obstacle);
+        }
+        for(size_t i = 0; i + 1 < game_map.borders.size(); ++i) {
+            found += checkCollision(circle, game_map.borders[i], game_map.borders[i + 1]);
+        }
+        found += checkCollision(circle, game_map.borders.back(), game_map.borders.front());
+    }
+    return found;
+}
+
+size_t grid(const StaticGeometry& geometry, const std::vector<Circle>& circles, GeometryQuery& query) {
+    size_t found = 0;
+    for(const auto& circle : circles) {
+        Point reach(circle.r, circle.r);
+        geometry.query(circle.centre - reach, circle.centre + reach, query);
+        for(uint32_t wall : query.walls) {
+            found += geometry.checkWall(circle, wall);
+        }
+        for(uint32_t obstacle : query.obstacles) {
+            found += geometry.checkObstacle(circle, obstacle);
+        }
+        for(uint32_t edge : query.edges) {
+            found += geometry.checkEdge(circle, edge);
+        }
+    }
+    return found;
+}
+
+template <typename Pass>
+double microsecondsPerTick(size_t ticks, size_t& found, Pass pass) {
+    auto start = std::chrono::steady_clock::now();
+    for(size_t tick = 0; tick < ticks; ++tick) {
+        found = pass();
+    }
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count()
+           / static_cast<double>(ticks);
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    size_t circles_size = argc > 1 ? std::stoul(argv[1]) : 1000;
+    size_t ticks = argc > 2 ? std::stoul(argv[2]) : 5;
+    std::mt19937 engine(42);
+    std::uniform_real_distribution<double> position(0, arena);
+    // a tenth are players, rest projectiles
+    std::vector<Circle> circles;
+    for(size_t i = 0; i < circles_size; ++i) {
+        circles.emplace_back(Point(position(engine), position(engine)), i % 10 == 0 ? player_radius : projectile_radius);
+    }
+    std::cout << "arena " << arena << "x" << arena << ", " << circles_size << " circles, " << ticks << " ticks"
+              << std::endl;
+    GeometryQuery query;
+    bool same = true;
+    for(size_t items : {10, 100, 1000, 5000}) {
+        GeneratedMap game_map = generateMap(items, items / 2, items / 4 + 4, engine);
+        StaticGeometry geometry;
+        auto build_start = std::chrono::steady_clock::now();
+        geometry.build(game_map.walls, game_map.obstacles, game_map.borders);
+        double build_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - build_start).count();
+        size_t brute_found = 0, grid_found = 0;
+        double brute_us = microsecondsPerTick(ticks, brute_found, [&]() { return bruteForce(game_map, circles); });
+        double grid_us = microsecondsPerTick(ticks, grid_found, [&]() { return grid(geometry, circles, query); });
+        same = same && brute_found == grid_found;
+        std::cout << game_map.walls.size() << " walls, " << game_map.obstacles.size() << " obstacles, "
+                  << game_map.borders.size() << " border edges: brute force " << brute_us << " us/tick, grid "
+                  << grid_us << " us/tick(build " << build_us << " us), collisions " << brute_found << "/"
+                  << grid_found << std::endl;
+    }
+    if(same == false) {
+        std::cout << "grid found different collisions" << std::endl;
+    }
+    return same ? 0 : 1;
+}
@@ -0,0 +1,130 @@
+// compares received messages queue(MpscQueue) with SynchronizedQueue + condition variable it replaced.
+// usage: bench_queue [producers] [messages per producer]
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <string>
+#include <pthread.h>
+#include <cerrno>
+#include <ctime>
+
+extern "C" {
+#include "../Server/server_queue.h"
+}
+#include "../Server/server_mpsc.h"
+#include "../Server/server_structs.h"
+
+namespace {
+
+struct LockedQueue {
+    SynchronizedQueue queue = queueSyncCreate(sizeof(IncomingMessage));
+    pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+
+    ~LockedQueue() {
+        queueSyncDestroy(&queue);
+    }
+
+    // same as old pushIncomingMessage()
+    void push(const IncomingMessage& message) {
+        queueLock(&queue);
+        queueSyncPushBack(&queue, &message);
+        pthread_cond_signal(&cond);
+        queueUnlock(&queue);
+    }
+
+    // same as old take()
+    IncomingMessage pop() {
+        IncomingMessage message{};
+        timespec time;
+        clock_gettime(CLOCK_REALTIME, &time);
+        time.tv_sec += 1;
+        queueLock(&queue);
+        while(queueSyncIsEmpty(&queue)) {
+            if(pthread_cond_timedwait(&cond, queue.mutex, &time) == ETIMEDOUT) {
+                break;
+            }
+        }
+        if(queueSyncIsEmpty(&queue) == false) {
+            queueSyncPopCopyFront(&queue, &message);
+        }
+        queueUnlock(&queue);
+        return message;
+    }
+};
+
+struct RingQueue {
+    MpscQueue* queue;
+
+    explicit RingQueue(size_t capacity) : queue(mpscCreate(sizeof(IncomingMessage), capacity)) {}
+
+    ~RingQueue() {
+        mpscDestroy(queue);
+    }
+
+    void push(const IncomingMessage& message) {
+        mpscPush(queue, &message, nullptr);
+    }
+
+    IncomingMessage pop() {
+        IncomingMessage message{};
+        mpscPop(queue, &message, 1000);
+        return message;
+    }
+};
+
+template <typename Queue>
+void run(const std::string& name, Queue& queue, size_t producers, size_t messages) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for(size_t producer = 0; producer < producers; ++producer) {
+        threads.emplace_back([&queue, producer, messages]() {
+            for(size_t i = 0; i < messages; ++i) {
+                IncomingMessage message{};
+                message.message_type = IncomingMessage::MESSAGE;
+                message.client_id = producer;
+                message.message.size = static_cast<uint32_t>(i);
+                queue.push(message);
+            }
+        });
+    }
+    std::vector<size_t> next(producers, 0);
+    size_t out_of_order = 0;
+    for(size_t i = 0; i < producers * messages; ++i) {
+        IncomingMessage message = queue.pop();
+        if(message.message_type != IncomingMessage::MESSAGE || message.message.size != next[message.client_id]++) {
+            ++out_of_order;
+        }
+    }
+    for(auto& thread : threads) {
+        thread.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << name << ": " << producers * messages / seconds / 1e6 << " M messages/s, "
+              << seconds * 1e9 / static_cast<double>(producers * messages) << " ns/message";
+    if(out_of_order != 0) {
+        std::cout << ", " << out_of_order << " messages lost or out of order!";
+    }
+    std::cout << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    size_t producers = argc > 1 ? std::stoul(argv[1]) : 4;
+    size_t messages = argc > 2 ? std::stoul(argv[2]) : 500000;
+    std::cout << producers << " producers, " << messages << " messages each" << std::endl;
+    {
+        LockedQueue queue;
+        run("SynchronizedQueue", queue, producers, messages);
+    }
+    {
+        RingQueue queue(64 * 1024);
+        run("MpscQueue(64k slots)", queue, producers, messages);
+    }
+    {
+        RingQueue queue(1024);
+        run("MpscQueue(1k slots)", queue, producers, messages);
+    }
+    return 0;
+}
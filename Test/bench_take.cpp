@@ -0,0 +1,104 @@
+// compares taking received messages one by one(take() + lock per message) with takeMany() + lock per batch.
+// usage: bench_take [producers] [messages per producer] [batch size]
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <string>
+#include <mutex>
+
+extern "C" {
+#include "../Server/server_receive.h"
+#include "../Server/server_pool.h"
+}
+#include "../Server/server.h"
+
+namespace {
+
+// stands for Game::update_mutex and game state changed by handleMessage()
+std::mutex update_mutex;
+size_t applied_bytes = 0;
+
+void apply(const IncomingMessage& message) {
+    for(uint32_t i = 0; i < message.message.size; ++i) {
+        applied_bytes += message.message.data[i];
+    }
+}
+
+void produce(size_t producers, size_t messages, std::vector<std::thread>& threads) {
+    for(size_t producer = 0; producer < producers; ++producer) {
+        threads.emplace_back([producer, messages]() {
+            for(size_t i = 0; i < messages; ++i) {
+                // PING sized payload, same as frames parsed by reactors
+                IncomingMessage message = {.message_type = IncomingMessage::MESSAGE, .client_id = producer,
+                                           .message = {.size = 3, .data = receivePoolAlloc(3)}};
+                message.message.data[0] = 14;
+                message.message.data[1] = static_cast<unsigned char>(i);
+                message.message.data[2] = static_cast<unsigned char>(i >> 8);
+                // server isn't running, so push gives up right away when queue is full
+                while(pushIncomingMessage(&message) == false) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+}
+
+void perMessage(size_t total) {
+    for(size_t i = 0; i < total; ++i) {
+        IncomingMessage message = take(1);
+        update_mutex.lock();
+        apply(message);
+        update_mutex.unlock();
+        freeMessage(message);
+    }
+}
+
+void batched(size_t total, size_t batch) {
+    std::vector<IncomingMessage> messages(batch);
+    size_t taken_total = 0;
+    size_t batches = 0;
+    while(taken_total < total) {
+        size_t taken = takeMany(messages.data(), batch, 1000);
+        update_mutex.lock();
+        for(size_t i = 0; i < taken; ++i) {
+            apply(messages[i]);
+        }
+        update_mutex.unlock();
+        for(size_t i = 0; i < taken; ++i) {
+            freeMessage(messages[i]);
+        }
+        taken_total += taken;
+        ++batches;
+    }
+    std::cout << "  average batch: " << static_cast<double>(total) / static_cast<double>(batches) << "\n";
+}
+
+template <typename Consumer>
+void run(const std::string& name, size_t producers, size_t messages, Consumer consume) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    produce(producers, messages, threads);
+    consume(producers * messages);
+    for(auto& thread : threads) {
+        thread.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << name << ": " << producers * messages / seconds / 1e6 << " M messages/s, "
+              << seconds * 1e9 / static_cast<double>(producers * messages) << " ns/message" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    size_t producers = argc > 1 ? std::stoul(argv[1]) : 2;
+    size_t messages = argc > 2 ? std::stoul(argv[2]) : 500000;
+    size_t batch = argc > 3 ? std::stoul(argv[3]) : 256;
+    std::cout << producers << " producers, " << messages << " messages each, batch " << batch << std::endl;
+    initReceivePool();
+    initReceivedQueue();
+    run("take() + lock per message", producers, messages, perMessage);
+    run("takeMany() + lock per batch", producers, messages, [batch](size_t total) { batched(total, batch); });
+    destroyReceivedQueue();
+    return applied_bytes == 0;
+}
@@ -0,0 +1,237 @@
+// gateway relays running in this process with fake servers: client is refused without server, load
+// report split between reads is applied, client goes to the least loaded server and bytes(also more than
+// pipe holds) are moved both ways until one side closes. Report with wrong size closes control channel.
+// usage: test_gateway [port]
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+extern "C" {
+#include "../Server/server_config.h"
+#include "../Server/server_gateway.h"
+#include "../Gateway/gateway_backends.h"
+#include "../Gateway/gateway_relay.h"
+}
+
+namespace {
+
+size_t failures = 0;
+
+void check(bool condition, const std::string& description) {
+    if(condition == false) {
+        ++failures;
+    }
+    printf("%s: %s\n", condition ? "OK" : "FAILED", description.c_str());
+    fflush(stdout);
+}
+
+void sendAll(int socket, const std::vector<unsigned char>& bytes) {
+    size_t sent = 0;
+    while(sent < bytes.size()) {
+        ssize_t result = send(socket, bytes.data() + sent, bytes.size() - sent, MSG_NOSIGNAL);
+        if(result <= 0) {
+            return;
+        }
+        sent += static_cast<size_t>(result);
+    }
+}
+
+// returns bytes socket got in 2 seconds, fewer than size if it was closed or timed out
+std::vector<unsigned char> receiveBytes(int socket, size_t size) {
+    timeval timeout = {2, 0};
+    setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    std::vector<unsigned char> bytes(size);
+    size_t received = 0;
+    while(received < size) {
+        ssize_t result = recv(socket, bytes.data() + received, size - received, 0);
+        if(result <= 0) {
+            break;
+        }
+        received += static_cast<size_t>(result);
+    }
+    bytes.resize(received);
+    return bytes;
+}
+
+// true if peer closed socket in 2 seconds
+bool isClosed(int socket) {
+    return receiveBytes(socket, 1).empty();
+}
+
+int connectClient(size_t port) {
+    int client = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if(client == -1 || connect(client, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == -1) {
+        perror("connect() error");
+        exit(1);
+    }
+    return client;
+}
+
+int openServerListener(const std::string& path) {
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    unlink(path.c_str());
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(listener == -1 || bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == -1
+       || listen(listener, 4) == -1) {
+        perror("server listener error");
+        exit(1);
+    }
+    return listener;
+}
+
+// load report frame of server reachable on Unix socket path
+std::vector<unsigned char> loadReport(const std::string& path, uint32_t players, uint32_t max_players) {
+    uint32_t size = static_cast<uint32_t>(GATEWAY_REPORT_SIZE + path.size());
+    uint16_t port = 0;
+    uint32_t load[3] = {players, 0, max_players};
+    std::vector<unsigned char> report(sizeof(size) + size);
+    unsigned char* position = report.data();
+    memcpy(position, &size, sizeof(size));
+    position += sizeof(size);
+    *position++ = GATEWAY_LOAD_REPORT;
+    memcpy(position, &port, sizeof(port));
+    position += sizeof(port);
+    memcpy(position, load, sizeof(load));
+    position += sizeof(load);
+    memcpy(position, path.data(), path.size());
+    return report;
+}
+
+// fake server connected to gateway control channel, control_socket is written by test
+struct FakeServer {
+    std::string path;
+    int listener;
+    int control_socket;
+    int backend;
+};
+
+FakeServer addServer(const std::string& path) {
+    int control[2];
+    if(socketpair(AF_UNIX, SOCK_STREAM, 0, control) == -1) {
+        perror("socketpair() error");
+        exit(1);
+    }
+    return {path, openServerListener(path), control[1], addBackend(control[0])};
+}
+
+// returns socket of relayed client accepted by one of servers, sets index of that server
+int acceptRelayed(const std::vector<FakeServer>& servers, size_t* index) {
+    std::vector<pollfd> fds;
+    for(const FakeServer& server : servers) {
+        fds.push_back({server.listener, POLLIN, 0});
+    }
+    if(poll(fds.data(), fds.size(), 2000) <= 0) {
+        return -1;
+    }
+    for(size_t i = 0; i < fds.size(); ++i) {
+        if(fds[i].revents & POLLIN) {
+            *index = i;
+            return accept(servers[i].listener, nullptr, nullptr);
+        }
+    }
+    return -1;
+}
+
+void testRefusedWithoutServer(size_t port) {
+    int client = connectClient(port);
+    check(isClosed(client), "client is closed when no server reported load");
+    check(getRelayStats().refused == 1, "refused client is counted");
+    close(client);
+}
+
+void testRelay(size_t port, std::vector<FakeServer>* servers) {
+    FakeServer& busy = servers->at(0);
+    FakeServer& idle = servers->at(1);
+    std::vector<unsigned char> report = loadReport(idle.path, 1, 10);
+    sendAll(idle.control_socket, std::vector<unsigned char>(report.begin(), report.begin() + 5));
+    receiveBackendReports(idle.backend);
+    BackendAddress address;
+    check(chooseBackend(&address) == false, "part of load report isn't applied");
+    sendAll(idle.control_socket, std::vector<unsigned char>(report.begin() + 5, report.end()));
+    receiveBackendReports(idle.backend);
+    sendAll(busy.control_socket, loadReport(busy.path, 5, 10));
+    receiveBackendReports(busy.backend);
+
+    int client = connectClient(port);
+    size_t chosen = servers->size();
+    int relayed = acceptRelayed(*servers, &chosen);
+    check(relayed != -1 && chosen == 1, "client is relayed to the least loaded server");
+    if(relayed == -1) {
+        close(client);
+        return;
+    }
+    std::vector<unsigned char> hello = {'h', 'e', 'l', 'l', 'o'};
+    sendAll(client, hello);
+    check(receiveBytes(relayed, hello.size()) == hello, "bytes of client reach server");
+    // more than pipe between sockets holds
+    std::vector<unsigned char> state(300000);
+    for(size_t i = 0; i < state.size(); ++i) {
+        state[i] = static_cast<unsigned char>(i * 7);
+    }
+    std::thread sender([relayed, &state] { sendAll(relayed, state); });
+    check(receiveBytes(client, state.size()) == state, "bytes of server reach client in order");
+    sender.join();
+    RelayStats stats = getRelayStats();
+    check(stats.relays == 1 && stats.client_bytes == hello.size() && stats.server_bytes == state.size(),
+          "relayed bytes are counted");
+    close(relayed);
+    check(isClosed(client), "client is closed after server closed relay");
+    close(client);
+}
+
+void testWrongReport(FakeServer* server) {
+    uint32_t size = 1u << 30;
+    sendAll(server->control_socket, std::vector<unsigned char>(reinterpret_cast<unsigned char*>(&size),
+                                                               reinterpret_cast<unsigned char*>(&size) + sizeof(size)));
+    check(receiveBackendReports(server->backend) == -1, "load report bigger than buffer closes control channel");
+    removeBackend(server->backend);
+    server->backend = -1;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    size_t port = argc > 1 ? std::stoul(argv[1]) : 5102;
+    ServerConfig config = defaultServerConfig();
+    config.port = port;
+    config.io_threads = 2;
+    setServerConfig(config);
+    initBackends();
+    if(startRelays() != 0) {
+        stopRelays();
+        std::cout << "Error during startRelays()\n";
+        return 1;
+    }
+    testRefusedWithoutServer(port);
+    std::string prefix = "/tmp/test_gateway_" + std::to_string(getpid());
+    std::vector<FakeServer> servers = {addServer(prefix + "_busy.sock"), addServer(prefix + "_idle.sock")};
+    testRelay(port, &servers);
+    testWrongReport(&servers[0]);
+    stopRelays();
+    destroyBackends();
+    for(const FakeServer& server : servers) {
+        close(server.listener);
+        close(server.control_socket);
+        unlink(server.path.c_str());
+    }
+    printf("test_gateway: %zu failed\n", failures);
+    return failures == 0 ? 0 : 1;
+}
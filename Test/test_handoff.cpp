@@ -0,0 +1,215 @@
+// takeOverServer() with fake old server sending broken handoff: every case fails without closing sockets
+// it didn't receive(descriptor 0 used to be closed when blob ended inside client list) and without leaking
+// the ones it did. Last case checks that fake old server speaks the same protocol as handOffServer().
+// usage: test_handoff [socket path]
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+extern "C" {
+#include "../Server/server_config.h"
+}
+#include "../Server/server.h"
+
+namespace {
+
+// "PRSH", first 4 bytes of blob
+const uint32_t HANDOFF_MAGIC = 0x48535250u;
+size_t failures = 0;
+
+void check(bool condition, const std::string& description) {
+    if(condition == false) {
+        ++failures;
+    }
+    printf("%s: %s\n", condition ? "OK" : "FAILED", description.c_str());
+    fflush(stdout);
+}
+
+void append(std::vector<unsigned char>* blob, const void* bytes, size_t size) {
+    const unsigned char* data = static_cast<const unsigned char*>(bytes);
+    blob->insert(blob->end(), data, data + size);
+}
+
+void appendSize(std::vector<unsigned char>* blob, uint64_t value) {
+    append(blob, &value, sizeof(value));
+}
+
+// blob of server without UDP and Unix listeners, client list is left for caller
+std::vector<unsigned char> blobHeader(uint64_t listeners) {
+    std::vector<unsigned char> blob;
+    append(&blob, &HANDOFF_MAGIC, sizeof(HANDOFF_MAGIC));
+    appendSize(&blob, 0); // port
+    appendSize(&blob, 0); // udp_port
+    appendSize(&blob, 0); // broadcast sequence
+    appendSize(&blob, listeners);
+    blob.insert(blob.end(), {0, 0, 0}); // no UDP socket, no Unix listeners
+    return blob;
+}
+
+int openListener(const std::string& path) {
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    unlink(path.c_str());
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(listener == -1 || bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == -1
+       || listen(listener, 1) == -1) {
+        perror("handoff listener error");
+        exit(1);
+    }
+    return listener;
+}
+
+// old server: blob size, blob and one batch of sockets, then waits until new server closes connection
+void oldServer(int listener, uint64_t declared_size, std::vector<unsigned char> blob, std::vector<int> fds) {
+    int connection = accept(listener, nullptr, nullptr);
+    if(connection == -1) {
+        return;
+    }
+    send(connection, &declared_size, sizeof(declared_size), MSG_NOSIGNAL);
+    send(connection, blob.data(), blob.size(), MSG_NOSIGNAL);
+    if(fds.empty() == false) {
+        std::vector<char> control(CMSG_SPACE(sizeof(int) * fds.size()));
+        unsigned char byte = 0;
+        iovec iov = {&byte, 1};
+        msghdr msg = {};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control.data();
+        msg.msg_controllen = control.size();
+        cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+        memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * fds.size());
+        sendmsg(connection, &msg, MSG_NOSIGNAL);
+    }
+    shutdown(connection, SHUT_WR);
+    char rest[64];
+    while(recv(connection, rest, sizeof(rest), 0) > 0) {
+    }
+    close(connection);
+}
+
+size_t openDescriptors() {
+    size_t count = 0;
+    DIR* directory = opendir("/proc/self/fd");
+    if(directory == nullptr) {
+        return 0;
+    }
+    while(readdir(directory) != nullptr) {
+        ++count;
+    }
+    closedir(directory);
+    return count;
+}
+
+bool isOpen(int fd) {
+    return fcntl(fd, F_GETFD) != -1;
+}
+
+struct TakeOver {
+    int result;
+    std::vector<unsigned char> snapshot;
+};
+
+TakeOver takeOver(const std::string& path, uint64_t declared_size, const std::vector<unsigned char>& blob,
+                  const std::vector<int>& fds = {}) {
+    int listener = openListener(path);
+    std::thread old_server(oldServer, listener, declared_size, blob, fds);
+    unsigned char* snapshot = nullptr;
+    size_t snapshot_size = 0;
+    TakeOver take_over = {takeOverServer(&snapshot, &snapshot_size), {}};
+    if(take_over.result == 0) {
+        take_over.snapshot.assign(snapshot, snapshot + snapshot_size);
+        free(snapshot);
+    }
+    old_server.join();
+    close(listener);
+    unlink(path.c_str());
+    return take_over;
+}
+
+// sockets that existed before handoff are open and none was left by it
+void checkDescriptors(size_t before, int sentinel, const std::string& description) {
+    bool untouched = isOpen(STDIN_FILENO) && isOpen(sentinel) && openDescriptors() == before;
+    check(untouched, description + " keeps descriptors");
+}
+
+void testBrokenHandoffs(const std::string& path, int sentinel) {
+    size_t before = openDescriptors();
+    std::vector<unsigned char> blob = blobHeader(0);
+    blob[0] ^= 0xFF;
+    check(takeOver(path, blob.size(), blob).result == -1, "wrong magic is rejected");
+    checkDescriptors(before, sentinel, "wrong magic");
+
+    blob = blobHeader(1000000);
+    check(takeOver(path, blob.size(), blob).result == -1, "listener count bigger than blob is rejected");
+    checkDescriptors(before, sentinel, "listener count");
+
+    // blob ends inside first of two clients, their sockets were 0 and clearHandoff() closed stdin
+    blob = blobHeader(0);
+    appendSize(&blob, 2);
+    appendSize(&blob, 1); // client_id
+    appendSize(&blob, 0); // room
+    check(takeOver(path, blob.size(), blob).result == -1, "blob ending inside client list is rejected");
+    checkDescriptors(before, sentinel, "blob ending inside client list");
+
+    blob = blobHeader(0);
+    appendSize(&blob, 0);
+    check(takeOver(path, blob.size() + 100, blob).result == -1, "connection closed before whole blob is rejected");
+    checkDescriptors(before, sentinel, "connection closed before whole blob");
+
+    // two listeners are described, one socket comes, it has to be closed
+    blob = blobHeader(2);
+    appendSize(&blob, 0); // clients
+    appendSize(&blob, 0); // waiting
+    appendSize(&blob, 0); // snapshot
+    check(takeOver(path, blob.size(), blob, {sentinel}).result == -1, "wrong number of sockets is rejected");
+    checkDescriptors(before, sentinel, "wrong number of sockets");
+}
+
+void testHandoff(const std::string& path) {
+    std::vector<unsigned char> blob = blobHeader(0);
+    appendSize(&blob, 0); // clients
+    appendSize(&blob, 0); // waiting
+    const std::vector<unsigned char> snapshot = {'g', 'a', 'm', 'e'};
+    appendSize(&blob, snapshot.size());
+    blob.insert(blob.end(), snapshot.begin(), snapshot.end());
+    TakeOver take_over = takeOver(path, blob.size(), blob);
+    check(take_over.result == 0 && take_over.snapshot == snapshot, "server without clients is taken over with snapshot");
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    std::string path = argc > 1 ? argv[1] : "/tmp/test_handoff_" + std::to_string(getpid()) + ".sock";
+    // make test can run without stdin
+    if(isOpen(STDIN_FILENO) == false) {
+        open("/dev/null", O_RDONLY);
+    }
+    int sentinel[2];
+    if(pipe(sentinel) == -1) {
+        perror("pipe() error");
+        return 1;
+    }
+    ServerConfig config = defaultServerConfig();
+    strncpy(config.handoff_socket_path, path.c_str(), SOCKET_PATH_SIZE - 1);
+    setServerConfig(config);
+    testBrokenHandoffs(path, sentinel[1]);
+    testHandoff(path);
+    close(sentinel[0]);
+    close(sentinel[1]);
+    printf("test_handoff: %zu failed\n", failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,275 @@
+// receive path of server running in this process: full receive queue stops reading connection(reactor sleeps
+// instead of spinning) and reading resumes after queue is drained, every frame arrives once and in order.
+// Empty frames are dropped, oversized ones disconnect client and frames split between packets are joined.
+// Slot of stopped client is reused with newer id, messages for old id don't reach new client.
+// usage: test_receive [port]
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <ctime>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+extern "C" {
+#include "../Server/server_config.h"
+}
+#include "../Server/server.h"
+
+namespace {
+
+const unsigned char PING = 14;
+const size_t QUEUE_CAPACITY = 64;
+const size_t MAX_FRAME_SIZE = 256;
+const size_t MAX_CLIENTS = 4;
+const size_t SLOT_MASK = 0xFFFF;
+size_t failures = 0;
+
+void check(bool condition, const std::string& description) {
+    if(condition == false) {
+        ++failures;
+    }
+    printf("%s: %s\n", condition ? "OK" : "FAILED", description.c_str());
+    fflush(stdout);
+}
+
+int connectClient(size_t port) {
+    int client = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if(client == -1 || connect(client, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == -1) {
+        perror("connect() error");
+        exit(1);
+    }
+    return client;
+}
+
+void sendAll(int client, const std::vector<unsigned char>& bytes) {
+    size_t sent = 0;
+    while(sent < bytes.size()) {
+        ssize_t result = send(client, bytes.data() + sent, bytes.size() - sent, MSG_NOSIGNAL);
+        if(result <= 0) {
+            return;
+        }
+        sent += static_cast<size_t>(result);
+    }
+}
+
+// returns false if client didn't get size bytes in 2 seconds
+bool receiveAll(int client, unsigned char* bytes, size_t size) {
+    timeval timeout = {2, 0};
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    size_t received = 0;
+    while(received < size) {
+        ssize_t result = recv(client, bytes + received, size - received, 0);
+        if(result <= 0) {
+            return false;
+        }
+        received += static_cast<size_t>(result);
+    }
+    return true;
+}
+
+// frames with 4 byte size, PING type and 2 byte sequence
+std::vector<unsigned char> pingFrames(size_t count) {
+    std::vector<unsigned char> bytes;
+    for(size_t i = 0; i < count; ++i) {
+        unsigned char frame[7] = {3, 0, 0, 0, PING, static_cast<unsigned char>(i), static_cast<unsigned char>(i >> 8)};
+        bytes.insert(bytes.end(), frame, frame + sizeof(frame));
+    }
+    return bytes;
+}
+
+double processSeconds() {
+    timespec time;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time);
+    return static_cast<double>(time.tv_sec) + static_cast<double>(time.tv_nsec) / 1e9;
+}
+
+// CPU time used by process while this thread sleeps, idle reactors wait in epoll_wait()
+double cpuWhileSleeping(std::chrono::milliseconds duration) {
+    double start = processSeconds();
+    std::this_thread::sleep_for(duration);
+    return (processSeconds() - start) * 1000.0 / static_cast<double>(duration.count());
+}
+
+// waits for message of given type, messages of other types are freed
+bool takeType(IncomingMessage::MessageType type, IncomingMessage* result) {
+    for(int i = 0; i < 20; ++i) {
+        IncomingMessage message;
+        if(takeMany(&message, 1, 100) == 0) {
+            continue;
+        }
+        if(message.message_type == type) {
+            *result = message;
+            return true;
+        }
+        freeMessage(message);
+    }
+    return false;
+}
+
+// takes count PING frames, returns number of them that came in order
+size_t takePings(size_t count) {
+    std::vector<IncomingMessage> messages(QUEUE_CAPACITY);
+    size_t taken = 0, in_order = 0, timeouts = 0;
+    while(taken < count && timeouts < 20) {
+        size_t size = takeMany(messages.data(), messages.size(), 100);
+        timeouts = size == 0 ? timeouts + 1 : 0;
+        for(size_t i = 0; i < size; ++i) {
+            const Message& message = messages[i].message;
+            if(messages[i].message_type == IncomingMessage::MESSAGE && message.size == 3 && message.data[0] == PING) {
+                size_t sequence = message.data[1] | static_cast<size_t>(message.data[2]) << 8;
+                in_order += sequence == (taken & 0xFFFF);
+                ++taken;
+            }
+            freeMessage(messages[i]);
+        }
+    }
+    return in_order;
+}
+
+void testBackpressure(size_t port) {
+    int client = connectClient(port);
+    IncomingMessage connected;
+    check(takeType(IncomingMessage::NEW_CONNECTION, &connected), "client connects");
+    const size_t frames = QUEUE_CAPACITY * 50;
+    sendAll(client, pingFrames(frames));
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    // reactor used to yield in a loop until queue had free slot
+    double blocked_cpu = cpuWhileSleeping(std::chrono::milliseconds(300));
+    check(blocked_cpu < 0.3, "reactor sleeps while receive queue is full, cpu " + std::to_string(blocked_cpu));
+    check(takePings(frames) == frames, "every frame is taken in order after queue drains");
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    // reactors are woken to resume connection, wake has to be cleared or epoll_wait() returns right away
+    double drained_cpu = cpuWhileSleeping(std::chrono::milliseconds(300));
+    check(drained_cpu < 0.3, "reactors block in epoll_wait() after queue drained, cpu " + std::to_string(drained_cpu));
+    // connection is read again
+    sendAll(client, pingFrames(3));
+    check(takePings(3) == 3, "connection is read after it was resumed");
+    close(client);
+}
+
+void testFrames(size_t port) {
+    int client = connectClient(port);
+    IncomingMessage connected;
+    check(takeType(IncomingMessage::NEW_CONNECTION, &connected), "client connects");
+    ServerReceiveStats before = getServerReceiveStats();
+    // empty frame between two pings, second ping is split in the middle of its size
+    std::vector<unsigned char> bytes = {0, 0, 0, 0};
+    std::vector<unsigned char> pings = pingFrames(2);
+    bytes.insert(bytes.begin(), pings.begin(), pings.begin() + 7);
+    bytes.insert(bytes.end(), pings.begin() + 7, pings.begin() + 9);
+    sendAll(client, bytes);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    sendAll(client, std::vector<unsigned char>(pings.begin() + 9, pings.end()));
+    check(takePings(2) == 2, "frames around empty one and frame split between sends are taken");
+    check(getServerReceiveStats().empty_frames == before.empty_frames + 1, "empty frame is dropped and counted");
+    uint32_t oversized = MAX_FRAME_SIZE + 1;
+    std::vector<unsigned char> size_bytes(reinterpret_cast<unsigned char*>(&oversized),
+                                          reinterpret_cast<unsigned char*>(&oversized) + sizeof(oversized));
+    sendAll(client, size_bytes);
+    IncomingMessage lost;
+    bool disconnected = takeType(IncomingMessage::LOST_CONNECTION, &lost) && lost.client_id == connected.client_id;
+    check(disconnected, "client sending frame bigger than max_frame_size is disconnected");
+    check(getServerReceiveStats().oversized_frames == before.oversized_frames + 1, "oversized frame is counted");
+    close(client);
+}
+
+Message textMessage(const std::string& text) {
+    Message message;
+    message.size = static_cast<uint32_t>(text.size());
+    message.data = new unsigned char[text.size()];
+    memcpy(message.data, text.data(), text.size());
+    return message;
+}
+
+// every client before this one has stopped, so all MAX_CLIENTS slots are in free FIFO
+void testSlotReuse(size_t port) {
+    std::vector<size_t> ids;
+    int client = -1;
+    for(size_t i = 0; i <= MAX_CLIENTS; ++i) {
+        client = connectClient(port);
+        IncomingMessage connected;
+        if(takeType(IncomingMessage::NEW_CONNECTION, &connected) == false) {
+            check(false, "client connects to reused slot");
+            close(client);
+            return;
+        }
+        ids.push_back(connected.client_id);
+        if(i < MAX_CLIENTS) {
+            close(client);
+            IncomingMessage lost;
+            takeType(IncomingMessage::LOST_CONNECTION, &lost);
+        }
+    }
+    bool unique = true, in_range = true;
+    for(size_t i = 0; i < ids.size(); ++i) {
+        in_range = in_range && (ids[i] & SLOT_MASK) < MAX_CLIENTS;
+        for(size_t j = 0; j < i; ++j) {
+            unique = unique && ids[i] != ids[j];
+        }
+    }
+    check(in_range, "slots stay below max_clients");
+    check(unique, "client ids aren't reused");
+    size_t old_id = ids.front(), new_id = ids.back();
+    check((old_id & SLOT_MASK) == (new_id & SLOT_MASK), "slot of first stopped client is reused last");
+    ClientSendStats stats;
+    check(getClientSendStats(old_id, &stats) != 0 && getClientSendStats(new_id, &stats) == 0,
+          "stats of reused slot belong to new client");
+    check(setClientRoom(old_id, 0) != 0, "old id of reused slot can't change room");
+    // message for old id is dropped, so first frame new client gets is its own
+    sendTo(textMessage("old"), old_id);
+    sendTo(textMessage("new"), new_id);
+    unsigned char frame[7];
+    bool received = receiveAll(client, frame, sizeof(frame));
+    check(received && frame[0] == 3 && memcmp(frame + 4, "new", 3) == 0, "message for old id doesn't reach new client");
+    close(client);
+    IncomingMessage lost;
+    takeType(IncomingMessage::LOST_CONNECTION, &lost);
+}
+
+// server with full queue and connection that can't be read used to hang in stopServer()
+void testStopWithFullQueue(size_t port) {
+    int client = connectClient(port);
+    sendAll(client, pingFrames(QUEUE_CAPACITY * 4));
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    // LOST_CONNECTION needs free slot too
+    close(client);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    alarm(10);
+    stopServer();
+    alarm(0);
+    check(true, "server stops with full receive queue");
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    size_t port = argc > 1 ? std::stoul(argv[1]) : 5100;
+    ServerConfig config = defaultServerConfig();
+    config.port = port;
+    config.io_threads = 2;
+    config.receive_queue_capacity = QUEUE_CAPACITY;
+    config.max_frame_size = MAX_FRAME_SIZE;
+    config.max_clients = MAX_CLIENTS;
+    setServerConfig(config);
+    if(runServer([](unsigned char* ptr) { delete[] ptr; }) != 0) {
+        std::cout << "Error during runServer()\n";
+        return 1;
+    }
+    testBackpressure(port);
+    testFrames(port);
+    testSlotReuse(port);
+    testStopWithFullQueue(port);
+    printf("test_receive: %zu failed\n", failures);
+    return failures == 0 ? 0 : 1;
+}
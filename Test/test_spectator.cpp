@@ -0,0 +1,238 @@
+// spectator relay running in this process with fake host on Unix socket: relay asks for spectator place
+// in room, late viewer gets welcome, map and cached game state, next game states are broadcast to it
+// and host disconnecting calls on_close.
+// usage: test_spectator [port]
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+extern "C" {
+#include "../Server/server_config.h"
+#include "../Spectator/spectator_upstream.h"
+}
+#include "../Server/server.h"
+
+namespace {
+
+const unsigned char WELCOME_MESSAGE = 0;
+const unsigned char GAME_MAP = 1;
+const unsigned char GAME_STATE = 2;
+const unsigned char SPECTATE = 15;
+const size_t WELCOME_SIZE = 33;
+const size_t ROOM = 3;
+size_t failures = 0;
+std::atomic_bool upstream_closed(false);
+
+void check(bool condition, const std::string& description) {
+    if(condition == false) {
+        ++failures;
+    }
+    printf("%s: %s\n", condition ? "OK" : "FAILED", description.c_str());
+    fflush(stdout);
+}
+
+void sendAll(int socket, const std::vector<unsigned char>& bytes) {
+    size_t sent = 0;
+    while(sent < bytes.size()) {
+        ssize_t result = send(socket, bytes.data() + sent, bytes.size() - sent, MSG_NOSIGNAL);
+        if(result <= 0) {
+            return;
+        }
+        sent += static_cast<size_t>(result);
+    }
+}
+
+// returns false if socket didn't get size bytes in 2 seconds
+bool receiveAll(int socket, unsigned char* bytes, size_t size) {
+    timeval timeout = {2, 0};
+    setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    size_t received = 0;
+    while(received < size) {
+        ssize_t result = recv(socket, bytes + received, size - received, 0);
+        if(result <= 0) {
+            return false;
+        }
+        received += static_cast<size_t>(result);
+    }
+    return true;
+}
+
+std::vector<unsigned char> frame(const std::vector<unsigned char>& data) {
+    uint32_t size = static_cast<uint32_t>(data.size());
+    std::vector<unsigned char> bytes(reinterpret_cast<unsigned char*>(&size),
+                                     reinterpret_cast<unsigned char*>(&size) + sizeof(size));
+    bytes.insert(bytes.end(), data.begin(), data.end());
+    return bytes;
+}
+
+// data of next frame, empty if socket didn't get whole frame
+std::vector<unsigned char> receiveFrame(int socket) {
+    uint32_t size;
+    if(receiveAll(socket, reinterpret_cast<unsigned char*>(&size), sizeof(size)) == false) {
+        return {};
+    }
+    std::vector<unsigned char> data(size);
+    if(receiveAll(socket, data.data(), data.size()) == false) {
+        return {};
+    }
+    return data;
+}
+
+int connectViewer(size_t port) {
+    int viewer = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if(viewer == -1 || connect(viewer, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == -1) {
+        perror("connect() error");
+        exit(1);
+    }
+    return viewer;
+}
+
+int openHostListener(const std::string& path) {
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    unlink(path.c_str());
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(listener == -1 || bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == -1
+       || listen(listener, 1) == -1) {
+        perror("host listener error");
+        exit(1);
+    }
+    return listener;
+}
+
+// welcome of host with player 7 and radii 1.5 and 0.25
+std::vector<unsigned char> hostWelcome() {
+    std::vector<unsigned char> welcome(WELCOME_SIZE, 0);
+    welcome[0] = WELCOME_MESSAGE;
+    welcome[1] = 7;
+    double radii[2] = {1.5, 0.25};
+    memcpy(welcome.data() + 3, radii, sizeof(radii));
+    return welcome;
+}
+
+// host accepts relay and sends welcome and map, map is split between two sends
+void acceptRelay(int listener, int* host) {
+    *host = accept(listener, nullptr, nullptr);
+    std::vector<unsigned char> bytes = frame(hostWelcome());
+    std::vector<unsigned char> map = frame({GAME_MAP, 'm', 'a', 'p'});
+    bytes.insert(bytes.end(), map.begin(), map.begin() + 3);
+    sendAll(*host, bytes);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    sendAll(*host, std::vector<unsigned char>(map.begin() + 3, map.end()));
+}
+
+void onUpstreamClosed() {
+    upstream_closed = true;
+}
+
+template<typename Condition>
+bool waitFor(Condition condition) {
+    for(int i = 0; i < 200 && condition() == false; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return condition();
+}
+
+// takes NEW_CONNECTION of viewer and adds it like spectator's main loop
+bool addNextViewer(size_t* viewer_id) {
+    for(int i = 0; i < 20; ++i) {
+        IncomingMessage message;
+        if(takeMany(&message, 1, 100) == 0) {
+            continue;
+        }
+        bool connected = message.message_type == IncomingMessage::NEW_CONNECTION;
+        if(connected) {
+            *viewer_id = message.client_id;
+            addViewer(message.client_id);
+        }
+        freeMessage(message);
+        if(connected) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void testRelay(int host, size_t port) {
+    unsigned char spectate[7];
+    bool asked = receiveAll(host, spectate, sizeof(spectate));
+    check(asked && spectate[0] == 3 && spectate[4] == SPECTATE && (spectate[5] | spectate[6] << 8) == ROOM,
+          "relay asks host for spectator place in room");
+    std::vector<unsigned char> first_state = {GAME_STATE, 1};
+    sendAll(host, frame(first_state));
+    check(waitFor([] { return getUpstreamStats().sent_states == 1; }), "game state without viewers is sent");
+
+    int viewer = connectViewer(port);
+    size_t viewer_id = 0;
+    check(addNextViewer(&viewer_id), "viewer connects to relay");
+    std::vector<unsigned char> welcome = receiveFrame(viewer);
+    std::vector<unsigned char> host_welcome = hostWelcome();
+    uint64_t welcome_id = 0;
+    if(welcome.size() == WELCOME_SIZE) {
+        memcpy(&welcome_id, welcome.data() + 21, sizeof(welcome_id));
+    }
+    check(welcome.size() == WELCOME_SIZE && welcome[0] == WELCOME_MESSAGE && welcome[1] == 0xFF && welcome[2] == 0xFF
+          && memcmp(welcome.data() + 3, host_welcome.data() + 3, 2 * sizeof(double)) == 0 && welcome_id == viewer_id,
+          "viewer gets welcome without player, with host's radii and its id");
+    check(receiveFrame(viewer) == std::vector<unsigned char>({GAME_MAP, 'm', 'a', 'p'}), "viewer gets map split by host");
+    check(receiveFrame(viewer) == first_state && getUpstreamStats().cached_sends == 1, "late viewer gets cached game state");
+
+    std::vector<unsigned char> second_state = {GAME_STATE, 2};
+    sendAll(host, frame(second_state));
+    check(receiveFrame(viewer) == second_state, "next game state is broadcast to viewer");
+    check(getUpstreamStats().received_states == 2, "relay counts game states from host");
+
+    close(host);
+    check(waitFor([] { return upstream_closed.load(); }), "host disconnecting calls on_close");
+    close(viewer);
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    size_t port = argc > 1 ? std::stoul(argv[1]) : 5101;
+    std::string path = "/tmp/test_spectator_" + std::to_string(getpid()) + ".sock";
+    ServerConfig config = defaultServerConfig();
+    config.port = port;
+    setServerConfig(config);
+    int listener = openHostListener(path);
+    int host = -1;
+    std::thread host_thread(acceptRelay, listener, &host);
+    int connected = connectUpstream(path.c_str(), ROOM);
+    host_thread.join();
+    close(listener);
+    unlink(path.c_str());
+    check(connected == 0, "relay connects after host sent welcome and map");
+    if(connected != 0 || runServer([](unsigned char* ptr) { free(ptr); }) != 0) {
+        stopUpstream();
+        std::cout << "Error during connectUpstream() or runServer()\n";
+        return 1;
+    }
+    if(startUpstream(0, onUpstreamClosed) == 0) {
+        testRelay(host, port);
+    } else {
+        check(false, "upstream thread starts");
+        close(host);
+    }
+    stopUpstream();
+    stopServer();
+    printf("test_spectator: %zu failed\n", failures);
+    return failures == 0 ? 0 : 1;
+}